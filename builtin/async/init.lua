@@ -1,8 +1,24 @@
 
 core.log("info", "Initializing Asynchronous environment")
 
+-- Read-only data published by the main environment
+core.async_shared = {}
+
+function core.set_async_shared(name, serialized_value)
+	core.async_shared[name] = core.deserialize(serialized_value)
+end
+
+-- The jobs of a batch share their function, load it once
+local last_serialized_func, last_func
+
 function core.job_processor(serialized_func, serialized_param)
-	local func = loadstring(serialized_func)
+	local func
+	if serialized_func == last_serialized_func then
+		func = last_func
+	else
+		func = loadstring(serialized_func)
+		last_serialized_func, last_func = serialized_func, func
+	end
 	local param = core.deserialize(serialized_param)
 	local retval = nil
 
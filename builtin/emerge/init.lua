@@ -0,0 +1,24 @@
+core.log("info", "Initializing emerge environment")
+
+local scriptpath = core.get_builtin_path()
+local commonpath = scriptpath .. "common" .. DIR_DELIM
+local gamepath   = scriptpath .. "game" .. DIR_DELIM
+
+dofile(commonpath .. "vector.lua")
+dofile(gamepath .. "constants.lua")
+dofile(gamepath .. "voxelarea.lua")
+
+core.registered_on_generateds = {}
+
+function core.register_on_generated(func)
+	assert(type(func) == "function",
+		"register_on_generated: expected a function")
+	core.registered_on_generateds[#core.registered_on_generateds + 1] = func
+end
+
+-- Called by the emerge thread once the mapgen made a chunk
+function core.on_generated(vm, minp, maxp, blockseed)
+	for _, func in ipairs(core.registered_on_generateds) do
+		func(vm, minp, maxp, blockseed)
+	end
+end
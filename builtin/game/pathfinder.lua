@@ -0,0 +1,49 @@
+-- KIDSCODE - Asynchronous pathfinding
+-- Path requests are queued and answered in the following server steps,
+-- spending at most pathfinder_async_budget milliseconds per step.
+
+local budget_us = (tonumber(core.settings:get("pathfinder_async_budget")) or 10) * 1000
+
+local find_path = core.find_path
+local queue = {}
+local first, last = 1, 0
+
+core.register_globalstep(function()
+	if first > last then
+		return
+	end
+
+	-- At least one request per step, so that the queue always moves
+	local start = core.get_us_time()
+	repeat
+		local job = queue[first]
+		queue[first] = nil
+		first = first + 1
+
+		local path = find_path(job.pos1, job.pos2, job.searchdistance,
+			job.max_jump, job.max_drop, job.algorithm)
+		core.set_last_run_mod(job.mod_origin)
+		job.callback(path)
+	until first > last or core.get_us_time() - start >= budget_us
+end)
+
+function core.find_path_async(pos1, pos2, searchdistance, max_jump, max_drop,
+		algorithm, callback)
+	if type(algorithm) == "function" then
+		algorithm, callback = nil, algorithm
+	end
+	assert(type(callback) == "function",
+		"Invalid minetest.find_path_async invocation")
+
+	last = last + 1
+	queue[last] = {
+		pos1 = vector.new(pos1),
+		pos2 = vector.new(pos2),
+		searchdistance = searchdistance,
+		max_jump = max_jump,
+		max_drop = max_drop,
+		algorithm = algorithm,
+		callback = callback,
+		mod_origin = core.get_last_run_mod(),
+	}
+end
@@ -30,3 +30,35 @@ function core.handle_async(func, parameter, callback)
 	return true
 end
 
+
+-- Queues one job per parameter, calling the same function. The callback is
+-- called with (retval, index) as the results come in.
+function core.handle_async_batch(func, parameters, callback)
+	local serialized_func = string.dump(func)
+
+	assert(serialized_func ~= nil)
+
+	local serialized_params = {}
+	for i, parameter in ipairs(parameters) do
+		serialized_params[i] = core.serialize(parameter)
+		if serialized_params[i] == nil then
+			return false
+		end
+	end
+
+	local first_jobid = core.do_async_callbacks(serialized_func, serialized_params)
+
+	for i = 1, #serialized_params do
+		core.async_jobs[first_jobid + i - 1] = function(retval)
+			callback(retval, i)
+		end
+	end
+
+	return true
+end
+
+-- Publishes read-only data to the async environments, where jobs find it
+-- in core.async_shared[name]
+function core.set_async_shared(name, value)
+	core.do_async_set_shared(name, core.serialize(value))
+end
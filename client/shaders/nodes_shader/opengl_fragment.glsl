@@ -9,6 +9,8 @@ uniform vec3 eyePosition;
 // The cameraOffset is the current center of the visible world.
 uniform vec3 cameraOffset;
 uniform float animationTimer;
+// Slots per side of the texture atlas, 0 if the texture is not one
+uniform float atlasSlots;
 
 varying vec3 vPosition;
 // World position in the visible world (i.e. relative to the cameraOffset.)
@@ -133,6 +135,10 @@ void main(void)
 	vec3 color;
 	vec4 bump;
 	vec2 uv = gl_TexCoord[0].st;
+	if (atlasSlots > 0.0) {
+		// Slot in the atlas and wrapped coordinates in the slot
+		uv = (floor(uv / TEXTURE_ATLAS_SLOT_SPAN) + fract(uv)) / atlasSlots;
+	}
 	bool use_normalmap = false;
 	get_texture_flags();
 
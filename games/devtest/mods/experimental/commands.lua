@@ -86,6 +86,223 @@ minetest.register_chatcommand("bench_bulk_set_node", {
 	end,
 })
 
+-- The FFI path of the benchmark needs the mod in secure.trusted_mods and LuaJIT
+local ffi
+do
+	local ie = minetest.request_insecure_environment()
+	if ie and rawget(_G, "jit") then
+		ffi = ie.require("ffi")
+		ffi.cdef[[
+		void VoxelBuffer_get_pointer(void *lbp, void **ptr, int32_t *stride);
+		int32_t VoxelBuffer_get_volume(void *lbp);
+		]]
+	end
+end
+
+-- Raw view of a VoxelBuffer: pointer, distance between values and volume
+local function ffi_view(buffer, ctype)
+	local ptr = ffi.new("void *[1]")
+	local stride = ffi.new("int32_t[1]")
+	ffi.C.VoxelBuffer_get_pointer(buffer, ptr, stride)
+	local p = ffi.cast(ctype .. " *", ptr[0])
+	return p, stride[0] / ffi.sizeof(ctype), ffi.C.VoxelBuffer_get_volume(buffer)
+end
+
+minetest.register_chatcommand("bench_vmanip_buffer", {
+	params = "",
+	description = "Benchmark: Read and write 80×80×80 nodes with VoxelManip tables and buffers",
+	func = function(name, param)
+		local player = minetest.get_player_by_name(name)
+		if not player then
+			return false, "No player."
+		end
+		local ppos = vector.round(player:get_pos())
+		local vm = minetest.get_voxel_manip()
+		local emin, emax = vm:read_from_map(vector.subtract(ppos, 40), vector.add(ppos, 39))
+		local c_stone = minetest.get_content_id("mapgen_stone")
+		local c_air = minetest.CONTENT_AIR
+		local runs = 5
+
+		-- Same work on both paths: count air and turn it into stone
+		local function run_table()
+			local data = vm:get_data()
+			local param2 = vm:get_param2_data()
+			local count = 0
+			for i = 1, #data do
+				if data[i] == c_air then
+					data[i] = c_stone
+					param2[i] = 0
+					count = count + 1
+				end
+			end
+			vm:set_data(data)
+			vm:set_param2_data(param2)
+			return count
+		end
+
+		local function run_buffer()
+			local data = vm:get_buffer()
+			local param2 = vm:get_buffer("param2")
+			local count = 0
+			for i = 1, #data do
+				if data[i] == c_air then
+					data[i] = c_stone
+					param2[i] = 0
+					count = count + 1
+				end
+			end
+			return count
+		end
+
+		-- Reading only, no node changes after the first run
+		local function read_table()
+			local data = vm:get_data()
+			local count = 0
+			for i = 1, #data do
+				if data[i] == c_stone then
+					count = count + 1
+				end
+			end
+			return count
+		end
+
+		local function read_buffer()
+			local data = vm:get_buffer()
+			local count = 0
+			for i = 1, #data do
+				if data[i] == c_stone then
+					count = count + 1
+				end
+			end
+			return count
+		end
+
+		-- Same as the buffer functions through the FFI pointers, which the
+		-- JIT can compile. Content ids written there are only checked by
+		-- write_to_map().
+		local function run_ffi()
+			local data, step, volume = ffi_view(vm:get_buffer(), "uint16_t")
+			local param2, step2 = ffi_view(vm:get_buffer("param2"), "uint8_t")
+			local count = 0
+			for i = 0, volume - 1 do
+				if data[i * step] == c_air then
+					data[i * step] = c_stone
+					param2[i * step2] = 0
+					count = count + 1
+				end
+			end
+			return count
+		end
+
+		local function read_ffi()
+			local data, step, volume = ffi_view(vm:get_buffer(), "uint16_t")
+			local count = 0
+			for i = 0, volume - 1 do
+				if data[i * step] == c_stone then
+					count = count + 1
+				end
+			end
+			return count
+		end
+
+		minetest.chat_send_player(name, "Benchmarking VoxelManip buffers ...")
+
+		local function bench(func)
+			-- Warm up
+			func()
+			local start_time = minetest.get_us_time()
+			for _ = 1, runs do
+				func()
+			end
+			return (minetest.get_us_time() - start_time) / runs / 1000
+		end
+
+		local time_read_table = bench(read_table)
+		local time_read_buffer = bench(read_buffer)
+		local time_table = bench(run_table)
+		local time_buffer = bench(run_buffer)
+
+		local msg = string.format("Benchmark results (%d nodes): read: tables %.2f ms, buffers %.2f ms; " ..
+			"read/write: tables %.2f ms, buffers %.2f ms",
+			(emax.x - emin.x + 1) * (emax.y - emin.y + 1) * (emax.z - emin.z + 1),
+			time_read_table, time_read_buffer, time_table, time_buffer)
+		if ffi then
+			msg = msg .. string.format("; FFI: read %.2f ms, read/write %.2f ms",
+				bench(read_ffi), bench(run_ffi))
+		else
+			msg = msg .. " (add experimental to secure.trusted_mods to bench the FFI path)"
+		end
+		return true, msg
+	end,
+})
+
+-- Identical cubes, drawn in one batch when object_batching is enabled
+minetest.register_entity("experimental:bench_cube", {
+	initial_properties = {
+		visual = "cube",
+		textures = {
+			"experimental_callback_node.png", "experimental_callback_node.png",
+			"experimental_callback_node.png", "experimental_callback_node.png",
+			"experimental_callback_node.png", "experimental_callback_node.png",
+		},
+		visual_size = {x = 0.5, y = 0.5},
+		pointable = false,
+		static_save = false,
+	},
+})
+
+local bench_cubes = {}
+
+local function clear_bench_cubes()
+	for _, obj in ipairs(bench_cubes) do
+		obj:remove()
+	end
+	bench_cubes = {}
+end
+
+minetest.register_chatcommand("bench_object_batch", {
+	params = "[<count>]",
+	description = "Benchmark: Draw <count> (default 1000) identical cubes, still then moving",
+	func = function(name, param)
+		local player = minetest.get_player_by_name(name)
+		if not player then
+			return false, "No player."
+		end
+		local count = tonumber(param) or 1000
+		local phase_time = 10
+
+		clear_bench_cubes()
+		local ppos = vector.round(player:get_pos())
+		local side = math.ceil(math.sqrt(count))
+		for i = 0, count - 1 do
+			local pos = vector.add(ppos, {x = i % side - side / 2, y = 2,
+				z = math.floor(i / side) + 2})
+			local obj = minetest.add_entity(pos, "experimental:bench_cube")
+			if obj then
+				table.insert(bench_cubes, obj)
+			end
+		end
+
+		-- The render time is measured by the client, the profiler (F6)
+		-- shows it as "ObjectBatch::render()". Compare the two phases, and
+		-- runs with object_batching disabled.
+		minetest.chat_send_player(name, string.format("%d cubes standing still for %d s, " ..
+			"watch ObjectBatch::render() in the profiler ...", #bench_cubes, phase_time))
+		minetest.after(phase_time, function()
+			minetest.chat_send_player(name, string.format("%d cubes moving for %d s ...",
+				#bench_cubes, phase_time))
+			for i, obj in ipairs(bench_cubes) do
+				obj:set_velocity({x = 0, y = (i % 2 == 0) and 0.5 or -0.5, z = 0})
+			end
+		end)
+		minetest.after(2 * phase_time, function()
+			clear_bench_cubes()
+			minetest.chat_send_player(name, "Object batch benchmark finished.")
+		end)
+		return true
+	end,
+})
+
 local function advance_pos(pos, start_pos, advance_z)
 	if advance_z then
 		pos.z = pos.z + 2
@@ -420,6 +420,7 @@ void Client::step(float dtime)
 			g_settings->getFloat("client_unload_unused_data_timeout"),
 			g_settings->getS32("client_mapblock_limit"),
 			&deleted_blocks);
+		m_env.getClientMap().onBlocksUnloaded(deleted_blocks); // KIDSCODE - Draw list index
 
 		/*
 			Send info to server
@@ -551,6 +552,7 @@ void Client::step(float dtime)
 						// Replace with the new mesh
 						block->mesh = r.mesh;
 				}
+				m_env.getClientMap().onBlockMeshChanged(block); // KIDSCODE - Draw list index
 			} else {
 				delete r.mesh;
 			}
@@ -576,6 +578,12 @@ void Client::step(float dtime)
 			g_profiler->graphAdd("num_processed_meshes", num_processed_meshes);
 	}
 
+	// >> KIDSCODE - Mesh LOD
+	// Meshes of the blocks that moved to another level of detail
+	for (v3s16 p : m_env.getClientMap().takeLodUpdates())
+		addUpdateMeshTask(p);
+	// << KIDSCODE
+
 	/*
 		Load fetched media
 	*/
@@ -1035,7 +1043,7 @@ AuthMechanism Client::choseAuthMech(const u32 mechs)
 
 void Client::sendInit(const std::string &playerName)
 {
-	NetworkPacket pkt(TOSERVER_INIT, 1 + 2 + 2 + (1 + playerName.size()));
+	NetworkPacket pkt(TOSERVER_INIT, 1 + 2 + 2 + (1 + playerName.size()) + 4);
 
 	// we don't support network compression yet
 	u16 supp_comp_modes = NETPROTO_COMPRESSION_NONE;
@@ -1043,6 +1051,7 @@ void Client::sendInit(const std::string &playerName)
 	pkt << (u8) SER_FMT_VER_HIGHEST_READ << (u16) supp_comp_modes;
 	pkt << (u16) CLIENT_PROTOCOL_VERSION_MIN << (u16) CLIENT_PROTOCOL_VERSION_MAX;
 	pkt << playerName;
+	pkt << (u32) KIDSCODE_CLIENT_CAPABILITIES; // KIDSCODE - Fork capabilities
 
 	Send(&pkt);
 }
@@ -1600,7 +1609,9 @@ void Client::addUpdateMeshTask(v3s16 p, bool ack_to_server, bool urgent)
 	if (b == NULL)
 		return;
 
-	m_mesh_update_thread.updateBlock(&m_env.getMap(), p, ack_to_server, urgent);
+	// KIDSCODE - Mesh LOD
+	m_mesh_update_thread.updateBlock(&m_env.getMap(), p, ack_to_server, urgent,
+		m_env.getClientMap().getBlockLod(p));
 }
 
 void Client::addUpdateMeshTaskWithEdge(v3s16 blockpos, bool ack_to_server, bool urgent)
@@ -1776,6 +1787,17 @@ void Client::afterContentReceived()
 	m_nodedef->updateTextures(this, texture_update_progress, &tu_args);
 	delete[] tu_args.text_base;
 
+	// >> KIDSCODE - Texture atlas
+	TextureSettings tsettings;
+	tsettings.readSettings();
+	if (tsettings.texture_atlas) {
+		infostream << "- Building texture atlases" << std::endl;
+		std::vector<u32> texture_ids;
+		m_nodedef->getAtlasTextureIds(&texture_ids);
+		m_tsrc->buildTextureAtlases(texture_ids);
+	}
+	// << KIDSCODE
+
 	// Start mesh update thread after setting up content definitions
 	infostream<<"- Starting mesh update thread"<<std::endl;
 	m_mesh_update_thread.start();
@@ -34,6 +34,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "settings.h"
 #include "shader.h"
 #include "content_cao.h"
+#include "objectbatch.h" // KIDSCODE - Object batching
 #include <algorithm>
 #include "client/renderingengine.h"
 
@@ -104,12 +105,24 @@ ClientEnvironment::ClientEnvironment(ClientMap *map,
 {
 	auto *shdrsrc = m_client->getShaderSource();
 	shdrsrc->addShaderConstantSetterFactory(new CAOShaderConstantSetterFactory());
+
+	// >> KIDSCODE - Object batching
+	m_object_batching = g_settings->getBool("object_batching") &&
+		g_settings->getBool("enable_shaders");
+	// << KIDSCODE
 }
 
 ClientEnvironment::~ClientEnvironment()
 {
 	m_ao_manager.clear();
 
+	// >> KIDSCODE - Object batching
+	if (m_object_batch) {
+		m_object_batch->remove();
+		m_object_batch->drop();
+	}
+	// << KIDSCODE
+
 	for (auto &simple_object : m_simple_objects) {
 		delete simple_object;
 	}
@@ -120,6 +133,17 @@ ClientEnvironment::~ClientEnvironment()
 	delete m_local_player;
 }
 
+// >> KIDSCODE - Object batching
+ObjectBatchSceneNode *ClientEnvironment::getObjectBatch()
+{
+	if (!m_object_batch && m_object_batching) {
+		scene::ISceneManager *smgr = RenderingEngine::get_scene_manager();
+		m_object_batch = new ObjectBatchSceneNode(smgr->getRootSceneNode(), smgr);
+	}
+	return m_object_batch;
+}
+// << KIDSCODE
+
 Map & ClientEnvironment::getMap()
 {
 	return *m_map;
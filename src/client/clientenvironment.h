@@ -31,6 +31,7 @@ class ClientScripting;
 class ClientActiveObject;
 class GenericCAO;
 class LocalPlayer;
+class ObjectBatchSceneNode; // KIDSCODE - Object batching
 
 /*
 	The client-side environment.
@@ -141,6 +142,12 @@ class ClientEnvironment : public Environment
 	void updateCameraOffset(const v3s16 &camera_offset)
 	{ m_camera_offset = camera_offset; }
 	v3s16 getCameraOffset() const { return m_camera_offset; }
+
+	// >> KIDSCODE - Object batching
+	// Scene node drawing the objects that can be batched, nullptr if
+	// disabled
+	ObjectBatchSceneNode *getObjectBatch();
+	// << KIDSCODE
 private:
 	ClientMap *m_map;
 	LocalPlayer *m_local_player = nullptr;
@@ -153,4 +160,8 @@ class ClientEnvironment : public Environment
 	IntervalLimiter m_active_object_light_update_interval;
 	std::list<std::string> m_player_names;
 	v3s16 m_camera_offset;
+	// >> KIDSCODE - Object batching
+	bool m_object_batching;
+	ObjectBatchSceneNode *m_object_batch = nullptr;
+	// << KIDSCODE
 };
@@ -29,6 +29,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "camera.h"               // CameraModes
 #include "util/basic_macros.h"
 #include <algorithm>
+#include <unordered_map> // KIDSCODE - Render queue
+#include <unordered_set> // KIDSCODE - Render queue
 #include "client/renderingengine.h"
 
 ClientMap::ClientMap(
@@ -57,9 +59,18 @@ ClientMap::ClientMap(
 	m_cache_trilinear_filter  = g_settings->getBool("trilinear_filter");
 	m_cache_bilinear_filter   = g_settings->getBool("bilinear_filter");
 	m_cache_anistropic_filter = g_settings->getBool("anisotropic_filter");
+	m_cache_enable_vbo        = g_settings->getBool("enable_vbo"); // KIDSCODE - Render queue
+	m_cache_lod_distance      = g_settings->getFloat("mesh_lod_distance"); // KIDSCODE - Mesh LOD
 
 }
 
+// >> KIDSCODE - Render queue
+ClientMap::~ClientMap()
+{
+	clearMeshBatches();
+}
+// << KIDSCODE
+
 MapSector * ClientMap::emergeSector(v2s16 p2d)
 {
 	// Check that it doesn't exist already
@@ -112,12 +123,126 @@ void ClientMap::getBlocksInViewRange(v3s16 cam_pos_nodes,
 			p_nodes_max.Z / MAP_BLOCKSIZE + 1);
 }
 
+// >> KIDSCODE - Draw list index
+// Side of the index cells, in blocks
+#define MESH_INDEX_CELL_SIZE 8
+// KIDSCODE - Occlusion buffer: distance of the occluding blocks, in blocks
+#define OCCLUDER_RANGE 3
+// >> KIDSCODE - Render queue
+// Side of the regions whose mesh buffers are merged, in blocks
+#define MESH_BATCH_REGION_SIZE 2
+// Larger mesh buffers are drawn on their own
+#define MESH_BATCH_MAX_VERTICES 1024
+// << KIDSCODE
+
+void ClientMap::onBlockMeshChanged(MapBlock *block)
+{
+	v3s16 p = block->getPos();
+	dropMeshBatches(getContainerPos(p, MESH_BATCH_REGION_SIZE)); // KIDSCODE - Render queue
+	m_lod_pending.erase(p); // KIDSCODE - Mesh LOD
+	v3s16 cellpos = getContainerPos(p, MESH_INDEX_CELL_SIZE);
+	auto cell = m_mesh_index.find(cellpos);
+
+	if (block->mesh) {
+		if (cell == m_mesh_index.end()) {
+			cell = m_mesh_index.emplace(cellpos, MeshIndexCell()).first;
+			m_cells_in_range_dirty = true;
+		}
+		cell->second.blocks[p] = block;
+	} else if (cell != m_mesh_index.end()) {
+		cell->second.blocks.erase(p);
+		if (cell->second.blocks.empty()) {
+			m_mesh_index.erase(cell);
+			m_cells_in_range_dirty = true;
+		}
+	}
+}
+
+void ClientMap::onBlocksUnloaded(const std::vector<v3s16> &blocks)
+{
+	m_occlusion_buffer.forgetBlocks(blocks); // KIDSCODE - Occlusion buffer
+
+	for (v3s16 p : blocks) {
+		dropMeshBatches(getContainerPos(p, MESH_BATCH_REGION_SIZE)); // KIDSCODE - Render queue
+		m_lod_pending.erase(p); // KIDSCODE - Mesh LOD
+		auto cell = m_mesh_index.find(getContainerPos(p, MESH_INDEX_CELL_SIZE));
+		if (cell == m_mesh_index.end())
+			continue;
+		cell->second.blocks.erase(p);
+		if (cell->second.blocks.empty()) {
+			m_mesh_index.erase(cell);
+			m_cells_in_range_dirty = true;
+		}
+	}
+}
+
+// >> KIDSCODE - Mesh LOD
+u8 ClientMap::getBlockLod(v3s16 blockpos)
+{
+	MapBlock *block = getBlockNoCreateNoEx(blockpos);
+	return getBlockLod(blockpos, block ? block->mesh : nullptr);
+}
+
+u8 ClientMap::getBlockLod(v3s16 blockpos, const MapBlockMesh *mesh)
+{
+	if (m_cache_lod_distance <= 0.0f)
+		return 0;
+
+	v3f center = intToFloat(blockpos * MAP_BLOCKSIZE, BS) +
+		v3f(1, 1, 1) * ((MAP_BLOCKSIZE - 1) * BS / 2);
+	f32 d = m_camera_position.getDistanceFrom(center) / BS;
+	if (mesh)
+		return getMeshLod(d, m_cache_lod_distance, mesh->getLod());
+	return getMeshLod(d, m_cache_lod_distance);
+}
+
+std::vector<v3s16> ClientMap::takeLodUpdates()
+{
+	std::vector<v3s16> blocks;
+	blocks.swap(m_lod_updates);
+	return blocks;
+}
+// << KIDSCODE
+
+void ClientMap::updateCellsInRange(v3s16 cam_pos_nodes)
+{
+	v3s16 camera_block = getNodeBlockPos(cam_pos_nodes);
+	if (!m_cells_in_range_dirty && camera_block == m_cells_in_range_camera_block &&
+			m_control.wanted_range == m_cells_in_range_range &&
+			m_control.range_all == m_cells_in_range_all)
+		return;
+
+	ScopeProfiler sp(g_profiler, "CM::updateDrawList(): cells in range", SPT_AVG);
+
+	m_cells_in_range_dirty = false;
+	m_cells_in_range_camera_block = camera_block;
+	m_cells_in_range_range = m_control.wanted_range;
+	m_cells_in_range_all = m_control.range_all;
+
+	v3s16 p_blocks_min;
+	v3s16 p_blocks_max;
+	getBlocksInViewRange(cam_pos_nodes, &p_blocks_min, &p_blocks_max);
+	v3s16 cells_min = getContainerPos(p_blocks_min, MESH_INDEX_CELL_SIZE);
+	v3s16 cells_max = getContainerPos(p_blocks_max, MESH_INDEX_CELL_SIZE);
+
+	m_cells_in_range.clear();
+	for (auto &cell : m_mesh_index) {
+		const v3s16 &p = cell.first;
+		if (!m_control.range_all && (
+				p.X < cells_min.X || p.X > cells_max.X ||
+				p.Y < cells_min.Y || p.Y > cells_max.Y ||
+				p.Z < cells_min.Z || p.Z > cells_max.Z))
+			continue;
+		m_cells_in_range.emplace_back(p, &cell.second);
+	}
+}
+// << KIDSCODE
+
 void ClientMap::updateDrawList()
 {
 	ScopeProfiler sp(g_profiler, "CM::updateDrawList()", SPT_AVG);
 
-	for (auto &i : m_drawlist) {
-		MapBlock *block = i.second;
+	for (MapBlock *block : m_drawlist) { // KIDSCODE - Draw list index
 		block->refDrop();
 	}
 	m_drawlist.clear();
@@ -132,9 +257,6 @@ void ClientMap::updateDrawList()
 	camera_fov *= 1.2;
 
 	v3s16 cam_pos_nodes = floatToInt(camera_position, BS);
-	v3s16 p_blocks_min;
-	v3s16 p_blocks_max;
-	getBlocksInViewRange(cam_pos_nodes, &p_blocks_min, &p_blocks_max);
 
 	// Number of blocks with mesh in rendering range
 	u32 blocks_in_range_with_mesh = 0;
@@ -156,57 +278,88 @@ void ClientMap::updateDrawList()
 	//if (occlusion_culling_enabled && m_control.show_wireframe)
 	//    occlusion_culling_enabled = porting::getTimeS() & 1;
 
-	for (const auto &sector_it : m_sectors) {
-		MapSector *sector = sector_it.second;
-		v2s16 sp = sector->getPos();
-
-		if (!m_control.range_all) {
-			if (sp.X < p_blocks_min.X || sp.X > p_blocks_max.X ||
-					sp.Y < p_blocks_min.Z || sp.Y > p_blocks_max.Z)
-				continue;
+	// >> KIDSCODE - Occlusion buffer
+	// The nearby blocks hide the ones behind them
+	if (occlusion_culling_enabled) {
+		ScopeProfiler sp(g_profiler, "CM::updateDrawList(): occlusion buffer", SPT_AVG);
+		m_occlusion_buffer.begin(camera_position, camera_direction, camera_fov);
+		v3s16 cam_block = getNodeBlockPos(cam_pos_nodes);
+		v3s16 p;
+		for (p.Z = cam_block.Z - OCCLUDER_RANGE; p.Z <= cam_block.Z + OCCLUDER_RANGE; p.Z++)
+		for (p.Y = cam_block.Y - OCCLUDER_RANGE; p.Y <= cam_block.Y + OCCLUDER_RANGE; p.Y++)
+		for (p.X = cam_block.X - OCCLUDER_RANGE; p.X <= cam_block.X + OCCLUDER_RANGE; p.X++) {
+			MapBlock *block = getBlockNoCreateNoEx(p);
+			if (block)
+				m_occlusion_buffer.addBlock(block, m_nodedef);
+		}
+		m_occlusion_buffer.finish();
+		g_profiler->avg("Occluder quads [#]", m_occlusion_buffer.getQuadCount());
+	}
+	// << KIDSCODE
+
+	// >> KIDSCODE - Draw list index
+	updateCellsInRange(cam_pos_nodes);
+
+	float range = 100000 * BS;
+	if (!m_control.range_all)
+		range = m_control.wanted_range * BS;
+
+	// Radius of a cell, see isBlockInSight(), with a margin of one block
+	// so that no block in sight is in a culled cell
+	static constexpr const f32 cell_max_radius =
+		0.866025403784f * (MESH_INDEX_CELL_SIZE + 1) * MAP_BLOCKSIZE * BS;
+	u32 cells_culled = 0;
+
+	std::vector<std::pair<float, MapBlock *>> drawlist;
+
+	for (const auto &cell : m_cells_in_range) {
+		// Whole cells out of sight are skipped at once
+		v3f cell_center = intToFloat(cell.first * MESH_INDEX_CELL_SIZE *
+			MAP_BLOCKSIZE, BS) + v3f(1, 1, 1) *
+			(MESH_INDEX_CELL_SIZE * MAP_BLOCKSIZE * BS / 2);
+		if (!isSphereInSight(cell_center, cell_max_radius, camera_position,
+				camera_direction, camera_fov, range)) {
+			cells_culled++;
+			continue;
 		}
 
-		MapBlockVect sectorblocks;
-		sector->getBlocks(sectorblocks);
-
-		/*
-			Loop through blocks in sector
-		*/
-
-		u32 sector_blocks_drawn = 0;
-
-		for (MapBlock *block : sectorblocks) {
+		for (const auto &it : cell.second->blocks) {
+			MapBlock *block = it.second;
 			/*
 				Compare block position to camera position, skip
 				if not seen on display
 			*/
 
-			if (block->mesh)
-				block->mesh->updateCameraOffset(m_camera_offset);
-
-			float range = 100000 * BS;
-			if (!m_control.range_all)
-				range = m_control.wanted_range * BS;
-
 			float d = 0.0;
 			if (!isBlockInSight(block->getPos(), camera_position,
 					camera_direction, camera_fov, range, &d))
 				continue;
 
-
 			/*
 				Ignore if mesh doesn't exist
 			*/
 			if (!block->mesh)
 				continue;
 
+			block->mesh->updateCameraOffset(m_camera_offset);
+
+			// >> KIDSCODE - Mesh LOD
+			if (m_cache_lod_distance > 0.0f &&
+					getBlockLod(it.first, block->mesh) != block->mesh->getLod() &&
+					m_lod_pending.insert(it.first).second)
+				m_lod_updates.push_back(it.first);
+			// << KIDSCODE
+
 			blocks_in_range_with_mesh++;
 
 			/*
 				Occlusion culling
 			*/
+			// KIDSCODE - Occlusion buffer
 			if ((!m_control.range_all && d > m_control.wanted_range * BS) ||
-					(occlusion_culling_enabled && isBlockOccluded(block, cam_pos_nodes))) {
+					(occlusion_culling_enabled && m_occlusion_buffer.isBoxOccluded(
+						aabb3f(intToFloat(block->getPosRelative(), BS) - BS / 2,
+							intToFloat(block->getPosRelative() + MAP_BLOCKSIZE, BS) - BS / 2)))) {
 				blocks_occlusion_culled++;
 				continue;
 			}
@@ -216,15 +369,25 @@ void ClientMap::updateDrawList()
 
 			// Add to set
 			block->refGrab();
-			m_drawlist[block->getPos()] = block;
-
-			sector_blocks_drawn++;
-		} // foreach sectorblocks
+			drawlist.emplace_back(d, block);
 
-		if (sector_blocks_drawn != 0)
-			m_last_drawn_sectors.insert(sp);
+			m_last_drawn_sectors.insert(v2s16(it.first.X, it.first.Z));
+		}
 	}
 
+	// Nearest first, hidden surfaces are rejected by the depth test
+	std::sort(drawlist.begin(), drawlist.end(),
+		[](const std::pair<float, MapBlock *> &a,
+				const std::pair<float, MapBlock *> &b) {
+			return a.first < b.first;
+		});
+	m_drawlist.reserve(drawlist.size());
+	for (const auto &it : drawlist)
+		m_drawlist.push_back(it.second);
+	m_render_queue_dirty = true; // KIDSCODE - Render queue
+
+	g_profiler->avg("MapBlock index cells culled [#]", cells_culled);
+	// << KIDSCODE
 	g_profiler->avg("MapBlock meshes in range [#]", blocks_in_range_with_mesh);
 	g_profiler->avg("MapBlocks occlusion culled [#]", blocks_occlusion_culled);
 	g_profiler->avg("MapBlocks drawn [#]", m_drawlist.size());
@@ -274,6 +437,254 @@ struct MeshBufListList
 	}
 };
 
+// >> KIDSCODE - Render queue
+void ClientMap::buildMeshBatches(v3s16 region,
+		std::vector<MergedMeshBuffer> &batches)
+{
+	// Static buffers small enough to be merged, by layer and material
+	struct Group
+	{
+		u8 layer;
+		const video::SMaterial *m;
+		video::E_VERTEX_TYPE vertex_type;
+		std::vector<std::pair<MapBlock *, scene::IMeshBuffer *>> sources;
+	};
+	std::vector<Group> groups;
+
+	v3s16 p0 = region * MESH_BATCH_REGION_SIZE;
+	v3s16 p;
+	for (p.Z = p0.Z; p.Z < p0.Z + MESH_BATCH_REGION_SIZE; p.Z++)
+	for (p.Y = p0.Y; p.Y < p0.Y + MESH_BATCH_REGION_SIZE; p.Y++)
+	for (p.X = p0.X; p.X < p0.X + MESH_BATCH_REGION_SIZE; p.X++) {
+		MapBlock *block = getBlockNoCreateNoEx(p);
+		if (!block || !block->mesh)
+			continue;
+
+		// The merged vertices are copies, at the current camera offset
+		block->mesh->updateCameraOffset(m_camera_offset);
+
+		for (u8 layer = 0; layer < MAX_TILE_LAYERS; layer++) {
+			scene::IMesh *mesh = block->mesh->getMesh(layer);
+			for (u32 i = 0; i < mesh->getMeshBufferCount(); i++) {
+				scene::IMeshBuffer *buf = mesh->getMeshBuffer(i);
+				if (buf->getVertexCount() == 0 ||
+						buf->getVertexCount() > MESH_BATCH_MAX_VERTICES ||
+						buf->getIndexType() != video::EIT_16BIT ||
+						!block->mesh->isBufferStatic(layer, i))
+					continue;
+
+				const video::SMaterial &m = buf->getMaterial();
+				Group *group = nullptr;
+				for (Group &g : groups) {
+					if (g.layer == layer && g.vertex_type == buf->getVertexType() &&
+							g.m->TextureLayer[0].Texture == m.TextureLayer[0].Texture &&
+							*g.m == m) {
+						group = &g;
+						break;
+					}
+				}
+				if (!group) {
+					groups.push_back(Group{layer, &m, buf->getVertexType(), {}});
+					group = &groups.back();
+				}
+				group->sources.emplace_back(block, buf);
+			}
+		}
+	}
+
+	for (const Group &group : groups) {
+		if (group.sources.size() < 2)
+			continue;
+
+		MergedMeshBuffer merged;
+		merged.layer = group.layer;
+		merged.buf = nullptr;
+		u32 vertex_count = 0;
+
+		auto flush = [&]() {
+			if (merged.sources.size() >= 2) {
+				merged.buf->recalculateBoundingBox();
+				if (m_cache_enable_vbo)
+					merged.buf->setHardwareMappingHint(scene::EHM_STATIC);
+				batches.push_back(merged);
+			} else if (merged.buf) {
+				merged.buf->drop();
+			}
+			merged.buf = nullptr;
+			merged.sources.clear();
+			vertex_count = 0;
+		};
+
+		for (const auto &source : group.sources) {
+			scene::IMeshBuffer *buf = source.second;
+			// The indices are 16 bits
+			if (vertex_count + buf->getVertexCount() > U16_MAX)
+				flush();
+
+			if (!merged.buf) {
+				if (group.vertex_type == video::EVT_TANGENTS)
+					merged.buf = new scene::SMeshBufferTangents();
+				else
+					merged.buf = new scene::SMeshBuffer();
+				merged.buf->getMaterial() = *group.m;
+			}
+			merged.buf->append(buf->getVertices(), buf->getVertexCount(),
+				buf->getIndices(), buf->getIndexCount());
+			merged.sources.push_back(source);
+			vertex_count += buf->getVertexCount();
+		}
+		flush();
+	}
+}
+
+void ClientMap::dropMeshBatches(v3s16 region)
+{
+	auto it = m_mesh_batches.find(region);
+	if (it == m_mesh_batches.end())
+		return;
+
+	video::IVideoDriver *driver = RenderingEngine::get_video_driver();
+	for (MergedMeshBuffer &merged : it->second) {
+		if (m_cache_enable_vbo)
+			driver->removeHardwareBuffer(merged.buf);
+		merged.buf->drop();
+	}
+	m_mesh_batches.erase(it);
+	m_render_queue_dirty = true;
+}
+
+void ClientMap::clearMeshBatches()
+{
+	while (!m_mesh_batches.empty())
+		dropMeshBatches(m_mesh_batches.begin()->first);
+}
+
+void ClientMap::applyMaterialSettings(video::SMaterial &material)
+{
+	material.setFlag(video::EMF_TRILINEAR_FILTER, m_cache_trilinear_filter);
+	material.setFlag(video::EMF_BILINEAR_FILTER, m_cache_bilinear_filter);
+	material.setFlag(video::EMF_ANISOTROPIC_FILTER, m_cache_anistropic_filter);
+	material.setFlag(video::EMF_WIREFRAME, m_control.show_wireframe);
+}
+
+void ClientMap::updateRenderQueue(video::IVideoDriver *driver)
+{
+	ScopeProfiler sp(g_profiler, "CM::updateRenderQueue()", SPT_AVG);
+
+	// Merged vertices are translated by the camera offset
+	if (m_mesh_batches_camera_offset != m_camera_offset) {
+		clearMeshBatches();
+		m_mesh_batches_camera_offset = m_camera_offset;
+	}
+
+	m_render_queue_dirty = false;
+	m_render_queue_wireframe = m_control.show_wireframe;
+
+	for (auto &pass : m_render_queue)
+		for (auto &lists : pass)
+			lists.clear();
+	for (auto &animated : m_render_queue_animated)
+		animated.clear();
+
+	auto is_transparent = [driver](const video::SMaterial &material) {
+		video::IMaterialRenderer *rnd =
+			driver->getMaterialRenderer(material.MaterialType);
+		return rnd && rnd->isTransparent();
+	};
+
+	auto get_list = [](std::vector<RenderList> &lists,
+			const video::SMaterial &m) -> RenderList & {
+		for (RenderList &l : lists) {
+			// comparing a full material is quite expensive so we don't do it if
+			// not even first texture is equal
+			if (l.m.TextureLayer[0].Texture == m.TextureLayer[0].Texture &&
+					l.m == m)
+				return l;
+		}
+		lists.emplace_back();
+		lists.back().m = m;
+		return lists.back();
+	};
+
+	std::unordered_map<MapBlock *, u32> drawlist_index;
+	std::set<v3s16> regions;
+	for (u32 i = 0; i < m_drawlist.size(); i++) {
+		MapBlock *block = m_drawlist[i];
+		if (!block->mesh)
+			continue;
+		drawlist_index[block] = i;
+		regions.insert(getContainerPos(block->getPos(), MESH_BATCH_REGION_SIZE));
+	}
+
+	// Merged buffers of the regions in the draw list
+	std::unordered_set<scene::IMeshBuffer *> merged_sources;
+	for (v3s16 region : regions) {
+		auto batches = m_mesh_batches.find(region);
+		if (batches == m_mesh_batches.end()) {
+			batches = m_mesh_batches.emplace(region,
+				std::vector<MergedMeshBuffer>()).first;
+			buildMeshBatches(region, batches->second);
+		}
+
+		for (const MergedMeshBuffer &merged : batches->second) {
+			std::vector<u32> indices;
+			indices.reserve(merged.sources.size());
+			for (const auto &source : merged.sources) {
+				auto it = drawlist_index.find(source.first);
+				indices.push_back(it == drawlist_index.end() ? U32_MAX : it->second);
+				merged_sources.insert(source.second);
+			}
+			const video::SMaterial &m = merged.buf->getMaterial();
+			get_list(m_render_queue[is_transparent(m)][merged.layer], m)
+				.merged.emplace_back(&merged, std::move(indices));
+		}
+	}
+
+	for (const auto &it : drawlist_index) {
+		MapBlock *block = it.first;
+		for (u8 layer = 0; layer < MAX_TILE_LAYERS; layer++) {
+			scene::IMesh *mesh = block->mesh->getMesh(layer);
+			assert(mesh);
+
+			u32 c = mesh->getMeshBufferCount();
+			for (u32 i = 0; i < c; i++) {
+				scene::IMeshBuffer *buf = mesh->getMeshBuffer(i);
+				if (buf->getVertexCount() == 0)
+					errorstream << "Block [" << analyze_block(block)
+						<< "] contains an empty meshbuf" << std::endl;
+
+				if (merged_sources.find(buf) != merged_sources.end())
+					continue;
+
+				const video::SMaterial &m = buf->getMaterial();
+				bool transparent = is_transparent(m);
+				if (!block->mesh->isMaterialStatic(layer, i)) {
+					m_render_queue_animated[transparent].push_back(
+						AnimatedBuffer{it.second, layer, buf});
+					continue;
+				}
+				get_list(m_render_queue[transparent][layer], m)
+					.bufs.emplace_back(it.second, buf);
+			}
+		}
+	}
+
+	// The draw list order is kept within each material
+	for (auto &pass : m_render_queue) {
+		for (auto &lists : pass) {
+			for (RenderList &list : lists) {
+				applyMaterialSettings(list.m);
+				std::sort(list.bufs.begin(), list.bufs.end(),
+					[](const std::pair<u32, scene::IMeshBuffer *> &a,
+							const std::pair<u32, scene::IMeshBuffer *> &b) {
+						return a.first < b.first;
+					});
+			}
+		}
+	}
+}
+// << KIDSCODE
+
 void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 {
 	bool is_transparent_pass = pass == scene::ESNRP_TRANSPARENT;
@@ -290,6 +701,12 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 	if (pass == scene::ESNRP_SOLID)
 		m_last_drawn_sectors.clear();
 
+	// >> KIDSCODE - Render queue
+	if (m_render_queue_dirty || m_render_queue_wireframe != m_control.show_wireframe ||
+			m_mesh_batches_camera_offset != m_camera_offset)
+		updateRenderQueue(driver);
+	// << KIDSCODE
+
 	/*
 		Get animation parameters
 	*/
@@ -306,6 +723,10 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 	*/
 
 	u32 vertex_count = 0;
+	// >> KIDSCODE - Render queue
+	u32 draw_calls = 0;
+	u32 merged_drawn = 0;
+	// << KIDSCODE
 
 	// For limiting number of mesh animations per frame
 	u32 mesh_animate_count = 0;
@@ -315,11 +736,11 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 		Draw the selected MapBlocks
 	*/
 
-	MeshBufListList drawbufs;
-
-	for (auto &i : m_drawlist) {
-		MapBlock *block = i.second;
+	// KIDSCODE - Render queue: blocks of the draw list in sight
+	std::vector<bool> visible(m_drawlist.size(), false);
 
+	for (u32 i = 0; i < m_drawlist.size(); i++) { // KIDSCODE - Render queue
+		MapBlock *block = m_drawlist[i];
 		// If the mesh of the block happened to get deleted, ignore it
 		if (!block->mesh)
 			continue;
@@ -329,6 +750,8 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 				camera_direction, camera_fov, 100000 * BS, &d))
 			continue;
 
+		visible[i] = true; // KIDSCODE - Render queue
+
 		// Mesh animation
 		if (pass == scene::ESNRP_SOLID) {
 			//MutexAutoLock lock(block->mesh_mutex);
@@ -347,54 +770,29 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 				mapBlockMesh->decreaseAnimationForceTimer();
 			}
 		}
+	}
 
-		/*
-			Get the meshbuffers of the block
-		*/
-		{
-			//MutexAutoLock lock(block->mesh_mutex);
-
-			MapBlockMesh *mapBlockMesh = block->mesh;
-			assert(mapBlockMesh);
-
-			for (int layer = 0; layer < MAX_TILE_LAYERS; layer++) {
-				scene::IMesh *mesh = mapBlockMesh->getMesh(layer);
-				assert(mesh);
-
-				u32 c = mesh->getMeshBufferCount();
-				for (u32 i = 0; i < c; i++) {
-					scene::IMeshBuffer *buf = mesh->getMeshBuffer(i);
-
-					video::SMaterial& material = buf->getMaterial();
-					video::IMaterialRenderer* rnd =
-						driver->getMaterialRenderer(material.MaterialType);
-					bool transparent = (rnd && rnd->isTransparent());
-					if (transparent == is_transparent_pass) {
-						if (buf->getVertexCount() == 0)
-							errorstream << "Block [" << analyze_block(block)
-								<< "] contains an empty meshbuf" << std::endl;
-
-						material.setFlag(video::EMF_TRILINEAR_FILTER,
-							m_cache_trilinear_filter);
-						material.setFlag(video::EMF_BILINEAR_FILTER,
-							m_cache_bilinear_filter);
-						material.setFlag(video::EMF_ANISOTROPIC_FILTER,
-							m_cache_anistropic_filter);
-						material.setFlag(video::EMF_WIREFRAME,
-							m_control.show_wireframe);
-
-						drawbufs.add(buf, layer);
-					}
-				}
-			}
-		}
+	// >> KIDSCODE - Render queue
+	// The materials of the animated buffers are the ones of this frame
+	MeshBufListList drawbufs;
+	for (const AnimatedBuffer &animated : m_render_queue_animated[is_transparent_pass]) {
+		if (!visible[animated.block])
+			continue;
+		applyMaterialSettings(animated.buf->getMaterial());
+		drawbufs.add(animated.buf, animated.layer);
 	}
 
 	TimeTaker draw("Drawing mesh buffers");
 
+	auto draw_buffer = [&](scene::IMeshBuffer *buf) {
+		driver->drawMeshBuffer(buf);
+		vertex_count += buf->getVertexCount();
+		draw_calls++;
+	};
+
 	// Render all layers in order
-	for (auto &lists : drawbufs.lists) {
-		for (MeshBufList &list : lists) {
+	for (u8 layer = 0; layer < MAX_TILE_LAYERS; layer++) {
+		for (const RenderList &list : m_render_queue[is_transparent_pass][layer]) {
 			// Check and abort if the machine is swapping a lot
 			if (draw.getTimerTime() > 2000) {
 				infostream << "ClientMap::renderMap(): Rendering took >2s, " <<
@@ -403,13 +801,42 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 			}
 			driver->setMaterial(list.m);
 
-			for (scene::IMeshBuffer *buf : list.bufs) {
-				driver->drawMeshBuffer(buf);
-				vertex_count += buf->getVertexCount();
+			for (const auto &merged : list.merged) {
+				bool all_visible = true;
+				for (u32 i : merged.second)
+					all_visible &= i != U32_MAX && visible[i];
+
+				if (all_visible) {
+					draw_buffer(merged.first->buf);
+					merged_drawn++;
+					continue;
+				}
+
+				// Part of the region is out of sight
+				for (size_t j = 0; j < merged.second.size(); j++) {
+					u32 i = merged.second[j];
+					if (i != U32_MAX && visible[i])
+						draw_buffer(merged.first->sources[j].second);
+				}
+			}
+
+			for (const auto &buf : list.bufs) {
+				if (visible[buf.first])
+					draw_buffer(buf.second);
 			}
 		}
+
+		for (MeshBufList &list : drawbufs.lists[layer]) {
+			driver->setMaterial(list.m);
+
+			for (scene::IMeshBuffer *buf : list.bufs)
+				draw_buffer(buf);
+		}
 	}
 	g_profiler->avg(prefix + "draw meshes [ms]", draw.stop(true));
+	g_profiler->avg(prefix + "draw calls [#]", draw_calls);
+	g_profiler->avg(prefix + "merged buffers drawn [#]", merged_drawn);
+	// << KIDSCODE
 
 	// Log only on solid pass because values are the same
 	if (pass == scene::ESNRP_SOLID) {
@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irrlichttypes_extrabloated.h"
 #include "map.h"
 #include "camera.h"
+#include "occlusionbuffer.h" // KIDSCODE - Occlusion buffer
 #include <set>
 #include <map>
 
@@ -37,6 +38,7 @@ struct MapDrawControl
 
 class Client;
 class ITextureSource;
+class MapBlockMesh; // KIDSCODE - Mesh LOD
 
 /*
 	ClientMap
@@ -53,7 +55,7 @@ class ClientMap : public Map, public scene::ISceneNode
 			s32 id
 	);
 
-	virtual ~ClientMap() = default;
+	virtual ~ClientMap(); // KIDSCODE - Render queue
 
 	s32 mapType() const
 	{
@@ -101,6 +103,20 @@ class ClientMap : public Map, public scene::ISceneNode
 	void getBlocksInViewRange(v3s16 cam_pos_nodes,
 		v3s16 *p_blocks_min, v3s16 *p_blocks_max);
 	void updateDrawList();
+
+	// >> KIDSCODE - Draw list index
+	// Keep the index of the blocks with a mesh up to date
+	void onBlockMeshChanged(MapBlock *block);
+	void onBlocksUnloaded(const std::vector<v3s16> &blocks);
+	// << KIDSCODE
+
+	// >> KIDSCODE - Mesh LOD
+	// Level of detail of the mesh of the block, from the camera position
+	u8 getBlockLod(v3s16 blockpos);
+	// Blocks in sight whose mesh has another level of detail than wanted
+	std::vector<v3s16> takeLodUpdates();
+	// << KIDSCODE
+
 	void renderMap(video::IVideoDriver* driver, s32 pass);
 
 	int getBackgroundBrightness(float max_d, u32 daylight_factor,
@@ -126,7 +142,83 @@ class ClientMap : public Map, public scene::ISceneNode
 	f32 m_camera_fov = M_PI;
 	v3s16 m_camera_offset;
 
-	std::map<v3s16, MapBlock*> m_drawlist;
+	// >> KIDSCODE - Draw list index
+	// Sorted from the nearest to the farthest block
+	std::vector<MapBlock *> m_drawlist;
+
+	// Blocks with a mesh, in cells of MESH_INDEX_CELL_SIZE^3 blocks
+	struct MeshIndexCell
+	{
+		std::map<v3s16, MapBlock *> blocks;
+	};
+	std::map<v3s16, MeshIndexCell> m_mesh_index;
+
+	// Cells around the camera, updated when the camera enters another
+	// block or cells are added or removed
+	void updateCellsInRange(v3s16 cam_pos_nodes);
+	std::vector<std::pair<v3s16, MeshIndexCell *>> m_cells_in_range;
+	bool m_cells_in_range_dirty = true;
+	v3s16 m_cells_in_range_camera_block;
+	float m_cells_in_range_range = 0.0f;
+	bool m_cells_in_range_all = false;
+	// << KIDSCODE
+
+	OcclusionBuffer m_occlusion_buffer; // KIDSCODE - Occlusion buffer
+
+	// >> KIDSCODE - Render queue
+	// Small static mesh buffers of the blocks of a region merged by
+	// material, drawn with one call when all these blocks are drawn
+	struct MergedMeshBuffer
+	{
+		u8 layer;
+		scene::IMeshBuffer *buf;
+		std::vector<std::pair<MapBlock *, scene::IMeshBuffer *>> sources;
+	};
+	// Per region of MESH_BATCH_REGION_SIZE^3 blocks
+	std::map<v3s16, std::vector<MergedMeshBuffer>> m_mesh_batches;
+	v3s16 m_mesh_batches_camera_offset;
+
+	void buildMeshBatches(v3s16 region, std::vector<MergedMeshBuffer> &batches);
+	void dropMeshBatches(v3s16 region);
+	void clearMeshBatches();
+
+	// Mesh buffers of the draw list with the same material
+	struct RenderList
+	{
+		video::SMaterial m;
+		// Index of the block in the draw list and buffer
+		std::vector<std::pair<u32, scene::IMeshBuffer *>> bufs;
+		// Merged buffer and the draw list index of each of its sources,
+		// U32_MAX for blocks outside of the draw list
+		std::vector<std::pair<const MergedMeshBuffer *, std::vector<u32>>> merged;
+	};
+
+	// Rebuilt when the draw list or a mesh changes, per pass and layer
+	void updateRenderQueue(video::IVideoDriver *driver);
+	void applyMaterialSettings(video::SMaterial &material);
+	std::vector<RenderList> m_render_queue[2][MAX_TILE_LAYERS];
+	// Buffers whose material changes with their animation, grouped by
+	// material at each frame: draw list index, layer and buffer
+	struct AnimatedBuffer
+	{
+		u32 block;
+		u8 layer;
+		scene::IMeshBuffer *buf;
+	};
+	std::vector<AnimatedBuffer> m_render_queue_animated[2];
+	bool m_render_queue_dirty = true;
+	bool m_render_queue_wireframe = false;
+
+	bool m_cache_enable_vbo;
+	// << KIDSCODE
+
+	// >> KIDSCODE - Mesh LOD
+	u8 getBlockLod(v3s16 blockpos, const MapBlockMesh *mesh);
+	std::vector<v3s16> m_lod_updates;
+	// Blocks in m_lod_updates or with a mesh update requested since
+	std::set<v3s16> m_lod_pending;
+	f32 m_cache_lod_distance;
+	// << KIDSCODE
 
 	std::set<v2s16> m_last_drawn_sectors;
 
@@ -39,6 +39,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "map.h"
 #include "mesh.h"
 #include "nodedef.h"
+#include "objectbatch.h" // KIDSCODE - Object batching
+#include "object_position.h" // KIDSCODE - Compact position updates
 #include "serialization.h" // For decompressZlib
 #include "settings.h"
 #include "sound.h"
@@ -544,6 +546,13 @@ void GenericCAO::removeFromScene(bool permanent)
 		clearParentAttachment();
 	}
 
+	// >> KIDSCODE - Object batching
+	if (m_batched) {
+		m_env->getObjectBatch()->removeInstance(this);
+		m_batched = false;
+	}
+	// << KIDSCODE
+
 	if (m_meshnode) {
 		m_meshnode->remove();
 		m_meshnode->drop();
@@ -961,6 +970,125 @@ void GenericCAO::setNodeLight(u8 light)
 	}
 }
 
+// >> KIDSCODE - Object batching
+bool GenericCAO::getBatchInstance(ObjectBatchInstance *instance)
+{
+	// The light is applied like the object shader does
+	if (!m_enable_shaders || !m_is_visible || m_prop.use_texture_alpha)
+		return false;
+
+	// The children are attached to the scene node
+	if (!m_matrixnode || !m_attachment_child_ids.empty())
+		return false;
+
+	scene::IMesh *mesh = nullptr;
+	if (m_prop.visual == "cube" && m_meshnode) {
+		mesh = m_env->getObjectBatch()->getCubeMesh();
+		instance->mesh = mesh;
+		instance->node = m_meshnode;
+	} else if (m_prop.visual == "mesh" && m_animated_meshnode) {
+		// Bone overrides are specific to the scene node
+		if (!m_bone_position.empty())
+			return false;
+
+		scene::IAnimatedMesh *animated_mesh = m_animated_meshnode->getMesh();
+		if (animated_mesh->getFrameCount() <= 1) {
+			instance->mesh = animated_mesh->getMesh(0);
+		} else if (animated_mesh->getMeshType() == scene::EAMT_SKINNED) {
+			instance->animated_mesh = animated_mesh;
+			instance->frame = std::round(m_batch_frame / OBJECT_BATCH_FRAME_STEP) *
+				OBJECT_BATCH_FRAME_STEP;
+		} else {
+			return false;
+		}
+		mesh = animated_mesh;
+		instance->node = m_animated_meshnode;
+	} else {
+		return false;
+	}
+
+	if (instance->node->getParent() != m_matrixnode ||
+			instance->node->getMaterialCount() != mesh->getMeshBufferCount())
+		return false;
+
+	for (u32 i = 0; i < mesh->getMeshBufferCount(); i++) {
+		scene::IMeshBuffer *buf = mesh->getMeshBuffer(i);
+		if (buf->getVertexType() != video::EVT_STANDARD ||
+				buf->getIndexType() != video::EIT_16BIT ||
+				buf->getVertexCount() > OBJECT_BATCH_MAX_VERTICES)
+			return false;
+	}
+
+	instance->light = video::SColor(255, m_last_light, m_last_light, m_last_light);
+	return true;
+}
+
+void GenericCAO::updateBatching(float dtime)
+{
+	ObjectBatchSceneNode *batch = m_env->getObjectBatch();
+	if (!batch)
+		return;
+
+	if (m_animated_meshnode) {
+		if (m_batched) {
+			stepBatchFrame(dtime);
+		} else {
+			m_batch_frame = m_animated_meshnode->getFrameNr();
+			m_batch_frame_loop = v2s32(m_animated_meshnode->getStartFrame(),
+				m_animated_meshnode->getEndFrame());
+		}
+	}
+
+	ObjectBatchInstance instance;
+	if (getBatchInstance(&instance)) {
+		batch->setInstance(this, instance);
+		m_batched = true;
+	} else if (m_batched) {
+		batch->removeInstance(this);
+		m_batched = false;
+		// setCurrentFrame() divides by the speed
+		if (m_animated_meshnode &&
+				m_animated_meshnode->getAnimationSpeed() != 0.0f)
+			m_animated_meshnode->setCurrentFrame(m_batch_frame);
+	}
+
+	// Hiding the parent keeps the scene from animating and skinning the
+	// node of a batched object each frame
+	if (m_matrixnode)
+		m_matrixnode->setVisible(!m_batched);
+}
+
+// Same as the animation of CAnimatedMeshSceneNode
+void GenericCAO::stepBatchFrame(float dtime)
+{
+	s32 start = m_animated_meshnode->getStartFrame();
+	s32 end = m_animated_meshnode->getEndFrame();
+	f32 speed = m_animated_meshnode->getAnimationSpeed();
+
+	// setFrameLoop() starts the new range over
+	if (m_batch_frame_loop != v2s32(start, end)) {
+		m_batch_frame_loop = v2s32(start, end);
+		m_batch_frame = speed < 0.0f ? end : start;
+	}
+
+	if (start == end) {
+		m_batch_frame = start;
+		return;
+	}
+
+	m_batch_frame += dtime * speed;
+	if (m_animated_meshnode->getLoopMode()) {
+		f32 length = end - start;
+		if (m_batch_frame > end)
+			m_batch_frame = start + std::fmod(m_batch_frame - start, length);
+		else if (m_batch_frame < start)
+			m_batch_frame = end - std::fmod(end - m_batch_frame, length);
+	} else {
+		m_batch_frame = rangelim(m_batch_frame, start, end);
+	}
+}
+// << KIDSCODE
+
 u16 GenericCAO::getLightPosition(v3s16 *pos)
 {
 	const auto &box = m_prop.collisionbox;
@@ -1131,6 +1259,8 @@ void GenericCAO::step(float dtime, ClientEnvironment *env)
 		}
 	}
 
+	updateBatching(dtime); // KIDSCODE - Object batching
+
 	// Make sure m_is_visible is always applied
 	scene::ISceneNode *node = getSceneNode();
 	if (node)
@@ -1249,8 +1379,11 @@ void GenericCAO::step(float dtime, ClientEnvironment *env)
 		if (m_matrixnode)
 			updatePositionRecursive(m_matrixnode);
 		m_animated_meshnode->updateAbsolutePosition();
-		m_animated_meshnode->animateJoints();
-		updateBonePosition();
+		// KIDSCODE - Object batching: batched objects have no bones in use
+		if (!m_batched) {
+			m_animated_meshnode->animateJoints();
+			updateBonePosition();
+		}
 	}
 }
 
@@ -1721,18 +1854,23 @@ void GenericCAO::processMessage(const std::string &data)
 			}
 			updateNametag();
 		}
-	} else if (cmd == AO_CMD_UPDATE_POSITION) {
+	} else if (cmd == AO_CMD_UPDATE_POSITION ||
+			cmd == AO_CMD_UPDATE_POSITION_COMPACT) { // KIDSCODE - Compact position updates
 		// Not sent by the server if this object is an attachment.
 		// We might however get here if the server notices the object being detached before the client.
-		m_position = readV3F32(is);
-		m_velocity = readV3F32(is);
-		m_acceleration = readV3F32(is);
-		m_rotation = readV3F32(is);
+		// >> KIDSCODE - Compact position updates
+		ObjectPositionUpdate update;
+		update.deSerialize(is, cmd);
+		m_position = update.position;
+		m_velocity = update.velocity;
+		m_acceleration = update.acceleration;
+		m_rotation = update.rotation;
 
 		m_rotation = wrapDegrees_0_360_v3f(m_rotation);
-		bool do_interpolate = readU8(is);
-		bool is_end_position = readU8(is);
-		float update_interval = readF32(is);
+		bool do_interpolate = update.do_interpolate;
+		bool is_end_position = update.is_movement_end;
+		float update_interval = update.update_interval;
+		// << KIDSCODE
 
 		// Place us a bit higher if we're physical, to not sink into
 		// the ground due to sucky collision detection...
@@ -31,6 +31,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 class Camera;
 class Client;
 struct Nametag;
+struct ObjectBatchInstance; // KIDSCODE - Object batching
 
 /*
 	SmoothTranslator
@@ -131,6 +132,13 @@ class GenericCAO : public ClientActiveObject
 	video::E_MATERIAL_TYPE m_material_type;
 	// Settings
 	bool m_enable_shaders = false;
+	// >> KIDSCODE - Object batching
+	// Drawn by the object batch of the environment instead of its own node
+	bool m_batched = false;
+	// The scene node is not animated while batched, the frame goes on here
+	f32 m_batch_frame = 0.0f;
+	v2s32 m_batch_frame_loop;
+	// << KIDSCODE
 
 	bool visualExpiryRequired(const ObjectProperties &newprops) const;
 
@@ -243,6 +251,13 @@ class GenericCAO : public ClientActiveObject
 
 	void setNodeLight(u8 light);
 
+	// >> KIDSCODE - Object batching
+	// False if the object can't be drawn in a batch
+	bool getBatchInstance(ObjectBatchInstance *instance);
+	void updateBatching(float dtime);
+	void stepBatchFrame(float dtime);
+	// << KIDSCODE
+
 	/* Get light position(s).
 	 * returns number of positions written into pos[], which must have space
 	 * for at least 3 vectors. */
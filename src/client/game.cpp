@@ -462,6 +462,8 @@ class GameGlobalShaderConstantSetter : public IShaderConstantSetter
 	CachedPixelShaderSetting<SamplerLayer_t> m_base_texture;
 	CachedPixelShaderSetting<SamplerLayer_t> m_normal_texture;
 	CachedPixelShaderSetting<SamplerLayer_t> m_texture_flags;
+	CachedPixelShaderSetting<float> m_atlas_slots; // KIDSCODE - Texture atlas
+	float m_material_atlas_slots = 0.0f; // KIDSCODE - Texture atlas
 	Client *m_client;
 
 public:
@@ -496,6 +498,7 @@ class GameGlobalShaderConstantSetter : public IShaderConstantSetter
 		m_base_texture("baseTexture"),
 		m_normal_texture("normalTexture"),
 		m_texture_flags("textureFlags"),
+		m_atlas_slots("atlasSlots"), // KIDSCODE - Texture atlas
 		m_client(client)
 	{
 		g_settings->registerChangedCallback("enable_fog", settingsCallback, this);
@@ -589,7 +592,16 @@ class GameGlobalShaderConstantSetter : public IShaderConstantSetter
 		m_base_texture.set(&base_tex, services);
 		m_normal_texture.set(&normal_tex, services);
 		m_texture_flags.set(&flags_tex, services);
+
+		m_atlas_slots.set(&m_material_atlas_slots, services); // KIDSCODE - Texture atlas
+	}
+
+	// >> KIDSCODE - Texture atlas
+	void onSetMaterial(const video::SMaterial &material) override
+	{
+		m_material_atlas_slots = material.MaterialTypeParam2;
 	}
+	// << KIDSCODE
 };
 
 
@@ -3912,6 +3924,9 @@ void Game::updateFrame(ProfilerGraph *graph, RunStats *stats, f32 dtime,
 			sunlight_seen, camera->getCameraMode(), player->getYaw(),
 			player->getPitch());
 
+	// KIDSCODE - Particle map cache
+	client->getParticleManager()->step(dtime);
+
 	/*
 		Update clouds
 	*/
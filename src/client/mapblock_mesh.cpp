@@ -30,6 +30,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "client/meshgen/collector.h"
 #include "client/renderingengine.h"
 #include <array>
+#include <cfloat> // KIDSCODE - Mesh LOD
 
 /*
 	MeshMakeData
@@ -1004,6 +1005,169 @@ static void updateAllFastFaceRows(MeshMakeData *data,
 				dest);
 }
 
+// >> KIDSCODE - Mesh LOD
+/*
+	Simplified mesh of a distant block. The block is split into cells of
+	2^lod nodes, a cell is filled when most of its nodes are, and the faces
+	between filled and empty cells use the tiles of the topmost filled
+	node of the cell. Special drawtypes are left out.
+	The neighbor blocks may use another level of detail: at the border, the
+	nodes themselves decide the faces and skirts cover the gaps.
+*/
+static void updateLodFaces(MeshMakeData *data, std::vector<FastFace> &dest)
+{
+	VoxelManipulator &vmanip = data->m_vmanip;
+	const NodeDefManager *ndef = data->m_client->ndef();
+	v3s16 blockpos_nodes = data->m_blockpos * MAP_BLOCKSIZE;
+	const s16 size = 1 << data->m_lod;
+	const s16 cells = MAP_BLOCKSIZE / size;
+
+	// Unknown nodes count as filled, no face is made towards them
+	auto is_filled = [ndef](const MapNode &n) {
+		if (n.getContent() == CONTENT_IGNORE)
+			return true;
+		const ContentFeatures &f = ndef->get(n);
+		return f.solidness != 0 || f.visual_solidness != 0;
+	};
+
+	// Cells of the block and the ones around it
+	const s16 side = cells + 2;
+	auto index = [side](s16 x, s16 y, s16 z) {
+		return ((z + 1) * side + y + 1) * side + x + 1;
+	};
+	std::vector<bool> filled(side * side * side, false);
+	std::vector<MapNode> top(side * side * side, MapNode(CONTENT_IGNORE));
+	std::vector<v3s16> top_pos(side * side * side);
+
+	v3s16 c;
+	for (c.Z = -1; c.Z <= cells; c.Z++)
+	for (c.Y = -1; c.Y <= cells; c.Y++)
+	for (c.X = -1; c.X <= cells; c.X++) {
+		v3s16 p0 = c * size;
+		u32 count = 0;
+		u32 i = index(c.X, c.Y, c.Z);
+		v3s16 p;
+		for (p.Y = p0.Y + size - 1; p.Y >= p0.Y; p.Y--)
+		for (p.Z = p0.Z; p.Z < p0.Z + size; p.Z++)
+		for (p.X = p0.X; p.X < p0.X + size; p.X++) {
+			const MapNode &n = vmanip.getNodeRefUnsafeCheckFlags(blockpos_nodes + p);
+			if (!is_filled(n))
+				continue;
+			count++;
+			if (top[i].getContent() == CONTENT_IGNORE &&
+					n.getContent() != CONTENT_IGNORE) {
+				top[i] = n;
+				top_pos[i] = p;
+			}
+		}
+		filled[i] = count * 2 >= (u32)(size * size * size);
+	}
+
+	auto inside = [cells](const v3s16 &c) {
+		return c.X >= 0 && c.Y >= 0 && c.Z >= 0 &&
+			c.X < cells && c.Y < cells && c.Z < cells;
+	};
+
+	// Brightest light of the empty nodes between p0 and p1 on the face of
+	// n towards dir, false if there is none
+	auto empty_light = [&](const MapNode &n, v3s16 p0, v3s16 p1, v3s16 dir,
+			u16 *light) -> bool {
+		bool found = false;
+		u16 day = 0;
+		u16 night = 0;
+		v3s16 p;
+		for (p.Z = p0.Z; p.Z <= p1.Z; p.Z++)
+		for (p.Y = p0.Y; p.Y <= p1.Y; p.Y++)
+		for (p.X = p0.X; p.X <= p1.X; p.X++) {
+			const MapNode &n1 = vmanip.getNodeRefUnsafeCheckFlags(blockpos_nodes + p);
+			if (is_filled(n1))
+				continue;
+			u16 l = getFaceLight(n, n1, dir, ndef);
+			day = MYMAX(day, l & 0xff);
+			night = MYMAX(night, l >> 8);
+			found = true;
+		}
+		*light = day | (night << 8);
+		return found;
+	};
+
+	// Face of a whole cell, textured like the face of its node n at n_pos
+	// so that the tile rotation applies
+	auto add_face = [&](const MapNode &n, v3s16 n_pos, v3s16 cell, v3s16 dir,
+			u16 light) {
+		TileSpec tile;
+		getNodeTile(n, n_pos, dir, data, tile);
+		tile.emissive_light = ndef->get(n).light_source;
+
+		v3f center = intToFloat(cell * size, 1.0f) +
+			v3f(1, 1, 1) * ((size - 1) * 0.5f);
+		makeFastFace(tile, light, light, light, light,
+				intToFloat(n_pos, 1.0f), center, dir, v3f(1, 1, 1), dest);
+
+		// One texture over the whole face
+		FastFace &face = dest.back();
+		v3f origin = center * BS;
+		for (video::S3DVertex &vertex : face.vertices)
+			vertex.Pos = origin + (vertex.Pos - origin) * size;
+	};
+
+	for (c.Z = 0; c.Z < cells; c.Z++)
+	for (c.Y = 0; c.Y < cells; c.Y++)
+	for (c.X = 0; c.X < cells; c.X++) {
+		u32 i = index(c.X, c.Y, c.Z);
+		v3s16 cell_p0 = c * size;
+		v3s16 cell_p1 = cell_p0 + v3s16(size - 1, size - 1, size - 1);
+
+		if (!filled[i]) {
+			// Skirts: the neighbor block may be drawn with more detail and
+			// hide its faces behind nodes this cell leaves out, the face of
+			// the filled cell across the border closes the gap
+			for (const v3s16 &dir : g_6dirs) {
+				v3s16 c1 = c + dir;
+				u32 i1 = index(c1.X, c1.Y, c1.Z);
+				if (inside(c1) || !filled[i1] ||
+						top[i1].getContent() == CONTENT_IGNORE)
+					continue;
+
+				u16 light;
+				empty_light(top[i1], cell_p0, cell_p1, -dir, &light);
+				add_face(top[i1], top_pos[i1], c1, -dir, light);
+			}
+			continue;
+		}
+
+		if (top[i].getContent() == CONTENT_IGNORE)
+			continue;
+
+		const MapNode &n = top[i];
+		for (const v3s16 &dir : g_6dirs) {
+			v3s16 c1 = c + dir;
+			bool border = !inside(c1);
+			if (!border && filled[index(c1.X, c1.Y, c1.Z)])
+				continue;
+
+			// Nodes of the neighbor cell along the face
+			v3s16 p0 = c1 * size;
+			v3s16 p1 = p0 + v3s16(size - 1, size - 1, size - 1);
+			if (dir.X)
+				p0.X = p1.X = dir.X > 0 ? p0.X : p1.X;
+			if (dir.Y)
+				p0.Y = p1.Y = dir.Y > 0 ? p0.Y : p1.Y;
+			if (dir.Z)
+				p0.Z = p1.Z = dir.Z > 0 ? p0.Z : p1.Z;
+
+			// Across the border, any empty node may see the face: the
+			// neighbor block may be drawn with more detail
+			u16 light;
+			if (!empty_light(n, p0, p1, dir, &light) && border)
+				continue;
+
+			add_face(n, top_pos[i], c, dir, light);
+		}
+	}
+}
+// << KIDSCODE
+
 static void applyTileColor(PreMeshBuffer &pmb)
 {
 	video::SColor tc = pmb.layer.color;
@@ -1018,6 +1182,85 @@ static void applyTileColor(PreMeshBuffer &pmb)
 	}
 }
 
+// >> KIDSCODE - Texture atlas
+static bool canUseTextureAtlas(const TileLayer &layer)
+{
+	if (layer.material_flags & (MATERIAL_FLAG_CRACK | MATERIAL_FLAG_ANIMATION))
+		return false;
+	// The waving shaders use the texture coordinates
+	switch (layer.material_type) {
+	case TILE_MATERIAL_WAVING_LEAVES:
+	case TILE_MATERIAL_WAVING_PLANTS:
+	case TILE_MATERIAL_WAVING_LIQUID_BASIC:
+	case TILE_MATERIAL_WAVING_LIQUID_TRANSPARENT:
+	case TILE_MATERIAL_WAVING_LIQUID_OPAQUE:
+		return false;
+	default:
+		break;
+	}
+	return !layer.normal_texture;
+}
+
+/*
+	Moves the buffers of the textures packed in an atlas to the atlas, and
+	merges those that end up with the same material.
+*/
+static void applyTextureAtlas(std::vector<PreMeshBuffer> &prebuffers,
+		ITextureSource *tsrc)
+{
+	const f32 span = TEXTURE_ATLAS_SLOT_SPAN;
+	std::vector<PreMeshBuffer> result;
+	result.reserve(prebuffers.size());
+
+	for (PreMeshBuffer &p : prebuffers) {
+		TextureAtlasSlot slot;
+		if (!canUseTextureAtlas(p.layer) ||
+				!tsrc->getAtlasSlot(p.layer.texture_id, &slot)) {
+			result.push_back(std::move(p));
+			continue;
+		}
+
+		// The color goes to the vertices, the wrapping to the shader
+		applyTileColor(p);
+		p.layer.color = video::SColor(0xFFFFFFFF);
+		p.layer.scale = 1;
+		p.layer.material_flags &= ~(MATERIAL_FLAG_TILEABLE_HORIZONTAL |
+			MATERIAL_FLAG_TILEABLE_VERTICAL);
+		p.layer.texture = slot.atlas;
+		p.layer.texture_id = slot.atlas_id;
+		p.atlas_slots = slot.slots;
+
+		v2f offset(slot.x * span + span / 2, slot.y * span + span / 2);
+		for (video::S3DVertex &v : p.vertices) {
+			v.TCoords.X = offset.X + rangelim(v.TCoords.X, -span / 2, span / 2 - 0.01f);
+			v.TCoords.Y = offset.Y + rangelim(v.TCoords.Y, -span / 2, span / 2 - 0.01f);
+		}
+
+		PreMeshBuffer *target = nullptr;
+		for (PreMeshBuffer &r : result) {
+			if (r.atlas_slots && r.layer == p.layer &&
+					r.layer.shader_id == p.layer.shader_id &&
+					r.layer.flags_texture == p.layer.flags_texture &&
+					r.vertices.size() + p.vertices.size() <= U16_MAX) {
+				target = &r;
+				break;
+			}
+		}
+		if (!target) {
+			result.push_back(std::move(p));
+			continue;
+		}
+		u32 base = target->vertices.size();
+		target->vertices.insert(target->vertices.end(),
+			p.vertices.begin(), p.vertices.end());
+		for (u16 i : p.indices)
+			target->indices.push_back(base + i);
+	}
+
+	prebuffers = std::move(result);
+}
+// << KIDSCODE
+
 /*
 	MapBlockMesh
 */
@@ -1035,6 +1278,7 @@ MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset):
 	m_enable_shaders = data->m_use_shaders;
 	m_use_tangent_vertices = data->m_use_tangent_vertices;
 	m_enable_vbo = g_settings->getBool("enable_vbo");
+	m_lod = data->m_lod; // KIDSCODE - Mesh LOD
 
 	if (data->m_client->getMinimap()) {
 		m_minimap_mapblock = new MinimapMapblock;
@@ -1059,7 +1303,12 @@ MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset):
 	{
 		// 4-23ms for MAP_BLOCKSIZE=16  (NOTE: probably outdated)
 		//TimeTaker timer2("updateAllFastFaceRows()");
-		updateAllFastFaceRows(data, fastfaces_new);
+		// >> KIDSCODE - Mesh LOD
+		if (m_lod > 0)
+			updateLodFaces(data, fastfaces_new);
+		else
+			updateAllFastFaceRows(data, fastfaces_new);
+		// << KIDSCODE
 	}
 	// End of slow part
 
@@ -1091,11 +1340,18 @@ MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset):
 		- whatever
 	*/
 
-	{
+	if (m_lod == 0) { // KIDSCODE - Mesh LOD
 		MapblockMeshGenerator generator(data, &collector);
 		generator.generate();
 	}
 
+	// >> KIDSCODE - Texture atlas
+	if (m_enable_shaders && !m_use_tangent_vertices) {
+		for (auto &prebuffers : collector.prebuffers)
+			applyTextureAtlas(prebuffers, m_tsrc);
+	}
+	// << KIDSCODE
+
 	/*
 		Convert MeshCollector to SMesh
 	*/
@@ -1181,6 +1437,7 @@ MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset):
 				if (p.layer.normal_texture)
 					material.setTexture(1, p.layer.normal_texture);
 				material.setTexture(2, p.layer.flags_texture);
+				material.MaterialTypeParam2 = p.atlas_slots; // KIDSCODE - Texture atlas
 			} else {
 				p.layer.applyMaterialOptions(material);
 			}
@@ -1390,3 +1647,33 @@ video::SColor encode_light(u16 light, u8 emissive_light)
 	float b = (day + night) / 2;
 	return video::SColor(r, b, b, b);
 }
+
+// >> KIDSCODE - Mesh LOD
+// Distance from the boundaries of its range at which a level is left
+#define MESH_LOD_HYSTERESIS MAP_BLOCKSIZE
+
+u8 getMeshLod(f32 distance, f32 lod_distance)
+{
+	if (lod_distance <= 0.0f)
+		return 0;
+
+	u8 lod = 0;
+	while (lod < MESH_LOD_MAX && distance >= lod_distance * (1 << lod))
+		lod++;
+	return lod;
+}
+
+u8 getMeshLod(f32 distance, f32 lod_distance, u8 current)
+{
+	u8 lod = getMeshLod(distance, lod_distance);
+	if (lod == current || lod_distance <= 0.0f || current > MESH_LOD_MAX)
+		return lod;
+
+	f32 min = current == 0 ? 0.0f : lod_distance * (1 << (current - 1));
+	f32 max = current == MESH_LOD_MAX ? FLT_MAX : lod_distance * (1 << current);
+	if (distance >= min - MESH_LOD_HYSTERESIS &&
+			distance < max + MESH_LOD_HYSTERESIS)
+		return current;
+	return lod;
+}
+// << KIDSCODE
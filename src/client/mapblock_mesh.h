@@ -42,6 +42,8 @@ struct MeshMakeData
 	v3s16 m_blockpos = v3s16(-1337,-1337,-1337);
 	v3s16 m_crack_pos_relative = v3s16(-1337,-1337,-1337);
 	bool m_smooth_lighting = false;
+	// KIDSCODE - Mesh LOD: the mesh is made of cells of 2^m_lod nodes
+	u8 m_lod = 0;
 
 	Client *m_client;
 	bool m_use_shaders;
@@ -134,6 +136,26 @@ class MapBlockMesh
 
 	void updateCameraOffset(v3s16 camera_offset);
 
+	u8 getLod() const { return m_lod; } // KIDSCODE - Mesh LOD
+
+	// >> KIDSCODE - Render queue
+	// False if animate() changes the material of the buffer
+	bool isMaterialStatic(u8 layer, u32 i) const
+	{
+		std::pair<u8, u32> key(layer, i);
+		return m_crack_materials.find(key) == m_crack_materials.end() &&
+			m_animation_tiles.find(key) == m_animation_tiles.end();
+	}
+
+	// False if animate() changes the material or the vertices of the buffer
+	bool isBufferStatic(u8 layer, u32 i) const
+	{
+		return isMaterialStatic(layer, i) &&
+			m_daynight_diffs.find(std::pair<u8, u32>(layer, i)) ==
+				m_daynight_diffs.end();
+	}
+	// << KIDSCODE
+
 private:
 	scene::IMesh *m_mesh[MAX_TILE_LAYERS];
 	MinimapMapblock *m_minimap_mapblock;
@@ -143,6 +165,7 @@ class MapBlockMesh
 	bool m_enable_shaders;
 	bool m_use_tangent_vertices;
 	bool m_enable_vbo;
+	u8 m_lod; // KIDSCODE - Mesh LOD
 
 	// Must animate() be called before rendering?
 	bool m_has_animation;
@@ -173,6 +196,18 @@ class MapBlockMesh
 	v3s16 m_camera_offset;
 };
 
+// >> KIDSCODE - Mesh LOD
+#define MESH_LOD_MAX 3
+
+// Level of detail of the mesh of a block at `distance` nodes from the
+// camera: 0 closer than `lod_distance`, then one more level each time
+// the distance doubles. 0 if `lod_distance` is not positive.
+u8 getMeshLod(f32 distance, f32 lod_distance);
+// Same, but keeps `current` while the distance is a little outside of
+// its range, so that meshes don't flip at the boundaries
+u8 getMeshLod(f32 distance, f32 lod_distance, u8 current);
+// << KIDSCODE
+
 /*!
  * Encodes light of a node.
  * The result is not the final color, but a
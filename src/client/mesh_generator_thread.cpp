@@ -72,7 +72,8 @@ MeshUpdateQueue::~MeshUpdateQueue()
 	}
 }
 
-void MeshUpdateQueue::addBlock(Map *map, v3s16 p, bool ack_block_to_server, bool urgent)
+void MeshUpdateQueue::addBlock(Map *map, v3s16 p, bool ack_block_to_server, bool urgent,
+		u8 lod) // KIDSCODE - Mesh LOD
 {
 	MutexAutoLock lock(m_mutex);
 
@@ -119,6 +120,7 @@ void MeshUpdateQueue::addBlock(Map *map, v3s16 p, bool ack_block_to_server, bool
 				q->ack_block_to_server = true;
 			q->crack_level = m_client->getCrackLevel();
 			q->crack_pos = m_client->getCrackPos();
+			q->lod = lod; // KIDSCODE - Mesh LOD
 			return;
 		}
 	}
@@ -131,6 +133,7 @@ void MeshUpdateQueue::addBlock(Map *map, v3s16 p, bool ack_block_to_server, bool
 	q->ack_block_to_server = ack_block_to_server;
 	q->crack_level = m_client->getCrackLevel();
 	q->crack_pos = m_client->getCrackPos();
+	q->lod = lod; // KIDSCODE - Mesh LOD
 	m_queue.push_back(q);
 
 	// This queue entry is a new reference to the cached blocks
@@ -232,6 +235,7 @@ void MeshUpdateQueue::fillDataFromMapBlockCache(QueuedMeshUpdate *q)
 
 	data->setCrack(q->crack_level, q->crack_pos);
 	data->setSmoothLighting(m_cache_smooth_lighting);
+	data->m_lod = q->lod; // KIDSCODE - Mesh LOD
 }
 
 void MeshUpdateQueue::cleanupCache()
@@ -276,10 +280,10 @@ MeshUpdateThread::MeshUpdateThread(Client *client):
 }
 
 void MeshUpdateThread::updateBlock(Map *map, v3s16 p, bool ack_block_to_server,
-		bool urgent)
+		bool urgent, u8 lod) // KIDSCODE - Mesh LOD
 {
 	// Allow the MeshUpdateQueue to do whatever it wants
-	m_queue_in.addBlock(map, p, ack_block_to_server, urgent);
+	m_queue_in.addBlock(map, p, ack_block_to_server, urgent, lod); // KIDSCODE - Mesh LOD
 	deferUpdate();
 }
 
@@ -43,6 +43,7 @@ struct QueuedMeshUpdate
 	bool urgent = false;
 	int crack_level = -1;
 	v3s16 crack_pos;
+	u8 lod = 0; // KIDSCODE - Mesh LOD
 	MeshMakeData *data = nullptr; // This is generated in MeshUpdateQueue::pop()
 
 	QueuedMeshUpdate() = default;
@@ -67,7 +68,8 @@ class MeshUpdateQueue
 
 	// Caches the block at p and its neighbors (if needed) and queues a mesh
 	// update for the block at p
-	void addBlock(Map *map, v3s16 p, bool ack_block_to_server, bool urgent);
+	void addBlock(Map *map, v3s16 p, bool ack_block_to_server, bool urgent,
+			u8 lod = 0); // KIDSCODE - Mesh LOD
 
 	// Returned pointer must be deleted
 	// Returns NULL if queue is empty
@@ -115,7 +117,8 @@ class MeshUpdateThread : public UpdateThread
 
 	// Caches the block at p and its neighbors (if needed) and queues a mesh
 	// update for the block at p
-	void updateBlock(Map *map, v3s16 p, bool ack_block_to_server, bool urgent);
+	void updateBlock(Map *map, v3s16 p, bool ack_block_to_server, bool urgent,
+			u8 lod = 0); // KIDSCODE - Mesh LOD
 
 	v3s16 m_camera_offset;
 	MutexedQueue<MeshUpdateResult> m_queue_out;
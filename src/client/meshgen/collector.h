@@ -29,6 +29,8 @@ struct PreMeshBuffer
 	TileLayer layer;
 	std::vector<u16> indices;
 	std::vector<video::S3DVertex> vertices;
+	// KIDSCODE - Texture atlas: slots per side of the atlas, 0 if none
+	u16 atlas_slots = 0;
 
 	PreMeshBuffer() = default;
 	explicit PreMeshBuffer(const TileLayer &layer) : layer(layer) {}
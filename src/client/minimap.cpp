@@ -17,6 +17,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#include <algorithm> // KIDSCODE - Minimap tiles
 #include <cmath>
 #include "minimap.h"
 #include "client.h"
@@ -26,6 +27,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mapblock.h"
 #include "client/renderingengine.h"
 #include "client/fontengine.h"
+#include "nodedef.h" // KIDSCODE - Minimap tiles
 #include "IGUIFont.h" // KIDSCODE - Metadata markers
 #include "gettext.h" // KIDSCODE - Metadata markers
 
@@ -44,6 +46,11 @@ MinimapUpdateThread::~MinimapUpdateThread()
 	for (auto &q : m_update_queue) {
 		delete q.data;
 	}
+
+	// >> KIDSCODE - Minimap tiles
+	for (auto &it : m_tiles)
+		delete it.second;
+	// << KIDSCODE
 }
 
 bool MinimapUpdateThread::pushBlockUpdate(v3s16 pos, MinimapMapblock *data)
@@ -94,6 +101,12 @@ void MinimapUpdateThread::doUpdate()
 	QueuedMinimapUpdate update;
 
 	while (popBlockUpdate(&update)) {
+		// >> KIDSCODE - Minimap tiles
+		auto tile = m_tiles.find(v2s16(update.pos.X, update.pos.Z));
+		if (tile != m_tiles.end())
+			tile->second->dirty = true;
+		// << KIDSCODE
+
 		if (update.data) {
 			// Swap two values in the map using single lookup
 			std::pair<std::map<v3s16, MinimapMapblock*>::iterator, bool>
@@ -120,6 +133,100 @@ void MinimapUpdateThread::doUpdate()
 	}
 }
 
+// >> KIDSCODE - Minimap tiles
+u32 MinimapUpdateThread::getSurfaceColor(MapNode n) const
+{
+	const ContentFeatures &f = ndef->get(n);
+	const TileDef *tile = &f.tiledef[0];
+
+	// Color of the 0th tile (mostly this is the topmost)
+	video::SColor tilecolor;
+	if (tile->has_color)
+		tilecolor = tile->color;
+	else
+		n.getColor(f, &tilecolor);
+
+	tilecolor.setRed(tilecolor.getRed() * f.minimap_color.getRed() / 255);
+	tilecolor.setGreen(tilecolor.getGreen() * f.minimap_color.getGreen() / 255);
+	tilecolor.setBlue(tilecolor.getBlue() * f.minimap_color.getBlue() / 255);
+	tilecolor.setAlpha(240);
+	return tilecolor.color;
+}
+
+void MinimapUpdateThread::buildTile(MinimapTile *tile, v2s16 column)
+{
+	u16 air_count[MAP_BLOCKSIZE * MAP_BLOCKSIZE] = {};
+	MapNode nodes[MAP_BLOCKSIZE * MAP_BLOCKSIZE];
+	for (u16 i = 0; i < MAP_BLOCKSIZE * MAP_BLOCKSIZE; i++) {
+		nodes[i] = MapNode(CONTENT_AIR);
+		tile->block_y[i] = S16_MIN;
+		tile->height[i] = 0;
+	}
+	tile->symbols.clear();
+
+	// The upper blocks cover the lower ones
+	for (s16 y = tile->block_y_min; y <= tile->block_y_max; y++) {
+		auto pblock = m_blocks_cache.find(v3s16(column.X, y, column.Y));
+		if (pblock == m_blocks_cache.end())
+			continue;
+		const MinimapMapblock &block = *pblock->second;
+
+		for (u16 i = 0; i < MAP_BLOCKSIZE * MAP_BLOCKSIZE; i++) {
+			const MinimapPixel &in_pixel = block.data[i];
+			air_count[i] += in_pixel.air_count;
+			if (in_pixel.n.param0 != CONTENT_AIR) {
+				nodes[i] = in_pixel.n;
+				tile->block_y[i] = y;
+				tile->height[i] = in_pixel.height;
+			}
+		}
+
+		for (const MinimapSymbol &symbol : block.m_symbols)
+			tile->symbols.emplace_back(symbol);
+	}
+
+	if (tile->type == MINIMAP_TYPE_SURFACE) {
+		// Neighbour pixels are often the same node
+		MapNode last_node(CONTENT_IGNORE);
+		u32 last_color = 0;
+		for (u16 i = 0; i < MAP_BLOCKSIZE * MAP_BLOCKSIZE; i++) {
+			if (i == 0 || !(nodes[i] == last_node)) {
+				last_node = nodes[i];
+				last_color = getSurfaceColor(last_node);
+			}
+			tile->colors[i] = last_color;
+		}
+	} else {
+		for (u16 i = 0; i < MAP_BLOCKSIZE * MAP_BLOCKSIZE; i++) {
+			u32 green = air_count[i] > 0 ?
+				std::min(32 + air_count[i] * 8, 255) : 0;
+			tile->colors[i] = video::SColor(240, 0, green, 0).color;
+		}
+	}
+
+	tile->dirty = false;
+}
+
+MinimapTile *MinimapUpdateThread::getTile(v2s16 column, s16 block_y_min,
+	s16 block_y_max, MinimapType type)
+{
+	MinimapTile *&tile = m_tiles[column];
+	if (!tile) {
+		tile = new MinimapTile();
+		tile->dirty = true;
+	}
+
+	if (tile->dirty || tile->block_y_min != block_y_min ||
+			tile->block_y_max != block_y_max || tile->type != type) {
+		tile->block_y_min = block_y_min;
+		tile->block_y_max = block_y_max;
+		tile->type = type;
+		buildTile(tile, column);
+	}
+	return tile;
+}
+// << KIDSCODE
+
 void MinimapUpdateThread::getMap(v3s16 pos, s16 size, s16 height)
 {
 	v3s16 pos_min(pos.X - size / 2, pos.Y - height / 2, pos.Z - size / 2);
@@ -127,55 +234,68 @@ void MinimapUpdateThread::getMap(v3s16 pos, s16 size, s16 height)
 	v3s16 blockpos_min = getNodeBlockPos(pos_min);
 	v3s16 blockpos_max = getNodeBlockPos(pos_max);
 
-// clear the map
-	for (int z = 0; z < size; z++)
-	for (int x = 0; x < size; x++) {
-		MinimapPixel &mmpixel = data->minimap_scan[x + z * size];
-		mmpixel.air_count = 0;
-		mmpixel.height = 0;
-		mmpixel.n = MapNode(CONTENT_AIR);
-	}
+	// >> KIDSCODE - Minimap tiles
+	// Copies the tiles in the scan, only the tiles of changed blocks are
+	// rebuilt
+	MinimapType type = data->mode.type;
+	bool surface = type == MINIMAP_TYPE_SURFACE;
+	data->scan_pixels.resize(size * size);
+	data->scan_heightmap.resize(size * size);
 	data->symbols.clear();
 
-// draw the map
-	v3s16 blockpos;
-	for (blockpos.Z = blockpos_min.Z; blockpos.Z <= blockpos_max.Z; ++blockpos.Z)
-	for (blockpos.Y = blockpos_min.Y; blockpos.Y <= blockpos_max.Y; ++blockpos.Y)
-	for (blockpos.X = blockpos_min.X; blockpos.X <= blockpos_max.X; ++blockpos.X) {
-		std::map<v3s16, MinimapMapblock *>::const_iterator pblock =
-			m_blocks_cache.find(blockpos);
-		if (pblock == m_blocks_cache.end())
-			continue;
-		const MinimapMapblock &block = *pblock->second;
+	v2s16 column;
+	for (column.Y = blockpos_min.Z; column.Y <= blockpos_max.Z; ++column.Y)
+	for (column.X = blockpos_min.X; column.X <= blockpos_max.X; ++column.X) {
+		const MinimapTile *tile = getTile(column, blockpos_min.Y,
+			blockpos_max.Y, type);
 
-		v3s16 block_node_min(blockpos * MAP_BLOCKSIZE);
-		v3s16 block_node_max(block_node_min + MAP_BLOCKSIZE - 1);
+		v2s16 tile_node_min(column * MAP_BLOCKSIZE);
 		// clip
-		v3s16 range_min = componentwise_max(block_node_min, pos_min);
-		v3s16 range_max = componentwise_min(block_node_max, pos_max);
-
-		v3s16 pos;
-		pos.Y = range_min.Y;
-		for (pos.Z = range_min.Z; pos.Z <= range_max.Z; ++pos.Z)
-		for (pos.X = range_min.X; pos.X <= range_max.X; ++pos.X) {
-			v3s16 inblock_pos = pos - block_node_min;
-			const MinimapPixel &in_pixel =
-				block.data[inblock_pos.Z * MAP_BLOCKSIZE + inblock_pos.X];
-
-			v3s16 inmap_pos = pos - pos_min;
-			MinimapPixel &out_pixel =
-				data->minimap_scan[inmap_pos.X + inmap_pos.Z * size];
-
-			out_pixel.air_count += in_pixel.air_count;
-			if (in_pixel.n.param0 != CONTENT_AIR) {
-				out_pixel.n = in_pixel.n;
-				out_pixel.height = inmap_pos.Y + in_pixel.height;
+		s16 x_min = MYMAX(tile_node_min.X, pos_min.X);
+		s16 x_max = MYMIN(tile_node_min.X + MAP_BLOCKSIZE - 1, pos_max.X);
+		s16 z_min = MYMAX(tile_node_min.Y, pos_min.Z);
+		s16 z_max = MYMIN(tile_node_min.Y + MAP_BLOCKSIZE - 1, pos_max.Z);
+
+		for (s16 z = z_min; z <= z_max; z++) {
+			// The image is upside down
+			s32 row = (size - 1 - (z - pos_min.Z)) * size - pos_min.X;
+			s32 in_row = (z - tile_node_min.Y) * MAP_BLOCKSIZE - tile_node_min.X;
+
+			for (s16 x = x_min; x <= x_max; x++)
+				data->scan_pixels[row + x] = tile->colors[in_row + x];
+
+			if (!surface)
+				continue;
+
+			// Height above the bottom of the scan
+			for (s16 x = x_min; x <= x_max; x++) {
+				s16 block_y = tile->block_y[in_row + x];
+				u32 h = 0;
+				if (block_y != S16_MIN)
+					h = MYMAX(block_y * MAP_BLOCKSIZE - pos_min.Y, 0) +
+						tile->height[in_row + x];
+				data->scan_heightmap[row + x] =
+					video::SColor(255, h, h, h).color;
 			}
 		}
 
-		for (MinimapSymbol symbol : block.m_symbols)
+		for (const MinimapSymbol &symbol : tile->symbols)
 			data->symbols.emplace_back(symbol);
 	}
+
+	// Forget the tiles out of the scan
+	for (auto it = m_tiles.begin(); it != m_tiles.end();) {
+		if (it->first.X < blockpos_min.X || it->first.X > blockpos_max.X ||
+				it->first.Y < blockpos_min.Z || it->first.Y > blockpos_max.Z) {
+			delete it->second;
+			it = m_tiles.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	data->scan_size = size;
+	// << KIDSCODE
 }
 
 ////
@@ -227,6 +347,20 @@ Minimap::Minimap(Client *client)
 		core::dimension2d<u32>(MINIMAP_MAX_SX, MINIMAP_MAX_SY));
 	data->minimap_overlay_square = m_tsrc->getTexture("minimap_overlay_square.png");
 
+	// >> KIDSCODE - Minimap tiles
+	m_minimap_pixels.resize(MINIMAP_MAX_SX * MINIMAP_MAX_SY);
+	m_mask_round.resize(MINIMAP_MAX_SX * MINIMAP_MAX_SY);
+	m_mask_square.resize(MINIMAP_MAX_SX * MINIMAP_MAX_SY);
+	for (s16 y = 0; y < MINIMAP_MAX_SY; y++)
+	for (s16 x = 0; x < MINIMAP_MAX_SX; x++) {
+		u32 i = y * MINIMAP_MAX_SX + x;
+		m_mask_round[i] = data->minimap_mask_round->getPixel(x, y).getAlpha() ?
+			0xFFFFFFFF : 0;
+		m_mask_square[i] = data->minimap_mask_square->getPixel(x, y).getAlpha() ?
+			0xFFFFFFFF : 0;
+	}
+	// << KIDSCODE
+
 	// Create player marker texture
 	data->player_marker = m_tsrc->getTexture("player_marker.png");
 	// Create object marker texture
@@ -240,6 +374,7 @@ Minimap::Minimap(Client *client)
 	// Initialize and start thread
 	m_minimap_update_thread = new MinimapUpdateThread();
 	m_minimap_update_thread->data = data;
+	m_minimap_update_thread->ndef = m_ndef; // KIDSCODE - Minimap tiles
 	m_minimap_update_thread->start();
 }
 
@@ -259,6 +394,11 @@ Minimap::~Minimap()
 	driver->removeTexture(data->minimap_overlay_square);
 	driver->removeTexture(data->object_marker_red);
 
+	// >> KIDSCODE - Minimap tiles
+	if (m_texture_mode_image)
+		m_texture_mode_image->drop();
+	// << KIDSCODE
+
 	delete data;
 	delete m_minimap_update_thread;
 }
@@ -417,50 +557,23 @@ void Minimap::setAngle(f32 angle)
 	m_angle = angle;
 }
 
-void Minimap::blitMinimapPixelsToImageRadar(video::IImage *map_image)
+// >> KIDSCODE - Minimap tiles
+void Minimap::blitMinimapPixels(const u32 *pixels, u16 size)
 {
-	video::SColor c(240, 0, 0, 0);
-	for (s16 x = 0; x < data->mode.map_size; x++)
-	for (s16 z = 0; z < data->mode.map_size; z++) {
-		MinimapPixel *mmpixel = &data->minimap_scan[x + z * data->mode.map_size];
-
-		if (mmpixel->air_count > 0)
-			c.setGreen(core::clamp(core::round32(32 + mmpixel->air_count * 8), 0, 255));
-		else
-			c.setGreen(0);
-
-		map_image->setPixel(x, data->mode.map_size - z - 1, c);
-	}
-}
-
-void Minimap::blitMinimapPixelsToImageSurface(
-	video::IImage *map_image, video::IImage *heightmap_image)
-{
-	// This variable creation/destruction has a 1% cost on rendering minimap
-	video::SColor tilecolor;
-	for (s16 x = 0; x < data->mode.map_size; x++)
-	for (s16 z = 0; z < data->mode.map_size; z++) {
-		MinimapPixel *mmpixel = &data->minimap_scan[x + z * data->mode.map_size];
-
-		const ContentFeatures &f = m_ndef->get(mmpixel->n);
-		const TileDef *tile = &f.tiledef[0];
-
-		// Color of the 0th tile (mostly this is the topmost)
-		if(tile->has_color)
-			tilecolor = tile->color;
-		else
-			mmpixel->n.getColor(f, &tilecolor);
-
-		tilecolor.setRed(tilecolor.getRed() * f.minimap_color.getRed() / 255);
-		tilecolor.setGreen(tilecolor.getGreen() * f.minimap_color.getGreen() / 255);
-		tilecolor.setBlue(tilecolor.getBlue() * f.minimap_color.getBlue() / 255);
-		tilecolor.setAlpha(240);
-
-		map_image->setPixel(x, data->mode.map_size - z - 1, tilecolor);
-
-		u32 h = mmpixel->height;
-		heightmap_image->setPixel(x,data->mode.map_size - z - 1,
-			video::SColor(255, h, h, h));
+	const u32 *mask = data->minimap_shape_round ?
+		m_mask_round.data() : m_mask_square.data();
+
+	// Nearest pixel scaling, like IImage::copyToScaling
+	u16 columns[MINIMAP_MAX_SX];
+	for (u32 x = 0; x < MINIMAP_MAX_SX; x++)
+		columns[x] = x * size / MINIMAP_MAX_SX;
+
+	for (u32 y = 0; y < MINIMAP_MAX_SY; y++) {
+		const u32 *src = pixels + (y * size / MINIMAP_MAX_SY) * size;
+		const u32 *mask_row = mask + y * MINIMAP_MAX_SX;
+		u32 *dst = m_minimap_pixels.data() + y * MINIMAP_MAX_SX;
+		for (u32 x = 0; x < MINIMAP_MAX_SX; x++)
+			dst[x] = src[columns[x]] & mask_row[x];
 	}
 }
 
@@ -470,76 +583,92 @@ video::ITexture *Minimap::getMinimapTexture()
 	if (data->map_invalidated && data->mode.type != MINIMAP_TYPE_TEXTURE)
 		return data->texture;
 
-	// create minimap and heightmap images in memory
-	core::dimension2d<u32> dim(data->mode.map_size, data->mode.map_size);
-	video::IImage *map_image       = driver->createImage(video::ECF_A8R8G8B8, dim);
-	video::IImage *heightmap_image = driver->createImage(video::ECF_A8R8G8B8, dim);
-	video::IImage *minimap_image   = driver->createImage(video::ECF_A8R8G8B8,
-		core::dimension2d<u32>(MINIMAP_MAX_SX, MINIMAP_MAX_SY));
+	u16 size = data->mode.map_size;
+	video::IImage *heightmap_image = nullptr;
 
-	// Blit MinimapPixels to images
 	switch(data->mode.type) {
 	case MINIMAP_TYPE_OFF:
+		std::fill(m_minimap_pixels.begin(), m_minimap_pixels.end(), 0);
 		break;
 	case MINIMAP_TYPE_SURFACE:
-		blitMinimapPixelsToImageSurface(map_image, heightmap_image);
-		break;
 	case MINIMAP_TYPE_RADAR:
-		blitMinimapPixelsToImageRadar(map_image);
+		// The scan may have been made for the previous mode
+		size = data->scan_size;
+		if (size == 0)
+			break;
+		blitMinimapPixels(data->scan_pixels.data(), size);
+		if (data->mode.type == MINIMAP_TYPE_SURFACE)
+			heightmap_image = driver->createImageFromData(video::ECF_A8R8G8B8,
+				core::dimension2d<u32>(size, size),
+				data->scan_heightmap.data(), true, false);
 		break;
-	case MINIMAP_TYPE_TEXTURE:
-		// Not sure with this code :/
-
-		// Want to use texture source, to : 1 find texture, 2 cache it
-		video::ITexture* texture = m_tsrc->getTexture(data->mode.texture);
-		video::IImage* image = driver->createImageFromData(
-			 texture->getColorFormat(), texture->getSize(), texture->lock(), true, false);
-		texture->unlock();
-
-		auto dim = image->getDimension();
+	case MINIMAP_TYPE_TEXTURE: {
+		TextureModeView view;
+		view.texture = data->mode.texture;
+		view.map_size = size;
+		view.offset = v2s16(data->pos.X / data->mode.scale,
+			data->pos.Z / data->mode.scale);
+		view.round = data->minimap_shape_round;
+		if (m_texture_mode_valid && view == m_texture_mode_view)
+			return data->texture;
+
+		if (!m_texture_mode_image || view.texture != m_texture_mode_view.texture) {
+			if (m_texture_mode_image)
+				m_texture_mode_image->drop();
+			video::ITexture *texture = m_tsrc->getTexture(view.texture);
+			m_texture_mode_image = driver->createImage(video::ECF_A8R8G8B8,
+				texture->getSize());
+			video::IImage *image = driver->createImageFromData(
+				texture->getColorFormat(), texture->getSize(), texture->lock(),
+				true, false);
+			texture->unlock();
+			image->copyTo(m_texture_mode_image);
+			image->drop();
+		}
+		m_texture_mode_view = view;
 
+		core::dimension2d<u32> dim(size, size);
+		video::IImage *map_image = driver->createImage(video::ECF_A8R8G8B8, dim);
 		map_image->fill(video::SColor(255, 0, 0, 0));
 
-		image->copyTo(map_image,
+		auto image_dim = m_texture_mode_image->getDimension();
+		m_texture_mode_image->copyTo(map_image,
 			irr::core::vector2d<int> {
-				((data->mode.map_size - (static_cast<int>(dim.Width))) >> 1)
-					- data->pos.X / data->mode.scale,
-				((data->mode.map_size - (static_cast<int>(dim.Height))) >> 1)
-					+ data->pos.Z / data->mode.scale
+				((size - (static_cast<int>(image_dim.Width))) >> 1) - view.offset.X,
+				((size - (static_cast<int>(image_dim.Height))) >> 1) + view.offset.Y
 			});
-		image->drop();
-	}
-
-	map_image->copyToScaling(minimap_image);
-	map_image->drop();
 
-	video::IImage *minimap_mask = data->minimap_shape_round ?
-		data->minimap_mask_round : data->minimap_mask_square;
-
-	if (minimap_mask) {
-		for (s16 y = 0; y < MINIMAP_MAX_SY; y++)
-		for (s16 x = 0; x < MINIMAP_MAX_SX; x++) {
-			const video::SColor &mask_col = minimap_mask->getPixel(x, y);
-			if (!mask_col.getAlpha())
-				minimap_image->setPixel(x, y, video::SColor(0,0,0,0));
-		}
+		blitMinimapPixels((const u32 *)map_image->lock(), size);
+		map_image->unlock();
+		map_image->drop();
+		break;
 	}
+	}
+
+	video::IImage *minimap_image = driver->createImageFromData(
+		video::ECF_A8R8G8B8,
+		core::dimension2d<u32>(MINIMAP_MAX_SX, MINIMAP_MAX_SY),
+		m_minimap_pixels.data(), true, false);
 
 	if (data->texture)
 		driver->removeTexture(data->texture);
-	if (data->heightmap_texture)
-		driver->removeTexture(data->heightmap_texture);
-
 	data->texture = driver->addTexture("minimap__", minimap_image);
-	data->heightmap_texture =
-		driver->addTexture("minimap_heightmap__", heightmap_image);
 	minimap_image->drop();
-	heightmap_image->drop();
+	m_texture_mode_valid = data->mode.type == MINIMAP_TYPE_TEXTURE;
+
+	if (heightmap_image) {
+		if (data->heightmap_texture)
+			driver->removeTexture(data->heightmap_texture);
+		data->heightmap_texture =
+			driver->addTexture("minimap_heightmap__", heightmap_image);
+		heightmap_image->drop();
+	}
 
 	data->map_invalidated = true;
 
 	return data->texture;
 }
+// << KIDSCODE
 
 v3f Minimap::getYawVec()
 {
@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irrlichttypes_extrabloated.h"
 #include "util/thread.h"
 #include "voxel.h"
+#include <atomic>
 #include <map>
 #include <string>
 #include <vector>
@@ -29,6 +30,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 class Client;
 class ITextureSource;
 class IShaderSource;
+class NodeDefManager; // KIDSCODE - Minimap tiles
 
 #define MINIMAP_MAX_SX 512
 #define MINIMAP_MAX_SY 512
@@ -75,13 +77,41 @@ struct MinimapMapblock {
 	std::list<MinimapSymbol> m_symbols;
 };
 
+// >> KIDSCODE - Minimap tiles
+/*
+	Minimap of a column of blocks, for the block Y range and the type of
+	a mode. The update thread keeps the tiles around the player and
+	rebuilds one only when one of its blocks changes.
+*/
+struct MinimapTile {
+	s16 block_y_min;
+	s16 block_y_max;
+	MinimapType type;
+	bool dirty;
+	// Color of the surface or of the radar
+	u32 colors[MAP_BLOCKSIZE * MAP_BLOCKSIZE];
+	// Block and height in the block of the topmost node, block_y is
+	// S16_MIN without node
+	s16 block_y[MAP_BLOCKSIZE * MAP_BLOCKSIZE];
+	u8 height[MAP_BLOCKSIZE * MAP_BLOCKSIZE];
+	std::list<MinimapSymbol> symbols;
+};
+// << KIDSCODE
+
 struct MinimapData {
 	MinimapModeDef mode;
 	v3s16 pos;
 	v3s16 old_pos;
-	MinimapPixel minimap_scan[MINIMAP_MAX_SX * MINIMAP_MAX_SY];
+	// >> KIDSCODE - Minimap tiles
+	// Colors of the scan, scan_size * scan_size pixels, top row first
+	u16 scan_size = 0;
+	std::vector<u32> scan_pixels;
+	std::vector<u32> scan_heightmap;
+	// << KIDSCODE
 	std::list<MinimapSymbol> symbols;
-	bool map_invalidated;
+	// KIDSCODE - Minimap tiles: set by the renderer, cleared by the update
+	// thread once the scan vectors hold a new scan
+	std::atomic<bool> map_invalidated;
 	bool minimap_shape_round;
 	video::IImage *minimap_mask_round = nullptr;
 	video::IImage *minimap_mask_square = nullptr;
@@ -109,14 +139,23 @@ class MinimapUpdateThread : public UpdateThread {
 	bool popBlockUpdate(QueuedMinimapUpdate *update);
 
 	MinimapData *data = nullptr;
+	const NodeDefManager *ndef = nullptr; // KIDSCODE - Minimap tiles
 
 protected:
 	virtual void doUpdate();
 
 private:
+	// >> KIDSCODE - Minimap tiles
+	MinimapTile *getTile(v2s16 column, s16 block_y_min, s16 block_y_max,
+		MinimapType type);
+	void buildTile(MinimapTile *tile, v2s16 column);
+	u32 getSurfaceColor(MapNode n) const;
+	// << KIDSCODE
+
 	std::mutex m_queue_mutex;
 	std::deque<QueuedMinimapUpdate> m_update_queue;
 	std::map<v3s16, MinimapMapblock *> m_blocks_cache;
+	std::map<v2s16, MinimapTile *> m_tiles; // KIDSCODE - Minimap tiles
 };
 
 struct MinimapMarker {
@@ -157,9 +196,10 @@ class Minimap {
 
 	video::ITexture *getMinimapTexture();
 
-	void blitMinimapPixelsToImageRadar(video::IImage *map_image);
-	void blitMinimapPixelsToImageSurface(video::IImage *map_image,
-		video::IImage *heightmap_image);
+	// >> KIDSCODE - Minimap tiles
+	// Scales the size * size pixels to the minimap image and masks it
+	void blitMinimapPixels(const u32 *pixels, u16 size);
+	// << KIDSCODE
 
 	scene::SMeshBuffer *getMinimapMeshBuffer();
 
@@ -188,4 +228,29 @@ class Minimap {
 	f32 m_angle;
 	std::mutex m_mutex;
 	std::list<MinimapMarker> m_active_markers;
+
+	// >> KIDSCODE - Minimap tiles
+	// Pixels of the minimap image and of the masks (0 where masked)
+	std::vector<u32> m_minimap_pixels;
+	std::vector<u32> m_mask_round;
+	std::vector<u32> m_mask_square;
+
+	// The texture mode is redrawn when the view changes only
+	struct TextureModeView {
+		std::string texture;
+		u16 map_size;
+		v2s16 offset;
+		bool round;
+
+		bool operator==(const TextureModeView &other) const
+		{
+			return texture == other.texture && map_size == other.map_size &&
+				offset == other.offset && round == other.round;
+		}
+	};
+	TextureModeView m_texture_mode_view;
+	// False when data->texture holds another mode
+	bool m_texture_mode_valid = false;
+	video::IImage *m_texture_mode_image = nullptr;
+	// << KIDSCODE
 };
@@ -0,0 +1,298 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include "objectbatch.h"
+#include <algorithm>
+#include <IAnimatedMesh.h>
+#include <ICameraSceneNode.h>
+#include <ISceneManager.h>
+#include <ISkinnedMesh.h>
+#include <IVideoDriver.h>
+#include "client/mesh.h"
+#include "constants.h"
+#include "profiler.h"
+
+ObjectBatchSceneNode::ObjectBatchSceneNode(scene::ISceneNode *parent,
+		scene::ISceneManager *mgr) :
+	scene::ISceneNode(parent, mgr, -1)
+{
+	// The instances are culled one by one
+	setAutomaticCulling(scene::EAC_OFF);
+	m_box.reset(v3f(0, 0, 0));
+}
+
+ObjectBatchSceneNode::~ObjectBatchSceneNode()
+{
+	for (Group *group : m_groups) {
+		for (auto &buffers : group->buffers)
+			for (scene::SMeshBuffer *buf : buffers)
+				buf->drop();
+		delete group;
+	}
+
+	if (m_cube_mesh)
+		m_cube_mesh->drop();
+}
+
+void ObjectBatchSceneNode::setInstance(const void *owner,
+	const ObjectBatchInstance &instance)
+{
+	m_instances[owner] = instance;
+}
+
+void ObjectBatchSceneNode::removeInstance(const void *owner)
+{
+	m_instances.erase(owner);
+}
+
+scene::IMesh *ObjectBatchSceneNode::getCubeMesh()
+{
+	if (!m_cube_mesh)
+		m_cube_mesh = createCubeMesh(v3f(BS, BS, BS));
+	return m_cube_mesh;
+}
+
+void ObjectBatchSceneNode::OnRegisterSceneNode()
+{
+	if (IsVisible && !m_instances.empty())
+		SceneManager->registerNodeForRendering(this, scene::ESNRP_SOLID);
+
+	ISceneNode::OnRegisterSceneNode();
+}
+
+ObjectBatchSceneNode::Group *ObjectBatchSceneNode::getGroup(
+	const ObjectBatchInstance &instance)
+{
+	const void *geometry = instance.animated_mesh ?
+		(const void *)instance.animated_mesh : (const void *)instance.mesh;
+	u32 material_count = instance.node->getMaterialCount();
+
+	// The light is applied to the vertices
+	std::vector<video::SMaterial> materials(material_count);
+	for (u32 i = 0; i < material_count; i++) {
+		materials[i] = instance.node->getMaterial(i);
+		materials[i].EmissiveColor = video::SColor(0xFFFFFFFF);
+	}
+
+	for (Group *group : m_groups)
+		if (group->geometry == geometry && group->materials == materials)
+			return group;
+
+	Group *group = new Group();
+	group->geometry = geometry;
+	group->materials = materials;
+	group->buffers.resize(material_count);
+	group->buffers_used.resize(material_count);
+	m_groups.push_back(group);
+	return group;
+}
+
+void ObjectBatchSceneNode::appendInstance(Group &group, scene::IMesh *mesh,
+	const core::matrix4 &transform, video::SColor light)
+{
+	u32 count = std::min<u32>(mesh->getMeshBufferCount(), group.buffers.size());
+	for (u32 i = 0; i < count; i++) {
+		scene::IMeshBuffer *src = mesh->getMeshBuffer(i);
+		u32 vertex_count = src->getVertexCount();
+		if (src->getVertexType() != video::EVT_STANDARD ||
+				src->getIndexType() != video::EIT_16BIT ||
+				vertex_count > OBJECT_BATCH_MAX_VERTICES)
+			continue;
+
+		// Next buffer when this one is full
+		std::vector<scene::SMeshBuffer *> &buffers = group.buffers[i];
+		u32 &used = group.buffers_used[i];
+		if (used == 0 || buffers[used - 1]->Vertices.size() + vertex_count >
+				OBJECT_BATCH_MAX_VERTICES) {
+			if (used == buffers.size()) {
+				scene::SMeshBuffer *buf = new scene::SMeshBuffer();
+				buf->Material = group.materials[i];
+				buf->setHardwareMappingHint(scene::EHM_STREAM);
+				buffers.push_back(buf);
+			}
+			used++;
+		}
+
+		scene::SMeshBuffer *dst = buffers[used - 1];
+		u16 base = dst->Vertices.size();
+		const video::S3DVertex *vertices =
+			(const video::S3DVertex *)src->getVertices();
+		for (u32 j = 0; j < vertex_count; j++) {
+			video::S3DVertex vertex = vertices[j];
+			transform.transformVect(vertex.Pos);
+			// The normals stay in object space, like for a scene node
+			// with the object shader
+			const video::SColor &c = vertex.Color;
+			vertex.Color = video::SColor(c.getAlpha(),
+				c.getRed() * light.getRed() / 255,
+				c.getGreen() * light.getGreen() / 255,
+				c.getBlue() * light.getBlue() / 255);
+			dst->Vertices.push_back(vertex);
+		}
+
+		const u16 *indices = src->getIndices();
+		u32 index_count = src->getIndexCount();
+		for (u32 j = 0; j < index_count; j++)
+			dst->Indices.push_back(base + indices[j]);
+	}
+}
+
+// IAnimatedMesh::getMesh() only takes whole frames
+static scene::IMesh *skin_mesh(scene::IAnimatedMesh *animated_mesh, f32 frame)
+{
+	scene::ISkinnedMesh *mesh = static_cast<scene::ISkinnedMesh *>(animated_mesh);
+	mesh->animateMesh(frame, 1.0f);
+	mesh->skinMesh();
+	return mesh;
+}
+
+static scene::IMesh *instance_mesh(const ObjectBatchInstance &instance)
+{
+	return instance.animated_mesh ? instance.animated_mesh : instance.mesh;
+}
+
+bool ObjectBatchSceneNode::isBuilt(const Group &group)
+{
+	if (group.instances.size() != group.built.size())
+		return false;
+
+	for (size_t i = 0; i < group.instances.size(); i++) {
+		const ObjectBatchInstance &instance = *group.instances[i].first;
+		const BuiltInstance &built = group.built[i];
+		if (instance_mesh(instance) != built.mesh ||
+				instance.frame != built.frame ||
+				instance.light != built.light ||
+				group.instances[i].second != built.transform)
+			return false;
+	}
+	return true;
+}
+
+void ObjectBatchSceneNode::buildGroup(Group &group)
+{
+	group.built.clear();
+	for (const auto &entry : group.instances)
+		group.built.push_back({instance_mesh(*entry.first), entry.first->frame,
+			entry.first->light, entry.second});
+
+	for (u32 i = 0; i < group.buffers.size(); i++) {
+		for (scene::SMeshBuffer *buf : group.buffers[i]) {
+			buf->Vertices.set_used(0);
+			buf->Indices.set_used(0);
+		}
+		group.buffers_used[i] = 0;
+	}
+
+	// Each frame of a skinned mesh is computed once
+	std::sort(group.instances.begin(), group.instances.end(),
+		[] (const std::pair<const ObjectBatchInstance *, core::matrix4> &a,
+				const std::pair<const ObjectBatchInstance *, core::matrix4> &b) {
+			return a.first->frame < b.first->frame;
+		});
+
+	scene::IMesh *mesh = nullptr;
+	f32 frame = 0.0f;
+	for (const auto &entry : group.instances) {
+		const ObjectBatchInstance &instance = *entry.first;
+		if (!mesh || instance.frame != frame) {
+			frame = instance.frame;
+			mesh = instance.animated_mesh ?
+				skin_mesh(instance.animated_mesh, frame) : instance.mesh;
+		}
+		appendInstance(group, mesh, entry.second, instance.light);
+	}
+
+	for (u32 i = 0; i < group.buffers.size(); i++)
+		for (u32 j = 0; j < group.buffers_used[i]; j++)
+			group.buffers[i][j]->setDirty();
+}
+
+void ObjectBatchSceneNode::render()
+{
+	ScopeProfiler sp(g_profiler, "ObjectBatch::render()", SPT_AVG);
+
+	video::IVideoDriver *driver = SceneManager->getVideoDriver();
+	scene::ICameraSceneNode *camera = SceneManager->getActiveCamera();
+	if (!camera)
+		return;
+
+	const core::aabbox3d<f32> view_box =
+		camera->getViewFrustum()->getBoundingBox();
+
+	for (Group *group : m_groups) {
+		group->instances.clear();
+		group->used = false;
+	}
+
+	for (const auto &it : m_instances) {
+		const ObjectBatchInstance &instance = it.second;
+		scene::ISceneNode *node = instance.node;
+		if (!node->getParent())
+			continue;
+
+		Group *group = getGroup(instance);
+		group->used = true;
+
+		// The parent is hidden, the scene doesn't update the transformations
+		node->getParent()->updateAbsolutePosition();
+		core::matrix4 transform =
+			node->getParent()->getAbsoluteTransformation() *
+			node->getRelativeTransformation();
+
+		core::aabbox3d<f32> box = instance_mesh(instance)->getBoundingBox();
+		transform.transformBoxEx(box);
+		if (!view_box.intersectsWithBox(box))
+			continue;
+
+		group->instances.emplace_back(&instance, transform);
+	}
+
+	driver->setTransform(video::ETS_WORLD, core::IdentityMatrix);
+
+	for (auto it = m_groups.begin(); it != m_groups.end();) {
+		Group *group = *it;
+
+		// Forget the groups nothing uses anymore
+		if (!group->used) {
+			for (auto &buffers : group->buffers)
+				for (scene::SMeshBuffer *buf : buffers)
+					buf->drop();
+			delete group;
+			it = m_groups.erase(it);
+			continue;
+		}
+
+		if (group->instances.empty()) {
+			++it;
+			continue;
+		}
+
+		if (!isBuilt(*group))
+			buildGroup(*group);
+		for (u32 i = 0; i < group->buffers.size(); i++) {
+			if (group->buffers_used[i] == 0)
+				continue;
+			driver->setMaterial(group->materials[i]);
+			for (u32 j = 0; j < group->buffers_used[i]; j++)
+				driver->drawMeshBuffer(group->buffers[i][j]);
+		}
+		++it;
+	}
+}
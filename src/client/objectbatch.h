@@ -0,0 +1,122 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#pragma once
+
+#include <ISceneNode.h>
+#include <SMeshBuffer.h>
+#include <unordered_map>
+#include <vector>
+#include "irrlichttypes_bloated.h"
+
+namespace irr { namespace scene {
+	class IAnimatedMesh;
+	class IMesh;
+}}
+
+// Most vertices in one buffer of a batch, buffers use 16 bit indices
+#define OBJECT_BATCH_MAX_VERTICES 0xFFFF
+// Frames of skinned meshes are rounded to this step, the instances on the
+// same rounded frame share the skinning
+#define OBJECT_BATCH_FRAME_STEP 0.25f
+
+// What is needed to draw an object in a batch, updated each client step
+struct ObjectBatchInstance
+{
+	// Geometry, a skinned mesh is animated to the frame first
+	scene::IAnimatedMesh *animated_mesh = nullptr;
+	scene::IMesh *mesh = nullptr;
+	f32 frame = 0.0f;
+
+	// Materials and transformation of the object's own (hidden) scene node
+	scene::ISceneNode *node = nullptr;
+	video::SColor light = video::SColor(0xFFFFFFFF);
+};
+
+/*
+	Draws the objects sharing the same geometry and materials together.
+	The vertices of the instances are transformed and lit on the CPU and
+	appended to a few large buffers per group, which replaces one draw call
+	and one scene node traversal per object by one draw call per material.
+
+	Irrlicht has no hardware instancing, so the per instance data (transform,
+	light color, animation frame) is applied while building the buffers.
+	Instances of a skinned mesh on the same frame share the skinning. A group
+	is only rebuilt, and uploaded again, when one of its visible instances
+	moved, changed frame or light, or appeared or went out of view.
+*/
+class ObjectBatchSceneNode : public scene::ISceneNode
+{
+public:
+	ObjectBatchSceneNode(scene::ISceneNode *parent, scene::ISceneManager *mgr);
+	~ObjectBatchSceneNode();
+
+	// Adds or updates the instance of an object
+	void setInstance(const void *owner, const ObjectBatchInstance &instance);
+	void removeInstance(const void *owner);
+
+	// Geometry shared by the batched "cube" objects
+	scene::IMesh *getCubeMesh();
+
+	virtual void OnRegisterSceneNode();
+	virtual void render();
+	virtual const core::aabbox3d<f32> &getBoundingBox() const { return m_box; }
+
+	u32 getInstanceCount() const { return m_instances.size(); }
+
+private:
+	// What the vertices of an instance were built from
+	struct BuiltInstance
+	{
+		scene::IMesh *mesh;
+		f32 frame;
+		video::SColor light;
+		core::matrix4 transform;
+	};
+
+	// Instances with the same geometry and materials
+	struct Group
+	{
+		const void *geometry;
+		std::vector<video::SMaterial> materials;
+		// Visible instances of the frame, with their transformation
+		std::vector<std::pair<const ObjectBatchInstance *, core::matrix4>> instances;
+		// Visible instances of the last build, in the same order. The
+		// buffers are kept as long as nothing of them changes.
+		std::vector<BuiltInstance> built;
+		// Per mesh buffer of the geometry, as many buffers as needed and
+		// how many of them are filled
+		std::vector<std::vector<scene::SMeshBuffer *>> buffers;
+		std::vector<u32> buffers_used;
+		// Some instance uses the group, visible or not
+		bool used = false;
+	};
+
+	Group *getGroup(const ObjectBatchInstance &instance);
+	static bool isBuilt(const Group &group);
+	void buildGroup(Group &group);
+	void appendInstance(Group &group, scene::IMesh *mesh,
+		const core::matrix4 &transform, video::SColor light);
+
+	std::unordered_map<const void *, ObjectBatchInstance> m_instances;
+	std::vector<Group *> m_groups;
+	scene::IMesh *m_cube_mesh = nullptr;
+	core::aabbox3d<f32> m_box;
+};
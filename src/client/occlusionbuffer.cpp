@@ -0,0 +1,337 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "occlusionbuffer.h"
+#include <algorithm>
+#include <bitset>
+#include <cfloat>
+#include <cmath>
+#include "mapblock.h"
+#include "nodedef.h"
+
+// Closer points are not projected, quads and boxes reaching them are skipped
+#define OCCLUSION_NEAR_PLANE (0.1f * BS)
+
+// Side of the squares of nodes that make up the occluders
+#define OCCLUDER_QUAD_SIZE 4
+
+#define TILES_PER_ROW (OCCLUSION_BUFFER_SIZE / OCCLUSION_TILE_SIZE)
+
+// Nodes that hide everything behind them
+static inline bool is_occluding(const ContentFeatures &f)
+{
+	return f.drawtype == NDT_NORMAL && f.solidness == 2 && f.alpha == 255;
+}
+
+// Fills the pixels entirely inside the convex quad. Partly covered pixels
+// are left alone, the buffer must never hide more than the quad does.
+static void rasterize_quad(std::vector<f32> &buffer, const v3f p[4], f32 depth)
+{
+	f32 area = 0.0f;
+	for (int i = 0; i < 4; i++) {
+		const v3f &a = p[i], &b = p[(i + 1) % 4];
+		area += a.X * b.Y - b.X * a.Y;
+	}
+	if (area == 0.0f)
+		return;
+	f32 sign = area > 0.0f ? 1.0f : -1.0f;
+
+	// Edge functions ex * x + ey * y + e0, positive inside. A pixel is
+	// inside when its center is at least half its extent along the normal
+	// away from every edge.
+	f32 ex[4], ey[4], e0[4];
+	for (int i = 0; i < 4; i++) {
+		const v3f &a = p[i], &b = p[(i + 1) % 4];
+		ex[i] = (a.Y - b.Y) * sign;
+		ey[i] = (b.X - a.X) * sign;
+		e0[i] = -(ex[i] * a.X + ey[i] * a.Y) -
+			0.5f * (std::fabs(ex[i]) + std::fabs(ey[i]));
+	}
+
+	const f32 max_pos = OCCLUSION_BUFFER_SIZE - 1;
+	s32 x0 = std::max(0.0f, std::ceil(std::min({p[0].X, p[1].X, p[2].X, p[3].X})));
+	s32 x1 = std::min(max_pos, std::floor(std::max({p[0].X, p[1].X, p[2].X, p[3].X})) - 1);
+	s32 y0 = std::max(0.0f, std::ceil(std::min({p[0].Y, p[1].Y, p[2].Y, p[3].Y})));
+	s32 y1 = std::min(max_pos, std::floor(std::max({p[0].Y, p[1].Y, p[2].Y, p[3].Y})) - 1);
+
+	for (s32 y = y0; y <= y1; y++) {
+		f32 py = y + 0.5f;
+		f32 *row = &buffer[y * OCCLUSION_BUFFER_SIZE];
+		for (s32 x = x0; x <= x1; x++) {
+			f32 px = x + 0.5f;
+			if (ex[0] * px + ey[0] * py + e0[0] < 0.0f ||
+					ex[1] * px + ey[1] * py + e0[1] < 0.0f ||
+					ex[2] * px + ey[2] * py + e0[2] < 0.0f ||
+					ex[3] * px + ey[3] * py + e0[3] < 0.0f)
+				continue;
+			row[x] = std::min(row[x], depth);
+		}
+	}
+}
+
+OcclusionBuffer::OcclusionBuffer() :
+	m_depth(OCCLUSION_BUFFER_SIZE * OCCLUSION_BUFFER_SIZE),
+	m_tile_depth(TILES_PER_ROW * TILES_PER_ROW)
+{
+}
+
+void OcclusionBuffer::begin(v3f camera_pos, v3f camera_dir, f32 fov)
+{
+	m_camera_pos = camera_pos;
+	m_forward = camera_dir;
+	m_forward.normalize();
+	v3f world_up = std::fabs(m_forward.Y) > 0.99f ? v3f(0, 0, 1) : v3f(0, 1, 0);
+	m_right = world_up.crossProduct(m_forward);
+	m_right.normalize();
+	m_up = m_forward.crossProduct(m_right);
+
+	// The buffer can't cover more than a half space
+	fov = std::min(fov, 3.0f);
+	m_scale = OCCLUSION_BUFFER_SIZE / 2 / std::tan(fov / 2);
+
+	std::fill(m_depth.begin(), m_depth.end(), FLT_MAX);
+	m_quad_count = 0;
+}
+
+v3f OcclusionBuffer::project(v3f p) const
+{
+	v3f rel = p - m_camera_pos;
+	f32 z = rel.dotProduct(m_forward);
+	if (z < OCCLUSION_NEAR_PLANE)
+		return v3f(0, 0, z);
+	return v3f(
+		rel.dotProduct(m_right) / z * m_scale + OCCLUSION_BUFFER_SIZE / 2,
+		-rel.dotProduct(m_up) / z * m_scale + OCCLUSION_BUFFER_SIZE / 2,
+		z);
+}
+
+void OcclusionBuffer::addQuad(const v3f corners[4])
+{
+	v3f p[4];
+	// Flat depth of the farthest corner, never in front of the quad
+	f32 depth = 0.0f;
+	for (int i = 0; i < 4; i++) {
+		p[i] = project(corners[i]);
+		if (p[i].Z < OCCLUSION_NEAR_PLANE)
+			return;
+		depth = std::max(depth, p[i].Z);
+	}
+
+	m_quad_count++;
+	rasterize_quad(m_depth, p, depth);
+}
+
+void OcclusionBuffer::addBlock(MapBlock *block, const NodeDefManager *ndef)
+{
+	if (block->isDummy())
+		return;
+
+	BlockOccluders &occluders = m_blocks[block->getPos()];
+	u32 version = block->getNodeDataVersion();
+	if (occluders.version != version) {
+		updateOccluders(occluders, block, ndef);
+		occluders.version = version;
+	}
+
+	v3s16 origin = block->getPosRelative();
+	const f32 origin_nodes[3] = {(f32)origin.X, (f32)origin.Y, (f32)origin.Z};
+	const f32 camera_nodes[3] = {m_camera_pos.X / BS, m_camera_pos.Y / BS,
+		m_camera_pos.Z / BS};
+
+	for (int axis = 0; axis < 3; axis++) {
+		int u_axis = axis == 0 ? 1 : 0;
+		int v_axis = axis == 2 ? 1 : 2;
+		// The side facing the camera hides the most
+		bool max_side = camera_nodes[axis] >
+			origin_nodes[axis] + MAP_BLOCKSIZE / 2;
+
+		for (const Occluder &o : occluders.faces[axis * 2 + max_side]) {
+			f32 c[3];
+			c[axis] = origin_nodes[axis] + o.layer;
+			f32 u0 = origin_nodes[u_axis] + o.u0 - 0.5f;
+			f32 u1 = origin_nodes[u_axis] + o.u1 + 0.5f;
+			f32 v0 = origin_nodes[v_axis] + o.v0 - 0.5f;
+			f32 v1 = origin_nodes[v_axis] + o.v1 + 0.5f;
+
+			v3f corners[4];
+			const f32 uv[4][2] = {{u0, v0}, {u1, v0}, {u1, v1}, {u0, v1}};
+			for (int i = 0; i < 4; i++) {
+				c[u_axis] = uv[i][0];
+				c[v_axis] = uv[i][1];
+				corners[i] = v3f(c[0], c[1], c[2]) * BS;
+			}
+			addQuad(corners);
+		}
+	}
+}
+
+void OcclusionBuffer::updateOccluders(BlockOccluders &occluders, MapBlock *block,
+	const NodeDefManager *ndef)
+{
+	for (std::vector<Occluder> &face : occluders.faces)
+		face.clear();
+
+	std::vector<content_t> occluding_contents;
+	for (const auto &entry : block->getContentHistogram()) {
+		if (is_occluding(ndef->get(entry.first)))
+			occluding_contents.push_back(entry.first);
+	}
+	if (occluding_contents.empty())
+		return;
+
+	const MapNode *data = block->getData();
+	std::bitset<MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE> occluding;
+	for (u32 i = 0; i < MapBlock::nodecount; i++) {
+		content_t c = data[i].getContent();
+		if (std::find(occluding_contents.begin(), occluding_contents.end(), c) !=
+				occluding_contents.end())
+			occluding.set(i);
+	}
+
+	// Index strides of the X, Y and Z axes
+	const u32 strides[3] = {1, MAP_BLOCKSIZE, MAP_BLOCKSIZE * MAP_BLOCKSIZE};
+	const int quads = MAP_BLOCKSIZE / OCCLUDER_QUAD_SIZE;
+	const u8 none = MAP_BLOCKSIZE;
+
+	for (int axis = 0; axis < 3; axis++) {
+		u32 u_stride = strides[axis == 0 ? 1 : 0];
+		u32 v_stride = strides[axis == 2 ? 1 : 2];
+
+		// Per square of nodes, the first occluding layer from each side
+		u8 layers[2][quads][quads];
+		for (int qv = 0; qv < quads; qv++)
+		for (int qu = 0; qu < quads; qu++) {
+			u32 first = (qu * u_stride + qv * v_stride) * OCCLUDER_QUAD_SIZE;
+			std::bitset<MAP_BLOCKSIZE> full;
+			for (int layer = 0; layer < MAP_BLOCKSIZE; layer++) {
+				u32 layer_first = first + layer * strides[axis];
+				bool all = true;
+				for (int v = 0; v < OCCLUDER_QUAD_SIZE && all; v++)
+				for (int u = 0; u < OCCLUDER_QUAD_SIZE && all; u++)
+					all = occluding[layer_first + u * u_stride + v * v_stride];
+				full[layer] = all;
+			}
+
+			layers[0][qv][qu] = none;
+			layers[1][qv][qu] = none;
+			for (int layer = 0; layer < MAP_BLOCKSIZE; layer++) {
+				if (full[layer]) {
+					layers[0][qv][qu] = layer;
+					break;
+				}
+			}
+			for (int layer = MAP_BLOCKSIZE - 1; layer >= 0; layer--) {
+				if (full[layer]) {
+					layers[1][qv][qu] = layer;
+					break;
+				}
+			}
+		}
+
+		// Squares of a row at the same layer are merged
+		for (int side = 0; side < 2; side++)
+		for (int qv = 0; qv < quads; qv++) {
+			int qu = 0;
+			while (qu < quads) {
+				u8 layer = layers[side][qv][qu];
+				int end = qu + 1;
+				while (end < quads && layers[side][qv][end] == layer)
+					end++;
+				if (layer != none) {
+					Occluder o;
+					o.layer = layer;
+					o.u0 = qu * OCCLUDER_QUAD_SIZE;
+					o.v0 = qv * OCCLUDER_QUAD_SIZE;
+					o.u1 = end * OCCLUDER_QUAD_SIZE - 1;
+					o.v1 = (qv + 1) * OCCLUDER_QUAD_SIZE - 1;
+					occluders.faces[axis * 2 + side].push_back(o);
+				}
+				qu = end;
+			}
+		}
+	}
+}
+
+void OcclusionBuffer::finish()
+{
+	for (int ty = 0; ty < TILES_PER_ROW; ty++)
+	for (int tx = 0; tx < TILES_PER_ROW; tx++) {
+		f32 depth = 0.0f;
+		for (int y = 0; y < OCCLUSION_TILE_SIZE; y++) {
+			const f32 *row = &m_depth[(ty * OCCLUSION_TILE_SIZE + y) *
+				OCCLUSION_BUFFER_SIZE + tx * OCCLUSION_TILE_SIZE];
+			for (int x = 0; x < OCCLUSION_TILE_SIZE; x++)
+				depth = std::max(depth, row[x]);
+		}
+		m_tile_depth[ty * TILES_PER_ROW + tx] = depth;
+	}
+}
+
+bool OcclusionBuffer::isBoxOccluded(const aabb3f &box) const
+{
+	v3f corners[8];
+	box.getEdges(corners);
+
+	f32 min_x = OCCLUSION_BUFFER_SIZE, max_x = 0.0f;
+	f32 min_y = OCCLUSION_BUFFER_SIZE, max_y = 0.0f;
+	f32 min_depth = FLT_MAX;
+	for (const v3f &corner : corners) {
+		v3f p = project(corner);
+		if (p.Z < OCCLUSION_NEAR_PLANE)
+			return false;
+		min_x = std::min(min_x, p.X);
+		max_x = std::max(max_x, p.X);
+		min_y = std::min(min_y, p.Y);
+		max_y = std::max(max_y, p.Y);
+		min_depth = std::min(min_depth, p.Z);
+	}
+
+	// Partly out of the buffer, the rest of the box may be seen
+	if (min_x < 0.0f || min_y < 0.0f ||
+			max_x >= OCCLUSION_BUFFER_SIZE || max_y >= OCCLUSION_BUFFER_SIZE)
+		return false;
+
+	// Every pixel the box touches
+	s32 x0 = min_x, x1 = max_x;
+	s32 y0 = min_y, y1 = max_y;
+
+	for (s32 ty = y0 / OCCLUSION_TILE_SIZE; ty <= y1 / OCCLUSION_TILE_SIZE; ty++)
+	for (s32 tx = x0 / OCCLUSION_TILE_SIZE; tx <= x1 / OCCLUSION_TILE_SIZE; tx++) {
+		// The whole tile is in front of the box
+		if (m_tile_depth[ty * TILES_PER_ROW + tx] < min_depth)
+			continue;
+
+		s32 px0 = std::max(x0, tx * OCCLUSION_TILE_SIZE);
+		s32 px1 = std::min(x1, tx * OCCLUSION_TILE_SIZE + OCCLUSION_TILE_SIZE - 1);
+		s32 py0 = std::max(y0, ty * OCCLUSION_TILE_SIZE);
+		s32 py1 = std::min(y1, ty * OCCLUSION_TILE_SIZE + OCCLUSION_TILE_SIZE - 1);
+		for (s32 y = py0; y <= py1; y++)
+		for (s32 x = px0; x <= px1; x++) {
+			if (m_depth[y * OCCLUSION_BUFFER_SIZE + x] >= min_depth)
+				return false;
+		}
+	}
+	return true;
+}
+
+void OcclusionBuffer::forgetBlocks(const std::vector<v3s16> &blocks)
+{
+	for (v3s16 p : blocks)
+		m_blocks.erase(p);
+}
@@ -0,0 +1,102 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include "irrlichttypes_bloated.h"
+
+class MapBlock;
+class NodeDefManager;
+
+// Width and height of the buffer, in pixels
+#define OCCLUSION_BUFFER_SIZE 128
+// Width and height of the tiles of the hierarchical depth, in pixels
+#define OCCLUSION_TILE_SIZE 8
+
+/*
+	Low resolution depth buffer, rasterized on the CPU from the large opaque
+	faces of the blocks around the camera. Boxes entirely behind them are
+	occluded.
+
+	The buffer uses its own square projection covering the field of view, it
+	doesn't have to match the one of the screen.
+*/
+class OcclusionBuffer
+{
+public:
+	OcclusionBuffer();
+
+	// Clears the buffer, fov is the widest angle to cover
+	void begin(v3f camera_pos, v3f camera_dir, f32 fov);
+
+	// Adds the occluders of a block, which are computed once per version of
+	// the block data
+	void addBlock(MapBlock *block, const NodeDefManager *ndef);
+
+	// Adds an opaque quad, in world coordinates
+	void addQuad(const v3f corners[4]);
+
+	// Builds the hierarchical depth, call before the tests
+	void finish();
+
+	// True if the box is hidden by the occluders
+	bool isBoxOccluded(const aabb3f &box) const;
+
+	// Drops the cached occluders of the blocks
+	void forgetBlocks(const std::vector<v3s16> &blocks);
+
+	u32 getQuadCount() const { return m_quad_count; }
+
+private:
+	// Rectangle of the face of a block perpendicular to an axis, one node
+	// thick. u and v are the other two axes, in XYZ order.
+	struct Occluder
+	{
+		u8 layer;
+		u8 u0, v0, u1, v1;
+	};
+
+	struct BlockOccluders
+	{
+		u32 version = 0;
+		// Per axis, nearest to the min and to the max side of the block
+		std::vector<Occluder> faces[6];
+	};
+
+	void updateOccluders(BlockOccluders &occluders, MapBlock *block,
+		const NodeDefManager *ndef);
+
+	// Screen coordinates and depth
+	v3f project(v3f p) const;
+
+	v3f m_camera_pos;
+	v3f m_forward;
+	v3f m_right;
+	v3f m_up;
+	f32 m_scale;
+
+	std::vector<f32> m_depth;
+	// Farthest depth of each tile
+	std::vector<f32> m_tile_depth;
+	u32 m_quad_count = 0;
+
+	std::map<v3s16, BlockOccluders> m_blocks;
+};
@@ -31,9 +31,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "nodedef.h"
 #include "client.h"
 #include "settings.h"
+#include "mapblock.h" // KIDSCODE - Particle map cache
+#include <algorithm> // KIDSCODE - Particle map cache
 #include <array>
 #include <atomic>
+#include <bitset> // KIDSCODE - Particle map cache
 #include <cmath>
+#include <limits> // KIDSCODE - Particle map cache
+#include <queue> // KIDSCODE - Particle map cache
+#include <tuple> // KIDSCODE - Particle map cache
 
 static std::atomic<u64> single_particles_count(0);
 static std::atomic<u64> particle_spawners_count(0);
@@ -84,61 +90,191 @@ class CameraOffsetAffector : public irr::scene::IParticleAffector
 	v3f position;
 };
 
-class LightingAffector : public irr::scene::IParticleAffector
+// >> KIDSCODE - Particle map cache
+// Blocks kept from frame to frame before the unused ones are dropped
+#define PARTICLE_CACHE_MAX_BLOCKS 64
+// Larger moves go through collisionMovePoint without checking
+#define PARTICLE_CACHE_MAX_NODES 64
+
+/*
+	The map as the particles see it during one frame. The blocks are looked
+	up once per frame and the light and walkability of a node are read once,
+	instead of a ClientMap::getNode for each particle.
+*/
+class ParticleMapCache
 {
 public:
-	LightingAffector(ClientEnvironment *env, IGameDef *gamedef,
-		u8 glow, const video::SColor &base_color = video::SColor(0xFFFFFFFF))
-		: m_env(env), m_gamedef(gamedef), glow(glow),
-		base_color(base_color)
+	ParticleMapCache(ClientEnvironment *env) : m_env(env) {}
+
+	// Forgets the blocks looked up in the previous frame, which may be
+	// deleted since
+	void newFrame()
 	{
+		m_frame++;
+		m_last_block = nullptr;
+		m_objects_known = false;
+		m_daynight_ratio = m_env->getDayNightRatio();
+
+		if (m_blocks.size() > PARTICLE_CACHE_MAX_BLOCKS) {
+			for (auto it = m_blocks.begin(); it != m_blocks.end();) {
+				if (it->second.frame + 1 < m_frame)
+					it = m_blocks.erase(it);
+				else
+					++it;
+			}
+		}
 	}
 
-	void affect(u32 now, irr::scene::SParticle *particlearray, u32 count) override
+	video::SColor getLightColor(v3s16 p, u8 glow, video::SColor base_color)
 	{
-		for (u32 i = 0; i < count; ++i) {
-			v3f pos = particlearray[i].pos +
-				intToFloat(m_env->getCameraOffset(), BS);
-			color = getParticleLightColor(pos / BS);
-			particlearray[i].color = color;
-		}
+		u8 light = decode_light(getLight(p) + glow);
+		return video::SColor(255,
+			light * base_color.getRed() / 255,
+			light * base_color.getGreen() / 255,
+			light * base_color.getBlue() / 255);
 	}
 
-	irr::scene::E_PARTICLE_AFFECTOR_TYPE getType() const override
+	// False when nothing can be in the way of a move from `from` to `to`
+	bool mayCollide(const v3f &from, const v3f &to, f32 radius,
+			bool object_collision)
 	{
-		return irr::scene::EPAT_NONE;
+		aabb3f box(from);
+		box.addInternalPoint(to);
+		box.MinEdge -= v3f(radius);
+		box.MaxEdge += v3f(radius);
+
+		// One more node for the node boxes reaching out of their node
+		v3s16 minp = floatToInt(box.MinEdge, BS) - v3s16(1, 1, 1);
+		v3s16 maxp = floatToInt(box.MaxEdge, BS) + v3s16(1, 1, 1);
+		v3s16 size = maxp - minp + v3s16(1, 1, 1);
+		if ((s32)size.X * size.Y * size.Z > PARTICLE_CACHE_MAX_NODES)
+			return true;
+
+		v3s16 p;
+		for (p.Z = minp.Z; p.Z <= maxp.Z; p.Z++)
+		for (p.Y = minp.Y; p.Y <= maxp.Y; p.Y++)
+		for (p.X = minp.X; p.X <= maxp.X; p.X++) {
+			if (isWalkable(p))
+				return true;
+		}
+
+		if (object_collision) {
+			if (!m_objects_known)
+				updateObjectBoxes();
+			// Same tolerance as collisionMovePoint
+			aabb3f near_box(box.MinEdge - v3f(1.5f * BS),
+				box.MaxEdge + v3f(1.5f * BS));
+			for (const aabb3f &object_box : m_object_boxes) {
+				if (object_box.intersectsWithBox(near_box))
+					return true;
+			}
+		}
+		return false;
 	}
-private:
-	ClientEnvironment *m_env;
-	IGameDef *m_gamedef;
-	u8 glow;
-	video::SColor base_color;
-	video::SColor color;
 
-	video::SColor getParticleLightColor(const v3f &position)
+private:
+	struct CachedBlock
+	{
+		u32 frame = 0;
+		MapBlock *block = nullptr;
+		std::bitset<MapBlock::nodecount> light_known;
+		std::bitset<MapBlock::nodecount> walkable_known;
+		std::bitset<MapBlock::nodecount> walkable;
+		u8 light[MapBlock::nodecount];
+	};
+
+	CachedBlock &getBlock(v3s16 blockpos)
 	{
-		u8 light = 0;
-		bool pos_ok = true;
+		if (m_last_block && m_last_blockpos == blockpos)
+			return *m_last_block;
+
+		CachedBlock &b = m_blocks[blockpos];
+		if (b.frame != m_frame) {
+			b.frame = m_frame;
+			b.block = m_env->getClientMap().getBlockNoCreateNoEx(blockpos);
+			b.light_known.reset();
+			b.walkable_known.reset();
+		}
+		m_last_block = &b;
+		m_last_blockpos = blockpos;
+		return b;
+	}
 
-		v3s16 p = v3s16(
-			std::floor(position.X + 0.5f),
-			std::floor(position.Y + 0.5f),
-			std::floor(position.Z + 0.5f));
+	MapNode getNode(CachedBlock &b, v3s16 relpos, bool *pos_ok)
+	{
+		if (!b.block) {
+			*pos_ok = false;
+			return {CONTENT_IGNORE};
+		}
+		return b.block->getNodeNoCheck(relpos, pos_ok);
+	}
 
-		MapNode map_node = m_env->getClientMap().getNode(p, &pos_ok);
+	u8 getLight(v3s16 p)
+	{
+		v3s16 blockpos = getNodeBlockPos(p);
+		v3s16 relpos = p - blockpos * MAP_BLOCKSIZE;
+		u16 i = relpos.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE +
+			relpos.Y * MAP_BLOCKSIZE + relpos.X;
+		CachedBlock &b = getBlock(blockpos);
+		if (!b.light_known[i]) {
+			bool pos_ok;
+			MapNode n = getNode(b, relpos, &pos_ok);
+			if (pos_ok)
+				b.light[i] = n.getLightBlend(m_daynight_ratio,
+					m_env->getGameDef()->ndef());
+			else
+				b.light[i] = blend_light(m_daynight_ratio, LIGHT_SUN, 0);
+			b.light_known[i] = true;
+		}
+		return b.light[i];
+	}
 
-		if (pos_ok)
-			light = map_node.getLightBlend(m_env->getDayNightRatio(), m_gamedef->ndef());
-		else
-			light = blend_light(m_env->getDayNightRatio(), LIGHT_SUN, 0);
+	bool isWalkable(v3s16 p)
+	{
+		v3s16 blockpos = getNodeBlockPos(p);
+		v3s16 relpos = p - blockpos * MAP_BLOCKSIZE;
+		u16 i = relpos.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE +
+			relpos.Y * MAP_BLOCKSIZE + relpos.X;
+		CachedBlock &b = getBlock(blockpos);
+		if (!b.walkable_known[i]) {
+			bool pos_ok;
+			MapNode n = getNode(b, relpos, &pos_ok);
+			// Unloaded nodes don't collide, like in collisionMovePoint
+			b.walkable[i] = pos_ok && n.getContent() != CONTENT_IGNORE &&
+				m_env->getGameDef()->ndef()->get(n).walkable;
+			b.walkable_known[i] = true;
+		}
+		return b.walkable[i];
+	}
 
-		u8 m_light = decode_light(light + glow);
-		return video::SColor (255,
-			m_light * base_color.getRed() / 255,
-			m_light * base_color.getGreen() / 255,
-			m_light * base_color.getBlue() / 255);
+	void updateObjectBoxes()
+	{
+		m_object_boxes.clear();
+		// All the objects
+		std::vector<DistanceSortedActiveObject> objects;
+		m_env->getActiveObjects(v3f(0.0f), std::numeric_limits<f32>::max(),
+			objects);
+		for (const DistanceSortedActiveObject &object : objects) {
+			aabb3f box;
+			if (object.obj->collideWithObjects() &&
+					object.obj->getCollisionBox(&box))
+				m_object_boxes.push_back(box);
+		}
+		m_objects_known = true;
 	}
+
+	ClientEnvironment *m_env;
+	// Cached blocks start at frame 0, which is never current
+	u32 m_frame = 1;
+	u32 m_daynight_ratio = 0;
+	std::map<v3s16, CachedBlock> m_blocks;
+	// Blocks are mostly looked up several times in a row
+	CachedBlock *m_last_block = nullptr;
+	v3s16 m_last_blockpos;
+	std::vector<aabb3f> m_object_boxes;
+	bool m_objects_known = false;
 };
+// << KIDSCODE
 
 class AnimationAffector : public irr::scene::IParticleAffector
 {
@@ -189,50 +325,47 @@ class AnimationAffector : public irr::scene::IParticleAffector
 	u32 last_time = 0;
 };
 
-// Should be added before AccelerationAffector to make behaviour in case of
-// collision consistent with the one for no collision
-class CollisionAffector : public irr::scene::IParticleAffector
+// >> KIDSCODE - Particle map cache
+/*
+	Moves and lights the particles of a system in one pass: collisions
+	first, to behave the same with and without them, then acceleration
+	and lighting.
+*/
+class ParticleStepAffector : public irr::scene::IParticleAffector
 {
 public:
-	CollisionAffector(ClientEnvironment *env, bool collision_removal, bool object_collision,
-			f32 bounce_fraction, f32 bounce_threshold)
-		: m_env(env), last_time(0), collision_removal(collision_removal),
-		object_collision(object_collision), bounce_fraction(bounce_fraction),
-		bounce_threshold(bounce_threshold)
+	ParticleStepAffector(ClientEnvironment *env, ParticleMapCache *cache,
+			const v3f &acc, bool collisiondetection, bool collision_removal,
+			bool object_collision, f32 bounce_fraction, f32 bounce_threshold,
+			u8 glow) :
+		m_env(env), m_cache(cache), acc(acc), disabled(acc.getLengthSQ() == 0.f),
+		collisiondetection(collisiondetection),
+		collision_removal(collision_removal), object_collision(object_collision),
+		bounce_fraction(bounce_fraction), bounce_threshold(bounce_threshold),
+		glow(glow)
 	{
 	}
 
 	void affect(u32 now, irr::scene::SParticle *particlearray, u32 count) override
 	{
-		if (last_time == 0) {
-			last_time = now;
-			return;
-		}
-		f32 dtime = (now - last_time) * 1e-3f;
+		f32 dtime = last_time != 0 ? (now - last_time) * 1e-3f : 0.f;
 		last_time = now;
+		v3f camera_offset = intToFloat(m_env->getCameraOffset(), BS);
+		v3f dvector = dtime * acc * BS * 1e-3f;
 
 		for (u32 i = 0; i < count; ++i) {
 			irr::scene::SParticle &p = particlearray[i];
-			float half_width = p.size.Width / 2;
-			v3f camera_offset = intToFloat(m_env->getCameraOffset(), BS);
-
-			// Undo Irrlicht position step
-			v3f position = p.pos + camera_offset - dtime * p.vector * 1e3;;
-			v3f velocity = p.vector * 1e3f;
-
-			collisionMoveResult r = collisionMovePoint(m_env, m_env->getGameDef(),
-					half_width, dtime, &position, &velocity, v3f {0.f, 0.f, 0.f},
-					nullptr, bounce_fraction, bounce_threshold, object_collision);
-
-			if (r.collides) {
-				if (collision_removal) {
-					p.endTime = 0;
-				} else {
-					velocity = {0.f, 0.f, 0.f};
-					p.pos = position - camera_offset;
-					p.vector = velocity * 1e-3f;
-				}
-			}
+
+			// Particles emitted this frame haven't moved yet, there is no
+			// step to undo
+			if (collisiondetection && dtime > 0.f && p.startTime != now)
+				collide(p, dtime, camera_offset);
+
+			if (!disabled)
+				p.vector += dvector;
+
+			p.color = m_cache->getLightColor(
+				floatToInt(p.pos + camera_offset, BS), glow, base_color);
 		}
 	}
 
@@ -241,50 +374,48 @@ class CollisionAffector : public irr::scene::IParticleAffector
 		return irr::scene::EPAT_NONE;
 	}
 private:
-	ClientEnvironment *m_env;
-	u32 last_time;
-	const bool collision_removal;
-	const bool object_collision;
-	const f32 bounce_fraction;
-	const f32 bounce_threshold;
-};
-
-class AccelerationAffector : public irr::scene::IParticleAffector
-{
-public:
-	AccelerationAffector(const v3f &minacc, const v3f &maxacc)
-		: last_time(0)
-	{
-		disabled = minacc.getLengthSQ() <= 1e-6 && maxacc.getLengthSQ() <= 1e-6;
-		acc = random_v3f(minacc,maxacc);
-	}
-	AccelerationAffector(const v3f &acc)
-		: acc(acc), disabled(acc.getLengthSQ() == 0.f), last_time(0)
+	void collide(irr::scene::SParticle &p, f32 dtime, const v3f &camera_offset)
 	{
-	}
+		float half_width = p.size.Width / 2;
 
-	void affect(u32 now, irr::scene::SParticle *particlearray, u32 count) override
-	{
-		if (last_time == 0) {
-			last_time = now;
+		// Undo Irrlicht position step
+		v3f velocity = p.vector * 1e3f;
+		v3f position = p.pos + camera_offset - dtime * velocity;
+
+		// Most particles fly in the air
+		if (!m_cache->mayCollide(position, position + dtime * velocity,
+				half_width, object_collision))
 			return;
-		}
-		float dtime = (now - last_time) * 1e-3f;
-		last_time = now;
-		for (u32 i = 0; i < count; ++i) {
-			particlearray[i].vector += dtime * acc * BS * 1e-3f;
+
+		collisionMoveResult r = collisionMovePoint(m_env, m_env->getGameDef(),
+				half_width, dtime, &position, &velocity, v3f {0.f, 0.f, 0.f},
+				nullptr, bounce_fraction, bounce_threshold, object_collision);
+
+		if (r.collides) {
+			if (collision_removal) {
+				p.endTime = 0;
+			} else {
+				velocity = {0.f, 0.f, 0.f};
+				p.pos = position - camera_offset;
+				p.vector = velocity * 1e-3f;
+			}
 		}
 	}
 
-	irr::scene::E_PARTICLE_AFFECTOR_TYPE getType() const override
-	{
-		return irr::scene::EPAT_NONE;
-	}
-private:
-	v3f acc;
-	bool disabled;
-	u32 last_time;
+	ClientEnvironment *m_env;
+	ParticleMapCache *m_cache;
+	u32 last_time = 0;
+	const v3f acc;
+	const bool disabled;
+	const bool collisiondetection;
+	const bool collision_removal;
+	const bool object_collision;
+	const f32 bounce_fraction;
+	const f32 bounce_threshold;
+	const u8 glow;
+	const video::SColor base_color = video::SColor(0xFFFFFFFF);
 };
+// << KIDSCODE
 
 class CustomEmitter : public irr::scene::IParticleEmitter
 {
@@ -528,9 +659,98 @@ class ContinuousEmitter : public CustomEmitter
 	irr::scene::SParticle p;
 };
 
+// >> KIDSCODE - Particle map cache
+/*
+	Emits the single particles added to a batch. The particle system is
+	deleted once they all vanished.
+*/
+class BatchEmitter : public CustomEmitter
+{
+public:
+	BatchEmitter(irr::scene::ISceneManager *smgr, ParticleManager *pmgr,
+		irr::scene::IParticleSystemSceneNode *ps, const ParticleBatchKey &key)
+		: m_smgr(smgr), m_pmgr(pmgr), ps(ps), key(key)
+	{
+	}
+
+	~BatchEmitter()
+	{
+		single_particles_count -= pending.size() + end_times.size();
+	}
+
+	void add(const v3f &pos, const v3f &vel, f32 expirationtime, f32 size)
+	{
+		irr::scene::SParticle p;
+		p.color = video::SColor(0xFFFFFFFF);
+		p.startColor = p.color;
+		p.pos = pos * BS;
+		p.startVector = p.vector = vel * BS * 1e-3f;
+		p.startSize = core::dimension2df(size, size);
+		p.size = p.startSize;
+		// Made absolute when emitted
+		p.startTime = 0;
+		p.endTime = (u32) (expirationtime * 1e3f);
+		pending.push_back(p);
+		++single_particles_count;
+	}
+
+	s32 emitt(u32 now, u32 timeSinceLastCall, irr::scene::SParticle *&outArray) override
+	{
+		// The particle system drops the particles past their end time
+		while (!end_times.empty() && end_times.top() < now) {
+			end_times.pop();
+			--single_particles_count;
+		}
+
+		if (pending.empty()) {
+			if (!deleted && now > deletion_time) {
+				m_pmgr->removeParticleBatch(key, ps);
+				m_smgr->addToDeletionQueue(ps);
+				deleted = true;
+			}
+			return 0;
+		}
+
+		particles.swap(pending);
+		pending.clear();
+		for (irr::scene::SParticle &p : particles) {
+			p.startTime = now;
+			p.endTime += now;
+			deletion_time = std::max(deletion_time, p.endTime);
+			end_times.push(p.endTime);
+		}
+		outArray = particles.data();
+		return particles.size();
+	}
+private:
+	irr::scene::ISceneManager *m_smgr;
+	ParticleManager *m_pmgr;
+	irr::scene::IParticleSystemSceneNode *ps;
+	const ParticleBatchKey key;
+	std::vector<irr::scene::SParticle> pending;
+	std::vector<irr::scene::SParticle> particles;
+	u32 deletion_time = 0;
+	// Of the emitted particles, earliest first
+	std::priority_queue<u32, std::vector<u32>, std::greater<u32>> end_times;
+	bool deleted = false;
+};
+
+bool ParticleBatchKey::operator<(const ParticleBatchKey &other) const
+{
+	return std::tie(texture, acc.X, acc.Y, acc.Z, collisiondetection,
+			collision_removal, object_collision, bounce_fraction,
+			bounce_threshold) <
+		std::tie(other.texture, other.acc.X, other.acc.Y, other.acc.Z,
+			other.collisiondetection, other.collision_removal,
+			other.object_collision, other.bounce_fraction,
+			other.bounce_threshold);
+}
+// << KIDSCODE
+
 
 ParticleManager::ParticleManager(ClientEnvironment *env)
-	: m_env(env)
+	: m_env(env),
+	m_map_cache(new ParticleMapCache(env)) // KIDSCODE - Particle map cache
 {
 	m_smgr = RenderingEngine::get_scene_manager();
 }
@@ -539,6 +759,12 @@ ParticleManager::~ParticleManager()
 {
 }
 
+// KIDSCODE - Particle map cache
+void ParticleManager::step(float dtime)
+{
+	m_map_cache->newFrame();
+}
+
 void ParticleManager::handleParticleEvent(ClientEvent *event, Client *client, LocalPlayer *player)
 {
 	switch (event->type) {
@@ -610,39 +836,41 @@ void ParticleManager::handleParticleEvent(ClientEvent *event, Client *client, Lo
 			animation_affector->drop();
 		}
 
-		if (p.collisiondetection) {
-			scene::IParticleAffector *collision_affector =
-				new CollisionAffector(m_env,
-					p.collision_removal,
-					p.object_collision,
-					p.bounce_fraction,
-					p.bounce_threshold);
-			ps->addAffector(collision_affector);
-			collision_affector->drop();
-		}
-
-		scene::IParticleAffector *acceleration_affector =
-			new AccelerationAffector(p.minacc, p.maxacc);
-		ps->addAffector(acceleration_affector);
-		acceleration_affector->drop();
-
-		scene::IParticleAffector *lighting_affector =
-			new LightingAffector(m_env, client, 0);
-		ps->addAffector(lighting_affector);
-		lighting_affector->drop();
+		// >> KIDSCODE - Particle map cache
+		scene::IParticleAffector *step_affector =
+			new ParticleStepAffector(m_env, m_map_cache.get(),
+				random_v3f(p.minacc, p.maxacc),
+				p.collisiondetection,
+				p.collision_removal,
+				p.object_collision,
+				p.bounce_fraction,
+				p.bounce_threshold, 0);
+		ps->addAffector(step_affector);
+		step_affector->drop();
+		// << KIDSCODE
 		break;
 	}
 	case CE_SPAWN_PARTICLE: {
 		const ParticleParameters &p = *event->spawn_particle;
 
+		video::ITexture *texture =
+			client->tsrc()->getTextureForMesh(p.texture);
+
+		// >> KIDSCODE - Particle map cache
+		// Particles without animation share a particle system with the
+		// ones looking and moving the same
+		if (p.animation.type == TAT_NONE) {
+			addBatchedParticle(p, texture);
+			break;
+		}
+		// << KIDSCODE
+
 		scene::IParticleSystemSceneNode *ps =
 			m_smgr->addParticleSystemSceneNode(false,
 				RenderingEngine::get_scene_manager()->getRootSceneNode());
 
 		ps->getMaterial(0).getTextureMatrix(0) = bottomUpTextureMatrix(1.f,1.f,0.f,0.f);
 
-		video::ITexture *texture =
-			client->tsrc()->getTextureForMesh(p.texture);
 		ps->setMaterialTexture(0, texture);
 
 		v3s16 camera_offset = m_env->getCameraOffset();
@@ -671,26 +899,18 @@ void ParticleManager::handleParticleEvent(ClientEvent *event, Client *client, Lo
 			animation_affector->drop();
 		}
 
-		if (p.collisiondetection){
-			scene::IParticleAffector *collision_affector =
-				new CollisionAffector(m_env,
-						p.collision_removal,
-						p.object_collision,
-						p.bounce_fraction,
-						p.bounce_threshold);
-			ps->addAffector(collision_affector);
-			collision_affector->drop();
-		}
-
-		scene::IParticleAffector *acceleration_affector =
-			new AccelerationAffector(p.acc);
-		ps->addAffector(acceleration_affector);
-		acceleration_affector->drop();
-
-		scene::IParticleAffector *lighting_affector =
-			new LightingAffector(m_env, client, 0);
-		ps->addAffector(lighting_affector);
-		lighting_affector->drop();
+		// >> KIDSCODE - Particle map cache
+		scene::IParticleAffector *step_affector =
+			new ParticleStepAffector(m_env, m_map_cache.get(),
+				p.acc,
+				p.collisiondetection,
+				p.collision_removal,
+				p.object_collision,
+				p.bounce_fraction,
+				p.bounce_threshold, 0);
+		ps->addAffector(step_affector);
+		step_affector->drop();
+		// << KIDSCODE
 
 		ps->setMaterialFlag(video::EMF_LIGHTING, false);
 		ps->setMaterialFlag(video::EMF_BACK_FACE_CULLING, false);
@@ -763,20 +983,13 @@ void ParticleManager::addNodeParticle(IGameDef *gamedef, LocalPlayer *player, v3
 		0.f
 	);
 
-	scene::IParticleAffector *collision_affector =
-		new CollisionAffector(m_env, false, true, 0.3f, 0.2f);
-	ps->addAffector(collision_affector);
-	collision_affector->drop();
-
-	scene::IParticleAffector *acceleration_affector =
-		new AccelerationAffector(acceleration);
-	ps->addAffector(acceleration_affector);
-	acceleration_affector->drop();
-
-	scene::IParticleAffector *lighting_affector =
-		new LightingAffector(m_env, gamedef, 0);
-	ps->addAffector(lighting_affector);
-	lighting_affector->drop();
+	// >> KIDSCODE - Particle map cache
+	scene::IParticleAffector *step_affector =
+		new ParticleStepAffector(m_env, m_map_cache.get(), acceleration,
+			true, false, true, 0.3f, 0.2f, 0);
+	ps->addAffector(step_affector);
+	step_affector->drop();
+	// << KIDSCODE
 
 	ps->setMaterialTexture(0, texture);
 
@@ -798,6 +1011,73 @@ void ParticleManager::addNodeParticle(IGameDef *gamedef, LocalPlayer *player, v3
 		scale_factor, texpos.X, texpos.Y);
 }
 
+// >> KIDSCODE - Particle map cache
+void ParticleManager::addBatchedParticle(const ParticleParameters &p,
+	video::ITexture *texture)
+{
+	ParticleBatchKey key {texture, p.acc, p.collisiondetection,
+		p.collision_removal, p.object_collision, p.bounce_fraction,
+		p.bounce_threshold};
+
+	MutexAutoLock lock(m_spawner_list_lock);
+	scene::IParticleSystemSceneNode *ps;
+	auto it = m_particle_batches.find(key);
+	if (it != m_particle_batches.end()) {
+		ps = it->second;
+	} else {
+		ps = m_smgr->addParticleSystemSceneNode(false,
+			RenderingEngine::get_scene_manager()->getRootSceneNode());
+		m_particle_batches[key] = ps;
+
+		ps->getMaterial(0).getTextureMatrix(0) = bottomUpTextureMatrix(1.f,1.f,0.f,0.f);
+		ps->setMaterialTexture(0, texture);
+
+		// The particles are emitted at their map position
+		ps->setPosition(-intToFloat(m_env->getCameraOffset(), BS));
+		scene::IParticleAffector *camera_offset_affector =
+			new CameraOffsetAffector(m_env, ps, v3f(0.f, 0.f, 0.f));
+		ps->addAffector(camera_offset_affector);
+		camera_offset_affector->drop();
+
+		// Deletes ps after the particles have vanished
+		scene::IParticleEmitter *em = new BatchEmitter(m_smgr, this, ps, key);
+		ps->setEmitter(em);
+		em->drop();
+
+		scene::IParticleAffector *step_affector =
+			new ParticleStepAffector(m_env, m_map_cache.get(),
+				p.acc,
+				p.collisiondetection,
+				p.collision_removal,
+				p.object_collision,
+				p.bounce_fraction,
+				p.bounce_threshold, 0);
+		ps->addAffector(step_affector);
+		step_affector->drop();
+
+		ps->setMaterialFlag(video::EMF_LIGHTING, false);
+		ps->setMaterialFlag(video::EMF_BACK_FACE_CULLING, false);
+		ps->setMaterialFlag(video::EMF_BILINEAR_FILTER, false);
+		ps->setMaterialFlag(video::EMF_FOG_ENABLE, true);
+		ps->setMaterialFlag(video::EMF_ZWRITE_ENABLE, false);
+		ps->setMaterialType(video::EMT_TRANSPARENT_ALPHA_CHANNEL);
+		ps->setAutomaticCulling(scene::EAC_OFF);
+	}
+
+	static_cast<BatchEmitter *>(ps->getEmitter())->add(p.pos, p.vel,
+		p.expirationtime, p.size);
+}
+
+void ParticleManager::removeParticleBatch(const ParticleBatchKey &key,
+	scene::IParticleSystemSceneNode *ps)
+{
+	MutexAutoLock lock(m_spawner_list_lock);
+	auto it = m_particle_batches.find(key);
+	if (it != m_particle_batches.end() && it->second == ps)
+		m_particle_batches.erase(it);
+}
+// << KIDSCODE
+
 u64 ParticleManager::getSingleParticleNumber()
 {
 	return single_particles_count.load();
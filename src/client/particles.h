@@ -20,6 +20,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #pragma once
 
 #include <iostream>
+#include <map> // KIDSCODE - Particle map cache
+#include <memory> // KIDSCODE - Particle map cache
 #include "irrlichttypes_extrabloated.h"
 #include "client/tile.h"
 #include "localplayer.h"
@@ -29,6 +31,23 @@ struct ClientEvent;
 class ClientEnvironment;
 struct MapNode;
 struct ContentFeatures;
+class ParticleMapCache; // KIDSCODE - Particle map cache
+
+// >> KIDSCODE - Particle map cache
+// Single particles drawn by the same particle system
+struct ParticleBatchKey
+{
+	video::ITexture *texture;
+	v3f acc;
+	bool collisiondetection;
+	bool collision_removal;
+	bool object_collision;
+	f32 bounce_fraction;
+	f32 bounce_threshold;
+
+	bool operator<(const ParticleBatchKey &other) const;
+};
+// << KIDSCODE
 
 /**
  * Class doing handling of single particles and particle spawners
@@ -39,6 +58,9 @@ class ParticleManager
 	ParticleManager(ClientEnvironment* env);
 	~ParticleManager();
 
+	// KIDSCODE - Particle map cache: call once per frame, before drawing
+	void step(float dtime);
+
 	void handleParticleEvent(ClientEvent *event, Client *client,
 			LocalPlayer *player);
 
@@ -63,11 +85,23 @@ class ParticleManager
 	u64 getSingleParticleNumber();
 	u64 getParticleSpawnerNumber();
 	void removeParticleSpawner(u64 id, bool stop);
+	// KIDSCODE - Particle map cache: called when the batch system is deleted
+	void removeParticleBatch(const ParticleBatchKey &key,
+		scene::IParticleSystemSceneNode *ps);
 
 private:
+	// KIDSCODE - Particle map cache
+	void addBatchedParticle(const ParticleParameters &p, video::ITexture *texture);
+
 	ClientEnvironment* m_env;
 	irr::scene::ISceneManager *m_smgr;
 	u64 m_next_particle_spawner_id = U32_MAX + 1;
 	std::unordered_map<u64, scene::IParticleSystemSceneNode*> m_particle_spawners;
 	std::mutex m_spawner_list_lock;
+	// >> KIDSCODE - Particle map cache
+	// Shared by the affectors of all the particle systems
+	std::unique_ptr<ParticleMapCache> m_map_cache;
+	// Behind m_spawner_list_lock
+	std::map<ParticleBatchKey, scene::IParticleSystemSceneNode *> m_particle_batches;
+	// << KIDSCODE
 };
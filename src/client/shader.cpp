@@ -756,6 +756,10 @@ ShaderInfo generate_shader(const std::string &name, u8 material_type, u8 drawtyp
 	shaders_header += ftos(rangelim(g_settings->getFloat("fog_start"), 0.0f, 0.99f));
 	shaders_header += "\n";
 
+	// KIDSCODE - Texture atlas
+	shaders_header += "#define TEXTURE_ATLAS_SLOT_SPAN " +
+		std::to_string(TEXTURE_ATLAS_SLOT_SPAN) + ".0\n";
+
 	// Call addHighLevelShaderMaterial() or addShaderMaterial()
 	const c8* vertex_program_ptr = 0;
 	const c8* pixel_program_ptr = 0;
@@ -20,6 +20,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "tile.h"
 
 #include <algorithm>
+#include <list> // KIDSCODE - Generated image cache
+#include <unordered_set> // KIDSCODE - Texture atlas
 #include <ICameraSceneNode.h>
 #include <IrrCompileConfig.h>
 #include "util/string.h"
@@ -279,6 +281,99 @@ class SourceImageCache
 	std::map<std::string, video::IImage*> m_images;
 };
 
+// >> KIDSCODE - Texture atlas
+// Largest textures packed in atlases
+#define TEXTURE_ATLAS_MAX_TILE_SIZE 256
+// Largest atlas, also limited by the video driver
+#define TEXTURE_ATLAS_MAX_SIZE 2048
+
+struct TextureAtlas
+{
+	u32 tile_size;
+	u16 slots;
+	// Packed textures, row by row
+	std::vector<std::string> names;
+};
+// << KIDSCODE
+
+// >> KIDSCODE - Generated image cache
+/*
+	GeneratedImageCache: A cache of the images generated for texture names
+	and their prefixes, so that the modifiers shared by several textures
+	(e.g. "stone.png^mineral.png" with every "^[crack" level) are applied
+	once. The least recently used images are dropped beyond max_bytes.
+*/
+
+class GeneratedImageCache
+{
+public:
+	GeneratedImageCache(u32 max_bytes): m_max_bytes(max_bytes) {}
+	~GeneratedImageCache() { clear(); }
+
+	void clear()
+	{
+		for (auto &it : m_images)
+			it.second.img->drop();
+		m_images.clear();
+		m_lru.clear();
+		m_bytes = 0;
+	}
+
+	// Returns a copy of the image, to be dropped by the caller
+	video::IImage *getCopy(const std::string &name)
+	{
+		auto it = m_images.find(name);
+		if (it == m_images.end())
+			return NULL;
+		m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+		return copy(it->second.img);
+	}
+
+	// Stores a copy of the image
+	void insert(const std::string &name, video::IImage *img)
+	{
+		u32 bytes = img->getImageDataSizeInBytes();
+		if (bytes > m_max_bytes / 4 || m_images.find(name) != m_images.end())
+			return;
+
+		while (m_bytes + bytes > m_max_bytes) {
+			auto it = m_images.find(m_lru.back());
+			m_bytes -= it->second.img->getImageDataSizeInBytes();
+			it->second.img->drop();
+			m_images.erase(it);
+			m_lru.pop_back();
+		}
+
+		m_lru.push_front(name);
+		m_images[name] = Entry{copy(img), m_lru.begin()};
+		m_bytes += bytes;
+	}
+
+private:
+	static video::IImage *copy(video::IImage *img)
+	{
+		video::IImage *result = RenderingEngine::get_video_driver()->
+			createImage(img->getColorFormat(), img->getDimension());
+		img->copyTo(result);
+		return result;
+	}
+
+	struct Entry
+	{
+		video::IImage *img;
+		std::list<std::string>::iterator lru;
+	};
+	std::unordered_map<std::string, Entry> m_images;
+	// Most recently used first
+	std::list<std::string> m_lru;
+	u32 m_bytes = 0;
+	u32 m_max_bytes;
+};
+
+// Size of the generated image cache
+#define GENERATED_IMAGE_CACHE_SIZE (32 * 1024 * 1024)
+// << KIDSCODE
+
 /*
 	TextureSource
 */
@@ -384,6 +479,13 @@ class TextureSource : public IWritableTextureSource
 	video::SColor getTextureAverageColor(const std::string &name);
 	video::ITexture *getShaderFlagsTexture(bool normamap_present);
 
+	// >> KIDSCODE - Texture atlas
+	// Shall be called from the main thread.
+	void buildTextureAtlases(const std::vector<u32> &texture_ids);
+
+	bool getAtlasSlot(u32 texture_id, TextureAtlasSlot *slot);
+	// << KIDSCODE
+
 private:
 
 	// The id of the thread that is allowed to use irrlicht directly
@@ -393,6 +495,9 @@ class TextureSource : public IWritableTextureSource
 	// This should be only accessed from the main thread
 	SourceImageCache m_sourcecache;
 
+	// KIDSCODE - Generated image cache: only accessed from the main thread
+	GeneratedImageCache m_generated_images;
+
 	// Generate a texture
 	u32 generateTexture(const std::string &name);
 
@@ -407,6 +512,9 @@ class TextureSource : public IWritableTextureSource
 	 */
 	video::IImage* generateImage(const std::string &name);
 
+	// KIDSCODE - Texture atlas: shall be called from the main thread.
+	video::IImage *generateAtlasImage(const TextureAtlas &atlas);
+
 	// Thread-safe cache of what source images are known (true = known)
 	MutexedMap<std::string, bool> m_source_image_existence;
 
@@ -415,7 +523,13 @@ class TextureSource : public IWritableTextureSource
 	std::vector<TextureInfo> m_textureinfo_cache;
 	// Maps a texture name to an index in the former.
 	std::map<std::string, u32> m_name_to_id;
-	// The two former containers are behind this mutex
+	// >> KIDSCODE - Texture atlas
+	// Texture id of the atlas -> its contents
+	std::map<u32, TextureAtlas> m_atlases;
+	// Texture id of a packed texture -> its place
+	std::unordered_map<u32, TextureAtlasSlot> m_atlas_slots;
+	// << KIDSCODE
+	// The former containers are behind this mutex
 	std::mutex m_textureinfo_cache_mutex;
 
 	// Queued texture fetches (to be processed by the main thread)
@@ -439,7 +553,8 @@ IWritableTextureSource *createTextureSource()
 	return new TextureSource();
 }
 
-TextureSource::TextureSource()
+TextureSource::TextureSource():
+	m_generated_images(GENERATED_IMAGE_CACHE_SIZE) // KIDSCODE - Generated image cache
 {
 	m_main_thread = std::this_thread::get_id();
 
@@ -763,6 +878,7 @@ void TextureSource::insertSourceImage(const std::string &name, video::IImage *im
 
 	m_sourcecache.insert(name, img, true);
 	m_source_image_existence.set(name, true);
+	m_generated_images.clear(); // KIDSCODE - Generated image cache
 }
 
 void TextureSource::rebuildImagesAndTextures()
@@ -775,9 +891,16 @@ void TextureSource::rebuildImagesAndTextures()
 	infostream << "TextureSource: recreating " << m_textureinfo_cache.size()
 		<< " textures" << std::endl;
 
+	m_generated_images.clear(); // KIDSCODE - Generated image cache
+
 	// Recreate textures
-	for (TextureInfo &ti : m_textureinfo_cache) {
-		video::IImage *img = generateImage(ti.name);
+	for (u32 i = 0; i < m_textureinfo_cache.size(); i++) {
+		TextureInfo &ti = m_textureinfo_cache[i];
+		// >> KIDSCODE - Texture atlas
+		auto atlas = m_atlases.find(i);
+		video::IImage *img = atlas != m_atlases.end() ?
+			generateAtlasImage(atlas->second) : generateImage(ti.name);
+		// << KIDSCODE
 #if ENABLE_GLES
 		img = Align2Npot2(img, driver);
 #endif
@@ -795,8 +918,138 @@ void TextureSource::rebuildImagesAndTextures()
 		if (t_old)
 			m_texture_trash.push_back(t_old);
 	}
+
+	// >> KIDSCODE - Texture atlas
+	for (auto &it : m_atlas_slots)
+		it.second.atlas = m_textureinfo_cache[it.second.atlas_id].texture;
+	// << KIDSCODE
 }
 
+// >> KIDSCODE - Texture atlas
+void TextureSource::buildTextureAtlases(const std::vector<u32> &texture_ids)
+{
+	sanity_check(std::this_thread::get_id() == m_main_thread);
+
+	video::IVideoDriver *driver = RenderingEngine::get_video_driver();
+	sanity_check(driver);
+
+	u32 max_size = TEXTURE_ATLAS_MAX_SIZE;
+	core::dimension2du driver_max = driver->getMaxTextureSize();
+	max_size = std::min(max_size, std::min(driver_max.Width, driver_max.Height));
+
+	// Square power of two textures, by size
+	std::map<u32, std::vector<u32>> groups;
+	{
+		MutexAutoLock lock(m_textureinfo_cache_mutex);
+		std::unordered_set<u32> seen;
+		for (u32 id : texture_ids) {
+			if (id == 0 || id >= m_textureinfo_cache.size() ||
+					!seen.insert(id).second || m_atlas_slots.count(id) ||
+					m_atlases.count(id))
+				continue;
+			video::ITexture *t = m_textureinfo_cache[id].texture;
+			if (!t)
+				continue;
+			core::dimension2du dim = t->getOriginalSize();
+			if (dim.Width != dim.Height || dim.Width != npot2(dim.Width) ||
+					dim.Width > TEXTURE_ATLAS_MAX_TILE_SIZE ||
+					dim.Width * 2 > max_size)
+				continue;
+			groups[dim.Width].push_back(id);
+		}
+	}
+
+	u32 packed = 0;
+	u32 atlas_count = 0;
+	for (const auto &group : groups) {
+		u32 tile_size = group.first;
+		const std::vector<u32> &ids = group.second;
+		u32 max_slots = max_size / tile_size;
+
+		for (u32 first = 0; first < ids.size(); first += max_slots * max_slots) {
+			u32 count = std::min<u32>(ids.size() - first, max_slots * max_slots);
+			// Nothing to gain
+			if (count < 2)
+				break;
+
+			TextureAtlas atlas;
+			atlas.tile_size = tile_size;
+			atlas.slots = std::min(max_slots,
+				npot2((u32)std::ceil(std::sqrt((float)count))));
+			for (u32 k = 0; k < count; k++)
+				atlas.names.push_back(getTextureName(ids[first + k]));
+
+			std::string name = "[atlas:" + std::to_string(tile_size) + ":" +
+				std::to_string(atlas_count++);
+			video::IImage *img = generateAtlasImage(atlas);
+			video::ITexture *tex = driver->addTexture(name.c_str(), img);
+			img->drop();
+			if (!tex)
+				continue;
+
+			MutexAutoLock lock(m_textureinfo_cache_mutex);
+			u32 atlas_id = m_textureinfo_cache.size();
+			m_textureinfo_cache.emplace_back(name, tex);
+			m_name_to_id[name] = atlas_id;
+			for (u32 k = 0; k < count; k++) {
+				TextureAtlasSlot &slot = m_atlas_slots[ids[first + k]];
+				slot.atlas_id = atlas_id;
+				slot.atlas = tex;
+				slot.x = k % atlas.slots;
+				slot.y = k / atlas.slots;
+				slot.slots = atlas.slots;
+			}
+			m_atlases[atlas_id] = std::move(atlas);
+			packed += count;
+		}
+	}
+
+	infostream << "TextureSource: packed " << packed << " textures in "
+		<< atlas_count << " atlases" << std::endl;
+}
+
+bool TextureSource::getAtlasSlot(u32 texture_id, TextureAtlasSlot *slot)
+{
+	MutexAutoLock lock(m_textureinfo_cache_mutex);
+
+	auto it = m_atlas_slots.find(texture_id);
+	if (it == m_atlas_slots.end() || !it->second.atlas)
+		return false;
+	*slot = it->second;
+	return true;
+}
+
+video::IImage *TextureSource::generateAtlasImage(const TextureAtlas &atlas)
+{
+	video::IVideoDriver *driver = RenderingEngine::get_video_driver();
+
+	core::dimension2du tile_dim(atlas.tile_size, atlas.tile_size);
+	u32 size = atlas.tile_size * atlas.slots;
+	video::IImage *img = driver->createImage(video::ECF_A8R8G8B8,
+		core::dimension2du(size, size));
+	img->fill(video::SColor(0, 0, 0, 0));
+
+	for (u32 k = 0; k < atlas.names.size(); k++) {
+		video::IImage *tile = generateImage(atlas.names[k]);
+		if (!tile)
+			continue;
+		// Source images may have been replaced by others of another size
+		if (tile->getDimension() != tile_dim) {
+			video::IImage *scaled = driver->createImage(video::ECF_A8R8G8B8,
+				tile_dim);
+			tile->copyToScaling(scaled);
+			tile->drop();
+			tile = scaled;
+		}
+		tile->copyTo(img, core::position2d<s32>(
+			(k % atlas.slots) * atlas.tile_size,
+			(k / atlas.slots) * atlas.tile_size));
+		tile->drop();
+	}
+	return img;
+}
+// << KIDSCODE
+
 inline static void applyShadeFactor(video::SColor &color, u32 factor)
 {
 	u32 f = core::clamp<u32>(factor, 0, 256);
@@ -923,88 +1176,104 @@ video::IImage* TextureSource::generateImage(const std::string &name)
 	const char paren_open = '(';
 	const char paren_close = ')';
 
-	// Find last separator in the name
-	s32 last_separator_pos = -1;
+	// >> KIDSCODE - Generated image cache
+	// Split the name once at its top level separators, each prefix of
+	// the name is the image generated so far
+	std::vector<size_t> part_ends;
 	u8 paren_bal = 0;
-	for (s32 i = name.size() - 1; i >= 0; i--) {
+	for (size_t i = 0; i < name.size(); i++) {
 		if (i > 0 && name[i-1] == escape)
 			continue;
 		switch (name[i]) {
 		case separator:
-			if (paren_bal == 0) {
-				last_separator_pos = i;
-				i = -1; // break out of loop
-			}
+			if (paren_bal == 0)
+				part_ends.push_back(i);
 			break;
 		case paren_open:
+			paren_bal++;
+			break;
+		case paren_close:
 			if (paren_bal == 0) {
 				errorstream << "generateImage(): unbalanced parentheses"
-						<< "(extranous '(') while generating texture \""
+						<< "(missing matching '(') while generating texture \""
 						<< name << "\"" << std::endl;
 				return NULL;
 			}
 			paren_bal--;
 			break;
-		case paren_close:
-			paren_bal++;
-			break;
 		default:
 			break;
 		}
 	}
 	if (paren_bal > 0) {
 		errorstream << "generateImage(): unbalanced parentheses"
-				<< "(missing matching '(') while generating texture \""
+				<< "(extranous '(') while generating texture \""
 				<< name << "\"" << std::endl;
 		return NULL;
 	}
-
+	part_ends.push_back(name.size());
 
 	video::IImage *baseimg = NULL;
 
 	/*
-		If separator was found, make the base image
-		using a recursive call.
+		Start from the longest prefix generated before
 	*/
-	if (last_separator_pos != -1) {
-		baseimg = generateImage(name.substr(0, last_separator_pos));
+	size_t first_part = 0;
+	for (size_t k = part_ends.size(); k-- > 0;) {
+		baseimg = m_generated_images.getCopy(name.substr(0, part_ends[k]));
+		if (baseimg) {
+			first_part = k + 1;
+			break;
+		}
 	}
 
-	/*
-		Parse out the last part of the name of the image and act
-		according to it
-	*/
-
-	std::string last_part_of_name = name.substr(last_separator_pos + 1);
+	for (size_t k = first_part; k < part_ends.size(); k++) {
+		/*
+			Parse out the next part of the name of the image and act
+			according to it
+		*/
+		size_t part_start = k == 0 ? 0 : part_ends[k - 1] + 1;
+		std::string part_of_name = name.substr(part_start,
+				part_ends[k] - part_start);
 
-	/*
-		If this name is enclosed in parentheses, generate it
-		and blit it onto the base image
-	*/
-	if (last_part_of_name[0] == paren_open
-			&& last_part_of_name[last_part_of_name.size() - 1] == paren_close) {
-		std::string name2 = last_part_of_name.substr(1,
-				last_part_of_name.size() - 2);
-		video::IImage *tmp = generateImage(name2);
-		if (!tmp) {
+		/*
+			If this name is enclosed in parentheses, generate it
+			and blit it onto the base image
+		*/
+		if (!part_of_name.empty() && part_of_name[0] == paren_open
+				&& part_of_name[part_of_name.size() - 1] == paren_close) {
+			std::string name2 = part_of_name.substr(1,
+					part_of_name.size() - 2);
+			video::IImage *tmp = generateImage(name2);
+			if (!tmp) {
+				errorstream << "generateImage(): "
+					"Failed to generate \"" << name2 << "\""
+					<< std::endl;
+				if (baseimg)
+					baseimg->drop();
+				return NULL;
+			}
+			core::dimension2d<u32> dim = tmp->getDimension();
+			if (baseimg) {
+				blit_with_alpha(tmp, baseimg, v2s32(0, 0), v2s32(0, 0), dim);
+				tmp->drop();
+			} else {
+				baseimg = tmp;
+			}
+		} else if (!generateImagePart(part_of_name, baseimg)) {
+			// Generate image according to part of name
 			errorstream << "generateImage(): "
-				"Failed to generate \"" << name2 << "\""
-				<< std::endl;
-			return NULL;
-		}
-		core::dimension2d<u32> dim = tmp->getDimension();
-		if (baseimg) {
-			blit_with_alpha(tmp, baseimg, v2s32(0, 0), v2s32(0, 0), dim);
-			tmp->drop();
-		} else {
-			baseimg = tmp;
+					"Failed to generate \"" << part_of_name << "\""
+					<< std::endl;
+			continue;
 		}
-	} else if (!generateImagePart(last_part_of_name, baseimg)) {
-		// Generate image according to part of name
-		errorstream << "generateImage(): "
-				"Failed to generate \"" << last_part_of_name << "\""
-				<< std::endl;
+
+		// Plain images are in the source image cache already
+		if (baseimg && (k > 0 || part_of_name.empty() ||
+				part_of_name[0] == '[' || part_of_name[0] == paren_open))
+			m_generated_images.insert(name.substr(0, part_ends[k]), baseimg);
 	}
+	// << KIDSCODE
 
 	// If no resulting image, print a warning
 	if (baseimg == NULL) {
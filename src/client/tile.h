@@ -87,6 +87,25 @@ class ISimpleTextureSource
 			const std::string &name, u32 *id = nullptr) = 0;
 };
 
+// >> KIDSCODE - Texture atlas
+/*
+	Place of a texture in an atlas of slots x slots textures of the same size.
+	Mesh texture coordinates in the atlas are encoded as
+	slot * TEXTURE_ATLAS_SLOT_SPAN + TEXTURE_ATLAS_SLOT_SPAN / 2 + local, the
+	node shader decodes them and does the wrapping.
+*/
+#define TEXTURE_ATLAS_SLOT_SPAN 64
+
+struct TextureAtlasSlot
+{
+	u32 atlas_id = 0;
+	video::ITexture *atlas = nullptr;
+	u16 x = 0;
+	u16 y = 0;
+	u16 slots = 0;
+};
+// << KIDSCODE
+
 class ITextureSource : public ISimpleTextureSource
 {
 public:
@@ -112,6 +131,16 @@ class ITextureSource : public ISimpleTextureSource
 	virtual video::ITexture* getNormalTexture(const std::string &name)=0;
 	virtual video::SColor getTextureAverageColor(const std::string &name)=0;
 	virtual video::ITexture *getShaderFlagsTexture(bool normalmap_present)=0;
+	// >> KIDSCODE - Texture atlas
+	/*!
+	 * Finds the atlas the texture was packed in.
+	 * Can be called from any thread.
+	 */
+	virtual bool getAtlasSlot(u32 texture_id, TextureAtlasSlot *slot)
+	{
+		return false;
+	}
+	// << KIDSCODE
 };
 
 class IWritableTextureSource : public ITextureSource
@@ -134,6 +163,8 @@ class IWritableTextureSource : public ITextureSource
 	virtual video::ITexture* getNormalTexture(const std::string &name)=0;
 	virtual video::SColor getTextureAverageColor(const std::string &name)=0;
 	virtual video::ITexture *getShaderFlagsTexture(bool normalmap_present)=0;
+	// KIDSCODE - Texture atlas: packs the square textures of the same size
+	virtual void buildTextureAtlases(const std::vector<u32> &texture_ids)=0;
 
 	IWritableItemDefManager* m_itemdef_manager;
 	Client* m_client;
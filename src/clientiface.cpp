@@ -720,7 +720,8 @@ void ClientInterface::UpdatePlayerList()
 void ClientInterface::send(session_t peer_id, u8 channelnum,
 		NetworkPacket *pkt, bool reliable)
 {
-	m_con->Send(peer_id, channelnum, pkt, reliable);
+	m_con->Send(peer_id, channelnum, pkt, reliable,
+			clientCommandFactoryTable[pkt->getCommand()].priority); // KIDSCODE - Send scheduler
 }
 
 void ClientInterface::sendToAll(NetworkPacket *pkt)
@@ -732,7 +733,8 @@ void ClientInterface::sendToAll(NetworkPacket *pkt)
 		if (client->net_proto_version != 0) {
 			m_con->Send(client->peer_id,
 					clientCommandFactoryTable[pkt->getCommand()].channel, pkt,
-					clientCommandFactoryTable[pkt->getCommand()].reliable);
+					clientCommandFactoryTable[pkt->getCommand()].reliable,
+					clientCommandFactoryTable[pkt->getCommand()].priority); // KIDSCODE - Send scheduler
 		}
 	}
 }
@@ -758,7 +760,8 @@ void ClientInterface::sendToAllCompat(NetworkPacket *pkt, NetworkPacket *legacyp
 		m_con->Send(client->peer_id,
 			clientCommandFactoryTable[pkt_to_send->getCommand()].channel,
 			pkt_to_send,
-			clientCommandFactoryTable[pkt_to_send->getCommand()].reliable);
+			clientCommandFactoryTable[pkt_to_send->getCommand()].reliable,
+			clientCommandFactoryTable[pkt_to_send->getCommand()].priority); // KIDSCODE - Send scheduler
 	}
 }
 
@@ -232,6 +232,8 @@ class RemoteClient
 	u8 serialization_version = SER_FMT_VER_INVALID;
 	//
 	u16 net_proto_version = 0;
+	// Fork capabilities announced in TOSERVER_INIT
+	u32 kidscode_caps = 0; // KIDSCODE - Fork capabilities
 
 	/* Authentication information */
 	std::string enc_pwd = "";
@@ -43,6 +43,7 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("enable_mesh_cache", "false");
 	settings->setDefault("mesh_generation_interval", "0");
 	settings->setDefault("meshgen_block_cache_size", "20");
+	settings->setDefault("mesh_lod_distance", "200"); // KIDSCODE - Mesh LOD
 	settings->setDefault("enable_vbo", "true");
 	settings->setDefault("free_move", "false");
 	settings->setDefault("pitch_move", "false");
@@ -239,6 +240,8 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("item_rtt_speedup_resolution", "64");
 	settings->setDefault("texture_clean_transparent", "false");
 	settings->setDefault("texture_min_size", "64");
+	settings->setDefault("texture_atlas", "true"); // KIDSCODE - Texture atlas
+	settings->setDefault("object_batching", "true"); // KIDSCODE - Object batching
 	settings->setDefault("ambient_occlusion_gamma", "2.2");
 #if ENABLE_GLES
 	settings->setDefault("enable_shaders", "false");
@@ -418,9 +421,12 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("dedicated_server_step", "0.09");
 	settings->setDefault("active_block_mgmt_interval", "2.0");
 	settings->setDefault("abm_interval", "1.0");
+	settings->setDefault("abm_scan_threads", "-1"); // KIDSCODE - Parallel ABM scanning
 	settings->setDefault("nodetimer_interval", "0.2");
+	settings->setDefault("pathfinder_async_budget", "10"); // KIDSCODE - Asynchronous pathfinding
 	settings->setDefault("ignore_world_load_errors", "false");
 	settings->setDefault("remote_media", "");
+	settings->setDefault("media_memory_cache_size", "64"); // KIDSCODE - Media store
 	settings->setDefault("debug_log_level", "action");
 	settings->setDefault("debug_log_size_max", "50");
 	settings->setDefault("chat_log_level", "error");
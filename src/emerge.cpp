@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "emerge.h"
 
 #include <iostream>
+#include <memory>
 #include <queue>
 
 #include "util/container.h"
@@ -41,6 +42,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "nodedef.h"
 #include "profiler.h"
 #include "scripting_server.h"
+#include "scripting_emerge.h" // KIDSCODE - Emerge Lua environment
 #include "server.h"
 #include "settings.h"
 #include "voxel.h"
@@ -70,6 +72,7 @@ class EmergeThread : public Thread {
 	ServerMap *m_map;
 	EmergeManager *m_emerge;
 	Mapgen *m_mapgen;
+	std::unique_ptr<EmergeScripting> m_script; // KIDSCODE - Emerge Lua environment
 
 	Event m_queue_event;
 	std::queue<v3s16> m_block_queue;
@@ -296,6 +299,17 @@ void EmergeManager::stopThreads()
 }
 
 
+// >> KIDSCODE - Emerge Lua environment
+void EmergeManager::addMapgenScript(const std::string &mod_name,
+	const std::string &path)
+{
+	FATAL_ERROR_IF(m_threads_active,
+		"Mapgen scripts can only be added before the emerge threads start");
+	m_mapgen_scripts.push_back({mod_name, path});
+}
+// << KIDSCODE
+
+
 bool EmergeManager::isRunning()
 {
 	return m_threads_active;
@@ -668,6 +682,20 @@ void *EmergeThread::run()
 	m_mapgen = m_emerge->m_mapgens[id];
 	enable_mapgen_debug_info = m_emerge->enable_mapgen_debug_info;
 
+	// >> KIDSCODE - Emerge Lua environment
+	if (!m_emerge->m_mapgen_scripts.empty()) {
+		try {
+			m_script.reset(new EmergeScripting(m_server));
+			m_script->loadScripts(m_emerge->m_mapgen_scripts);
+		} catch (ModError &e) {
+			m_script.reset();
+			m_server->setAsyncFatalError(
+				"Lua: emerge environment: " + std::string(e.what()));
+			return NULL;
+		}
+	}
+	// << KIDSCODE
+
 	try {
 	while (!stopRequested()) {
 		std::map<v3s16, MapBlock *> modified_blocks;
@@ -696,6 +724,21 @@ void *EmergeThread::run()
 				m_mapgen->makeChunk(&bmdata);
 			}
 
+			// >> KIDSCODE - Emerge Lua environment
+			// Runs without the environment lock, in parallel with the
+			// other emerge threads
+			if (m_script) {
+				ScopeProfiler sp(g_profiler,
+					"EmergeThread: Lua on_generated", SPT_AVG);
+				try {
+					m_script->on_generated(&bmdata, m_mapgen->blockseed);
+				} catch (LuaError &e) {
+					m_server->setAsyncFatalError(
+						"Lua: emerge on_generated: " + std::string(e.what()));
+				}
+			}
+			// << KIDSCODE
+
 			block = finishGen(pos, &bmdata, &modified_blocks);
 		}
 
@@ -727,6 +770,9 @@ void *EmergeThread::run()
 		m_server->setAsyncFatalError(err.str());
 	}
 
+	// The Lua state belongs to this thread
+	m_script.reset(); // KIDSCODE - Emerge Lua environment
+
 	END_DEBUG_EXCEPTION_HANDLER
 	return NULL;
 }
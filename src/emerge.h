@@ -21,6 +21,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include <map>
 #include <mutex>
+#include <string>
+#include <vector>
 #include "network/networkprotocol.h"
 #include "irr_v3d.h"
 #include "util/container.h"
@@ -87,6 +89,14 @@ struct BlockEmergeData {
 	EmergeCallbackList callbacks;
 };
 
+// >> KIDSCODE - Emerge Lua environment
+// Script run in the Lua environment of each emerge thread
+struct MapgenScript {
+	std::string mod_name;
+	std::string path;
+};
+// << KIDSCODE
+
 class EmergeParams {
 	friend class EmergeManager;
 public:
@@ -175,6 +185,11 @@ class EmergeManager {
 
 	Mapgen *getCurrentMapgen();
 
+	// >> KIDSCODE - Emerge Lua environment
+	// Only at mod load time, before the threads are started
+	void addMapgenScript(const std::string &mod_name, const std::string &path);
+	// << KIDSCODE
+
 	// Mapgen helpers methods
 	int getSpawnLevelAtPoint(v2s16 p);
 	int getGroundLevelAtPoint(v2s16 p);
@@ -195,6 +210,8 @@ class EmergeManager {
 	u16 m_qlimit_diskonly;
 	u16 m_qlimit_generate;
 
+	std::vector<MapgenScript> m_mapgen_scripts; // KIDSCODE - Emerge Lua environment
+
 	// Managers of various map generation-related components
 	// Note that each Mapgen gets a copy(!) of these to work with
 	BiomeManager *biomemgr;
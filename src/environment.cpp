@@ -176,6 +176,12 @@ void Environment::continueRaycast(RaycastState *state, PointedThing *result)
 			v3s16 np(x, y, z);
 			bool is_valid_position;
 
+			// >> KIDSCODE - Batched raycasts
+			if (state->m_block_cache && !state->m_block_cache->isPointable(
+					np, state->m_liquids_pointable))
+				continue;
+			// << KIDSCODE
+
 			n = map.getNode(np, &is_valid_position);
 			if (!(is_valid_position && isPointableNode(n, nodedef,
 					state->m_liquids_pointable))) {
@@ -276,6 +282,39 @@ void Environment::continueRaycast(RaycastState *state, PointedThing *result)
 	}
 }
 
+// >> KIDSCODE - Batched raycasts
+void Environment::getSelectedActiveObjectsBatch(
+	const std::vector<core::line3d<f32>> &shootlines,
+	std::vector<std::vector<PointedThing>> &objects)
+{
+	objects.resize(shootlines.size());
+	for (size_t i = 0; i < shootlines.size(); i++)
+		getSelectedActiveObjects(shootlines[i], objects[i]);
+}
+
+void Environment::raycastBatch(const std::vector<core::line3d<f32>> &shootlines,
+	bool objects_pointable, bool liquids_pointable,
+	std::vector<PointedThing> &results)
+{
+	std::vector<std::vector<PointedThing>> objects;
+	if (objects_pointable)
+		getSelectedActiveObjectsBatch(shootlines, objects);
+
+	RaycastBlockCache block_cache(&getMap());
+	results.resize(shootlines.size());
+	for (size_t i = 0; i < shootlines.size(); i++) {
+		// Objects are already known, only the nodes are left to find
+		RaycastState state(shootlines[i], false, liquids_pointable);
+		state.m_block_cache = &block_cache;
+		if (objects_pointable) {
+			for (const PointedThing &pointed : objects[i])
+				state.m_found.push(pointed);
+		}
+		continueRaycast(&state, &results[i]);
+	}
+}
+// << KIDSCODE
+
 void Environment::stepTimeOfDay(float dtime)
 {
 	MutexAutoLock lock(this->m_time_lock);
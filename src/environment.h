@@ -106,6 +106,27 @@ class Environment
 	 */
 	void continueRaycast(RaycastState *state, PointedThing *result);
 
+	// >> KIDSCODE - Batched raycasts
+	/*!
+	 * Gets the objects pointed by each of the shootlines.
+	 * The default implementation tests the lines one by one.
+	 * @param[in]  shootlines shootlines in world coordinates
+	 * @param[out] objects    found objects, one list per shootline
+	 */
+	virtual void getSelectedActiveObjectsBatch(
+			const std::vector<core::line3d<f32>> &shootlines,
+			std::vector<std::vector<PointedThing>> &objects);
+
+	/*!
+	 * Returns the first node or object each shootline meets.
+	 * The map blocks and objects are looked up once for all the lines.
+	 * @param[out] results one pointed thing per shootline
+	 */
+	void raycastBatch(const std::vector<core::line3d<f32>> &shootlines,
+			bool objects_pointable, bool liquids_pointable,
+			std::vector<PointedThing> &results);
+	// << KIDSCODE
+
 	// counter used internally when triggering ABMs
 	u32 m_added_objects;
 
@@ -180,6 +180,54 @@ MapNode Map::getNode(v3s16 p, bool *is_valid_position)
 	return node;
 }
 
+// >> KIDSCODE - Bulk node reads
+void Map::getContentInArea(v3s16 minp, v3s16 maxp, content_t *dst)
+{
+	const v3s16 extent = maxp - minp + 1;
+	const u32 ystride = extent.X;
+	const u32 zstride = extent.X * extent.Y;
+
+	v3s16 bpmin = getNodeBlockPos(minp);
+	v3s16 bpmax = getNodeBlockPos(maxp);
+	v3s16 bp;
+	for (bp.Z = bpmin.Z; bp.Z <= bpmax.Z; bp.Z++)
+	for (bp.Y = bpmin.Y; bp.Y <= bpmax.Y; bp.Y++)
+	for (bp.X = bpmin.X; bp.X <= bpmax.X; bp.X++) {
+		// Part of the area inside of this block
+		v3s16 block_min = bp * MAP_BLOCKSIZE;
+		v3s16 from(
+			MYMAX(minp.X, block_min.X),
+			MYMAX(minp.Y, block_min.Y),
+			MYMAX(minp.Z, block_min.Z));
+		v3s16 to(
+			MYMIN(maxp.X, block_min.X + MAP_BLOCKSIZE - 1),
+			MYMIN(maxp.Y, block_min.Y + MAP_BLOCKSIZE - 1),
+			MYMIN(maxp.Z, block_min.Z + MAP_BLOCKSIZE - 1));
+		const u32 row_length = to.X - from.X + 1;
+
+		MapBlock *block = getBlockNoCreateNoEx(bp);
+		const MapNode *data = (block && !block->isDummy()) ?
+			block->getData() : nullptr;
+
+		for (s16 z = from.Z; z <= to.Z; z++)
+		for (s16 y = from.Y; y <= to.Y; y++) {
+			content_t *row = dst + (z - minp.Z) * zstride +
+				(y - minp.Y) * ystride + (from.X - minp.X);
+			if (!data) {
+				std::fill(row, row + row_length, CONTENT_IGNORE);
+				continue;
+			}
+
+			const MapNode *src = data +
+				(z - block_min.Z) * MAP_BLOCKSIZE * MAP_BLOCKSIZE +
+				(y - block_min.Y) * MAP_BLOCKSIZE + (from.X - block_min.X);
+			for (u32 i = 0; i < row_length; i++)
+				row[i] = src[i].getContent();
+		}
+	}
+}
+// << KIDSCODE
+
 // throws InvalidPositionException if not found
 void Map::setNode(v3s16 p, MapNode & n)
 {
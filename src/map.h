@@ -183,6 +183,14 @@ class Map /*: public NodeContainer*/
 	// position is valid, otherwise false
 	MapNode getNode(v3s16 p, bool *is_valid_position = NULL);
 
+	// >> KIDSCODE - Bulk node reads
+	// Copies the content ids of the area (inclusive) to `dst`, in VoxelArea
+	// order (X fastest, then Y, then Z). Nodes of blocks that are not loaded
+	// are CONTENT_IGNORE. Reads whole block rows instead of looking up the
+	// block for every node.
+	void getContentInArea(v3s16 minp, v3s16 maxp, content_t *dst);
+	// << KIDSCODE
+
 	/*
 		These handle lighting but not faces.
 	*/
@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "mapblock.h"
 
+#include <atomic> // KIDSCODE - Pathfinder cache
 #include <sstream>
 #include "map.h"
 #include "light.h"
@@ -152,8 +153,53 @@ void MapBlock::copyFrom(VoxelManipulator &dst)
 	// Copy from VoxelManipulator to data
 	dst.copyTo(data, data_area, v3s16(0,0,0),
 			getPosRelative(), data_size);
+	m_content_histogram_valid = false; // KIDSCODE - Content histogram
+	m_node_data_version = 0; // KIDSCODE - Pathfinder cache
 }
 
+// >> KIDSCODE - Pathfinder cache
+u32 MapBlock::nextNodeDataVersion()
+{
+	// Blocks are created by the emerge threads too
+	static std::atomic<u32> s_version(0);
+	u32 version = ++s_version;
+	if (version == 0)
+		version = ++s_version;
+	return version;
+}
+// << KIDSCODE
+
+// >> KIDSCODE - Content histogram
+void MapBlock::updateContentHistogram()
+{
+	m_content_histogram.clear();
+	m_content_histogram_valid = true;
+	if (!data)
+		return;
+
+	// Runs of the same content are common, count them at once
+	u32 i = 0;
+	while (i < nodecount) {
+		content_t c = data[i].getContent();
+		u32 run = i + 1;
+		while (run < nodecount && data[run].getContent() == c)
+			run++;
+
+		bool found = false;
+		for (auto &entry : m_content_histogram) {
+			if (entry.first == c) {
+				entry.second += run - i;
+				found = true;
+				break;
+			}
+		}
+		if (!found)
+			m_content_histogram.emplace_back(c, run - i);
+		i = run;
+	}
+}
+// << KIDSCODE
+
 void MapBlock::actuallyUpdateDayNightDiff()
 {
 	const NodeDefManager *nodemgr = m_gamedef->ndef();
@@ -550,6 +596,9 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 		}
 	}
 
+	updateContentHistogram(); // KIDSCODE - Content histogram
+	m_node_data_version = 0; // KIDSCODE - Pathfinder cache
+
 	TRACESTREAM(<<"MapBlock::deSerialize "<<PP(getPos())
 			<<": Done."<<std::endl);
 }
@@ -778,6 +827,8 @@ void MapBlock::deSerialize_pre22(std::istream &is, u8 version, bool disk)
 		}
 	}
 
+	updateContentHistogram(); // KIDSCODE - Content histogram
+	m_node_data_version = 0; // KIDSCODE - Pathfinder cache
 }
 
 /*
@@ -114,8 +114,15 @@ class MapBlock
 		} else if (mod == m_modified) {
 			m_modified_reason |= reason;
 		}
-		if (mod == MOD_STATE_WRITE_NEEDED)
-			contents_cached = false;
+		// >> KIDSCODE - Content histogram, Pathfinder cache
+		// setNode() keeps the histogram and the node data version up to
+		// date, anything else that writes the data goes through here
+		if (mod == MOD_STATE_WRITE_NEEDED && !(reason &
+				(MOD_REASON_SET_NODE | MOD_REASON_SET_NODE_NO_CHECK))) {
+			m_content_histogram_valid = false;
+			m_node_data_version = 0;
+		}
+		// << KIDSCODE
 	}
 
 	inline u32 getModified()
@@ -279,7 +286,10 @@ class MapBlock
 		if (!isValidPosition(x, y, z))
 			throw InvalidPositionException();
 
-		data[z * zstride + y * ystride + x] = n;
+		MapNode &old = data[z * zstride + y * ystride + x];
+		changeContentCount(old.getContent(), n.getContent()); // KIDSCODE - Content histogram
+		m_node_data_version = 0; // KIDSCODE - Pathfinder cache
+		old = n;
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE);
 	}
 
@@ -327,7 +337,10 @@ class MapBlock
 		if (!data)
 			throw InvalidPositionException();
 
-		data[z * zstride + y * ystride + x] = n;
+		MapNode &old = data[z * zstride + y * ystride + x];
+		changeContentCount(old.getContent(), n.getContent()); // KIDSCODE - Content histogram
+		m_node_data_version = 0; // KIDSCODE - Pathfinder cache
+		old = n;
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE_NO_CHECK);
 	}
 
@@ -531,13 +544,72 @@ class MapBlock
 
 	static const u32 nodecount = MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE;
 
-	//// ABM optimizations ////
-	// Cache of content types
-	std::unordered_set<content_t> contents;
-	// True if content types are cached
-	bool contents_cached = false;
-	// True if we never want to cache content types for this block
-	bool do_not_cache_contents = false;
+	// >> KIDSCODE - Content histogram
+	// Node count of each content type in the block, in no particular order
+	typedef std::vector<std::pair<content_t, u16>> ContentHistogram;
+
+	// Computed when the block is loaded, setNode() keeps it up to date.
+	// Empty for dummy blocks.
+	const ContentHistogram &getContentHistogram()
+	{
+		if (!m_content_histogram_valid)
+			updateContentHistogram();
+		return m_content_histogram;
+	}
+
+	bool containsContent(content_t c)
+	{
+		for (const auto &entry : getContentHistogram())
+			if (entry.first == c)
+				return true;
+		return false;
+	}
+
+private:
+	void updateContentHistogram();
+
+	inline void changeContentCount(content_t from, content_t to)
+	{
+		if (from == to || !m_content_histogram_valid)
+			return;
+
+		bool added = false;
+		for (size_t i = 0; i < m_content_histogram.size(); i++) {
+			auto &entry = m_content_histogram[i];
+			if (entry.first == to) {
+				entry.second++;
+				added = true;
+			} else if (entry.first == from && --entry.second == 0) {
+				entry = m_content_histogram.back();
+				m_content_histogram.pop_back();
+				i--;
+			}
+		}
+		if (!added)
+			m_content_histogram.emplace_back(to, 1);
+	}
+
+	ContentHistogram m_content_histogram;
+	bool m_content_histogram_valid = false;
+	// << KIDSCODE
+
+public:
+	// >> KIDSCODE - Pathfinder cache
+	// Changes whenever the node data may have changed. Versions are unique
+	// across blocks, a reloaded block never gets the version of the old one.
+	u32 getNodeDataVersion()
+	{
+		if (m_node_data_version == 0)
+			m_node_data_version = nextNodeDataVersion();
+		return m_node_data_version;
+	}
+
+private:
+	static u32 nextNodeDataVersion();
+
+	// 0 until asked for
+	u32 m_node_data_version = 0;
+	// << KIDSCODE
 
 private:
 	/*
@@ -0,0 +1,200 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "congestioncontrol.h"
+#include <algorithm>
+#include <cmath>
+#include "util/numeric.h"
+
+namespace con
+{
+
+/* CUBIC scaling constant and multiplicative decrease factor (RFC 8312) */
+#define CUBIC_C 0.4f
+#define CUBIC_BETA 0.7f
+
+/* pacing rate relative to cwnd / srtt, above 1 to leave room for growth */
+#define PACING_GAIN_SLOW_START 2.0f
+#define PACING_GAIN 1.25f
+
+/* the send thread sleeps up to 50ms, the bucket has to hold at least that */
+#define PACING_MAX_INTERVAL 0.05f
+#define PACING_MIN_BURST 16.0f
+
+/* shortest interval a delivery rate sample is taken over [ms] */
+#define BW_MIN_INTERVAL 100
+
+CongestionControl::CongestionControl(float initial_window, float min_window,
+		float max_window) :
+	m_min_window(min_window),
+	m_max_window(max_window),
+	m_cwnd(initial_window),
+	m_ssthresh(max_window)
+{
+	for (float &sample : m_bw_samples)
+		sample = 0.0f;
+}
+
+void CongestionControl::reset(float window)
+{
+	m_cwnd = rangelim(window, m_min_window, m_max_window);
+	m_ssthresh = m_max_window;
+	m_w_max = 0.0f;
+	m_epoch_start = 0;
+	m_last_reduction = 0;
+}
+
+void CongestionControl::onAck(u32 bytes, float rtt, u64 now)
+{
+	if (rtt >= 0.0f) {
+		if (m_srtt < 0.0f)
+			m_srtt = rtt;
+		else
+			m_srtt = 0.875f * m_srtt + 0.125f * rtt;
+
+		if (m_min_rtt < 0.0f || rtt < m_min_rtt)
+			m_min_rtt = rtt;
+	}
+
+	updateBandwidth(bytes, now);
+
+	if (m_cwnd < m_ssthresh) {
+		// Slow start: one packet per ACK doubles the window each round trip
+		m_cwnd = std::min(m_cwnd + 1.0f, m_max_window);
+		return;
+	}
+
+	// Congestion avoidance, cubic growth around the last window maximum
+	if (m_epoch_start == 0) {
+		m_epoch_start = now;
+		if (m_cwnd < m_w_max) {
+			m_k = std::cbrt((m_w_max - m_cwnd) / CUBIC_C);
+		} else {
+			m_k = 0.0f;
+			m_w_max = m_cwnd;
+		}
+		m_w_est = m_cwnd;
+	}
+
+	float t = (now - m_epoch_start) / 1000.0f + std::max(m_min_rtt, 0.0f);
+	float target = CUBIC_C * (t - m_k) * (t - m_k) * (t - m_k) + m_w_max;
+
+	if (target > m_cwnd)
+		m_cwnd += (target - m_cwnd) / m_cwnd;
+	else
+		m_cwnd += 0.01f / m_cwnd;
+
+	// Never grow slower than Reno would (TCP friendly region)
+	m_w_est += 3.0f * (1.0f - CUBIC_BETA) / (1.0f + CUBIC_BETA) / m_cwnd;
+	m_cwnd = rangelim(std::max(m_cwnd, m_w_est), m_min_window, m_max_window);
+}
+
+void CongestionControl::onLoss(u32 count, u64 last_sent, u64 now)
+{
+	if (count == 0)
+		return;
+
+	// Packets sent before the last reduction belong to the same congestion
+	// event, the window already reacted to it
+	if (m_last_reduction != 0 && last_sent <= m_last_reduction)
+		return;
+	m_last_reduction = now;
+
+	// Fast convergence: release bandwidth if the last maximum wasn't reached
+	if (m_cwnd < m_w_max)
+		m_w_max = m_cwnd * (1.0f + CUBIC_BETA) / 2.0f;
+	else
+		m_w_max = m_cwnd;
+
+	m_cwnd = std::max(m_cwnd * CUBIC_BETA, m_min_window);
+	m_ssthresh = m_cwnd;
+	m_epoch_start = 0;
+}
+
+u32 CongestionControl::getPacingBudget(u64 now)
+{
+	float rate = getPacingRate();
+	if (rate < 0.0f) {
+		// The first paced call starts with a full bucket
+		m_pacing_last = 0;
+		return U32_MAX;
+	}
+
+	float burst = std::max(PACING_MIN_BURST, rate * PACING_MAX_INTERVAL);
+	if (m_pacing_last != 0 && now > m_pacing_last)
+		m_pacing_tokens += rate * (now - m_pacing_last) / 1000.0f;
+	else if (m_pacing_last == 0)
+		m_pacing_tokens = burst;
+	m_pacing_last = now;
+
+	m_pacing_tokens = std::min(m_pacing_tokens, burst);
+
+	if (m_pacing_tokens < 1.0f)
+		return 0;
+	return (u32)m_pacing_tokens;
+}
+
+void CongestionControl::onPacketSent()
+{
+	// Resends may overdraw the bucket, they are paid back before sending more
+	m_pacing_tokens = std::max(m_pacing_tokens - 1.0f, -PACING_MIN_BURST);
+}
+
+float CongestionControl::getBandwidth() const
+{
+	if (m_bw_sample_count == 0)
+		return -1.0f;
+
+	return *std::max_element(m_bw_samples, m_bw_samples + m_bw_sample_count);
+}
+
+float CongestionControl::getPacingRate() const
+{
+	if (m_srtt <= 0.0f)
+		return -1.0f;
+
+	float gain = inSlowStart() ? PACING_GAIN_SLOW_START : PACING_GAIN;
+	return gain * m_cwnd / m_srtt;
+}
+
+void CongestionControl::updateBandwidth(u32 bytes, u64 now)
+{
+	if (m_bw_interval_start == 0) {
+		m_bw_interval_start = now;
+		m_bw_interval_bytes = 0;
+	}
+
+	m_bw_interval_bytes += bytes;
+
+	u64 interval = std::max<u64>(BW_MIN_INTERVAL,
+		m_srtt > 0.0f ? (u64)(m_srtt * 1000.0f) : 0);
+	if (now < m_bw_interval_start + interval)
+		return;
+
+	m_bw_samples[m_bw_sample_next] =
+		m_bw_interval_bytes * 1000.0f / (now - m_bw_interval_start);
+	m_bw_sample_next = (m_bw_sample_next + 1) % BW_SAMPLES;
+	if (m_bw_sample_count < BW_SAMPLES)
+		m_bw_sample_count++;
+
+	m_bw_interval_start = now;
+	m_bw_interval_bytes = 0;
+}
+
+}
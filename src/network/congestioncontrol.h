@@ -0,0 +1,101 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include "irrlichttypes.h"
+
+namespace con
+{
+
+/*
+	CUBIC-like congestion controller with send pacing for a reliable channel.
+
+	The congestion window is counted in packets. All times are absolute
+	milliseconds (porting::getTimeMs() in the connection threads), which
+	allows to drive the controller with a simulated clock.
+	This class is not thread safe, the owning Channel locks around it.
+*/
+class CongestionControl
+{
+public:
+	CongestionControl(float initial_window, float min_window, float max_window);
+
+	// Restarts slow start from the given window size
+	void reset(float window);
+
+	// A reliable packet of `bytes` was acknowledged.
+	// `rtt` is the measured round trip time in seconds, < 0 if unknown
+	// (e.g. the packet was resent)
+	void onAck(u32 bytes, float rtt, u64 now);
+
+	// `count` reliable packets timed out and are going to be resent.
+	// `last_sent` is the send time of the most recently sent one of them.
+	void onLoss(u32 count, u64 last_sent, u64 now);
+
+	// Returns how many packets may be sent at `now` without exceeding the
+	// pacing rate. Returns U32_MAX while no RTT sample is known.
+	u32 getPacingBudget(u64 now);
+
+	// Accounts a packet put on the wire (sent or resent)
+	void onPacketSent();
+
+	float getWindow() const { return m_cwnd; }
+	bool inSlowStart() const { return m_cwnd < m_ssthresh; }
+	// Smoothed round trip time in seconds, < 0 if unknown
+	float getSmoothedRTT() const { return m_srtt; }
+	// Windowed maximum of the delivery rate in bytes/s, < 0 if unknown
+	float getBandwidth() const;
+	// Packets per second, < 0 while unpaced
+	float getPacingRate() const;
+
+private:
+	void updateBandwidth(u32 bytes, u64 now);
+
+	float m_min_window;
+	float m_max_window;
+
+	float m_cwnd;
+	float m_ssthresh;
+
+	// CUBIC state
+	float m_w_max = 0.0f;
+	float m_w_est = 0.0f;
+	float m_k = 0.0f;
+	u64 m_epoch_start = 0;
+	u64 m_last_reduction = 0;
+
+	// RTT
+	float m_srtt = -1.0f;
+	float m_min_rtt = -1.0f;
+
+	// Delivery rate samples, one per round trip
+	static const unsigned int BW_SAMPLES = 10;
+	float m_bw_samples[BW_SAMPLES];
+	unsigned int m_bw_sample_count = 0;
+	unsigned int m_bw_sample_next = 0;
+	u64 m_bw_interval_start = 0;
+	u32 m_bw_interval_bytes = 0;
+
+	// Pacing token bucket, in packets
+	float m_pacing_tokens = 0.0f;
+	u64 m_pacing_last = 0;
+};
+
+}
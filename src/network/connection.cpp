@@ -62,23 +62,23 @@ namespace con
 
 #define PING_TIMEOUT 5.0
 
-BufferedPacket makePacket(Address &address, const SharedBuffer<u8> &data,
+BufferedPacketPtr makePacket(Address &address, const SharedBuffer<u8> &data,
 		u32 protocol_id, session_t sender_peer_id, u8 channel)
 {
 	u32 packet_size = data.getSize() + BASE_HEADER_SIZE;
-	BufferedPacket p(packet_size);
-	p.address = address;
+	BufferedPacketPtr p = std::make_shared<BufferedPacket>(packet_size);
+	p->address = address;
 
-	writeU32(&p.data[0], protocol_id);
-	writeU16(&p.data[4], sender_peer_id);
-	writeU8(&p.data[6], channel);
+	writeU32(&p->data[0], protocol_id);
+	writeU16(&p->data[4], sender_peer_id);
+	writeU8(&p->data[6], channel);
 
-	memcpy(&p.data[BASE_HEADER_SIZE], *data, data.getSize());
+	memcpy(&p->data[BASE_HEADER_SIZE], *data, data.getSize());
 
 	return p;
 }
 
-SharedBuffer<u8> makeOriginalPacket(const SharedBuffer<u8> &data)
+SharedBuffer<u8> makeOriginalPacket(const Buffer<u8> &data)
 {
 	u32 header_size = 1;
 	u32 packet_size = data.getSize() + header_size;
@@ -92,7 +92,7 @@ SharedBuffer<u8> makeOriginalPacket(const SharedBuffer<u8> &data)
 }
 
 // Split data in chunks and add TYPE_SPLIT headers to them
-void makeSplitPacket(const SharedBuffer<u8> &data, u32 chunksize_max, u16 seqnum,
+void makeSplitPacket(const Buffer<u8> &data, u32 chunksize_max, u16 seqnum,
 		std::list<SharedBuffer<u8>> *chunks)
 {
 	// Chunk packets, containing the TYPE_SPLIT header
@@ -132,7 +132,7 @@ void makeSplitPacket(const SharedBuffer<u8> &data, u32 chunksize_max, u16 seqnum
 	}
 }
 
-void makeAutoSplitPacket(const SharedBuffer<u8> &data, u32 chunksize_max,
+void makeAutoSplitPacket(const Buffer<u8> &data, u32 chunksize_max,
 		u16 &split_seqnum, std::list<SharedBuffer<u8>> *list)
 {
 	u32 original_header_size = 1;
@@ -160,6 +160,26 @@ SharedBuffer<u8> makeReliablePacket(const SharedBuffer<u8> &data, u16 seqnum)
 	return b;
 }
 
+BufferedPacketPtr makeReliableBufferedPacket(Address &address,
+		const SharedBuffer<u8> &data, u16 seqnum, u32 protocol_id,
+		session_t sender_peer_id, u8 channel)
+{
+	u32 packet_size = data.getSize() + BASE_HEADER_SIZE + RELIABLE_HEADER_SIZE;
+	BufferedPacketPtr p = std::make_shared<BufferedPacket>(packet_size);
+	p->address = address;
+
+	writeU32(&p->data[0], protocol_id);
+	writeU16(&p->data[4], sender_peer_id);
+	writeU8(&p->data[6], channel);
+	writeU8(&p->data[BASE_HEADER_SIZE], PACKET_TYPE_RELIABLE);
+	writeU16(&p->data[BASE_HEADER_SIZE + 1], seqnum);
+
+	memcpy(&p->data[BASE_HEADER_SIZE + RELIABLE_HEADER_SIZE], *data,
+			data.getSize());
+
+	return p;
+}
+
 /*
 	ReliablePacketBuffer
 */
@@ -169,8 +189,8 @@ void ReliablePacketBuffer::print()
 	MutexAutoLock listlock(m_list_mutex);
 	LOG(dout_con<<"Dump of ReliablePacketBuffer:" << std::endl);
 	unsigned int index = 0;
-	for (BufferedPacket &bufferedPacket : m_list) {
-		u16 s = readU16(&(bufferedPacket.data[BASE_HEADER_SIZE+1]));
+	for (BufferedPacketPtr &bufferedPacket : m_list) {
+		u16 s = readU16(&(bufferedPacket->data[BASE_HEADER_SIZE+1]));
 		LOG(dout_con<<index<< ":" << s << std::endl);
 		index++;
 	}
@@ -190,10 +210,10 @@ u32 ReliablePacketBuffer::size()
 
 RPBSearchResult ReliablePacketBuffer::findPacket(u16 seqnum)
 {
-	std::list<BufferedPacket>::iterator i = m_list.begin();
+	std::list<BufferedPacketPtr>::iterator i = m_list.begin();
 	for(; i != m_list.end(); ++i)
 	{
-		u16 s = readU16(&(i->data[BASE_HEADER_SIZE+1]));
+		u16 s = readU16(&((*i)->data[BASE_HEADER_SIZE+1]));
 		if (s == seqnum)
 			break;
 	}
@@ -210,29 +230,29 @@ bool ReliablePacketBuffer::getFirstSeqnum(u16& result)
 	MutexAutoLock listlock(m_list_mutex);
 	if (m_list.empty())
 		return false;
-	const BufferedPacket &p = *m_list.begin();
-	result = readU16(&p.data[BASE_HEADER_SIZE + 1]);
+	const BufferedPacketPtr &p = *m_list.begin();
+	result = readU16(&p->data[BASE_HEADER_SIZE + 1]);
 	return true;
 }
 
-BufferedPacket ReliablePacketBuffer::popFirst()
+BufferedPacketPtr ReliablePacketBuffer::popFirst()
 {
 	MutexAutoLock listlock(m_list_mutex);
 	if (m_list.empty())
 		throw NotFoundException("Buffer is empty");
-	BufferedPacket p = *m_list.begin();
+	BufferedPacketPtr p = std::move(*m_list.begin());
 	m_list.erase(m_list.begin());
 
 	if (m_list.empty()) {
 		m_oldest_non_answered_ack = 0;
 	} else {
 		m_oldest_non_answered_ack =
-				readU16(&m_list.begin()->data[BASE_HEADER_SIZE + 1]);
+				readU16(&(*m_list.begin())->data[BASE_HEADER_SIZE + 1]);
 	}
 	return p;
 }
 
-BufferedPacket ReliablePacketBuffer::popSeqnum(u16 seqnum)
+BufferedPacketPtr ReliablePacketBuffer::popSeqnum(u16 seqnum)
 {
 	MutexAutoLock listlock(m_list_mutex);
 	RPBSearchResult r = findPacket(seqnum);
@@ -241,13 +261,13 @@ BufferedPacket ReliablePacketBuffer::popSeqnum(u16 seqnum)
 				<< " not found in reliable buffer"<<std::endl);
 		throw NotFoundException("seqnum not found in buffer");
 	}
-	BufferedPacket p = *r;
+	BufferedPacketPtr p = std::move(*r);
 
 
 	RPBSearchResult next = r;
 	++next;
 	if (next != notFound()) {
-		u16 s = readU16(&(next->data[BASE_HEADER_SIZE+1]));
+		u16 s = readU16(&((*next)->data[BASE_HEADER_SIZE+1]));
 		m_oldest_non_answered_ack = s;
 	}
 
@@ -257,14 +277,15 @@ BufferedPacket ReliablePacketBuffer::popSeqnum(u16 seqnum)
 		m_oldest_non_answered_ack = 0;
 	} else {
 		m_oldest_non_answered_ack =
-				readU16(&m_list.begin()->data[BASE_HEADER_SIZE + 1]);
+				readU16(&(*m_list.begin())->data[BASE_HEADER_SIZE + 1]);
 	}
 	return p;
 }
 
-void ReliablePacketBuffer::insert(BufferedPacket &p, u16 next_expected)
+void ReliablePacketBuffer::insert(const BufferedPacketPtr &p_ptr, u16 next_expected)
 {
 	MutexAutoLock listlock(m_list_mutex);
+	BufferedPacket &p = *p_ptr;
 	if (p.data.getSize() < BASE_HEADER_SIZE + 3) {
 		errorstream << "ReliablePacketBuffer::insert(): Invalid data size for "
 			"reliable packet" << std::endl;
@@ -295,16 +316,16 @@ void ReliablePacketBuffer::insert(BufferedPacket &p, u16 next_expected)
 	// If list is empty, just add it
 	if (m_list.empty())
 	{
-		m_list.push_back(p);
+		m_list.push_back(p_ptr);
 		m_oldest_non_answered_ack = seqnum;
 		// Done.
 		return;
 	}
 
 	// Otherwise find the right place
-	std::list<BufferedPacket>::iterator i = m_list.begin();
+	std::list<BufferedPacketPtr>::iterator i = m_list.begin();
 	// Find the first packet in the list which has a higher seqnum
-	u16 s = readU16(&(i->data[BASE_HEADER_SIZE+1]));
+	u16 s = readU16(&((*i)->data[BASE_HEADER_SIZE+1]));
 
 	/* case seqnum is smaller then next_expected seqnum */
 	/* this is true e.g. on wrap around */
@@ -312,7 +333,7 @@ void ReliablePacketBuffer::insert(BufferedPacket &p, u16 next_expected)
 		while(((s < seqnum) || (s >= next_expected)) && (i != m_list.end())) {
 			++i;
 			if (i != m_list.end())
-				s = readU16(&(i->data[BASE_HEADER_SIZE+1]));
+				s = readU16(&((*i)->data[BASE_HEADER_SIZE+1]));
 		}
 	}
 	/* non wrap around case (at least for incoming and next_expected */
@@ -321,17 +342,18 @@ void ReliablePacketBuffer::insert(BufferedPacket &p, u16 next_expected)
 		while(((s < seqnum) && (s >= next_expected)) && (i != m_list.end())) {
 			++i;
 			if (i != m_list.end())
-				s = readU16(&(i->data[BASE_HEADER_SIZE+1]));
+				s = readU16(&((*i)->data[BASE_HEADER_SIZE+1]));
 		}
 	}
 
 	if (s == seqnum) {
 		/* nothing to do this seems to be a resent packet */
 		/* for paranoia reason data should be compared */
+		BufferedPacket &old = **i;
 		if (
-			(readU16(&(i->data[BASE_HEADER_SIZE+1])) != seqnum) ||
-			(i->data.getSize() != p.data.getSize()) ||
-			(i->address != p.address)
+			(readU16(&(old.data[BASE_HEADER_SIZE+1])) != seqnum) ||
+			(old.data.getSize() != p.data.getSize()) ||
+			(old.address != p.address)
 			)
 		{
 			/* if this happens your maximum transfer window may be to big */
@@ -339,8 +361,8 @@ void ReliablePacketBuffer::insert(BufferedPacket &p, u16 next_expected)
 					"Duplicated seqnum %d non matching packet detected:\n",
 					seqnum);
 			fprintf(stderr, "Old: seqnum: %05d size: %04d, address: %s\n",
-					readU16(&(i->data[BASE_HEADER_SIZE+1])),i->data.getSize(),
-					i->address.serializeString().c_str());
+					readU16(&(old.data[BASE_HEADER_SIZE+1])),old.data.getSize(),
+					old.address.serializeString().c_str());
 			fprintf(stderr, "New: seqnum: %05d size: %04u, address: %s\n",
 					readU16(&(p.data[BASE_HEADER_SIZE+1])),p.data.getSize(),
 					p.address.serializeString().c_str());
@@ -349,35 +371,36 @@ void ReliablePacketBuffer::insert(BufferedPacket &p, u16 next_expected)
 	}
 	/* insert or push back */
 	else if (i != m_list.end()) {
-		m_list.insert(i, p);
+		m_list.insert(i, p_ptr);
 	} else {
-		m_list.push_back(p);
+		m_list.push_back(p_ptr);
 	}
 
 	/* update last packet number */
-	m_oldest_non_answered_ack = readU16(&(*m_list.begin()).data[BASE_HEADER_SIZE+1]);
+	m_oldest_non_answered_ack = readU16(&(*m_list.begin())->data[BASE_HEADER_SIZE+1]);
 }
 
 void ReliablePacketBuffer::incrementTimeouts(float dtime)
 {
 	MutexAutoLock listlock(m_list_mutex);
-	for (BufferedPacket &bufferedPacket : m_list) {
-		bufferedPacket.time += dtime;
-		bufferedPacket.totaltime += dtime;
+	for (BufferedPacketPtr &bufferedPacket : m_list) {
+		bufferedPacket->time += dtime;
+		bufferedPacket->totaltime += dtime;
 	}
 }
 
-std::list<BufferedPacket> ReliablePacketBuffer::getTimedOuts(float timeout,
+std::list<BufferedPacketPtr> ReliablePacketBuffer::getTimedOuts(float timeout,
 													unsigned int max_packets)
 {
 	MutexAutoLock listlock(m_list_mutex);
-	std::list<BufferedPacket> timed_outs;
-	for (BufferedPacket &bufferedPacket : m_list) {
-		if (bufferedPacket.time >= timeout) {
+	std::list<BufferedPacketPtr> timed_outs;
+	for (BufferedPacketPtr &bufferedPacket : m_list) {
+		if (bufferedPacket->time >= timeout) {
+			// the resend list shares the payload with the buffered packet
 			timed_outs.push_back(bufferedPacket);
 
 			//this packet will be sent right afterwards reset timeout here
-			bufferedPacket.time = 0.0f;
+			bufferedPacket->time = 0.0f;
 			if (timed_outs.size() >= max_packets)
 				break;
 		}
@@ -532,13 +555,14 @@ void IncomingSplitBuffer::removeUnreliableTimedOuts(float dtime, float timeout)
  */
 
 void ConnectionCommand::send(session_t peer_id_, u8 channelnum_, NetworkPacket *pkt,
-	bool reliable_)
+	bool reliable_, u8 priority_)
 {
 	type = CONNCMD_SEND;
 	peer_id = peer_id_;
 	channelnum = channelnum_;
 	data = pkt->oldForgePacket();
 	reliable = reliable_;
+	priority = priority_; // KIDSCODE - Send scheduler
 }
 
 /*
@@ -626,11 +650,10 @@ bool Channel::putBackSequenceNumber(u16 seqnum)
 	return false;
 }
 
-void Channel::UpdateBytesSent(unsigned int bytes, unsigned int packets)
+void Channel::UpdateBytesSent(unsigned int bytes)
 {
 	MutexAutoLock internal(m_internal_mutex);
 	current_bytes_transfered += bytes;
-	current_packet_successful += packets;
 }
 
 void Channel::UpdateBytesReceived(unsigned int bytes) {
@@ -645,87 +668,63 @@ void Channel::UpdateBytesLost(unsigned int bytes)
 }
 
 
-void Channel::UpdatePacketLossCounter(unsigned int count)
+void Channel::UpdatePacketLossCounter(unsigned int count, u64 last_sent)
 {
 	MutexAutoLock internal(m_internal_mutex);
-	current_packet_loss += count;
+	// >> KIDSCODE - Congestion control
+	m_congestion.onLoss(count, last_sent, porting::getTimeMs());
+	window_size = m_congestion.getWindow();
+	// << KIDSCODE
 }
 
-void Channel::UpdatePacketTooLateCounter()
+// >> KIDSCODE - Congestion control
+void Channel::UpdateAcked(unsigned int bytes, float rtt)
 {
 	MutexAutoLock internal(m_internal_mutex);
-	current_packet_too_late++;
+	m_congestion.onAck(bytes, rtt, porting::getTimeMs());
+	window_size = m_congestion.getWindow();
 }
 
-void Channel::UpdateTimers(float dtime)
+u32 Channel::getPacingBudget()
 {
-	bpm_counter += dtime;
-	packet_loss_counter += dtime;
-
-	if (packet_loss_counter > 1.0f) {
-		packet_loss_counter -= 1.0f;
+	MutexAutoLock internal(m_internal_mutex);
+	return m_congestion.getPacingBudget(porting::getTimeMs());
+}
 
-		unsigned int packet_loss = 11; /* use a neutral value for initialization */
-		unsigned int packets_successful = 0;
-		//unsigned int packet_too_late = 0;
+void Channel::UpdatePacketsSent(unsigned int packets)
+{
+	MutexAutoLock internal(m_internal_mutex);
+	for (unsigned int i = 0; i < packets; i++)
+		m_congestion.onPacketSent();
+}
 
-		bool reasonable_amount_of_data_transmitted = false;
+const float Channel::getBandwidthEstimateKB() const
+{
+	MutexAutoLock internal(m_internal_mutex);
+	float bandwidth = m_congestion.getBandwidth();
+	return bandwidth < 0.0f ? -1.0f : bandwidth / 1024.0f;
+}
 
-		{
-			MutexAutoLock internal(m_internal_mutex);
-			packet_loss = current_packet_loss;
-			//packet_too_late = current_packet_too_late;
-			packets_successful = current_packet_successful;
+void Channel::setWindowSize(unsigned int size)
+{
+	MutexAutoLock internal(m_internal_mutex);
+	m_congestion.reset(size);
+	window_size = m_congestion.getWindow();
+}
+// << KIDSCODE
 
-			if (current_bytes_transfered > (unsigned int) (window_size*512/2)) {
-				reasonable_amount_of_data_transmitted = true;
-			}
-			current_packet_loss = 0;
-			current_packet_too_late = 0;
-			current_packet_successful = 0;
-		}
+void Channel::UpdatePacketTooLateCounter()
+{
+	MutexAutoLock internal(m_internal_mutex);
+	current_packet_too_late++;
+}
 
-		/* dynamic window size */
-		float successful_to_lost_ratio = 0.0f;
-		bool done = false;
-
-		if (packets_successful > 0) {
-			successful_to_lost_ratio = packet_loss/packets_successful;
-		} else if (packet_loss > 0) {
-			window_size = std::max(
-					(window_size - 10),
-					MIN_RELIABLE_WINDOW_SIZE);
-			done = true;
-		}
+void Channel::UpdateTimers(float dtime)
+{
+	bpm_counter += dtime;
 
-		if (!done) {
-			if ((successful_to_lost_ratio < 0.01f) &&
-				(window_size < MAX_RELIABLE_WINDOW_SIZE)) {
-				/* don't even think about increasing if we didn't even
-				 * use major parts of our window */
-				if (reasonable_amount_of_data_transmitted)
-					window_size = std::min(
-							(window_size + 100),
-							MAX_RELIABLE_WINDOW_SIZE);
-			} else if ((successful_to_lost_ratio < 0.05f) &&
-					(window_size < MAX_RELIABLE_WINDOW_SIZE)) {
-				/* don't even think about increasing if we didn't even
-				 * use major parts of our window */
-				if (reasonable_amount_of_data_transmitted)
-					window_size = std::min(
-							(window_size + 50),
-							MAX_RELIABLE_WINDOW_SIZE);
-			} else if (successful_to_lost_ratio > 0.15f) {
-				window_size = std::max(
-						(window_size - 100),
-						MIN_RELIABLE_WINDOW_SIZE);
-			} else if (successful_to_lost_ratio > 0.1f) {
-				window_size = std::max(
-						(window_size - 50),
-						MIN_RELIABLE_WINDOW_SIZE);
-			}
-		}
-	}
+	// KIDSCODE - Congestion control: the window size is driven by the
+	// congestion controller on ACKs and losses
 
 	if (bpm_counter > 10.0f) {
 		{
@@ -945,7 +944,17 @@ void UDPPeer::reportRTT(float rtt)
 	}
 	RTTStatistics(rtt,"rudp",MAX_RELIABLE_WINDOW_SIZE*10);
 
-	float timeout = getStat(AVG_RTT) * RESEND_TIMEOUT_FACTOR;
+	// >> KIDSCODE - Congestion control
+	if (m_srtt < 0.0f) {
+		m_srtt = rtt;
+		m_rttvar = rtt / 2.0f;
+	} else {
+		m_rttvar = 0.75f * m_rttvar + 0.25f * std::fabs(m_srtt - rtt);
+		m_srtt = 0.875f * m_srtt + 0.125f * rtt;
+	}
+
+	float timeout = m_srtt + RESEND_TIMEOUT_FACTOR * m_rttvar;
+	// << KIDSCODE
 	if (timeout < RESEND_TIMEOUT_MIN)
 		timeout = RESEND_TIMEOUT_MIN;
 	if (timeout > RESEND_TIMEOUT_MAX)
@@ -955,6 +964,40 @@ void UDPPeer::reportRTT(float rtt)
 	resend_timeout = timeout;
 }
 
+// >> KIDSCODE - Congestion control
+void UDPPeer::backoffResendTimeout(u64 now)
+{
+	MutexAutoLock usage_lock(m_exclusive_access_mutex);
+
+	// Packets sent together time out together, back off once per timeout
+	if (now - m_last_backoff < resend_timeout * 1000.0f)
+		return;
+
+	m_last_backoff = now;
+	resend_timeout = std::min(resend_timeout * 2.0f, (float)RESEND_TIMEOUT_MAX);
+}
+// << KIDSCODE
+
+// >> KIDSCODE - Congestion control
+float UDPPeer::getStat(rtt_stat_type type) const
+{
+	float retval = 0.0f;
+
+	switch (type) {
+	case BANDWIDTH_ESTIMATE:
+		for (const Channel &channel : channels)
+			retval += std::max(channel.getBandwidthEstimateKB(), 0.0f);
+		return retval > 0.0f ? retval : -1.0f;
+	case CONGESTION_WINDOW:
+		for (const Channel &channel : channels)
+			retval += channel.getCongestionWindow();
+		return retval;
+	default:
+		return Peer::getStat(type);
+	}
+}
+// << KIDSCODE
+
 bool UDPPeer::Ping(float dtime,SharedBuffer<u8>& data)
 {
 	m_ping_timer += dtime;
@@ -1028,7 +1071,7 @@ bool UDPPeer::processReliableSendCommand(
 
 	bool have_sequence_number = true;
 	bool have_initial_sequence_number = false;
-	std::queue<BufferedPacket> toadd;
+	std::queue<BufferedPacketPtr> toadd;
 	volatile u16 initial_sequence_number = 0;
 
 	for (SharedBuffer<u8> &original : originals) {
@@ -1044,27 +1087,26 @@ bool UDPPeer::processReliableSendCommand(
 			have_initial_sequence_number = true;
 		}
 
-		SharedBuffer<u8> reliable = makeReliablePacket(original, seqnum);
-
-		// Add base headers and make a packet
-		BufferedPacket p = con::makePacket(address, reliable,
-				m_connection->GetProtocolID(), m_connection->GetPeerID(),
+		// Add reliable and base headers and make a packet
+		BufferedPacketPtr p = con::makeReliableBufferedPacket(address, original,
+				seqnum, m_connection->GetProtocolID(), m_connection->GetPeerID(),
 				c.channelnum);
+		p->priority = c.priority; // KIDSCODE - Send scheduler
 
-		toadd.push(p);
+		toadd.push(std::move(p));
 	}
 
 	if (have_sequence_number) {
 		volatile u16 pcount = 0;
 		while (!toadd.empty()) {
-			BufferedPacket p = toadd.front();
+			BufferedPacketPtr p = std::move(toadd.front());
 			toadd.pop();
 //			LOG(dout_con<<connection->getDesc()
 //					<< " queuing reliable packet for peer_id: " << c.peer_id
 //					<< " channel: " << (c.channelnum&0xFF)
 //					<< " seqnum: " << readU16(&p.data[BASE_HEADER_SIZE+1])
 //					<< std::endl)
-			chan.queued_reliables.push(p);
+			chan.queued_reliables.push(std::move(p));
 			pcount++;
 		}
 		sanity_check(chan.queued_reliables.size() < 0xFFFF);
@@ -1119,7 +1161,7 @@ void UDPPeer::RunCommandQueues(
 				(channel.queued_reliables.size() < maxtransfer) &&
 				(commands_processed < maxcommands)) {
 			try {
-				ConnectionCommand c = channel.queued_commands.front();
+				ConnectionCommand &c = channel.queued_commands.front();
 
 				LOG(dout_con << m_connection->getDesc()
 						<< " processing queued reliable command " << std::endl);
@@ -1298,10 +1340,10 @@ ConnectionEvent Connection::waitEvent(u32 timeout_ms)
 	}
 }
 
-void Connection::putCommand(ConnectionCommand &c)
+void Connection::putCommand(ConnectionCommand &&c)
 {
 	if (!m_shutting_down) {
-		m_command_queue.push_back(c);
+		m_command_queue.push_back(std::move(c));
 		m_sendThread->Trigger();
 	}
 }
@@ -1310,14 +1352,14 @@ void Connection::Serve(Address bind_addr)
 {
 	ConnectionCommand c;
 	c.serve(bind_addr);
-	putCommand(c);
+	putCommand(std::move(c));
 }
 
 void Connection::Connect(Address address)
 {
 	ConnectionCommand c;
 	c.connect(address);
-	putCommand(c);
+	putCommand(std::move(c));
 }
 
 bool Connection::Connected()
@@ -1341,7 +1383,7 @@ void Connection::Disconnect()
 {
 	ConnectionCommand c;
 	c.disconnect();
-	putCommand(c);
+	putCommand(std::move(c));
 }
 
 bool Connection::Receive(NetworkPacket *pkt, u32 timeout)
@@ -1400,14 +1442,14 @@ bool Connection::TryReceive(NetworkPacket *pkt)
 }
 
 void Connection::Send(session_t peer_id, u8 channelnum,
-		NetworkPacket *pkt, bool reliable)
+		NetworkPacket *pkt, bool reliable, u8 priority)
 {
 	assert(channelnum < CHANNEL_COUNT); // Pre-condition
 
 	ConnectionCommand c;
 
-	c.send(peer_id, channelnum, pkt, reliable);
-	putCommand(c);
+	c.send(peer_id, channelnum, pkt, reliable, priority);
+	putCommand(std::move(c));
 }
 
 Address Connection::GetPeerAddress(session_t peer_id)
@@ -1512,7 +1554,7 @@ u16 Connection::createPeer(Address& sender, MTProtocols protocol, int fd)
 	writeU8(&reply[1], CONTROLTYPE_SET_PEER_ID);
 	writeU16(&reply[2], peer_id_new);
 	cmd.createPeer(peer_id_new,reply);
-	putCommand(cmd);
+	putCommand(std::move(cmd));
 
 	// Create peer addition event
 	ConnectionEvent e;
@@ -1540,7 +1582,7 @@ void Connection::DisconnectPeer(session_t peer_id)
 {
 	ConnectionCommand discon;
 	discon.disconnect_peer(peer_id);
-	putCommand(discon);
+	putCommand(std::move(discon));
 }
 
 void Connection::sendAck(session_t peer_id, u8 channelnum, u16 seqnum)
@@ -1559,7 +1601,7 @@ void Connection::sendAck(session_t peer_id, u8 channelnum, u16 seqnum)
 	writeU16(&ack[2], seqnum);
 
 	c.ack(peer_id, channelnum, ack);
-	putCommand(c);
+	putCommand(std::move(c));
 	m_sendThread->Trigger();
 }
 
@@ -28,10 +28,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/thread.h"
 #include "util/numeric.h"
 #include "networkprotocol.h"
+#include "congestioncontrol.h" // KIDSCODE - Congestion control
 #include <iostream>
 #include <fstream>
+#include <atomic>
 #include <list>
 #include <map>
+#include <memory>
 
 class NetworkPacket;
 
@@ -99,21 +102,35 @@ struct BufferedPacket
 	float totaltime = 0.0f; // Seconds from buffering the packet
 	u64 absolute_send_time = -1;
 	Address address; // Sender or destination
-	unsigned int resend_count = 0;
+	// Shared by the send and receive threads
+	std::atomic<unsigned int> resend_count{0};
+	u8 priority = PRIORITY_NORMAL; // KIDSCODE - Send scheduler
 };
 
+/*
+	Buffered packets are shared between the send queue, the buffer of
+	packets waiting for an ACK and the resend list, so the payload is
+	only built once. The reference count is thread-safe.
+*/
+typedef std::shared_ptr<BufferedPacket> BufferedPacketPtr;
+
 // This adds the base headers to the data and makes a packet out of it
-BufferedPacket makePacket(Address &address, const SharedBuffer<u8> &data,
+BufferedPacketPtr makePacket(Address &address, const SharedBuffer<u8> &data,
 		u32 protocol_id, session_t sender_peer_id, u8 channel);
 
 // Depending on size, make a TYPE_ORIGINAL or TYPE_SPLIT packet
 // Increments split_seqnum if a split packet is made
-void makeAutoSplitPacket(const SharedBuffer<u8> &data, u32 chunksize_max,
+void makeAutoSplitPacket(const Buffer<u8> &data, u32 chunksize_max,
 		u16 &split_seqnum, std::list<SharedBuffer<u8>> *list);
 
 // Add the TYPE_RELIABLE header to the data
 SharedBuffer<u8> makeReliablePacket(const SharedBuffer<u8> &data, u16 seqnum);
 
+// Add the TYPE_RELIABLE and the base headers to the data, copying it only once
+BufferedPacketPtr makeReliableBufferedPacket(Address &address,
+		const SharedBuffer<u8> &data, u16 seqnum, u32 protocol_id,
+		session_t sender_peer_id, u8 channel);
+
 struct IncomingSplitPacket
 {
 	IncomingSplitPacket(u32 cc, bool r):
@@ -231,7 +248,7 @@ enum PacketType: u8 {
 	for fast access to the smallest one.
 */
 
-typedef std::list<BufferedPacket>::iterator RPBSearchResult;
+typedef std::list<BufferedPacketPtr>::iterator RPBSearchResult;
 
 class ReliablePacketBuffer
 {
@@ -240,12 +257,12 @@ class ReliablePacketBuffer
 
 	bool getFirstSeqnum(u16& result);
 
-	BufferedPacket popFirst();
-	BufferedPacket popSeqnum(u16 seqnum);
-	void insert(BufferedPacket &p, u16 next_expected);
+	BufferedPacketPtr popFirst();
+	BufferedPacketPtr popSeqnum(u16 seqnum);
+	void insert(const BufferedPacketPtr &p, u16 next_expected);
 
 	void incrementTimeouts(float dtime);
-	std::list<BufferedPacket> getTimedOuts(float timeout,
+	std::list<BufferedPacketPtr> getTimedOuts(float timeout,
 			unsigned int max_packets);
 
 	void print();
@@ -257,7 +274,7 @@ class ReliablePacketBuffer
 private:
 	RPBSearchResult findPacket(u16 seqnum); // does not perform locking
 
-	std::list<BufferedPacket> m_list;
+	std::list<BufferedPacketPtr> m_list;
 
 	u16 m_oldest_non_answered_ack;
 
@@ -327,20 +344,15 @@ struct ConnectionCommand
 	Buffer<u8> data;
 	bool reliable = false;
 	bool raw = false;
+	u8 priority = PRIORITY_NORMAL; // KIDSCODE - Send scheduler
 
 	ConnectionCommand() = default;
-	ConnectionCommand &operator=(const ConnectionCommand &other)
-	{
-		type = other.type;
-		address = other.address;
-		peer_id = other.peer_id;
-		channelnum = other.channelnum;
-		// We must copy the buffer here to prevent race condition
-		data = SharedBuffer<u8>(*other.data, other.data.getSize());
-		reliable = other.reliable;
-		raw = other.raw;
-		return *this;
-	}
+	// Copies deep-copy the data buffer as commands cross threads,
+	// moves hand it over without copying
+	ConnectionCommand(const ConnectionCommand &other) = default;
+	ConnectionCommand(ConnectionCommand &&other) = default;
+	ConnectionCommand &operator=(const ConnectionCommand &other) = default;
+	ConnectionCommand &operator=(ConnectionCommand &&other) = default;
 
 	void serve(Address address_)
 	{
@@ -362,7 +374,8 @@ struct ConnectionCommand
 		peer_id = peer_id_;
 	}
 
-	void send(session_t peer_id_, u8 channelnum_, NetworkPacket *pkt, bool reliable_);
+	void send(session_t peer_id_, u8 channelnum_, NetworkPacket *pkt, bool reliable_,
+			u8 priority_ = PRIORITY_NORMAL); // KIDSCODE - Send scheduler
 
 	void ack(session_t peer_id_, u8 channelnum_, const SharedBuffer<u8> &data_)
 	{
@@ -416,7 +429,7 @@ class Channel
 	ReliablePacketBuffer outgoing_reliables_sent;
 
 	//queued reliable packets
-	std::queue<BufferedPacket> queued_reliables;
+	std::queue<BufferedPacketPtr> queued_reliables;
 
 	//queue commands prior splitting to packets
 	std::deque<ConnectionCommand> queued_commands;
@@ -426,14 +439,26 @@ class Channel
 	Channel() = default;
 	~Channel() = default;
 
-	void UpdatePacketLossCounter(unsigned int count);
+	void UpdatePacketLossCounter(unsigned int count, u64 last_sent); // KIDSCODE - Congestion control
 	void UpdatePacketTooLateCounter();
-	void UpdateBytesSent(unsigned int bytes,unsigned int packages=1);
+	void UpdateBytesSent(unsigned int bytes);
 	void UpdateBytesLost(unsigned int bytes);
 	void UpdateBytesReceived(unsigned int bytes);
 
 	void UpdateTimers(float dtime);
 
+	// >> KIDSCODE - Congestion control
+	// A reliable packet was acknowledged, rtt < 0 if it was resent
+	void UpdateAcked(unsigned int bytes, float rtt);
+	// Reliable packets allowed on the wire now by the pacing rate
+	u32 getPacingBudget();
+	void UpdatePacketsSent(unsigned int packets = 1);
+
+	const float getBandwidthEstimateKB() const;
+	const float getCongestionWindow() const
+		{ MutexAutoLock lock(m_internal_mutex); return m_congestion.getWindow(); };
+	// << KIDSCODE
+
 	const float getCurrentDownloadRateKB()
 		{ MutexAutoLock lock(m_internal_mutex); return cur_kbps; };
 	const float getMaxDownloadRateKB()
@@ -458,20 +483,23 @@ class Channel
 
 	const unsigned int getWindowSize() const { return window_size; };
 
-	void setWindowSize(unsigned int size) { window_size = size; };
+	void setWindowSize(unsigned int size);
 private:
-	std::mutex m_internal_mutex;
+	mutable std::mutex m_internal_mutex;
 	int window_size = MIN_RELIABLE_WINDOW_SIZE;
 
+	// >> KIDSCODE - Congestion control
+	// window_size follows the congestion window of this controller
+	CongestionControl m_congestion {MIN_RELIABLE_WINDOW_SIZE,
+			MIN_RELIABLE_WINDOW_SIZE, MAX_RELIABLE_WINDOW_SIZE};
+	// << KIDSCODE
+
 	u16 next_incoming_seqnum = SEQNUM_INITIAL;
 
 	u16 next_outgoing_seqnum = SEQNUM_INITIAL;
 	u16 next_outgoing_split_seqnum = SEQNUM_INITIAL;
 
-	unsigned int current_packet_loss = 0;
 	unsigned int current_packet_too_late = 0;
-	unsigned int current_packet_successful = 0;
-	float packet_loss_counter = 0.0f;
 
 	unsigned int current_bytes_transfered = 0;
 	unsigned int current_bytes_received = 0;
@@ -556,6 +584,7 @@ class Peer {
 		bool isTimedOut(float timeout);
 
 		unsigned int m_increment_packets_remaining = 0;
+		unsigned int m_increment_bytes_remaining = 0; // KIDSCODE - Send scheduler
 
 		virtual u16 getNextSplitSequenceNumber(u8 channel) { return 0; };
 		virtual void setNextSplitSequenceNumber(u8 channel, u16 seqnum) {};
@@ -583,6 +612,8 @@ class Peer {
 					return m_rtt.jitter_max;
 				case AVG_JITTER:
 					return m_rtt.jitter_avg;
+				default: // KIDSCODE - Congestion control
+					break;
 			}
 			return -1;
 		}
@@ -649,6 +680,8 @@ class UDPPeer : public Peer
 
 	bool getAddress(MTProtocols type, Address& toset);
 
+	float getStat(rtt_stat_type type) const; // KIDSCODE - Congestion control
+
 	u16 getNextSplitSequenceNumber(u8 channel);
 	void setNextSplitSequenceNumber(u8 channel, u16 seqnum);
 
@@ -662,6 +695,12 @@ class UDPPeer : public Peer
 	*/
 	void reportRTT(float rtt);
 
+	// >> KIDSCODE - Congestion control
+	// Doubles the resend timeout when packets time out (RFC 6298 5.5), the
+	// next RTT sample computes it again
+	void backoffResendTimeout(u64 now);
+	// << KIDSCODE
+
 	void RunCommandQueues(
 					unsigned int max_packet_size,
 					unsigned int maxcommands,
@@ -680,6 +719,13 @@ class UDPPeer : public Peer
 	// This is changed dynamically
 	float resend_timeout = 0.5;
 
+	// >> KIDSCODE - Congestion control
+	// Smoothed RTT and RTT variation for the resend timeout (RFC 6298)
+	float m_srtt = -1.0f;
+	float m_rttvar = 0.0f;
+	u64 m_last_backoff = 0;
+	// << KIDSCODE
+
 	bool processReliableSendCommand(
 					ConnectionCommand &c,
 					unsigned int max_packet_size);
@@ -763,7 +809,7 @@ class Connection
 
 	/* Interface */
 	ConnectionEvent waitEvent(u32 timeout_ms);
-	void putCommand(ConnectionCommand &c);
+	void putCommand(ConnectionCommand &&c);
 
 	void SetTimeoutMs(u32 timeout) { m_bc_receive_timeout = timeout; }
 	void Serve(Address bind_addr);
@@ -772,7 +818,8 @@ class Connection
 	void Disconnect();
 	void Receive(NetworkPacket* pkt);
 	bool TryReceive(NetworkPacket *pkt);
-	void Send(session_t peer_id, u8 channelnum, NetworkPacket *pkt, bool reliable);
+	void Send(session_t peer_id, u8 channelnum, NetworkPacket *pkt, bool reliable,
+			u8 priority = PRIORITY_NORMAL); // KIDSCODE - Send scheduler
 	session_t GetPeerID() const { return m_peer_id; }
 	Address GetPeerAddress(session_t peer_id);
 	float getPeerStat(session_t peer_id, rtt_stat_type type);
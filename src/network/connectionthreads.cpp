@@ -48,11 +48,15 @@ std::mutex log_conthread_mutex;
 #undef DEBUG_CONNECTION_KBPS
 #endif
 
-/* maximum number of retries for reliable packets */
+/* maximum number of retries for reliable packets, the peer is only dropped
+   when the packet is also older than the peer timeout */
 #define MAX_RELIABLE_RETRY 5
 
 #define WINDOW_SIZE 5
 
+/* part of the per-peer budget kept for bulk transfers (1/n) */
+#define BULK_MIN_SHARE 4 // KIDSCODE - Send scheduler
+
 static session_t readPeerId(u8 *packetdata)
 {
 	return readU16(&packetdata[4]);
@@ -208,8 +212,9 @@ void ConnectionSendThread::runTimeouts(float dtime)
 
 		float resend_timeout = udpPeer->getResendTimeout();
 		bool retry_count_exceeded = false;
+		bool packets_lost = false; // KIDSCODE - Congestion control
 		for (Channel &channel : udpPeer->channels) {
-			std::list<BufferedPacket> timed_outs;
+			std::list<BufferedPacketPtr> timed_outs;
 
 			// Remove timed out incomplete unreliable split packets
 			channel.incoming_splits.removeUnreliableTimedOuts(dtime, m_timeout);
@@ -226,13 +231,18 @@ void ConnectionSendThread::runTimeouts(float dtime)
 			timed_outs = channel.outgoing_reliables_sent.getTimedOuts(resend_timeout,
 				(m_max_data_packets_per_iteration / numpeers));
 
-			channel.UpdatePacketLossCounter(timed_outs.size());
+			// >> KIDSCODE - Congestion control
+			u64 last_sent = 0;
+			for (const BufferedPacketPtr &k : timed_outs)
+				last_sent = std::max(last_sent, k->absolute_send_time);
+			channel.UpdatePacketLossCounter(timed_outs.size(), last_sent);
+			packets_lost |= !timed_outs.empty();
+			// << KIDSCODE
 			g_profiler->graphAdd("packets_lost", timed_outs.size());
 
 			m_iteration_packets_avaialble -= timed_outs.size();
 
-			for (std::list<BufferedPacket>::iterator k = timed_outs.begin();
-				k != timed_outs.end(); ++k) {
+			for (const BufferedPacketPtr &k : timed_outs) {
 				session_t peer_id = readPeerId(*(k->data));
 				u8 channelnum = readChannel(*(k->data));
 				u16 seqnum = readU16(&(k->data[BASE_HEADER_SIZE + 1]));
@@ -240,7 +250,9 @@ void ConnectionSendThread::runTimeouts(float dtime)
 				channel.UpdateBytesLost(k->data.getSize());
 				k->resend_count++;
 
-				if (k->resend_count > MAX_RELIABLE_RETRY) {
+				// Short losses don't drop the peer
+				if (k->resend_count > MAX_RELIABLE_RETRY &&
+						k->totaltime >= m_timeout) {
 					retry_count_exceeded = true;
 					timeouted_peers.push_back(peer->id);
 					/* no need to check additional packets if a single one did timeout*/
@@ -257,6 +269,7 @@ void ConnectionSendThread::runTimeouts(float dtime)
 					<< std::endl);
 
 				rawSend(*k);
+				channel.UpdatePacketsSent(); // KIDSCODE - Congestion control
 
 				// do not handle rtt here as we can't decide if this packet was
 				// lost or really takes more time to transmit
@@ -273,6 +286,11 @@ void ConnectionSendThread::runTimeouts(float dtime)
 		if (retry_count_exceeded)
 			continue;
 
+		// >> KIDSCODE - Congestion control
+		if (packets_lost)
+			udpPeer->backoffResendTimeout(porting::getTimeMs());
+		// << KIDSCODE
+
 		/* send ping if necessary */
 		if (udpPeer->Ping(dtime, data)) {
 			LOG(dout_con << m_connection->getDesc()
@@ -312,10 +330,10 @@ void ConnectionSendThread::rawSend(const BufferedPacket &packet)
 	}
 }
 
-void ConnectionSendThread::sendAsPacketReliable(BufferedPacket &p, Channel *channel)
+void ConnectionSendThread::sendAsPacketReliable(BufferedPacketPtr &p, Channel *channel)
 {
 	try {
-		p.absolute_send_time = porting::getTimeMs();
+		p->absolute_send_time = porting::getTimeMs();
 		// Buffer the packet
 		channel->outgoing_reliables_sent.insert(p,
 			(channel->readOutgoingSequenceNumber() - MAX_RELIABLE_WINDOW_SIZE)
@@ -328,7 +346,8 @@ void ConnectionSendThread::sendAsPacketReliable(BufferedPacket &p, Channel *chan
 	}
 
 	// Send the packet
-	rawSend(p);
+	rawSend(*p);
+	channel->UpdatePacketsSent(); // KIDSCODE - Congestion control
 }
 
 bool ConnectionSendThread::rawSendAsPacket(session_t peer_id, u8 channelnum,
@@ -351,13 +370,12 @@ bool ConnectionSendThread::rawSendAsPacket(session_t peer_id, u8 channelnum,
 		if (!have_sequence_number_for_raw_packet)
 			return false;
 
-		SharedBuffer<u8> reliable = makeReliablePacket(data, seqnum);
 		Address peer_address;
 		peer->getAddress(MTP_MINETEST_RELIABLE_UDP, peer_address);
 
-		// Add base headers and make a packet
-		BufferedPacket p = con::makePacket(peer_address, reliable,
-			m_connection->GetProtocolID(), m_connection->GetPeerID(),
+		// Add reliable and base headers and make a packet
+		BufferedPacketPtr p = con::makeReliableBufferedPacket(peer_address, data,
+			seqnum, m_connection->GetProtocolID(), m_connection->GetPeerID(),
 			channelnum);
 
 		// first check if our send window is already maxed out
@@ -375,19 +393,19 @@ bool ConnectionSendThread::rawSendAsPacket(session_t peer_id, u8 channelnum,
 			<< " INFO: queueing reliable packet for peer_id: " << peer_id
 			<< " channel: " << (u32)channelnum
 			<< " seqnum: " << seqnum << std::endl);
-		channel->queued_reliables.push(p);
+		channel->queued_reliables.push(std::move(p));
 		return false;
 	}
 
 	Address peer_address;
 	if (peer->getAddress(MTP_UDP, peer_address)) {
 		// Add base headers and make a packet
-		BufferedPacket p = con::makePacket(peer_address, data,
+		BufferedPacketPtr p = con::makePacket(peer_address, data,
 			m_connection->GetProtocolID(), m_connection->GetPeerID(),
 			channelnum);
 
 		// Send the packet
-		rawSend(p);
+		rawSend(*p);
 		return true;
 	}
 
@@ -578,7 +596,7 @@ void ConnectionSendThread::disconnect_peer(session_t peer_id)
 }
 
 void ConnectionSendThread::send(session_t peer_id, u8 channelnum,
-	const SharedBuffer<u8> &data)
+	const Buffer<u8> &data)
 {
 	assert(channelnum < CHANNEL_COUNT); // Pre-condition
 
@@ -618,7 +636,7 @@ void ConnectionSendThread::sendReliable(ConnectionCommand &c)
 	peer->PutReliableSendCommand(c, m_max_packet_size);
 }
 
-void ConnectionSendThread::sendToAll(u8 channelnum, const SharedBuffer<u8> &data)
+void ConnectionSendThread::sendToAll(u8 channelnum, const Buffer<u8> &data)
 {
 	std::list<session_t> peerids = m_connection->getPeerIDs();
 
@@ -649,6 +667,8 @@ void ConnectionSendThread::sendPackets(float dtime)
 
 	const unsigned int peer_packet_quota = m_iteration_packets_avaialble
 		/ MYMAX(peerIds.size(), 1);
+	// KIDSCODE - Send scheduler
+	const unsigned int peer_byte_quota = peer_packet_quota * m_max_packet_size;
 
 	for (session_t peerId : peerIds) {
 		PeerHelper peer = m_connection->getPeerNoEx(peerId);
@@ -660,6 +680,7 @@ void ConnectionSendThread::sendPackets(float dtime)
 			continue;
 		}
 		peer->m_increment_packets_remaining = peer_packet_quota;
+		peer->m_increment_bytes_remaining = peer_byte_quota; // KIDSCODE - Send scheduler
 
 		UDPPeer *udpPeer = dynamic_cast<UDPPeer *>(&peer);
 
@@ -712,22 +733,21 @@ void ConnectionSendThread::sendPackets(float dtime)
 				<< "\t\t\tqueued commands  : "
 				<< channel.queued_commands.size()
 				<< std::endl);
+		}
 
-			while (!channel.queued_reliables.empty() &&
-					channel.outgoing_reliables_sent.size()
-					< channel.getWindowSize() &&
-					peer->m_increment_packets_remaining > 0) {
-				BufferedPacket p = channel.queued_reliables.front();
-				channel.queued_reliables.pop();
-				LOG(dout_con << m_connection->getDesc()
-					<< " INFO: sending a queued reliable packet "
-					<< " channel: " << i
-					<< ", seqnum: " << readU16(&p.data[BASE_HEADER_SIZE + 1])
-					<< std::endl);
-				sendAsPacketReliable(p, &channel);
-				peer->m_increment_packets_remaining--;
-			}
+		// >> KIDSCODE - Send scheduler
+		// Interactive and normal packets first, bulk transfers are sent after
+		// the unreliable packets but keep a share of the budget
+		bool bulk_queued = false;
+		for (Channel &channel : udpPeer->channels) {
+			if (!channel.queued_reliables.empty() &&
+					channel.queued_reliables.back()->priority == PRIORITY_BULK)
+				bulk_queued = true;
 		}
+
+		sendQueuedReliables(udpPeer, PRIORITY_NORMAL,
+			bulk_queued ? peer_byte_quota / BULK_MIN_SHARE : 0);
+		// << KIDSCODE
 	}
 
 	if (!m_outgoing_queue.empty()) {
@@ -739,7 +759,7 @@ void ConnectionSendThread::sendPackets(float dtime)
 	unsigned int initial_queuesize = m_outgoing_queue.size();
 	/* send non reliable packets*/
 	for (unsigned int i = 0; i < initial_queuesize; i++) {
-		OutgoingPacket packet = m_outgoing_queue.front();
+		OutgoingPacket packet = std::move(m_outgoing_queue.front());
 		m_outgoing_queue.pop();
 
 		if (packet.reliable)
@@ -762,11 +782,23 @@ void ConnectionSendThread::sendPackets(float dtime)
 			if (peer->m_increment_packets_remaining > 0)
 				peer->m_increment_packets_remaining--;
 		} else {
-			m_outgoing_queue.push(packet);
-			pending_unreliable[packet.peer_id] = true;
+			session_t peer_id = packet.peer_id;
+			m_outgoing_queue.push(std::move(packet));
+			pending_unreliable[peer_id] = true;
 		}
 	}
 
+	// >> KIDSCODE - Send scheduler
+	for (session_t peerId : peerIds) {
+		PeerHelper peer = m_connection->getPeerNoEx(peerId);
+		UDPPeer *udpPeer = dynamic_cast<UDPPeer *>(&peer);
+		if (!udpPeer)
+			continue;
+
+		sendQueuedReliables(udpPeer, PRIORITY_BULK, 0);
+	}
+	// << KIDSCODE
+
 	if (peer_packet_quota > 0) {
 		for (session_t peerId : peerIds) {
 			PeerHelper peer = m_connection->getPeerNoEx(peerId);
@@ -787,6 +819,64 @@ void ConnectionSendThread::sendPackets(float dtime)
 	}
 }
 
+// >> KIDSCODE - Send scheduler
+void ConnectionSendThread::sendQueuedReliables(UDPPeer *peer, u8 max_priority,
+	unsigned int reserve)
+{
+	// Spread packets over the round trip (congestion control)
+	u32 pacing_budget[CHANNEL_COUNT];
+	for (unsigned int i = 0; i < CHANNEL_COUNT; i++)
+		pacing_budget[i] = peer->channels[i].getPacingBudget();
+
+	while (true) {
+		// Packets of a channel keep their order, pick the channel with the
+		// most urgent packet in front
+		unsigned int next = CHANNEL_COUNT;
+		u8 next_priority = max_priority + 1;
+
+		for (unsigned int i = 0; i < CHANNEL_COUNT; i++) {
+			Channel &channel = peer->channels[i];
+			if (channel.queued_reliables.empty() || pacing_budget[i] == 0 ||
+					channel.outgoing_reliables_sent.size()
+					>= channel.getWindowSize())
+				continue;
+
+			u8 priority = channel.queued_reliables.front()->priority;
+			if (priority < next_priority) {
+				next = i;
+				next_priority = priority;
+			}
+		}
+
+		if (next == CHANNEL_COUNT)
+			break;
+
+		Channel &channel = peer->channels[next];
+		u32 size = channel.queued_reliables.front()->data.getSize();
+
+		// Interactive packets are never held back by the budget
+		if (next_priority != PRIORITY_INTERACTIVE) {
+			if (peer->m_increment_packets_remaining == 0 ||
+					peer->m_increment_bytes_remaining < size + reserve)
+				break;
+			peer->m_increment_packets_remaining--;
+			peer->m_increment_bytes_remaining -= size;
+		}
+
+		BufferedPacketPtr p = std::move(channel.queued_reliables.front());
+		channel.queued_reliables.pop();
+		LOG(dout_con << m_connection->getDesc()
+			<< " INFO: sending a queued reliable packet "
+			<< " channel: " << next
+			<< ", priority: " << (int)next_priority
+			<< ", seqnum: " << readU16(&p->data[BASE_HEADER_SIZE + 1])
+			<< std::endl);
+		sendAsPacketReliable(p, &channel);
+		pacing_budget[next]--;
+	}
+}
+// << KIDSCODE
+
 void ConnectionSendThread::sendAsPacket(session_t peer_id, u8 channelnum,
 	const SharedBuffer<u8> &data, bool ack)
 {
@@ -1064,10 +1154,10 @@ bool ConnectionReceiveThread::checkIncomingBuffers(Channel *channel,
 	u16 firstseqnum = 0;
 	if (channel->incoming_reliables.getFirstSeqnum(firstseqnum)) {
 		if (firstseqnum == channel->readNextIncomingSeqNum()) {
-			BufferedPacket p = channel->incoming_reliables.popFirst();
-			peer_id = readPeerId(*p.data);
-			u8 channelnum = readChannel(*p.data);
-			u16 seqnum = readU16(&p.data[BASE_HEADER_SIZE + 1]);
+			BufferedPacketPtr p = channel->incoming_reliables.popFirst();
+			peer_id = readPeerId(*p->data);
+			u8 channelnum = readChannel(*p->data);
+			u16 seqnum = readU16(&p->data[BASE_HEADER_SIZE + 1]);
 
 			LOG(dout_con << m_connection->getDesc()
 				<< "UNBUFFERING TYPE_RELIABLE"
@@ -1080,8 +1170,8 @@ bool ConnectionReceiveThread::checkIncomingBuffers(Channel *channel,
 
 			u32 headers_size = BASE_HEADER_SIZE + RELIABLE_HEADER_SIZE;
 			// Get out the inside packet and re-process it
-			SharedBuffer<u8> payload(p.data.getSize() - headers_size);
-			memcpy(*payload, &p.data[headers_size], payload.getSize());
+			SharedBuffer<u8> payload(p->data.getSize() - headers_size);
+			memcpy(*payload, &p->data[headers_size], payload.getSize());
 
 			dst = processPacket(channel, payload, peer_id, channelnum, true);
 			return true;
@@ -1151,23 +1241,25 @@ SharedBuffer<u8> ConnectionReceiveThread::handlePacketType_Control(Channel *chan
 			<< seqnum << " ]" << std::endl);
 
 		try {
-			BufferedPacket p = channel->outgoing_reliables_sent.popSeqnum(seqnum);
+			BufferedPacketPtr p = channel->outgoing_reliables_sent.popSeqnum(seqnum);
+
+			float rtt = -1.0f; // KIDSCODE - Congestion control
 
 			// only calculate rtt from straight sent packets
-			if (p.resend_count == 0) {
+			if (p->resend_count == 0) {
 				// Get round trip time
 				u64 current_time = porting::getTimeMs();
 
 				// a overflow is quite unlikely but as it'd result in major
 				// rtt miscalculation we handle it here
-				if (current_time > p.absolute_send_time) {
-					float rtt = (current_time - p.absolute_send_time) / 1000.0;
+				if (current_time > p->absolute_send_time) {
+					rtt = (current_time - p->absolute_send_time) / 1000.0;
 
 					// Let peer calculate stuff according to it
 					// (avg_rtt and resend_timeout)
 					dynamic_cast<UDPPeer *>(peer)->reportRTT(rtt);
-				} else if (p.totaltime > 0) {
-					float rtt = p.totaltime;
+				} else if (p->totaltime > 0) {
+					rtt = p->totaltime;
 
 					// Let peer calculate stuff according to it
 					// (avg_rtt and resend_timeout)
@@ -1175,7 +1267,8 @@ SharedBuffer<u8> ConnectionReceiveThread::handlePacketType_Control(Channel *chan
 				}
 			}
 			// put bytes for max bandwidth calculation
-			channel->UpdateBytesSent(p.data.getSize(), 1);
+			channel->UpdateBytesSent(p->data.getSize());
+			channel->UpdateAcked(p->data.getSize(), rtt); // KIDSCODE - Congestion control
 			if (channel->outgoing_reliables_sent.size() == 0)
 				m_connection->TriggerSend();
 		} catch (NotFoundException &e) {
@@ -1251,14 +1344,14 @@ SharedBuffer<u8> ConnectionReceiveThread::handlePacketType_Split(Channel *channe
 	if (peer->getAddress(MTP_UDP, peer_address)) {
 		// We have to create a packet again for buffering
 		// This isn't actually too bad an idea.
-		BufferedPacket packet = makePacket(peer_address,
+		BufferedPacketPtr packet = makePacket(peer_address,
 			packetdata,
 			m_connection->GetProtocolID(),
 			peer->id,
 			channelnum);
 
 		// Buffer the packet
-		SharedBuffer<u8> data = peer->addSplitPacket(channelnum, packet, reliable);
+		SharedBuffer<u8> data = peer->addSplitPacket(channelnum, *packet, reliable);
 
 		if (data.getSize() != 0) {
 			LOG(dout_con << m_connection->getDesc()
@@ -1330,7 +1423,7 @@ SharedBuffer<u8> ConnectionReceiveThread::handlePacketType_Reliable(Channel *cha
 		// This one comes later, buffer it.
 		// Actually we have to make a packet to buffer one.
 		// Well, we have all the ingredients, so just do it.
-		BufferedPacket packet = con::makePacket(
+		BufferedPacketPtr packet = con::makePacket(
 			peer_address,
 			packetdata,
 			m_connection->GetProtocolID(),
@@ -1349,7 +1442,7 @@ SharedBuffer<u8> ConnectionReceiveThread::handlePacketType_Reliable(Channel *cha
 		} catch (IncomingDataCorruption &e) {
 			ConnectionCommand discon;
 			discon.disconnect_peer(peer->id);
-			m_connection->putCommand(discon);
+			m_connection->putCommand(std::move(discon));
 
 			LOG(derr_con << m_connection->getDesc()
 				<< "INVALID, TYPE_RELIABLE peer_id: " << peer->id
@@ -1370,7 +1463,7 @@ SharedBuffer<u8> ConnectionReceiveThread::handlePacketType_Reliable(Channel *cha
 	u16 queued_seqnum = 0;
 	if (channel->incoming_reliables.getFirstSeqnum(queued_seqnum)) {
 		if (queued_seqnum == seqnum) {
-			BufferedPacket queued_packet = channel->incoming_reliables.popFirst();
+			BufferedPacketPtr queued_packet = channel->incoming_reliables.popFirst();
 			/** TODO find a way to verify the new against the old packet */
 		}
 	}
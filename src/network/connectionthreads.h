@@ -61,9 +61,9 @@ class ConnectionSendThread : public Thread
 	void connect(Address address);
 	void disconnect();
 	void disconnect_peer(session_t peer_id);
-	void send(session_t peer_id, u8 channelnum, const SharedBuffer<u8> &data);
+	void send(session_t peer_id, u8 channelnum, const Buffer<u8> &data);
 	void sendReliable(ConnectionCommand &c);
-	void sendToAll(u8 channelnum, const SharedBuffer<u8> &data);
+	void sendToAll(u8 channelnum, const Buffer<u8> &data);
 	void sendToAllReliable(ConnectionCommand &c);
 
 	void sendPackets(float dtime);
@@ -71,7 +71,11 @@ class ConnectionSendThread : public Thread
 	void sendAsPacket(session_t peer_id, u8 channelnum, const SharedBuffer<u8> &data,
 			bool ack = false);
 
-	void sendAsPacketReliable(BufferedPacket &p, Channel *channel);
+	void sendAsPacketReliable(BufferedPacketPtr &p, Channel *channel);
+	// KIDSCODE - Send scheduler
+	// Sends queued reliables up to max_priority, most urgent first, keeping
+	// `reserve` bytes of the peer budget
+	void sendQueuedReliables(UDPPeer *peer, u8 max_priority, unsigned int reserve);
 
 	bool packetsQueued();
 
@@ -116,7 +116,8 @@ class NetworkPacket
 	NetworkPacket &operator<<(video::SColor src);
 
 	// Temp, we remove SharedBuffer when migration finished
-	SharedBuffer<u8> oldForgePacket();
+	// Returns the serialized command and data, the buffer is moved out
+	Buffer<u8> oldForgePacket();
 
 private:
 	void checkReadOffset(u32 from_offset, u32 field_size);
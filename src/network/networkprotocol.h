@@ -792,6 +792,7 @@ enum ToServerCommand
 		u16 minimum supported network protocol version
 		u16 maximum supported network protocol version
 		std::string player name
+		u32 fork capabilities (KIDSCODE, optional, see KidscodeCapability)
 	*/
 
 	TOSERVER_INIT_LEGACY = 0x10, // Obsolete
@@ -1079,3 +1080,27 @@ enum InteractAction : u8
 	INTERACT_USE,               // 4: use item
 	INTERACT_ACTIVATE           // 5: rightclick air ("activate")
 };
+
+// >> KIDSCODE - Fork capabilities
+// Fork-specific features a client announces at the end of TOSERVER_INIT.
+// Upstream clients do not send the field, so the server never uses these
+// features with them whatever their protocol version.
+enum KidscodeCapability : u32
+{
+	KIDSCODE_CAP_COMPACT_POSITION = 1 << 0, // AO_CMD_UPDATE_POSITION_COMPACT
+};
+
+#define KIDSCODE_CLIENT_CAPABILITIES KIDSCODE_CAP_COMPACT_POSITION
+// << KIDSCODE
+
+// >> KIDSCODE - Send scheduler
+// Scheduling class of outgoing packets, from most to least urgent.
+// Packets of a channel are always sent in order, the priority only picks
+// which channel sends next.
+enum PacketPriority : u8
+{
+	PRIORITY_INTERACTIVE, // player feedback, sent before anything else
+	PRIORITY_NORMAL,
+	PRIORITY_BULK,        // mapblocks and media, sent with the remaining budget
+};
+// << KIDSCODE
@@ -31,7 +31,11 @@ typedef enum
 	AVG_RTT,
 	MIN_JITTER,
 	MAX_JITTER,
-	AVG_JITTER
+	AVG_JITTER,
+	// >> KIDSCODE - Congestion control
+	BANDWIDTH_ESTIMATE, // kB/s, summed over channels
+	CONGESTION_WINDOW // packets, summed over channels
+	// << KIDSCODE
 } rtt_stat_type;
 
 class Peer;
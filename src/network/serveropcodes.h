@@ -43,6 +43,7 @@ struct ClientCommandFactory
 	const char* name;
 	u8 channel;
 	bool reliable;
+	PacketPriority priority; // KIDSCODE - Send scheduler
 };
 
 extern const ToServerCommandHandler toServerCommandTable[TOSERVER_NUM_MSG_TYPES];
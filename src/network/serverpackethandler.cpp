@@ -103,6 +103,11 @@ void Server::handleCommand_Init(NetworkPacket* pkt)
 	*pkt >> client_max >> supp_compr_modes >> min_net_proto_version
 			>> max_net_proto_version >> playerName;
 
+	// >> KIDSCODE - Fork capabilities
+	if (pkt->getRemainingBytes() >= 4)
+		*pkt >> client->kidscode_caps;
+	// << KIDSCODE
+
 	u8 our_max = SER_FMT_VER_HIGHEST_READ;
 	// Use the highest version supported by both
 	u8 depl_serial_v = std::min(client_max, our_max);
@@ -283,6 +283,16 @@ void TextureSettings::readSettings()
 
 	use_normal_texture = enable_shaders &&
 		(enable_bumpmapping || enable_parallax_occlusion);
+	// >> KIDSCODE - Texture atlas
+	// The node shader picks the texels in the atlas, neighbour textures
+	// would bleed in with filtering or mipmapping
+	texture_atlas = enable_shaders && !use_normal_texture &&
+		g_settings->getBool("texture_atlas") &&
+		!g_settings->getBool("mip_map") &&
+		!g_settings->getBool("bilinear_filter") &&
+		!g_settings->getBool("trilinear_filter") &&
+		!g_settings->getBool("anisotropic_filter");
+	// << KIDSCODE
 	if (leaves_style_str == "fancy") {
 		leaves_style = LEAVES_FANCY;
 	} else if (leaves_style_str == "simple") {
@@ -1377,6 +1387,29 @@ void NodeDefManager::updateTextures(IGameDef *gamedef,
 #endif
 }
 
+// >> KIDSCODE - Texture atlas
+void NodeDefManager::getAtlasTextureIds(std::vector<u32> *ids) const
+{
+#ifndef SERVER
+	auto add_tile = [ids](const TileSpec &tile) {
+		for (const TileLayer &layer : tile.layers) {
+			if (layer.texture_id != 0 &&
+					!(layer.material_flags & MATERIAL_FLAG_ANIMATION))
+				ids->push_back(layer.texture_id);
+		}
+	};
+	for (const ContentFeatures &f : m_content_features) {
+		if (f.name.empty())
+			continue;
+		for (const TileSpec &tile : f.tiles)
+			add_tile(tile);
+		for (const TileSpec &tile : f.special_tiles)
+			add_tile(tile);
+	}
+#endif
+}
+// << KIDSCODE
+
 void NodeDefManager::serialize(std::ostream &os, u16 protocol_version) const
 {
 	writeU8(os, 1); // version
@@ -161,6 +161,7 @@ class TextureSettings {
 	bool use_normal_texture;
 	bool enable_mesh_cache;
 	bool enable_minimap;
+	bool texture_atlas; // KIDSCODE - Texture atlas
 
 	TextureSettings() = default;
 
@@ -492,6 +493,17 @@ class NodeDefManager {
 				m_content_features[c] : m_content_features[CONTENT_UNKNOWN];
 	}
 
+	// >> KIDSCODE - VoxelManip buffers
+	/*!
+	 * Returns true if the given content type has a definition.
+	 * @param c content type of a node
+	 */
+	inline bool isRegistered(content_t c) const {
+		return c < m_content_features.size() &&
+			!m_content_features[c].name.empty();
+	}
+	// << KIDSCODE
+
 	/*!
 	 * Returns the properties of the given node.
 	 * @param n a map node
@@ -623,6 +635,14 @@ class NodeDefManager {
 		void (*progress_cbk)(void *progress_args, u32 progress, u32 max_progress),
 		void *progress_cbk_args);
 
+	// >> KIDSCODE - Texture atlas
+	/*!
+	 * Only the client uses this. Lists the texture ids of the node tiles
+	 * that can be drawn from a texture atlas, i.e. not animated.
+	 */
+	void getAtlasTextureIds(std::vector<u32> *ids) const;
+	// << KIDSCODE
+
 	/*!
 	 * Writes the content of this manager to the given output stream.
 	 * @param protocol_version serialization version of ContentFeatures
@@ -63,7 +63,7 @@ void NodeTimerList::serialize(std::ostream &os, u8 map_format_version) const
 	for (const auto &timer : m_timers) {
 		NodeTimer t = timer.second;
 		NodeTimer nt = NodeTimer(t.timeout,
-			t.timeout - (f32)(timer.first - m_time), t.position);
+			t.timeout - (f32)(timer.first - getTime()), t.position); // KIDSCODE - Node timer scheduling
 		v3s16 p = t.position;
 
 		u16 p16 = p.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE + p.Y * MAP_BLOCKSIZE + p.X;
@@ -128,15 +128,22 @@ void NodeTimerList::deSerialize(std::istream &is, u8 map_format_version)
 std::vector<NodeTimer> NodeTimerList::step(float dtime)
 {
 	std::vector<NodeTimer> elapsed_timers;
-	m_time += dtime;
-	if (m_next_trigger_time == -1. || m_time < m_next_trigger_time) {
+	// >> KIDSCODE - Node timer scheduling
+	if (m_scheduler)
+		m_time_offset -= dtime;
+	else
+		m_time += dtime;
+	double now = getTime();
+	if (m_next_trigger_time == -1. || now < m_next_trigger_time) {
+		reschedule(); // KIDSCODE - Node timer scheduling
 		return elapsed_timers;
 	}
 	std::multimap<double, NodeTimer>::iterator i = m_timers.begin();
 	// Process timers
-	for (; i != m_timers.end() && i->first <= m_time; ++i) {
+	for (; i != m_timers.end() && i->first <= now; ++i) {
 		NodeTimer t = i->second;
-		t.elapsed = t.timeout + (f32)(m_time - i->first);
+		t.elapsed = t.timeout + (f32)(now - i->first);
+	// << KIDSCODE
 		elapsed_timers.push_back(t);
 		m_iterators.erase(t.position);
 	}
@@ -146,5 +153,55 @@ std::vector<NodeTimer> NodeTimerList::step(float dtime)
 		m_next_trigger_time = -1.;
 	else
 		m_next_trigger_time = m_timers.begin()->first;
+	reschedule(); // KIDSCODE - Node timer scheduling
 	return elapsed_timers;
 }
+
+// >> KIDSCODE - Node timer scheduling
+void NodeTimerList::attach(NodeTimerScheduler *scheduler, v3s16 blockpos)
+{
+	if (m_scheduler == scheduler)
+		return;
+	detach();
+
+	m_scheduler = scheduler;
+	m_blockpos = blockpos;
+	m_time_offset = scheduler->getTime() - m_time;
+	m_scheduled_time = -1.;
+	reschedule();
+}
+
+void NodeTimerList::detach()
+{
+	if (!m_scheduler)
+		return;
+
+	m_time = getTime();
+	m_scheduler = nullptr;
+	// Entries left in the scheduler are outdated now
+	m_scheduled_time = -1.;
+}
+
+bool NodeTimerList::popScheduled(double time)
+{
+	if (!m_scheduler || time != m_scheduled_time)
+		return false;
+
+	m_scheduled_time = -1.;
+	return true;
+}
+
+void NodeTimerList::reschedule()
+{
+	if (!m_scheduler || m_next_trigger_time == -1.)
+		return;
+
+	// An entry that is due earlier already wakes the block up in time
+	double time = m_next_trigger_time + m_time_offset;
+	if (m_scheduled_time != -1. && m_scheduled_time <= time)
+		return;
+
+	m_scheduler->schedule(m_blockpos, time);
+	m_scheduled_time = time;
+}
+// << KIDSCODE
@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irr_v3d.h"
 #include <iostream>
 #include <map>
+#include <queue> // KIDSCODE - Node timer scheduling
 #include <vector>
 
 /*
@@ -50,6 +51,47 @@ class NodeTimer
 	v3s16 position;
 };
 
+// >> KIDSCODE - Node timer scheduling
+/*
+	Clock shared by the timer lists of all active blocks, with a queue of
+	the blocks by the time of their next timer. Only the blocks that have
+	a timer due need to be stepped.
+	Entries can be outdated, NodeTimerList::popScheduled() tells.
+*/
+
+class NodeTimerScheduler
+{
+public:
+	double getTime() const { return m_time; }
+	void step(float dtime) { m_time += dtime; }
+
+	void schedule(v3s16 blockpos, double time) {
+		m_queue.push(Entry(time, blockpos));
+	}
+	// Pops an entry that is due, returns false if there is none
+	bool popDue(v3s16 *blockpos, double *time) {
+		if (m_queue.empty() || m_queue.top().first > m_time)
+			return false;
+		*time = m_queue.top().first;
+		*blockpos = m_queue.top().second;
+		m_queue.pop();
+		return true;
+	}
+	size_t size() const { return m_queue.size(); }
+
+private:
+	typedef std::pair<double, v3s16> Entry;
+	struct LaterFirst {
+		bool operator()(const Entry &a, const Entry &b) const {
+			return a.first > b.first;
+		}
+	};
+
+	double m_time = 0.0;
+	std::priority_queue<Entry, std::vector<Entry>, LaterFirst> m_queue;
+};
+// << KIDSCODE
+
 /*
 	List of timers of all the nodes of a block
 */
@@ -70,7 +112,7 @@ class NodeTimerList
 		if (n == m_iterators.end())
 			return NodeTimer();
 		NodeTimer t = n->second->second;
-		t.elapsed = t.timeout - (n->second->first - m_time);
+		t.elapsed = t.timeout - (n->second->first - getTime()); // KIDSCODE - Node timer scheduling
 		return t;
 	}
 	// Deletes timer
@@ -95,7 +137,7 @@ class NodeTimerList
 	// Undefined behaviour if there already is a timer
 	void insert(NodeTimer timer) {
 		v3s16 p = timer.position;
-		double trigger_time = m_time + (double)(timer.timeout - timer.elapsed);
+		double trigger_time = getTime() + (double)(timer.timeout - timer.elapsed); // KIDSCODE - Node timer scheduling
 		std::multimap<double, NodeTimer>::iterator it =
 			m_timers.insert(std::pair<double, NodeTimer>(
 				trigger_time, timer
@@ -104,6 +146,7 @@ class NodeTimerList
 			std::pair<v3s16, std::multimap<double, NodeTimer>::iterator>(p, it));
 		if (m_next_trigger_time == -1. || trigger_time < m_next_trigger_time)
 			m_next_trigger_time = trigger_time;
+		reschedule(); // KIDSCODE - Node timer scheduling
 	}
 	// Deletes old timer and sets a new one
 	inline void set(const NodeTimer &timer) {
@@ -120,9 +163,34 @@ class NodeTimerList
 	// Move forward in time, returns elapsed timers
 	std::vector<NodeTimer> step(float dtime);
 
+	// >> KIDSCODE - Node timer scheduling
+	// While attached, the list follows the clock of the scheduler and
+	// keeps an entry for its next timer in it
+	void attach(NodeTimerScheduler *scheduler, v3s16 blockpos);
+	void detach();
+	bool isAttached() const { return m_scheduler != nullptr; }
+	// Accepts an entry popped from the scheduler, false if it is outdated
+	bool popScheduled(double time);
+	// << KIDSCODE
+
 private:
+	// >> KIDSCODE - Node timer scheduling
+	double getTime() const {
+		return m_scheduler ? m_scheduler->getTime() - m_time_offset : m_time;
+	}
+	void reschedule();
+	// << KIDSCODE
+
 	std::multimap<double, NodeTimer> m_timers;
 	std::map<v3s16, std::multimap<double, NodeTimer>::iterator> m_iterators;
 	double m_next_trigger_time = -1.0;
 	double m_time = 0.0;
+	// >> KIDSCODE - Node timer scheduling
+	NodeTimerScheduler *m_scheduler = nullptr;
+	v3s16 m_blockpos;
+	// Scheduler time - own time while attached
+	double m_time_offset = 0.0;
+	// Scheduler time of the live entry, -1 if there is none
+	double m_scheduled_time = -1.0;
+	// << KIDSCODE
 };
@@ -0,0 +1,180 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "object_position.h"
+#include <cmath>
+#include "activeobject.h"
+#include "constants.h"
+#include "util/numeric.h"
+#include "util/serialize.h"
+
+#define POS_FLAG_VELOCITY       0x01
+#define POS_FLAG_ACCELERATION   0x02
+#define POS_FLAG_ROTATION       0x04
+#define POS_FLAG_INTERPOLATE    0x08
+#define POS_FLAG_MOVEMENT_END   0x10
+
+// Fixed point scales
+#define BLOCK_SIZE_BS ((float)(MAP_BLOCKSIZE * BS))
+#define OFFSET_SCALE (65536.0f / BLOCK_SIZE_BS)
+#define VECTOR_SCALE 16.0f
+#define ROTATION_SCALE (65536.0f / 360.0f)
+#define INTERVAL_SCALE 100.0f
+
+// False for NaN and infinities too
+static bool inS16Range(const v3f &v)
+{
+	return std::fabs(v.X) <= S16_MAX && std::fabs(v.Y) <= S16_MAX &&
+		std::fabs(v.Z) <= S16_MAX;
+}
+
+static bool toFixedS16(const v3f &v, v3s16 *result)
+{
+	v3f scaled = v * VECTOR_SCALE;
+	if (!inS16Range(scaled))
+		return false;
+
+	*result = v3s16(std::round(scaled.X), std::round(scaled.Y),
+		std::round(scaled.Z));
+	return true;
+}
+
+static v3f fromFixedS16(const v3s16 &v)
+{
+	return v3f(v.X, v.Y, v.Z) / VECTOR_SCALE;
+}
+
+static u16 toFixedRotation(f32 degrees)
+{
+	return (u16)((s32)std::round(wrapDegrees_0_360(degrees) * ROTATION_SCALE)
+		& 0xFFFF);
+}
+
+void ObjectPositionUpdate::serialize(std::ostream &os) const
+{
+	// command
+	writeU8(os, AO_CMD_UPDATE_POSITION);
+	// pos
+	writeV3F32(os, position);
+	// velocity
+	writeV3F32(os, velocity);
+	// acceleration
+	writeV3F32(os, acceleration);
+	// rotation
+	writeV3F32(os, rotation);
+	// do_interpolate
+	writeU8(os, do_interpolate);
+	// is_end_position (for interpolation)
+	writeU8(os, is_movement_end);
+	// update_interval (for interpolation)
+	writeF32(os, update_interval);
+}
+
+bool ObjectPositionUpdate::serializeCompact(std::ostream &os) const
+{
+	v3f block_f(
+		std::floor(position.X / BLOCK_SIZE_BS),
+		std::floor(position.Y / BLOCK_SIZE_BS),
+		std::floor(position.Z / BLOCK_SIZE_BS));
+	// Converting an out of range float to s16 is undefined
+	if (!inS16Range(block_f) || block_f.X < S16_MIN ||
+			block_f.Y < S16_MIN || block_f.Z < S16_MIN)
+		return false;
+
+	v3s16 block(block_f.X, block_f.Y, block_f.Z);
+	v3f offset = (position - intToFloat(block, BLOCK_SIZE_BS)) * OFFSET_SCALE;
+
+	v3s16 fixed_velocity, fixed_acceleration;
+	if (!toFixedS16(velocity, &fixed_velocity) ||
+			!toFixedS16(acceleration, &fixed_acceleration) ||
+			update_interval < 0.0f ||
+			update_interval * INTERVAL_SCALE > U8_MAX)
+		return false;
+
+	u8 flags = 0;
+	if (fixed_velocity != v3s16(0, 0, 0))
+		flags |= POS_FLAG_VELOCITY;
+	if (fixed_acceleration != v3s16(0, 0, 0))
+		flags |= POS_FLAG_ACCELERATION;
+	if (rotation != v3f(0.0f, 0.0f, 0.0f))
+		flags |= POS_FLAG_ROTATION;
+	if (do_interpolate)
+		flags |= POS_FLAG_INTERPOLATE;
+	if (is_movement_end)
+		flags |= POS_FLAG_MOVEMENT_END;
+
+	writeU8(os, AO_CMD_UPDATE_POSITION_COMPACT);
+	writeU8(os, flags);
+	writeV3S16(os, block);
+	// Offset in the block, rounding up to the block size stays in the block
+	writeU16(os, MYMIN(std::round(offset.X), U16_MAX));
+	writeU16(os, MYMIN(std::round(offset.Y), U16_MAX));
+	writeU16(os, MYMIN(std::round(offset.Z), U16_MAX));
+	if (flags & POS_FLAG_VELOCITY)
+		writeV3S16(os, fixed_velocity);
+	if (flags & POS_FLAG_ACCELERATION)
+		writeV3S16(os, fixed_acceleration);
+	if (flags & POS_FLAG_ROTATION) {
+		writeU16(os, toFixedRotation(rotation.X));
+		writeU16(os, toFixedRotation(rotation.Y));
+		writeU16(os, toFixedRotation(rotation.Z));
+	}
+	writeU8(os, std::round(update_interval * INTERVAL_SCALE));
+	return true;
+}
+
+void ObjectPositionUpdate::deSerialize(std::istream &is, u8 cmd)
+{
+	if (cmd == AO_CMD_UPDATE_POSITION) {
+		position = readV3F32(is);
+		velocity = readV3F32(is);
+		acceleration = readV3F32(is);
+		rotation = readV3F32(is);
+		do_interpolate = readU8(is);
+		is_movement_end = readU8(is);
+		update_interval = readF32(is);
+		return;
+	}
+
+	u8 flags = readU8(is);
+	v3s16 block = readV3S16(is);
+	position = intToFloat(block, BLOCK_SIZE_BS);
+	position.X += readU16(is) / OFFSET_SCALE;
+	position.Y += readU16(is) / OFFSET_SCALE;
+	position.Z += readU16(is) / OFFSET_SCALE;
+
+	velocity = v3f(0.0f, 0.0f, 0.0f);
+	if (flags & POS_FLAG_VELOCITY)
+		velocity = fromFixedS16(readV3S16(is));
+
+	acceleration = v3f(0.0f, 0.0f, 0.0f);
+	if (flags & POS_FLAG_ACCELERATION)
+		acceleration = fromFixedS16(readV3S16(is));
+
+	rotation = v3f(0.0f, 0.0f, 0.0f);
+	if (flags & POS_FLAG_ROTATION) {
+		rotation.X = readU16(is) / ROTATION_SCALE;
+		rotation.Y = readU16(is) / ROTATION_SCALE;
+		rotation.Z = readU16(is) / ROTATION_SCALE;
+	}
+
+	do_interpolate = flags & POS_FLAG_INTERPOLATE;
+	is_movement_end = flags & POS_FLAG_MOVEMENT_END;
+	update_interval = readU8(is) / INTERVAL_SCALE;
+}
@@ -0,0 +1,50 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <iostream>
+#include "irrlichttypes_bloated.h"
+
+/*
+	Contents of the AO_CMD_UPDATE_POSITION and
+	AO_CMD_UPDATE_POSITION_COMPACT object messages.
+
+	The compact form stores the position as fixed point inside its mapblock,
+	velocity and acceleration in 1/16 BS and rotation in 1/65536 turn, and
+	leaves out the vectors that are zero. It takes 15 to 33 bytes instead
+	of 55. It is only sent to clients announcing KIDSCODE_CAP_COMPACT_POSITION.
+*/
+struct ObjectPositionUpdate
+{
+	v3f position;
+	v3f velocity;
+	v3f acceleration;
+	v3f rotation;
+	bool do_interpolate = false;
+	bool is_movement_end = false;
+	f32 update_interval = 0.0f;
+
+	// Writes the whole message, including the command
+	void serialize(std::ostream &os) const;
+	// Returns false, and writes nothing, if a value can't be represented
+	bool serializeCompact(std::ostream &os) const;
+	// Reads the message of either form after the command byte
+	void deSerialize(std::istream &is, u8 cmd);
+};
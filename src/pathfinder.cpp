@@ -25,6 +25,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "pathfinder.h"
 #include "map.h"
 #include "nodedef.h"
+// >> KIDSCODE - Pathfinder cache
+#include <algorithm>
+#include <set>
+#include "mapblock.h"
+// << KIDSCODE
 
 //#define PATHFINDER_DEBUG
 //#define PATHFINDER_CALC_TIME
@@ -59,6 +64,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define PATHFINDER_MAX_WAYPOINTS 700
 
+// >> KIDSCODE - Pathfinder cache
+/* maximum number of blocks kept in the navigation cache, about 4kB each */
+#define PATHFINDER_CACHE_MAX_BLOCKS 1024
+
+/* minimum distance in blocks between start and end for the block search */
+#define PATHFINDER_CORRIDOR_MIN_BLOCKS 2
+// << KIDSCODE
+
 /******************************************************************************/
 /* Class definitions                                                          */
 /******************************************************************************/
@@ -180,7 +193,7 @@ class Pathfinder {
 
 public:
 	Pathfinder() = delete;
-	Pathfinder(Map *map, const NodeDefManager *ndef) : m_map(map), m_ndef(ndef) {}
+	Pathfinder(PathfinderCache *cache) : m_cache(cache) {} // KIDSCODE - Pathfinder cache
 
 	~Pathfinder();
 
@@ -301,6 +314,36 @@ class Pathfinder {
 	 */
 	v3s16         walkDownwards(v3s16 pos, unsigned int max_down);
 
+	// >> KIDSCODE - Hierarchical pathfinding
+	/**
+	 * search a path in the graph of the blocks within the search area,
+	 * two blocks being connected if free nodes face each other on their
+	 * common face. The blocks along that path and their neighbours make
+	 * the corridor the node search is limited to.
+	 * @param source start position
+	 * @param destination end position
+	 * @return false if no path can possibly exist
+	 */
+	bool          findCorridor(v3s16 source, v3s16 destination);
+
+	/**
+	 * check if a node may be part of the path
+	 * @param pos real world position
+	 * @return true if there is no corridor or pos is inside it
+	 */
+	bool          isInCorridor(v3s16 pos);
+
+	/**
+	 * search the nodes for a path, using a new node container
+	 * @param isource start position (index pos)
+	 * @param idestination end position (index pos)
+	 * @param algo Algorithm to use for finding a path
+	 * @return true/false path to destination has been found
+	 */
+	bool          searchPath(v3s16 isource, v3s16 idestination,
+			PathAlgorithm algo);
+	// << KIDSCODE
+
 	/* variables */
 	int m_max_index_x = 0;            /**< max index of search area in x direction  */
 	int m_max_index_y = 0;            /**< max index of search area in y direction  */
@@ -324,9 +367,12 @@ class Pathfinder {
 	friend class GridNodeContainer;
 	GridNodeContainer *m_nodes_container = nullptr;
 
-	Map *m_map = nullptr;
+	// >> KIDSCODE - Pathfinder cache
+	PathfinderCache *m_cache = nullptr;
 
-	const NodeDefManager *m_ndef = nullptr;
+	/** blocks the search is limited to, no limit if empty */
+	std::set<v3s16> m_corridor;
+	// << KIDSCODE
 
 	friend class PathfinderCompareHeuristic;
 
@@ -408,7 +454,7 @@ class PathfinderCompareHeuristic
 /* implementation                                                             */
 /******************************************************************************/
 
-std::vector<v3s16> get_path(Map* map, const NodeDefManager *ndef,
+std::vector<v3s16> get_path(PathfinderCache *cache, // KIDSCODE - Pathfinder cache
 		v3s16 source,
 		v3s16 destination,
 		unsigned int searchdistance,
@@ -416,10 +462,172 @@ std::vector<v3s16> get_path(Map* map, const NodeDefManager *ndef,
 		unsigned int max_drop,
 		PathAlgorithm algo)
 {
-	return Pathfinder(map, ndef).getPath(source, destination,
+	return Pathfinder(cache).getPath(source, destination,
 				searchdistance, max_jump, max_drop, algo);
 }
 
+// >> KIDSCODE - Pathfinder cache
+/******************************************************************************/
+PathfinderCache::PathfinderCache(Map *map, const NodeDefManager *ndef) :
+	m_map(map), m_ndef(ndef)
+{
+}
+
+PathfinderCache::~PathfinderCache() = default;
+
+/******************************************************************************/
+void PathfinderCache::beginSearch()
+{
+	m_search++;
+	m_last_valid = false;
+
+	if (m_entries.size() > PATHFINDER_CACHE_MAX_BLOCKS)
+		expire();
+}
+
+/******************************************************************************/
+u8 PathfinderCache::getNodeFlags(v3s16 pos)
+{
+	v3s16 blockpos = getNodeBlockPos(pos);
+	Entry *entry = getEntry(blockpos);
+	if (!entry)
+		return PNF_IGNORE;
+
+	v3s16 relpos = pos - blockpos * MAP_BLOCKSIZE;
+	return entry->nodes[relpos.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE +
+			relpos.Y * MAP_BLOCKSIZE + relpos.X];
+}
+
+/******************************************************************************/
+bool PathfinderCache::isLinked(v3s16 blockpos, int face)
+{
+	const static v3s16 faces[6] = {
+		v3s16( 1, 0, 0),
+		v3s16(-1, 0, 0),
+		v3s16( 0, 1, 0),
+		v3s16( 0,-1, 0),
+		v3s16( 0, 0, 1),
+		v3s16( 0, 0,-1)
+	};
+
+	Entry *entry = getEntry(blockpos);
+	if (!entry || entry->faces[face].none())
+		return false;
+	Entry *neighbour = getEntry(blockpos + faces[face]);
+	if (!neighbour)
+		return false;
+	// the opposite face has the index with the lowest bit flipped
+	return (entry->faces[face] & neighbour->faces[face ^ 1]).any();
+}
+
+/******************************************************************************/
+PathfinderCache::Entry *PathfinderCache::getEntry(v3s16 blockpos)
+{
+	if (m_last_valid && blockpos == m_last_blockpos)
+		return m_last_entry;
+
+	Entry *entry = nullptr;
+	auto it = m_entries.find(blockpos);
+	if (it != m_entries.end() && it->second->search == m_search) {
+		// already checked during this search
+		entry = it->second.get();
+	} else {
+		MapBlock *block = m_map->getBlockNoCreateNoEx(blockpos);
+		if (!block || block->isDummy()) {
+			if (it != m_entries.end())
+				m_entries.erase(it);
+		} else {
+			if (it == m_entries.end())
+				it = m_entries.emplace(blockpos,
+						std::unique_ptr<Entry>(new Entry())).first;
+			entry = it->second.get();
+
+			u32 version = block->getNodeDataVersion();
+			if (entry->version != version) {
+				update(entry, block);
+				entry->version = version;
+			}
+			entry->search = m_search;
+		}
+	}
+
+	m_last_valid = true;
+	m_last_blockpos = blockpos;
+	m_last_entry = entry;
+	return entry;
+}
+
+/******************************************************************************/
+void PathfinderCache::update(Entry *entry, MapBlock *block)
+{
+	const MapNode *data = block->getData();
+
+	content_t last_content = CONTENT_IGNORE;
+	u8 last_flags = PNF_IGNORE;
+	for (u32 i = 0; i < MapBlock::nodecount; i++) {
+		content_t c = data[i].getContent();
+		if (c != last_content) {
+			last_content = c;
+			if (c == CONTENT_IGNORE)
+				last_flags = PNF_IGNORE;
+			else
+				last_flags = m_ndef->get(c).walkable ? PNF_WALKABLE : 0;
+		}
+		entry->nodes[i] = last_flags;
+	}
+
+	// free nodes on the faces; the bits of opposite faces match
+	const u32 n = MAP_BLOCKSIZE;
+	const u32 last = MAP_BLOCKSIZE - 1;
+	const u8 *nodes = entry->nodes;
+	for (u32 a = 0; a < n; a++)
+	for (u32 b = 0; b < n; b++) {
+		u32 bit = a * n + b;
+		// X faces: a = y, b = z
+		entry->faces[0][bit] = nodes[b * n * n + a * n + last] == 0;
+		entry->faces[1][bit] = nodes[b * n * n + a * n] == 0;
+		// Y faces: a = z, b = x
+		entry->faces[2][bit] = nodes[a * n * n + last * n + b] == 0;
+		entry->faces[3][bit] = nodes[a * n * n + b] == 0;
+		// Z faces: a = y, b = x
+		entry->faces[4][bit] = nodes[last * n * n + a * n + b] == 0;
+		entry->faces[5][bit] = nodes[a * n + b] == 0;
+	}
+}
+
+/******************************************************************************/
+void PathfinderCache::expire()
+{
+	// keep the half of the blocks used most recently
+	std::vector<u32> searches;
+	searches.reserve(m_entries.size());
+	for (const auto &it : m_entries)
+		searches.push_back(it.second->search);
+
+	size_t to_erase = searches.size() / 2;
+	auto middle = searches.begin() + to_erase;
+	std::nth_element(searches.begin(), middle, searches.end());
+	u32 oldest_kept = *middle;
+
+	// Blocks last used by the same search as the oldest kept one fill up
+	// the count, whichever they are, so expiring always frees half
+	size_t ties = to_erase - std::count_if(searches.begin(), middle,
+		[oldest_kept] (u32 search) { return search < oldest_kept; });
+
+	for (auto it = m_entries.begin(); it != m_entries.end();) {
+		u32 search = it->second->search;
+		if (search < oldest_kept) {
+			it = m_entries.erase(it);
+		} else if (search == oldest_kept && ties > 0) {
+			it = m_entries.erase(it);
+			ties--;
+		} else {
+			++it;
+		}
+	}
+}
+// << KIDSCODE
+
 /******************************************************************************/
 PathCost::PathCost(const PathCost &b)
 {
@@ -516,31 +724,40 @@ void PathGridnode::setCost(v3s16 dir, const PathCost &cost)
 
 void GridNodeContainer::initNode(v3s16 ipos, PathGridnode *p_node)
 {
-	const NodeDefManager *ndef = m_pathf->m_ndef;
 	PathGridnode &elem = *p_node;
 
 	v3s16 realpos = m_pathf->getRealPos(ipos);
 
-	MapNode current = m_pathf->m_map->getNode(realpos);
-	MapNode below   = m_pathf->m_map->getNode(realpos + v3s16(0, -1, 0));
+	// >> KIDSCODE - Pathfinder cache
+	u8 current = m_pathf->m_cache->getNodeFlags(realpos);
+	u8 below   = m_pathf->m_cache->getNodeFlags(realpos + v3s16(0, -1, 0));
+	// << KIDSCODE
 
 
-	if ((current.param0 == CONTENT_IGNORE) ||
-			(below.param0 == CONTENT_IGNORE)) {
+	if ((current & PNF_IGNORE) ||
+			(below & PNF_IGNORE)) {
 		DEBUG_OUT("Pathfinder: " << PP(realpos) <<
 			" current or below is invalid element" << std::endl);
-		if (current.param0 == CONTENT_IGNORE) {
+		if (current & PNF_IGNORE) {
 			elem.type = 'i';
 			DEBUG_OUT(PP(ipos) << ": " << 'i' << std::endl);
 		}
 		return;
 	}
 
+	// >> KIDSCODE - Hierarchical pathfinding
+	if (!m_pathf->isInCorridor(realpos)) {
+		DEBUG_OUT("Pathfinder: " << PP(realpos)
+			<< " outside of corridor" << std::endl);
+		return;
+	}
+	// << KIDSCODE
+
 	//don't add anything if it isn't an air node
-	if (ndef->get(current).walkable || !ndef->get(below).walkable) {
+	if ((current & PNF_WALKABLE) || !(below & PNF_WALKABLE)) {
 			DEBUG_OUT("Pathfinder: " << PP(realpos)
 				<< " not on surface" << std::endl);
-			if (ndef->get(current).walkable) {
+			if (current & PNF_WALKABLE) {
 				elem.type = 's';
 				DEBUG_OUT(PP(ipos) << ": " << 's' << std::endl);
 			} else {
@@ -655,31 +872,22 @@ std::vector<v3s16> Pathfinder::getPath(v3s16 source,
 	m_max_index_y = diff.Y;
 	m_max_index_z = diff.Z;
 
-	delete m_nodes_container;
-	if (diff.getLength() > 5) {
-		m_nodes_container = new MapGridNodeContainer(this);
-	} else {
-		m_nodes_container = new ArrayGridNodeContainer(this, diff);
-	}
-#ifdef PATHFINDER_DEBUG
-	printType();
-	printCost();
-	printYdir();
-#endif
+	// >> KIDSCODE - Pathfinder cache
+	m_cache->beginSearch();
+	m_corridor.clear();
 
 	//fail if source or destination is walkable
-	MapNode node_at_pos = m_map->getNode(destination);
-	if (m_ndef->get(node_at_pos).walkable) {
+	if (m_cache->getNodeFlags(destination) & PNF_WALKABLE) {
 		VERBOSE_TARGET << "Destination is walkable. " <<
 				"Pos: " << PP(destination) << std::endl;
 		return retval;
 	}
-	node_at_pos = m_map->getNode(source);
-	if (m_ndef->get(node_at_pos).walkable) {
+	if (m_cache->getNodeFlags(source) & PNF_WALKABLE) {
 		VERBOSE_TARGET << "Source is walkable. " <<
 				"Pos: " << PP(source) << std::endl;
 		return retval;
 	}
+	// << KIDSCODE
 
 	//If source pos is hovering above air, drop
 	//to the first walkable node (up to m_maxdrop).
@@ -695,46 +903,30 @@ std::vector<v3s16> Pathfinder::getPath(v3s16 source,
 	v3s16 true_destination = v3s16(destination);
 	destination = walkDownwards(destination, m_maxjump);
 
-	//validate and mark start and end pos
-
 	v3s16 StartIndex  = getIndexPos(source);
 	v3s16 EndIndex    = getIndexPos(destination);
 
-	PathGridnode &startpos = getIndexElement(StartIndex);
-	PathGridnode &endpos   = getIndexElement(EndIndex);
-
-	if (!startpos.valid) {
-		VERBOSE_TARGET << "Invalid startpos " <<
-				"Index: " << PP(StartIndex) <<
-				"Realpos: " << PP(getRealPos(StartIndex)) << std::endl;
-		return retval;
-	}
-	if (!endpos.valid) {
-		VERBOSE_TARGET << "Invalid stoppos " <<
-				"Index: " << PP(EndIndex) <<
-				"Realpos: " << PP(getRealPos(EndIndex)) << std::endl;
-		return retval;
+	// >> KIDSCODE - Hierarchical pathfinding
+	// Long paths are searched through the blocks first, the node search
+	// then only looks at the blocks along the way
+	v3s16 block_diff = getNodeBlockPos(destination) - getNodeBlockPos(source);
+	if (diff.getLength() > 5 && abs(block_diff.X) + abs(block_diff.Y) +
+			abs(block_diff.Z) >= PATHFINDER_CORRIDOR_MIN_BLOCKS) {
+		if (!findCorridor(source, destination)) {
+			INFO_TARGET << "No path found, blocks are not connected" << std::endl;
+			return retval;
+		}
 	}
 
-	endpos.target      = true;
-	startpos.source    = true;
-	startpos.totalcost = 0;
-
-	bool update_cost_retval = false;
+	bool update_cost_retval = searchPath(StartIndex, EndIndex, algo);
 
-	//calculate node costs
-	switch (algo) {
-		case PA_DIJKSTRA:
-			update_cost_retval = updateAllCosts(StartIndex, v3s16(0, 0, 0), 0, 0);
-			break;
-		case PA_PLAIN_NP:
-		case PA_PLAIN:
-			update_cost_retval = updateCostHeuristic(StartIndex, EndIndex);
-			break;
-		default:
-			ERROR_TARGET << "Missing PathAlgorithm" << std::endl;
-			break;
+	// The path may need more room than the corridor
+	if (!update_cost_retval && !m_corridor.empty()) {
+		VERBOSE_TARGET << "No path found in corridor, searching again" << std::endl;
+		m_corridor.clear();
+		update_cost_retval = searchPath(StartIndex, EndIndex, algo);
 	}
+	// << KIDSCODE
 
 	if (update_cost_retval) {
 
@@ -820,6 +1012,154 @@ Pathfinder::~Pathfinder()
 {
 	delete m_nodes_container;
 }
+
+// >> KIDSCODE - Hierarchical pathfinding
+/******************************************************************************/
+bool Pathfinder::searchPath(v3s16 StartIndex, v3s16 EndIndex,
+		PathAlgorithm algo)
+{
+	v3s16 diff(m_max_index_x, m_max_index_y, m_max_index_z);
+
+	m_min_target_distance = -1;
+
+	delete m_nodes_container;
+	if (diff.getLength() > 5) {
+		m_nodes_container = new MapGridNodeContainer(this);
+	} else {
+		m_nodes_container = new ArrayGridNodeContainer(this, diff);
+	}
+#ifdef PATHFINDER_DEBUG
+	printType();
+	printCost();
+	printYdir();
+#endif
+
+	//validate and mark start and end pos
+
+	PathGridnode &startpos = getIndexElement(StartIndex);
+	PathGridnode &endpos   = getIndexElement(EndIndex);
+
+	if (!startpos.valid) {
+		VERBOSE_TARGET << "Invalid startpos " <<
+				"Index: " << PP(StartIndex) <<
+				"Realpos: " << PP(getRealPos(StartIndex)) << std::endl;
+		return false;
+	}
+	if (!endpos.valid) {
+		VERBOSE_TARGET << "Invalid stoppos " <<
+				"Index: " << PP(EndIndex) <<
+				"Realpos: " << PP(getRealPos(EndIndex)) << std::endl;
+		return false;
+	}
+
+	endpos.target      = true;
+	startpos.source    = true;
+	startpos.totalcost = 0;
+
+	//calculate node costs
+	switch (algo) {
+		case PA_DIJKSTRA:
+			return updateAllCosts(StartIndex, v3s16(0, 0, 0), 0, 0);
+		case PA_PLAIN_NP:
+		case PA_PLAIN:
+			return updateCostHeuristic(StartIndex, EndIndex);
+		default:
+			ERROR_TARGET << "Missing PathAlgorithm" << std::endl;
+			break;
+	}
+	return false;
+}
+
+/******************************************************************************/
+bool Pathfinder::findCorridor(v3s16 source, v3s16 destination)
+{
+	// the 6 neighbours, in the face order of PathfinderCache
+	const static v3s16 faces[6] = {
+		v3s16( 1, 0, 0),
+		v3s16(-1, 0, 0),
+		v3s16( 0, 1, 0),
+		v3s16( 0,-1, 0),
+		v3s16( 0, 0, 1),
+		v3s16( 0, 0,-1)
+	};
+
+	core::aabbox3d<s16> block_limits(getNodeBlockPos(m_limits.MinEdge),
+			getNodeBlockPos(m_limits.MaxEdge));
+	v3s16 bp_source = getNodeBlockPos(source);
+	v3s16 bp_destination = getNodeBlockPos(destination);
+
+	// A* search on the blocks, one step costs one
+	struct OpenBlock {
+		int estimated_cost;
+		int cost;
+		v3s16 pos;
+
+		bool operator< (const OpenBlock &other) const
+		{
+			return estimated_cost > other.estimated_cost;
+		}
+	};
+	std::priority_queue<OpenBlock> open_list;
+	std::map<v3s16, std::pair<int, v3s16>> visited; // cost, previous block
+
+	auto distance = [&bp_destination] (v3s16 p) {
+		return abs(p.X - bp_destination.X) + abs(p.Y - bp_destination.Y) +
+				abs(p.Z - bp_destination.Z);
+	};
+
+	visited[bp_source] = std::make_pair(0, bp_source);
+	open_list.push({distance(bp_source), 0, bp_source});
+
+	while (!open_list.empty()) {
+		OpenBlock current = open_list.top();
+		open_list.pop();
+
+		if (current.cost > visited[current.pos].first)
+			continue; // outdated entry
+
+		if (current.pos == bp_destination) {
+			// the corridor is the path with its neighbourhood
+			v3s16 bp = bp_destination;
+			for (;;) {
+				v3s16 d;
+				for (d.Z = -1; d.Z <= 1; d.Z++)
+				for (d.Y = -1; d.Y <= 1; d.Y++)
+				for (d.X = -1; d.X <= 1; d.X++)
+					m_corridor.insert(bp + d);
+				if (bp == bp_source)
+					break;
+				bp = visited[bp].second;
+			}
+			VERBOSE_TARGET << "Corridor of " << current.cost + 1 <<
+					" blocks found" << std::endl;
+			return true;
+		}
+
+		for (int face = 0; face < 6; face++) {
+			v3s16 next = current.pos + faces[face];
+			if (!block_limits.isPointInside(next) ||
+					!m_cache->isLinked(current.pos, face))
+				continue;
+
+			int cost = current.cost + 1;
+			auto it = visited.find(next);
+			if (it != visited.end() && it->second.first <= cost)
+				continue;
+
+			visited[next] = std::make_pair(cost, current.pos);
+			open_list.push({cost + distance(next), cost, next});
+		}
+	}
+	return false;
+}
+
+/******************************************************************************/
+bool Pathfinder::isInCorridor(v3s16 pos)
+{
+	return m_corridor.empty() ||
+			m_corridor.find(getNodeBlockPos(pos)) != m_corridor.end();
+}
+// << KIDSCODE
 /******************************************************************************/
 v3s16 Pathfinder::getRealPos(v3s16 ipos)
 {
@@ -842,28 +1182,28 @@ PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 		return retval;
 	}
 
-	MapNode node_at_pos2 = m_map->getNode(pos2);
+	u8 node_at_pos2 = m_cache->getNodeFlags(pos2); // KIDSCODE - Pathfinder cache
 
 	//did we get information about node?
-	if (node_at_pos2.param0 == CONTENT_IGNORE ) {
+	if (node_at_pos2 & PNF_IGNORE) {
 			VERBOSE_TARGET << "Pathfinder: (1) area at pos: "
 					<< PP(pos2) << " not loaded";
 			return retval;
 	}
 
-	if (!m_ndef->get(node_at_pos2).walkable) {
-		MapNode node_below_pos2 =
-			m_map->getNode(pos2 + v3s16(0, -1, 0));
+	if (!(node_at_pos2 & PNF_WALKABLE)) {
+		u8 node_below_pos2 =
+			m_cache->getNodeFlags(pos2 + v3s16(0, -1, 0));
 
 		//did we get information about node?
-		if (node_below_pos2.param0 == CONTENT_IGNORE ) {
+		if (node_below_pos2 & PNF_IGNORE) {
 				VERBOSE_TARGET << "Pathfinder: (2) area at pos: "
 					<< PP((pos2 + v3s16(0, -1, 0))) << " not loaded";
 				return retval;
 		}
 
 		//test if the same-height neighbor is suitable
-		if (m_ndef->get(node_below_pos2).walkable) {
+		if (node_below_pos2 & PNF_WALKABLE) {
 			//SUCCESS!
 			retval.valid = true;
 			retval.value = 1;
@@ -874,19 +1214,17 @@ PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 		else {
 			//test if we can fall a couple of nodes (m_maxdrop)
 			v3s16 testpos = pos2 + v3s16(0, -1, 0);
-			MapNode node_at_pos = m_map->getNode(testpos);
+			u8 node_at_pos = m_cache->getNodeFlags(testpos);
 
-			while ((node_at_pos.param0 != CONTENT_IGNORE) &&
-					(!m_ndef->get(node_at_pos).walkable) &&
+			while (!(node_at_pos & (PNF_IGNORE | PNF_WALKABLE)) &&
 					(testpos.Y > m_limits.MinEdge.Y)) {
 				testpos += v3s16(0, -1, 0);
-				node_at_pos = m_map->getNode(testpos);
+				node_at_pos = m_cache->getNodeFlags(testpos);
 			}
 
 			//did we find surface?
 			if ((testpos.Y >= m_limits.MinEdge.Y) &&
-					(node_at_pos.param0 != CONTENT_IGNORE) &&
-					(m_ndef->get(node_at_pos).walkable)) {
+					(node_at_pos & PNF_WALKABLE)) {
 				if ((pos2.Y - testpos.Y - 1) <= m_maxdrop) {
 					//SUCCESS!
 					retval.valid = true;
@@ -912,34 +1250,31 @@ PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 
 		v3s16 targetpos = pos2; // position for jump target
 		v3s16 jumppos = pos; // position for checking if jumping space is free
-		MapNode node_target = m_map->getNode(targetpos);
-		MapNode node_jump = m_map->getNode(jumppos);
+		u8 node_target = m_cache->getNodeFlags(targetpos);
+		u8 node_jump = m_cache->getNodeFlags(jumppos);
 		bool headbanger = false; // true if anything blocks jumppath
 
-		while ((node_target.param0 != CONTENT_IGNORE) &&
-				(m_ndef->get(node_target).walkable) &&
+		while ((node_target & PNF_WALKABLE) &&
 				(targetpos.Y < m_limits.MaxEdge.Y)) {
 			//if the jump would hit any solid node, discard
-			if ((node_jump.param0 == CONTENT_IGNORE) ||
-					(m_ndef->get(node_jump).walkable)) {
+			if (node_jump & (PNF_IGNORE | PNF_WALKABLE)) {
 					headbanger = true;
 				break;
 			}
 			targetpos += v3s16(0, 1, 0);
 			jumppos   += v3s16(0, 1, 0);
-			node_target = m_map->getNode(targetpos);
-			node_jump   = m_map->getNode(jumppos);
+			node_target = m_cache->getNodeFlags(targetpos);
+			node_jump   = m_cache->getNodeFlags(jumppos);
 
 		}
 		//check headbanger one last time
-		if ((node_jump.param0 == CONTENT_IGNORE) ||
-			(m_ndef->get(node_jump).walkable)) {
+		if (node_jump & (PNF_IGNORE | PNF_WALKABLE)) {
 			headbanger = true;
 		}
 
 		//did we find surface without banging our head?
 		if ((!headbanger) && (targetpos.Y <= m_limits.MaxEdge.Y) &&
-				(!m_ndef->get(node_target).walkable)) {
+				!(node_target & PNF_WALKABLE)) {
 
 			if (targetpos.Y - pos2.Y <= m_maxjump) {
 				//SUCCESS!
@@ -958,6 +1293,14 @@ PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 			DEBUG_OUT("Pathfinder: no surface above found" << std::endl);
 		}
 	}
+
+	// >> KIDSCODE - Hierarchical pathfinding
+	// The open list mustn't get nodes that can't be part of the path
+	if (retval.valid && !isInCorridor(pos2 + v3s16(0, retval.y_change, 0))) {
+		DEBUG_OUT("Pathfinder: " << PP(pos2) << " outside of corridor" << std::endl);
+		retval.valid = false;
+	}
+	// << KIDSCODE
 	return retval;
 }
 
@@ -1239,20 +1582,18 @@ v3s16 Pathfinder::walkDownwards(v3s16 pos, unsigned int max_down) {
 	if (max_down == 0)
 		return pos;
 	v3s16 testpos = v3s16(pos);
-	MapNode node_at_pos = m_map->getNode(testpos);
+	u8 node_at_pos = m_cache->getNodeFlags(testpos); // KIDSCODE - Pathfinder cache
 	unsigned int down = 0;
-	while ((node_at_pos.param0 != CONTENT_IGNORE) &&
-			(!m_ndef->get(node_at_pos).walkable) &&
+	while (!(node_at_pos & (PNF_IGNORE | PNF_WALKABLE)) &&
 			(testpos.Y > m_limits.MinEdge.Y) &&
 			(down <= max_down)) {
 		testpos += v3s16(0, -1, 0);
 		down++;
-		node_at_pos = m_map->getNode(testpos);
+		node_at_pos = m_cache->getNodeFlags(testpos);
 	}
 	//did we find surface?
 	if ((testpos.Y >= m_limits.MinEdge.Y) &&
-			(node_at_pos.param0 != CONTENT_IGNORE) &&
-			(m_ndef->get(node_at_pos).walkable)) {
+			(node_at_pos & PNF_WALKABLE)) {
 		if (down == 0) {
 			pos = testpos;
 		} else if ((down - 1) <= max_down) {
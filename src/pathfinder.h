@@ -23,6 +23,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 /* Includes                                                                   */
 /******************************************************************************/
 #include <vector>
+// >> KIDSCODE - Pathfinder cache
+#include <bitset>
+#include <map>
+#include <memory>
+#include "constants.h"
+// << KIDSCODE
 #include "irr_v3d.h"
 
 /******************************************************************************/
@@ -31,6 +37,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 class NodeDefManager;
 class Map;
+class MapBlock; // KIDSCODE - Pathfinder cache
 
 /******************************************************************************/
 /* Typedefs and macros                                                        */
@@ -50,12 +57,82 @@ typedef enum {
 	PA_PLAIN_NP          /**< A* algorithm without prefetching of map data */
 } PathAlgorithm;
 
+// >> KIDSCODE - Pathfinder cache
+/** Flags of a node in the navigation cache */
+typedef enum {
+	PNF_WALKABLE = 0x01,   /**< node is walkable                  */
+	PNF_IGNORE   = 0x02    /**< node is not loaded                */
+} PathNodeFlags;
+// << KIDSCODE
+
 /******************************************************************************/
 /* declarations                                                               */
 /******************************************************************************/
 
+// >> KIDSCODE - Pathfinder cache
+/** Walkability of the loaded map, kept between searches */
+class PathfinderCache {
+public:
+	PathfinderCache(Map *map, const NodeDefManager *ndef);
+	~PathfinderCache();
+
+	/**
+	 * start a new search; the cached blocks are checked against the map
+	 * once per search and rebuilt if their node data changed
+	 */
+	void beginSearch();
+
+	/**
+	 * get the flags of a node
+	 * @param pos real world position
+	 * @return PathNodeFlags of the node, PNF_IGNORE if it is not loaded
+	 */
+	u8 getNodeFlags(v3s16 pos);
+
+	/**
+	 * check if a path may lead from a block to one of its neighbours, that
+	 * is if their common face has a free node on both sides
+	 * @param blockpos position of the block
+	 * @param face index of the neighbour in order +X -X +Y -Y +Z -Z
+	 */
+	bool isLinked(v3s16 blockpos, int face);
+
+	size_t size() const { return m_entries.size(); }
+
+private:
+	struct Entry {
+		u32 version = 0;          /**< node data version of the block      */
+		u32 search = 0;           /**< last search that checked the entry  */
+		u8 nodes[MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE];
+		/** free nodes on the faces, in order +X -X +Y -Y +Z -Z */
+		std::bitset<MAP_BLOCKSIZE * MAP_BLOCKSIZE> faces[6];
+	};
+
+	/**
+	 * get the entry of a block, nullptr if the block is not loaded
+	 */
+	Entry *getEntry(v3s16 blockpos);
+
+	void update(Entry *entry, MapBlock *block);
+
+	/** drop the entries unused for the longest time */
+	void expire();
+
+	Map *m_map;
+	const NodeDefManager *m_ndef;
+
+	std::map<v3s16, std::unique_ptr<Entry>> m_entries;
+	u32 m_search = 0;
+
+	/* last looked up block, most lookups hit the same block */
+	bool  m_last_valid = false;
+	v3s16 m_last_blockpos;
+	Entry *m_last_entry = nullptr;
+};
+// << KIDSCODE
+
 /** c wrapper function to use from scriptapi */
-std::vector<v3s16> get_path(Map *map, const NodeDefManager *ndef,
+std::vector<v3s16> get_path(PathfinderCache *cache, // KIDSCODE - Pathfinder cache
 		v3s16 source,
 		v3s16 destination,
 		unsigned int searchdistance,
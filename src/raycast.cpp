@@ -21,6 +21,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irr_v3d.h"
 #include "irr_aabb3d.h"
 #include "constants.h"
+// >> KIDSCODE - Batched raycasts
+#include "map.h"
+#include "mapblock.h"
+#include "nodedef.h"
+// << KIDSCODE
 
 bool RaycastSort::operator() (const PointedThing &pt1,
 	const PointedThing &pt2) const
@@ -67,6 +72,137 @@ RaycastState::RaycastState(const core::line3d<f32> &shootline,
 }
 
 
+// >> KIDSCODE - Batched raycasts
+RaycastBlockCache::RaycastBlockCache(Map *map) :
+	m_map(map),
+	m_ndef(map->getNodeDefManager())
+{
+}
+
+bool RaycastBlockCache::isPointable(v3s16 p, bool liquids_pointable)
+{
+	v3s16 blockpos = getNodeBlockPos(p);
+	const Block *block = getBlock(blockpos);
+	if (block->empty)
+		return false;
+
+	v3s16 relpos = p - blockpos * MAP_BLOCKSIZE;
+	u32 i = relpos.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE +
+		relpos.Y * MAP_BLOCKSIZE + relpos.X;
+	return liquids_pointable ? block->liquid_pointable[i] : block->pointable[i];
+}
+
+const RaycastBlockCache::Block *RaycastBlockCache::getBlock(v3s16 blockpos)
+{
+	if (m_last_block && blockpos == m_last_blockpos)
+		return m_last_block;
+
+	auto it = m_blocks.find(blockpos);
+	if (it == m_blocks.end()) {
+		it = m_blocks.emplace(blockpos, std::unique_ptr<Block>(new Block())).first;
+		MapBlock *mapblock = m_map->getBlockNoCreateNoEx(blockpos);
+		if (mapblock && !mapblock->isDummy())
+			update(it->second.get(), mapblock);
+	}
+
+	m_last_blockpos = blockpos;
+	m_last_block = it->second.get();
+	return m_last_block;
+}
+
+void RaycastBlockCache::update(Block *block, MapBlock *mapblock)
+{
+	// Bit 0: pointable, bit 1: pointable with liquids
+	std::vector<std::pair<content_t, u8>> flags;
+	u8 any_flags = 0;
+	for (const auto &entry : mapblock->getContentHistogram()) {
+		const ContentFeatures &f = m_ndef->get(entry.first);
+		u8 content_flags = (f.pointable ? 0x01 : 0) |
+			(f.pointable || f.isLiquid() ? 0x02 : 0);
+		flags.emplace_back(entry.first, content_flags);
+		any_flags |= content_flags;
+	}
+	if (!any_flags)
+		return;
+
+	block->empty = false;
+	const MapNode *data = mapblock->getData();
+	content_t last_content = CONTENT_IGNORE;
+	u8 last_flags = 0;
+	for (u32 i = 0; i < MapBlock::nodecount; i++) {
+		content_t c = data[i].getContent();
+		if (c != last_content) {
+			last_content = c;
+			last_flags = 0;
+			for (const auto &entry : flags) {
+				if (entry.first == c) {
+					last_flags = entry.second;
+					break;
+				}
+			}
+		}
+		if (last_flags & 0x01)
+			block->pointable.set(i);
+		if (last_flags & 0x02)
+			block->liquid_pointable.set(i);
+	}
+}
+
+// Side of the cells of the box grid
+#define RAYCAST_OBJECT_CELL_SIZE (4 * BS)
+
+void selectBoxesBatch(const std::vector<std::pair<u16, aabb3f>> &boxes,
+	const std::vector<core::line3d<f32>> &shootlines,
+	std::vector<std::vector<PointedThing>> &objects)
+{
+	objects.resize(shootlines.size());
+	if (boxes.empty())
+		return;
+
+	// A box is listed in every cell it touches
+	std::map<v3s16, std::vector<u32>> cells;
+	for (u32 index = 0; index < boxes.size(); index++) {
+		const aabb3f &box = boxes[index].second;
+		v3s16 min_cell = floatToInt(box.MinEdge, RAYCAST_OBJECT_CELL_SIZE);
+		v3s16 max_cell = floatToInt(box.MaxEdge, RAYCAST_OBJECT_CELL_SIZE);
+		for (s16 x = min_cell.X; x <= max_cell.X; x++)
+		for (s16 y = min_cell.Y; y <= max_cell.Y; y++)
+		for (s16 z = min_cell.Z; z <= max_cell.Z; z++)
+			cells[v3s16(x, y, z)].push_back(index);
+	}
+
+	// Ray that tested each box last, a box can be met in several cells
+	std::vector<u32> tested(boxes.size(), U32_MAX);
+	for (u32 i = 0; i < shootlines.size(); i++) {
+		const core::line3d<f32> &line = shootlines[i];
+		const v3f line_vector = line.getVector();
+		voxalgo::VoxelLineIterator iterator(line.start / RAYCAST_OBJECT_CELL_SIZE,
+			line_vector / RAYCAST_OBJECT_CELL_SIZE);
+		do {
+			auto cell = cells.find(iterator.m_current_node_pos);
+			if (cell != cells.end()) {
+				for (u32 index : cell->second) {
+					if (tested[index] == i)
+						continue;
+					tested[index] = i;
+
+					v3f current_intersection;
+					v3s16 current_normal;
+					if (boxLineCollision(boxes[index].second, line.start,
+							line_vector, &current_intersection, &current_normal)) {
+						objects[i].emplace_back(
+							(s16) boxes[index].first, current_intersection,
+							current_normal,
+							(current_intersection - line.start).getLengthSQ());
+					}
+				}
+			}
+			iterator.next();
+		} while (iterator.m_current_index <= iterator.m_last_index);
+	}
+}
+// << KIDSCODE
+
 bool boxLineCollision(const aabb3f &box, const v3f &start,
 	const v3f &dir, v3f *collision_point, v3s16 *collision_normal)
 {
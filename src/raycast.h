@@ -21,6 +21,16 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "voxelalgorithms.h"
 #include "util/pointedthing.h"
+// >> KIDSCODE - Batched raycasts
+#include <bitset>
+#include <map>
+#include <memory>
+#include "constants.h"
+
+class Map;
+class MapBlock;
+class NodeDefManager;
+// << KIDSCODE
 
 //! Sorts PointedThings based on their distance.
 struct RaycastSort
@@ -28,6 +38,45 @@ struct RaycastSort
 	bool operator() (const PointedThing &pt1, const PointedThing &pt2) const;
 };
 
+// >> KIDSCODE - Batched raycasts
+/*!
+ * Pointable nodes of the map blocks met by a batch of raycasts. Each block
+ * is looked up once, the rays then only test bits for the nodes they pass.
+ * Only valid while the map doesn't change.
+ */
+class RaycastBlockCache
+{
+public:
+	RaycastBlockCache(Map *map);
+
+	/*!
+	 * Returns false if the node can't be pointed, that is if it is not
+	 * pointable or not loaded.
+	 * @param liquids_pointable if true, liquid nodes are pointable
+	 */
+	bool isPointable(v3s16 p, bool liquids_pointable);
+
+private:
+	struct Block
+	{
+		//! Nothing can be pointed in the block, the masks are unused
+		bool empty = true;
+		std::bitset<MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE> pointable;
+		std::bitset<MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE> liquid_pointable;
+	};
+
+	const Block *getBlock(v3s16 blockpos);
+	void update(Block *block, MapBlock *mapblock);
+
+	Map *m_map;
+	const NodeDefManager *m_ndef;
+	std::map<v3s16, std::unique_ptr<Block>> m_blocks;
+
+	v3s16 m_last_blockpos;
+	const Block *m_last_block = nullptr;
+};
+// << KIDSCODE
+
 //! Describes the state of a raycast.
 class RaycastState
 {
@@ -61,6 +110,9 @@ class RaycastState
 
 	//! If true, the Environment will initialize this state.
 	bool m_initialization_needed = true;
+
+	//! If set, only the nodes it finds pointable are tested. // KIDSCODE - Batched raycasts
+	RaycastBlockCache *m_block_cache = nullptr;
 };
 
 /*!
@@ -75,3 +127,17 @@ class RaycastState
  */
 bool boxLineCollision(const aabb3f &box, const v3f &start, const v3f &dir,
 	v3f *collision_point, v3s16 *collision_normal);
+
+// >> KIDSCODE - Batched raycasts
+/*!
+ * Finds the boxes each shootline meets. The boxes are put in a grid once,
+ * each line then only tests the boxes of the cells it passes.
+ * @param[in]  boxes      boxes in world coordinates, with the id of their
+ * object
+ * @param[in]  shootlines shootlines in world coordinates
+ * @param[out] objects    found objects, one list per shootline
+ */
+void selectBoxesBatch(const std::vector<std::pair<u16, aabb3f>> &boxes,
+	const std::vector<core::line3d<f32>> &shootlines,
+	std::vector<std::vector<PointedThing>> &objects);
+// << KIDSCODE
@@ -88,57 +88,114 @@ void AsyncEngine::initialize(unsigned int numEngines)
 unsigned int AsyncEngine::queueAsyncJob(const std::string &func,
 		const std::string &params)
 {
-	jobQueueMutex.lock();
-	LuaJobInfo toAdd;
-	toAdd.id = jobIdCounter++;
-	toAdd.serializedFunction = func;
-	toAdd.serializedParams = params;
+	// KIDSCODE - Async batching
+	return queueAsyncJobs(func, std::vector<std::string>{params});
+}
 
-	jobQueue.push_back(toAdd);
+// >> KIDSCODE - Async batching
+/******************************************************************************/
+unsigned int AsyncEngine::queueAsyncJobs(const std::string &func,
+		const std::vector<std::string> &params)
+{
+	auto serialized_func = std::make_shared<const std::string>(func);
+
+	MutexAutoLock lock(jobQueueMutex);
+	unsigned int first_id = jobIdCounter;
+	for (const std::string &param : params) {
+		LuaJobInfo toAdd;
+		toAdd.id = jobIdCounter++;
+		toAdd.serializedFunction = serialized_func;
+		toAdd.serializedParams = param;
+		jobQueue.push_back(std::move(toAdd));
+	}
 
-	jobQueueCounter.post();
+	if (!params.empty())
+		jobQueueCounter.post(params.size());
 
-	jobQueueMutex.unlock();
+	return first_id;
+}
 
-	return toAdd.id;
+/******************************************************************************/
+void AsyncEngine::setSharedData(const std::string &name,
+		const std::string &serialized)
+{
+	MutexAutoLock lock(sharedDataMutex);
+	sharedData[name] = std::make_pair(++sharedDataVersion, serialized);
 }
 
 /******************************************************************************/
-LuaJobInfo AsyncEngine::getJob()
+void AsyncEngine::getSharedData(u32 &version,
+		std::vector<std::pair<std::string, std::string>> &changed)
 {
+	MutexAutoLock lock(sharedDataMutex);
+	if (version == sharedDataVersion)
+		return;
+
+	for (const auto &it : sharedData) {
+		if (it.second.first > version)
+			changed.emplace_back(it.first, it.second.second);
+	}
+	version = sharedDataVersion;
+}
+
+/******************************************************************************/
+void AsyncEngine::getJobs(std::vector<LuaJobInfo> &jobs)
+{
+	takeJobs(jobs, workerThreads.size());
+}
+
+/******************************************************************************/
+void AsyncEngine::takeJobs(std::vector<LuaJobInfo> &jobs, size_t workers)
+{
+	jobs.clear();
 	jobQueueCounter.wait();
-	jobQueueMutex.lock();
 
-	LuaJobInfo retval;
+	MutexAutoLock lock(jobQueueMutex);
+	if (jobQueue.empty())
+		return;
+
+	// Take a fair share of the queue, leaving work for the other workers
+	size_t count = jobQueue.size() / MYMAX(workers, 1);
+	count = MYMAX(MYMIN(count, ASYNC_MAX_BATCH), 1);
 
-	if (!jobQueue.empty()) {
-		retval = jobQueue.front();
+	for (size_t i = 0; i < count; i++) {
+		jobs.push_back(std::move(jobQueue.front()));
+		jobs.back().valid = true;
 		jobQueue.pop_front();
-		retval.valid = true;
+		// The counter was posted once per job. Another worker may have
+		// taken the post already, it then finds the queue empty.
+		if (i > 0)
+			jobQueueCounter.wait(0);
 	}
-	jobQueueMutex.unlock();
-
-	return retval;
 }
 
 /******************************************************************************/
-void AsyncEngine::putJobResult(const LuaJobInfo &result)
+void AsyncEngine::putJobResults(std::vector<LuaJobInfo> &results)
 {
-	resultQueueMutex.lock();
-	resultQueue.push_back(result);
-	resultQueueMutex.unlock();
+	MutexAutoLock lock(resultQueueMutex);
+	for (LuaJobInfo &result : results)
+		resultQueue.push_back(std::move(result));
+	results.clear();
 }
+// << KIDSCODE
 
 /******************************************************************************/
 void AsyncEngine::step(lua_State *L)
 {
+	// >> KIDSCODE - Async batching
+	// Callbacks run without the lock, workers keep streaming results
+	std::deque<LuaJobInfo> results;
+	{
+		MutexAutoLock lock(resultQueueMutex);
+		results.swap(resultQueue);
+	}
+	if (results.empty())
+		return;
+	// << KIDSCODE
+
 	int error_handler = PUSH_ERROR_HANDLER(L);
 	lua_getglobal(L, "core");
-	resultQueueMutex.lock();
-	while (!resultQueue.empty()) {
-		LuaJobInfo jobDone = resultQueue.front();
-		resultQueue.pop_front();
-
+	for (const LuaJobInfo &jobDone : results) { // KIDSCODE - Async batching
 		lua_getfield(L, -1, "async_event_handler");
 
 		if (lua_isnil(L, -1)) {
@@ -153,7 +210,6 @@ void AsyncEngine::step(lua_State *L)
 
 		PCALL_RESL(L, lua_pcall(L, 2, 0, error_handler));
 	}
-	resultQueueMutex.unlock();
 	lua_pop(L, 2); // Pop core and error handler
 }
 
@@ -242,44 +298,51 @@ void* AsyncWorkerThread::run()
 	}
 
 	// Main loop
+	std::vector<LuaJobInfo> jobs; // KIDSCODE - Async batching
 	while (!stopRequested()) {
-		// Wait for job
-		LuaJobInfo toProcess = jobDispatcher->getJob();
+		// >> KIDSCODE - Async batching
+		// Wait for jobs
+		jobDispatcher->getJobs(jobs);
 
-		if (!toProcess.valid || stopRequested()) {
+		if (jobs.empty() || stopRequested()) {
 			continue;
 		}
 
-		lua_getfield(L, -1, "job_processor");
-		if (lua_isnil(L, -1)) {
-			FATAL_ERROR("Unable to get async job processor!");
+		updateSharedData(L, error_handler);
+
+		for (LuaJobInfo &toProcess : jobs) {
+			lua_getfield(L, -1, "job_processor");
+			if (lua_isnil(L, -1)) {
+				FATAL_ERROR("Unable to get async job processor!");
+			}
+
+			luaL_checktype(L, -1, LUA_TFUNCTION);
+
+			// Call it
+			lua_pushlstring(L,
+					toProcess.serializedFunction->data(),
+					toProcess.serializedFunction->size());
+			lua_pushlstring(L,
+					toProcess.serializedParams.data(),
+					toProcess.serializedParams.size());
+
+			int result = lua_pcall(L, 2, 1, error_handler);
+			if (result) {
+				PCALL_RES(result);
+				toProcess.serializedResult = "";
+			} else {
+				// Fetch result
+				size_t length;
+				const char *retval = lua_tolstring(L, -1, &length);
+				toProcess.serializedResult = std::string(retval, length);
+			}
+
+			lua_pop(L, 1);  // Pop retval
 		}
 
-		luaL_checktype(L, -1, LUA_TFUNCTION);
-
-		// Call it
-		lua_pushlstring(L,
-				toProcess.serializedFunction.data(),
-				toProcess.serializedFunction.size());
-		lua_pushlstring(L,
-				toProcess.serializedParams.data(),
-				toProcess.serializedParams.size());
-
-		int result = lua_pcall(L, 2, 1, error_handler);
-		if (result) {
-			PCALL_RES(result);
-			toProcess.serializedResult = "";
-		} else {
-			// Fetch result
-			size_t length;
-			const char *retval = lua_tolstring(L, -1, &length);
-			toProcess.serializedResult = std::string(retval, length);
-		}
-
-		lua_pop(L, 1);  // Pop retval
-
-		// Put job result
-		jobDispatcher->putJobResult(toProcess);
+		// Put job results
+		jobDispatcher->putJobResults(jobs);
+		// << KIDSCODE
 	}
 
 	lua_pop(L, 2);  // Pop core and error handler
@@ -287,3 +350,21 @@ void* AsyncWorkerThread::run()
 	return 0;
 }
 
+
+// >> KIDSCODE - Async batching
+/******************************************************************************/
+void AsyncWorkerThread::updateSharedData(lua_State *L, int error_handler)
+{
+	std::vector<std::pair<std::string, std::string>> changed;
+	jobDispatcher->getSharedData(sharedDataVersion, changed);
+
+	for (const auto &it : changed) {
+		// core is on top of the stack
+		lua_getfield(L, -1, "set_async_shared");
+		luaL_checktype(L, -1, LUA_TFUNCTION);
+		lua_pushlstring(L, it.first.data(), it.first.size());
+		lua_pushlstring(L, it.second.data(), it.second.size());
+		PCALL_RES(lua_pcall(L, 2, 0, error_handler));
+	}
+}
+// << KIDSCODE
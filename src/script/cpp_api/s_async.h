@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <vector>
 #include <deque>
 #include <map>
+#include <memory>
 
 #include "threading/semaphore.h"
 #include "threading/thread.h"
@@ -31,6 +32,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // Forward declarations
 class AsyncEngine;
 
+// KIDSCODE - Async batching: most jobs a worker takes at once
+#define ASYNC_MAX_BATCH 32
+
 
 // Declarations
 
@@ -40,7 +44,8 @@ struct LuaJobInfo
 	LuaJobInfo() = default;
 
 	// Function to be called in async environment
-	std::string serializedFunction = "";
+	// KIDSCODE - Async batching: shared by the jobs of a batch
+	std::shared_ptr<const std::string> serializedFunction;
 	// Parameter to be passed to function
 	std::string serializedParams = "";
 	// Result of function call
@@ -60,7 +65,12 @@ class AsyncWorkerThread : public Thread, public ScriptApiBase {
 	void *run();
 
 private:
+	// KIDSCODE - Async batching
+	// Loads the shared data published since the last call
+	void updateSharedData(lua_State *L, int error_handler);
+
 	AsyncEngine *jobDispatcher = nullptr;
+	u32 sharedDataVersion = 0; // KIDSCODE - Async batching
 };
 
 // Asynchornous thread and job management
@@ -91,6 +101,25 @@ class AsyncEngine {
 	 */
 	unsigned int queueAsyncJob(const std::string &func, const std::string &params);
 
+	// >> KIDSCODE - Async batching
+	/**
+	 * Queue a batch of jobs calling the same function
+	 * @param func Serialized lua function
+	 * @param params Serialized parameters, one per job
+	 * @return jobid of the first job, the others follow in order
+	 */
+	unsigned int queueAsyncJobs(const std::string &func,
+			const std::vector<std::string> &params);
+
+	/**
+	 * Publish read-only data to all async environments, where it is
+	 * available as core.async_shared[name] from the next job on
+	 * @param name Key of the data
+	 * @param serialized Serialized value
+	 */
+	void setSharedData(const std::string &name, const std::string &serialized);
+	// << KIDSCODE
+
 	/**
 	 * Engine step to process finished jobs
 	 *   the engine step is one way to pass events back, PushFinishedJobs another
@@ -105,18 +134,33 @@ class AsyncEngine {
 	void pushFinishedJobs(lua_State *L);
 
 protected:
+	// >> KIDSCODE - Async batching
 	/**
-	 * Get a Job from queue to be processed
+	 * Get Jobs from queue to be processed, a share of the queue
 	 *  this function blocks until a job is ready
-	 * @return a job to be processed
+	 * @param jobs Filled with the jobs to be processed, may stay empty
+	 */
+	void getJobs(std::vector<LuaJobInfo> &jobs);
+
+	/**
+	 * Same as getJobs, sharing the queue between `workers` workers
 	 */
-	LuaJobInfo getJob();
+	void takeJobs(std::vector<LuaJobInfo> &jobs, size_t workers);
 
 	/**
-	 * Put a Job result back to result queue
-	 * @param result result of completed job
+	 * Put Job results back to result queue
+	 * @param results results of completed jobs, moved out
 	 */
-	void putJobResult(const LuaJobInfo &result);
+	void putJobResults(std::vector<LuaJobInfo> &results);
+
+	/**
+	 * Get the shared data published after `version`
+	 * @param version Version known by the caller, updated
+	 * @param changed Filled with the (name, serialized value) pairs
+	 */
+	void getSharedData(u32 &version,
+			std::vector<std::pair<std::string, std::string>> &changed);
+	// << KIDSCODE
 
 	/**
 	 * Initialize environment with current registred functions
@@ -143,6 +187,14 @@ class AsyncEngine {
 	// Job queue
 	std::deque<LuaJobInfo> jobQueue;
 
+	// >> KIDSCODE - Async batching
+	// Mutex to protect shared data
+	std::mutex sharedDataMutex;
+	// Name -> (version, serialized value)
+	std::map<std::string, std::pair<u32, std::string>> sharedData;
+	u32 sharedDataVersion = 0;
+	// << KIDSCODE
+
 	// Mutex to protect result queue
 	std::mutex resultQueueMutex;
 	// Result queue
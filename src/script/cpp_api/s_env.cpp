@@ -155,8 +155,14 @@ void ScriptApiEnv::initializeEnvironment(ServerEnvironment *env)
 		luaL_checktype(L, current_abm + 1, LUA_TFUNCTION);
 		lua_pop(L, 1);
 
+		// >> KIDSCODE - ABM scanning
+		std::string label;
+		getstringfield(L, current_abm, "label", label);
+		// << KIDSCODE
+
 		LuaABM *abm = new LuaABM(L, id, trigger_contents, required_neighbors,
-			trigger_interval, trigger_chance, simple_catch_up);
+			trigger_interval, trigger_chance, simple_catch_up,
+			label); // KIDSCODE - ABM scanning
 
 		env->addActiveBlockModifier(abm);
 
@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include <algorithm>
+#include <unordered_set> // KIDSCODE - Bulk node reads
 #include "lua_api/l_env.h"
 #include "lua_api/l_internal.h"
 #include "lua_api/l_nodemeta.h"
@@ -943,7 +944,7 @@ int ModApiEnvMod::l_find_nodes_in_area_under_air(lua_State *L)
 }
 
 // KIDSCODE SPECIFIC (removed from updstream)
-// aa(minp, maxp) -> list of nodes
+// get_nodes_in_area(minp, maxp) -> list of nodes
 int ModApiEnvMod::l_get_nodes_in_area(lua_State *L)
 {
 	GET_ENV_PTR;
@@ -973,26 +974,98 @@ int ModApiEnvMod::l_get_nodes_in_area(lua_State *L)
 		const NodeDefManager *ndef = getServer(L)->ndef();
 	#endif
 
+	// Compatibility wrapper around the bulk read, keeps the X, Y, Z
+	// iteration order of the result
+	cube = maxp - minp + 1;
+	std::vector<content_t> ids((u32)cube.X * cube.Y * cube.Z);
+	env->getMap().getContentInArea(minp, maxp, ids.data());
+	const u32 ystride = cube.X;
+	const u32 zstride = cube.X * cube.Y;
+
 	luaL_checkstack(L, 3, nullptr);
-	lua_newtable(L);
+	lua_createtable(L, ids.size(), 0);
 	u64 i = 0;
 
 	for (s16 x = minp.X; x <= maxp.X; x++)
 	for (s16 y = minp.Y; y <= maxp.Y; y++)
 	for (s16 z = minp.Z; z <= maxp.Z; z++) {
-		v3s16 p(x, y, z);
-		MapNode n = env->getMap().getNode(p);
+		content_t c = ids[(z - minp.Z) * zstride + (y - minp.Y) * ystride +
+			(x - minp.X)];
 
-		lua_newtable(L);
-		lua_pushstring(L, ndef->get(n).name.c_str());
+		lua_createtable(L, 0, 2);
+		lua_pushstring(L, ndef->get(c).name.c_str());
 		lua_setfield(L, -2, "name");
-		push_v3s16(L, p);
+		push_v3s16(L, v3s16(x, y, z));
 		lua_setfield(L, -2, "pos");
 		lua_rawseti(L, -2, ++i);
 	}
 
 	return 1;
 }
+
+// get_node_ids_in_area(minp, maxp, [buffer], [palette]) -> ids, palette
+int ModApiEnvMod::l_get_node_ids_in_area(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	v3s16 minp = read_v3s16(L, 1);
+	v3s16 maxp = read_v3s16(L, 2);
+	sortBoxVerticies(minp, maxp);
+
+	const NodeDefManager *ndef = env->getGameDef()->ndef();
+
+#ifndef SERVER
+	if (Client *client = getClient(L)) {
+		minp = client->CSMClampPos(minp);
+		maxp = client->CSMClampPos(maxp);
+	}
+#endif
+
+	v3s16 cube = maxp - minp + 1;
+	// Same limit as find_nodes_in_area, one content id per node is cheap
+	u64 volume = (u64)cube.X * (u64)cube.Y * (u64)cube.Z;
+	if (volume > 4096000) {
+		luaL_error(L, "get_node_ids_in_area(): area volume"
+				" exceeds allowed value of 4096000");
+		return 0;
+	}
+
+	// Areas up to 32^3 nodes reuse a buffer between calls, the environment
+	// lock serializes them. Larger ones don't keep their memory.
+	static thread_local std::vector<content_t> small_ids;
+	std::vector<content_t> large_ids;
+	std::vector<content_t> &ids = volume <= 32768 ? small_ids : large_ids;
+	ids.resize(volume);
+	env->getMap().getContentInArea(minp, maxp, ids.data());
+
+	if (lua_istable(L, 3))
+		lua_pushvalue(L, 3);
+	else
+		lua_createtable(L, volume, 0);
+
+	// Nodes mostly come in runs of the same content
+	std::unordered_set<content_t> seen;
+	for (u32 i = 0; i != volume; i++) {
+		content_t c = ids[i];
+		if (i == 0 || c != ids[i - 1])
+			seen.insert(c);
+		lua_pushinteger(L, c);
+		lua_rawseti(L, -2, i + 1);
+	}
+
+	// Palette of the content ids present in the area
+	if (lua_istable(L, 4))
+		lua_pushvalue(L, 4);
+	else
+		lua_newtable(L);
+
+	for (content_t c : seen) {
+		lua_pushstring(L, ndef->get(c).name.c_str());
+		lua_rawseti(L, -2, c);
+	}
+
+	return 2;
+}
 // END KIDSCODE SPECIFIC
 
 
@@ -1130,6 +1203,56 @@ int ModApiEnvMod::l_raycast(lua_State *L)
 	return LuaRaycast::create_object(L);
 }
 
+// >> KIDSCODE - Batched raycasts
+// raycast_batch(rays, objects, liquids)
+// rays: list of {pos1, pos2}
+int ModApiEnvMod::l_raycast_batch(lua_State *L)
+{
+	GET_PLAIN_ENV_PTR;
+
+	bool csm = false;
+#ifndef SERVER
+	csm = getClient(L) != nullptr;
+#endif
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+	bool objects = true;
+	bool liquids = false;
+	if (lua_isboolean(L, 2))
+		objects = readParam<bool>(L, 2);
+	if (lua_isboolean(L, 3))
+		liquids = readParam<bool>(L, 3);
+
+	std::vector<core::line3d<f32>> shootlines;
+	size_t count = lua_objlen(L, 1);
+	shootlines.reserve(count);
+	for (size_t i = 1; i <= count; i++) {
+		lua_rawgeti(L, 1, i);
+		luaL_checktype(L, -1, LUA_TTABLE);
+		int ray = lua_gettop(L);
+		lua_rawgeti(L, ray, 1);
+		v3f pos1 = checkFloatPos(L, ray + 1);
+		lua_rawgeti(L, ray, 2);
+		v3f pos2 = checkFloatPos(L, ray + 2);
+		lua_pop(L, 3);
+		shootlines.emplace_back(pos1, pos2);
+	}
+
+	std::vector<PointedThing> results;
+	env->raycastBatch(shootlines, objects, liquids, results);
+
+	lua_createtable(L, results.size(), 0);
+	for (size_t i = 0; i < results.size(); i++) {
+		if (results[i].type == POINTEDTHING_NOTHING)
+			lua_pushboolean(L, false);
+		else
+			push_pointed_thing(L, results[i], csm, true);
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 1;
+}
+// << KIDSCODE
+
 // load_area(p1, [p2])
 // load mapblocks in area p1..p2, but do not generate map
 int ModApiEnvMod::l_load_area(lua_State *L)
@@ -1254,8 +1377,8 @@ int ModApiEnvMod::l_find_path(lua_State *L)
 			algo = PA_DIJKSTRA;
 	}
 
-	std::vector<v3s16> path = get_path(&env->getServerMap(), env->getGameDef()->ndef(), pos1, pos2,
-		searchdistance, max_jump, max_drop, algo);
+	std::vector<v3s16> path = get_path(env->getPathfinderCache(), pos1, pos2,
+		searchdistance, max_jump, max_drop, algo); // KIDSCODE - Pathfinder cache
 
 	if (!path.empty()) {
 		lua_createtable(L, path.size(), 0);
@@ -1519,6 +1642,7 @@ void ModApiEnvMod::Initialize(lua_State *L, int top)
 	API_FCT(find_nodes_in_area);
 	API_FCT(find_nodes_in_area_under_air);
 	API_FCT(get_nodes_in_area); // KIDSCODE SPECIFIC
+	API_FCT(get_node_ids_in_area); // KIDSCODE - Bulk node reads
 	API_FCT(fix_light);
 	API_FCT(load_area);
 	API_FCT(emerge_area);
@@ -1531,6 +1655,7 @@ void ModApiEnvMod::Initialize(lua_State *L, int top)
 	API_FCT(find_path);
 	API_FCT(line_of_sight);
 	API_FCT(raycast);
+	API_FCT(raycast_batch); // KIDSCODE - Batched raycasts
 	API_FCT(transforming_liquid_add);
 	API_FCT(forceload_block);
 	API_FCT(forceload_free_block);
@@ -1558,4 +1683,5 @@ void ModApiEnvMod::InitializeClient(lua_State *L, int top)
 	API_FCT(find_nodes_in_area_under_air);
 	API_FCT(line_of_sight);
 	API_FCT(raycast);
+	API_FCT(raycast_batch); // KIDSCODE - Batched raycasts
 }
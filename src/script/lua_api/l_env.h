@@ -139,6 +139,9 @@ class ModApiEnvMod : public ModApiBase {
 	// get_nodes_in_area(minp, maxp, nodenames) -> list of nodenames and positions
 	static int l_get_nodes_in_area(lua_State *L);
 
+	// get_node_ids_in_area(minp, maxp, [buffer], [palette]) -> ids, palette
+	static int l_get_node_ids_in_area(lua_State *L); // KIDSCODE - Bulk node reads
+
 	// fix_light(p1, p2) -> true/false
 	static int l_fix_light(lua_State *L);
 
@@ -176,6 +179,11 @@ class ModApiEnvMod : public ModApiBase {
 	// raycast(pos1, pos2, objects, liquids) -> Raycast
 	static int l_raycast(lua_State *L);
 
+	// >> KIDSCODE - Batched raycasts
+	// raycast_batch(rays, objects, liquids) -> list of pointed_thing or false
+	static int l_raycast_batch(lua_State *L);
+	// << KIDSCODE
+
 	// find_path(pos1, pos2, searchdistance,
 	//     max_jump, max_drop, algorithm) -> table containing path
 	static int l_find_path(lua_State *L);
@@ -237,17 +245,20 @@ class LuaABM : public ActiveBlockModifier {
 	float m_trigger_interval;
 	u32 m_trigger_chance;
 	bool m_simple_catch_up;
+	std::string m_label; // KIDSCODE - ABM scanning
 public:
 	LuaABM(lua_State *L, int id,
 			const std::vector<std::string> &trigger_contents,
 			const std::vector<std::string> &required_neighbors,
-			float trigger_interval, u32 trigger_chance, bool simple_catch_up):
+			float trigger_interval, u32 trigger_chance, bool simple_catch_up,
+			const std::string &label): // KIDSCODE - ABM scanning
 		m_id(id),
 		m_trigger_contents(trigger_contents),
 		m_required_neighbors(required_neighbors),
 		m_trigger_interval(trigger_interval),
 		m_trigger_chance(trigger_chance),
-		m_simple_catch_up(simple_catch_up)
+		m_simple_catch_up(simple_catch_up),
+		m_label(label) // KIDSCODE - ABM scanning
 	{
 	}
 	virtual const std::vector<std::string> &getTriggerContents() const
@@ -270,6 +281,12 @@ class LuaABM : public ActiveBlockModifier {
 	{
 		return m_simple_catch_up;
 	}
+	// >> KIDSCODE - ABM scanning
+	virtual const std::string &getLabel() const
+	{
+		return m_label;
+	}
+	// << KIDSCODE
 	virtual void trigger(ServerEnvironment *env, v3s16 p, MapNode n,
 			u32 active_object_count, u32 active_object_count_wider);
 };
@@ -661,3 +661,12 @@ void ModApiItemMod::Initialize(lua_State *L, int top)
 	API_FCT(get_content_id);
 	API_FCT(get_name_from_content_id);
 }
+
+// >> KIDSCODE - Emerge Lua environment
+void ModApiItemMod::InitializeEmerge(lua_State *L, int top)
+{
+	// Definitions are read only in the emerge threads
+	API_FCT(get_content_id);
+	API_FCT(get_name_from_content_id);
+}
+// << KIDSCODE
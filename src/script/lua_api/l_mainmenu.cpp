@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "lua_api/l_internal.h"
 #include "common/c_content.h"
 #include "cpp_api/s_async.h"
+#include "scripting_mainmenu.h" // KIDSCODE - Async batching
 #include "gui/guiEngine.h"
 #include "gui/guiMainMenu.h"
 #include "gui/guiKeyChangeMenu.h"
@@ -1206,6 +1207,46 @@ int ModApiMainMenu::l_do_async_callback(lua_State *L)
 	return 1;
 }
 
+// >> KIDSCODE - Async batching
+/******************************************************************************/
+int ModApiMainMenu::l_do_async_callbacks(lua_State *L)
+{
+	size_t func_length;
+	const char *serialized_func_raw = luaL_checklstring(L, 1, &func_length);
+	luaL_checktype(L, 2, LUA_TTABLE);
+
+	std::vector<std::string> serialized_params;
+	size_t count = lua_objlen(L, 2);
+	serialized_params.reserve(count);
+	for (size_t i = 1; i <= count; i++) {
+		lua_rawgeti(L, 2, i);
+		size_t param_length;
+		const char *serialized_param_raw = luaL_checklstring(L, -1, &param_length);
+		serialized_params.emplace_back(serialized_param_raw, param_length);
+		lua_pop(L, 1);
+	}
+
+	AsyncEngine &async = getScriptApi<MainMenuScripting>(L)->getAsyncEngine();
+	lua_pushinteger(L, async.queueAsyncJobs(
+		std::string(serialized_func_raw, func_length), serialized_params));
+
+	return 1;
+}
+
+/******************************************************************************/
+int ModApiMainMenu::l_do_async_set_shared(lua_State *L)
+{
+	std::string name = luaL_checkstring(L, 1);
+	size_t length;
+	const char *serialized_raw = luaL_checklstring(L, 2, &length);
+
+	AsyncEngine &async = getScriptApi<MainMenuScripting>(L)->getAsyncEngine();
+	async.setSharedData(name, std::string(serialized_raw, length));
+
+	return 0;
+}
+// << KIDSCODE
+
 /******************************************************************************/
 void ModApiMainMenu::Initialize(lua_State *L, int top)
 {
@@ -1253,6 +1294,8 @@ void ModApiMainMenu::Initialize(lua_State *L, int top)
 	API_FCT(get_max_supp_proto);
 	API_FCT(open_url);
 	API_FCT(do_async_callback);
+	API_FCT(do_async_callbacks); // KIDSCODE - Async batching
+	API_FCT(do_async_set_shared); // KIDSCODE - Async batching
 }
 
 /******************************************************************************/
@@ -162,6 +162,12 @@ class ModApiMainMenu: public ModApiBase
 	// async
 	static int l_do_async_callback(lua_State *L);
 
+	// >> KIDSCODE - Async batching
+	static int l_do_async_callbacks(lua_State *L);
+
+	static int l_do_async_set_shared(lua_State *L);
+	// << KIDSCODE
+
 public:
 
 	/**
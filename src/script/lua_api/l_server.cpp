@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "cpp_api/s_base.h"
 #include "cpp_api/s_security.h"
 #include "server.h"
+#include "emerge.h" // KIDSCODE - Emerge Lua environment
 #include "environment.h"
 #include "remoteplayer.h"
 #include "log.h"
@@ -178,6 +179,13 @@ int ModApiServer::l_get_player_information(lua_State *L)
 		getConInfo(con::MAX_JITTER, &max_jitter) &&
 		getConInfo(con::AVG_JITTER, &avg_jitter);
 
+	// >> KIDSCODE - Congestion control
+	float bandwidth_estimate, congestion_window;
+	bool have_bandwidth_info =
+		getConInfo(con::BANDWIDTH_ESTIMATE, &bandwidth_estimate) &&
+		getConInfo(con::CONGESTION_WINDOW, &congestion_window);
+	// << KIDSCODE
+
 	bool r = server->getClientInfo(player->getPeerId(), &state, &uptime,
 		&ser_vers, &prot_vers, &major, &minor, &patch, &vers_string,
 		&lang_code);
@@ -230,6 +238,18 @@ int ModApiServer::l_get_player_information(lua_State *L)
 		lua_settable(L, table);
 	}
 
+	// >> KIDSCODE - Congestion control
+	if (have_bandwidth_info) { // may be missing
+		lua_pushstring(L, "bandwidth_estimate");
+		lua_pushnumber(L, bandwidth_estimate);
+		lua_settable(L, table);
+
+		lua_pushstring(L, "congestion_window");
+		lua_pushnumber(L, congestion_window);
+		lua_settable(L, table);
+	}
+	// << KIDSCODE
+
 	lua_pushstring(L,"connection_uptime");
 	lua_pushnumber(L, uptime);
 	lua_settable(L, table);
@@ -403,6 +423,29 @@ int ModApiServer::l_get_modpath(lua_State *L)
 	return 1;
 }
 
+// >> KIDSCODE - Emerge Lua environment
+// register_mapgen_script(path)
+int ModApiServer::l_register_mapgen_script(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	std::string path = luaL_checkstring(L, 1);
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, CUSTOM_RIDX_CURRENT_MOD_NAME);
+	std::string mod_name = readParam<std::string>(L, -1, "");
+	lua_pop(L, 1);
+
+	EmergeManager *emerge = getServer(L)->getEmergeManager();
+	if (mod_name.empty() || emerge->isRunning())
+		throw LuaError("register_mapgen_script can only be called at "
+			"mod load time");
+
+	CHECK_SECURE_PATH(L, path.c_str(), false);
+
+	emerge->addMapgenScript(mod_name, path);
+	return 0;
+}
+// << KIDSCODE
+
 // get_modnames()
 // the returned list is sorted alphabetically for you
 int ModApiServer::l_get_modnames(lua_State *L)
@@ -544,6 +587,7 @@ void ModApiServer::Initialize(lua_State *L, int top)
 	API_FCT(get_current_modname);
 	API_FCT(get_modpath);
 	API_FCT(get_modnames);
+	API_FCT(register_mapgen_script); // KIDSCODE - Emerge Lua environment
 
 	API_FCT(print);
 
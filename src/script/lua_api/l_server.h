@@ -49,6 +49,9 @@ class ModApiServer : public ModApiBase
 	// the returned list is sorted alphabetically for you
 	static int l_get_modnames(lua_State *L);
 
+	// register_mapgen_script(path)
+	static int l_register_mapgen_script(lua_State *L); // KIDSCODE - Emerge Lua environment
+
 	// print(text)
 	static int l_print(lua_State *L);
 
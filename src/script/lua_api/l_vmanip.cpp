@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "lua_api/l_internal.h"
 #include "common/c_content.h"
 #include "common/c_converter.h"
+#include "cpp_api/s_base.h" // KIDSCODE - Emerge Lua environment
 #include "emerge.h"
 #include "environment.h"
 #include "map.h"
@@ -42,7 +43,9 @@ extern "C" {
 		if (lvmp == nullptr || ptr == nullptr)
 			throw ModError("Nil pointer in C call");
 
-		*ptr = (*(LuaVoxelManip **)lvmp)->vm->m_data;
+		LuaVoxelManip *o = *(LuaVoxelManip **)lvmp;
+		o->raw_data_access = true; // KIDSCODE - VoxelManip buffers
+		*ptr = o->vm->m_data;
 	}
 
 	#ifdef WIN32
@@ -56,6 +59,34 @@ extern "C" {
 		return (*(LuaVoxelManip **)lvmp)->vm->m_area.getVolume();
 	}
 
+	// >> KIDSCODE - VoxelManip buffers
+	// For LuaJIT FFI loops, which can be compiled unlike the metamethods.
+	// `*ptr` is the value at index 1, the next values are `*stride` bytes
+	// apart. Writes through it are not checked, see raw_data_access.
+	#ifdef WIN32
+	__declspec(dllexport)
+	#endif
+	void VoxelBuffer_get_pointer(void **lbp, void **ptr, s32 *stride)
+	{
+		if (lbp == nullptr || ptr == nullptr || stride == nullptr)
+			throw ModError("Nil pointer in C call");
+
+		*ptr = (*(LuaVoxelBuffer **)lbp)->getPointer();
+		*stride = sizeof(MapNode);
+	}
+
+	#ifdef WIN32
+	__declspec(dllexport)
+	#endif
+	s32 VoxelBuffer_get_volume(void **lbp)
+	{
+		if (lbp == nullptr)
+			throw ModError("Nil pointer in C call");
+
+		return (*(LuaVoxelBuffer **)lbp)->getVolume();
+	}
+	// << KIDSCODE
+
 } // extern "C"
 // << ffi_accel patch
 
@@ -68,9 +99,19 @@ int LuaVoxelManip::gc_object(lua_State *L)
 	return 0;
 }
 
+// >> KIDSCODE - Emerge Lua environment
+void LuaVoxelManip::checkMapAccess(lua_State *L, const char *method)
+{
+	if (getScriptApiBase(L)->getType() == ScriptingType::Emerge)
+		throw LuaError(std::string("VoxelManip") + method +
+			" cannot be used in the mapgen environment");
+}
+// << KIDSCODE
+
 int LuaVoxelManip::l_read_from_map(lua_State *L)
 {
 	MAP_LOCK_REQUIRED;
+	checkMapAccess(L, ":read_from_map()"); // KIDSCODE - Emerge Lua environment
 
 	LuaVoxelManip *o = checkobject(L, 1);
 	MMVManip *vm = o->vm;
@@ -138,11 +179,17 @@ int LuaVoxelManip::l_set_data(lua_State *L)
 int LuaVoxelManip::l_write_to_map(lua_State *L)
 {
 	MAP_LOCK_REQUIRED;
+	checkMapAccess(L, ":write_to_map()"); // KIDSCODE - Emerge Lua environment
 
 	LuaVoxelManip *o = checkobject(L, 1);
 	bool update_light = !lua_isboolean(L, 2) || readParam<bool>(L, 2);
 	GET_ENV_PTR;
 	ServerMap *map = &(env->getServerMap());
+	// >> KIDSCODE - VoxelManip buffers
+	if (o->raw_data_access)
+		o->checkData(getServer(L)->getNodeDefManager(),
+			"VoxelManip:write_to_map");
+	// << KIDSCODE
 	if (o->is_mapgen_vm || !update_light) {
 		o->vm->blitBackAll(&(o->modified_blocks));
 	} else {
@@ -191,6 +238,7 @@ int LuaVoxelManip::l_set_node_at(lua_State *L)
 
 int LuaVoxelManip::l_update_liquids(lua_State *L)
 {
+	checkMapAccess(L, ":update_liquids()"); // KIDSCODE - Emerge Lua environment
 	GET_ENV_PTR;
 
 	LuaVoxelManip *o = checkobject(L, 1);
@@ -397,6 +445,46 @@ int LuaVoxelManip::l_get_emerged_area(lua_State *L)
 	return 2;
 }
 
+// >> KIDSCODE - VoxelManip buffers
+// get_buffer(self, [field])
+int LuaVoxelManip::l_get_buffer(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	checkobject(L, 1);
+
+	LuaVoxelBuffer::Field field = LuaVoxelBuffer::FIELD_CONTENT;
+	if (!lua_isnoneornil(L, 2)) {
+		std::string name = luaL_checkstring(L, 2);
+		if (name == "param1")
+			field = LuaVoxelBuffer::FIELD_PARAM1;
+		else if (name == "param2")
+			field = LuaVoxelBuffer::FIELD_PARAM2;
+		else if (name != "content")
+			throw LuaError("VoxelManip:get_buffer: unknown field \"" +
+				name + "\"");
+	}
+
+	LuaVoxelBuffer::create(L, 1, field);
+	return 1;
+}
+
+void LuaVoxelManip::checkData(const NodeDefManager *ndef, const char *caller)
+{
+	u32 volume = vm->m_area.getVolume();
+	content_t last_checked = CONTENT_IGNORE;
+	for (u32 i = 0; i != volume; i++) {
+		content_t c = vm->m_data[i].getContent();
+		if (c == last_checked)
+			continue;
+		if (!ndef->isRegistered(c))
+			throw LuaError(std::string(caller) + ": unknown content id " +
+				itos(c) + " at index " + itos(i + 1));
+		last_checked = c;
+	}
+}
+// << KIDSCODE
+
 LuaVoxelManip::LuaVoxelManip(MMVManip *mmvm, bool is_mg_vm) :
 	is_mapgen_vm(is_mg_vm),
 	vm(mmvm)
@@ -427,6 +515,7 @@ LuaVoxelManip::~LuaVoxelManip()
 // Creates an LuaVoxelManip and leaves it on top of stack
 int LuaVoxelManip::create_object(lua_State *L)
 {
+	checkMapAccess(L, "()"); // KIDSCODE - Emerge Lua environment
 	GET_ENV_PTR;
 
 	Map *map = &(env->getMap());
@@ -499,5 +588,165 @@ const luaL_Reg LuaVoxelManip::methods[] = {
 	luamethod(LuaVoxelManip, set_param2_data),
 	luamethod(LuaVoxelManip, was_modified),
 	luamethod(LuaVoxelManip, get_emerged_area),
+	luamethod(LuaVoxelManip, get_buffer), // KIDSCODE - VoxelManip buffers
 	{0,0}
 };
+
+// >> KIDSCODE - VoxelManip buffers
+LuaVoxelBuffer::LuaVoxelBuffer(LuaVoxelManip *vm, int vm_ref, Field field,
+		const NodeDefManager *ndef) :
+	m_vm(vm),
+	m_vm_ref(vm_ref),
+	m_field(field),
+	m_ndef(ndef)
+{
+}
+
+void LuaVoxelBuffer::create(lua_State *L, int narg, Field field)
+{
+	LuaVoxelManip *vm = LuaVoxelManip::checkobject(L, narg);
+	lua_pushvalue(L, narg);
+	int vm_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	LuaVoxelBuffer *o = new LuaVoxelBuffer(vm, vm_ref, field,
+		getServer(L)->getNodeDefManager());
+	*(void **)(lua_newuserdata(L, sizeof(void *))) = o;
+	luaL_getmetatable(L, className);
+	lua_setmetatable(L, -2);
+}
+
+int LuaVoxelBuffer::gc_object(lua_State *L)
+{
+	LuaVoxelBuffer *o = *(LuaVoxelBuffer **)(lua_touserdata(L, 1));
+	luaL_unref(L, LUA_REGISTRYINDEX, o->m_vm_ref);
+	delete o;
+
+	return 0;
+}
+
+// The metatable is hidden, the metamethods below can only be called with
+// a VoxelBuffer as first argument.
+
+// buffer[i], nil outside of the data like for the tables
+int LuaVoxelBuffer::mt_index(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelBuffer *o = *(LuaVoxelBuffer **)(lua_touserdata(L, 1));
+	MMVManip *vm = o->m_vm->vm;
+
+	if (lua_type(L, 2) != LUA_TNUMBER) {
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_Integer i = lua_tointeger(L, 2);
+	if (i < 1 || i > (lua_Integer)vm->m_area.getVolume()) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	const MapNode &n = vm->m_data[i - 1];
+	switch (o->m_field) {
+	case FIELD_CONTENT:
+		lua_pushinteger(L, n.getContent());
+		break;
+	case FIELD_PARAM1:
+		lua_pushinteger(L, n.param1);
+		break;
+	case FIELD_PARAM2:
+		lua_pushinteger(L, n.param2);
+		break;
+	}
+	return 1;
+}
+
+// buffer[i] = value, checked before it goes to the data
+int LuaVoxelBuffer::mt_newindex(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelBuffer *o = *(LuaVoxelBuffer **)(lua_touserdata(L, 1));
+	MMVManip *vm = o->m_vm->vm;
+
+	lua_Integer i = luaL_checkinteger(L, 2);
+	if (i < 1 || i > (lua_Integer)vm->m_area.getVolume())
+		throw LuaError("VoxelBuffer: index " + itos(i) + " out of range");
+	lua_Integer value = luaL_checkinteger(L, 3);
+
+	MapNode &n = vm->m_data[i - 1];
+	if (o->m_field == FIELD_CONTENT) {
+		if (value < 0 || value > U16_MAX ||
+				!o->m_ndef->isRegistered((content_t)value))
+			throw LuaError("VoxelBuffer: unknown content id " + itos(value));
+		n.setContent((content_t)value);
+		return 0;
+	}
+
+	if (value < 0 || value > U8_MAX)
+		throw LuaError("VoxelBuffer: value " + itos(value) + " out of range");
+	if (o->m_field == FIELD_PARAM1)
+		n.param1 = (u8)value;
+	else
+		n.param2 = (u8)value;
+	return 0;
+}
+
+void *LuaVoxelBuffer::getPointer()
+{
+	m_vm->raw_data_access = true;
+	u8 *node = (u8 *)m_vm->vm->m_data;
+	switch (m_field) {
+	case FIELD_PARAM1:
+		return node + offsetof(MapNode, param1);
+	case FIELD_PARAM2:
+		return node + offsetof(MapNode, param2);
+	default:
+		return node + offsetof(MapNode, param0);
+	}
+}
+
+s32 LuaVoxelBuffer::getVolume() const
+{
+	return m_vm->vm->m_area.getVolume();
+}
+
+// #buffer
+int LuaVoxelBuffer::mt_len(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelBuffer *o = *(LuaVoxelBuffer **)(lua_touserdata(L, 1));
+	lua_pushinteger(L, o->m_vm->vm->m_area.getVolume());
+	return 1;
+}
+
+void LuaVoxelBuffer::Register(lua_State *L)
+{
+	luaL_newmetatable(L, className);
+	int metatable = lua_gettop(L);
+
+	lua_pushliteral(L, "__metatable");
+	lua_pushstring(L, className);
+	lua_settable(L, metatable);  // hide metatable from Lua getmetatable()
+
+	lua_pushliteral(L, "__index");
+	lua_pushcfunction(L, mt_index);
+	lua_settable(L, metatable);
+
+	lua_pushliteral(L, "__newindex");
+	lua_pushcfunction(L, mt_newindex);
+	lua_settable(L, metatable);
+
+	lua_pushliteral(L, "__len");
+	lua_pushcfunction(L, mt_len);
+	lua_settable(L, metatable);
+
+	lua_pushliteral(L, "__gc");
+	lua_pushcfunction(L, gc_object);
+	lua_settable(L, metatable);
+
+	lua_pop(L, 1);  // drop metatable
+}
+
+const char LuaVoxelBuffer::className[] = "VoxelBuffer";
+// << KIDSCODE
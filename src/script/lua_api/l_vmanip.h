@@ -26,6 +26,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 class Map;
 class MapBlock;
 class MMVManip;
+class NodeDefManager;
 
 /*
   VoxelManip
@@ -41,6 +42,10 @@ class LuaVoxelManip : public ModApiBase
 
 	static int gc_object(lua_State *L);
 
+	// KIDSCODE - Emerge Lua environment: raises an error for methods that
+	// touch the map, which the emerge threads must not do
+	static void checkMapAccess(lua_State *L, const char *method);
+
 	static int l_read_from_map(lua_State *L);
 	static int l_get_data(lua_State *L);
 	static int l_set_data(lua_State *L);
@@ -63,8 +68,18 @@ class LuaVoxelManip : public ModApiBase
 	static int l_was_modified(lua_State *L);
 	static int l_get_emerged_area(lua_State *L);
 
+	static int l_get_buffer(lua_State *L); // KIDSCODE - VoxelManip buffers
+
 public:
 	MMVManip *vm = nullptr;
+	// >> KIDSCODE - VoxelManip buffers
+	// True once the data was handed out as a raw pointer, write_to_map()
+	// then checks the content ids before writing them to the map
+	bool raw_data_access = false;
+
+	// Throws a LuaError if the data holds unknown content ids
+	void checkData(const NodeDefManager *ndef, const char *caller);
+	// << KIDSCODE
 
 	LuaVoxelManip(MMVManip *mmvm, bool is_mapgen_vm);
 	LuaVoxelManip(Map *map, v3s16 p1, v3s16 p2);
@@ -79,3 +94,49 @@ class LuaVoxelManip : public ModApiBase
 
 	static void Register(lua_State *L);
 };
+
+// >> KIDSCODE - VoxelManip buffers
+/*
+  VoxelBuffer, a view of one field of the VoxelManip data, indexed like
+  the tables of get_data(), get_light_data() and get_param2_data()
+ */
+class LuaVoxelBuffer : public ModApiBase
+{
+public:
+	enum Field
+	{
+		FIELD_CONTENT,
+		FIELD_PARAM1,
+		FIELD_PARAM2,
+	};
+
+private:
+	// The VoxelManip is kept alive through a registry reference
+	LuaVoxelManip *m_vm;
+	int m_vm_ref;
+	Field m_field;
+	const NodeDefManager *m_ndef;
+
+	static const char className[];
+
+	static int gc_object(lua_State *L);
+
+	static int mt_index(lua_State *L);
+	static int mt_newindex(lua_State *L);
+	static int mt_len(lua_State *L);
+
+public:
+	LuaVoxelBuffer(LuaVoxelManip *vm, int vm_ref, Field field,
+		const NodeDefManager *ndef);
+
+	// Creates a LuaVoxelBuffer of the VoxelManip at index `narg` and leaves
+	// it on top of stack
+	static void create(lua_State *L, int narg, Field field);
+
+	// Raw pointer to the field of the first node, for the FFI entry points
+	void *getPointer();
+	s32 getVolume() const;
+
+	static void Register(lua_State *L);
+};
+// << KIDSCODE
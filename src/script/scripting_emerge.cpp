@@ -0,0 +1,106 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "scripting_emerge.h"
+#include "emerge.h"
+#include "filesys.h"
+#include "log.h"
+#include "server.h"
+#include "settings.h"
+#include "cpp_api/s_internal.h"
+#include "common/c_converter.h"
+#include "lua_api/l_item.h"
+#include "lua_api/l_noise.h"
+#include "lua_api/l_settings.h"
+#include "lua_api/l_util.h"
+#include "lua_api/l_vmanip.h"
+
+EmergeScripting::EmergeScripting(Server *server):
+		ScriptApiBase(ScriptingType::Emerge)
+{
+	setGameDef(server);
+
+	SCRIPTAPI_PRECHECKHEADER
+
+	if (g_settings->getBool("secure.enable_security"))
+		initializeSecurity();
+
+	lua_getglobal(L, "core");
+	int top = lua_gettop(L);
+
+	InitializeModApi(L, top);
+	lua_pop(L, 1);
+
+	// Push builtin initialization type
+	lua_pushstring(L, "emerge");
+	lua_setglobal(L, "INIT");
+}
+
+void EmergeScripting::InitializeModApi(lua_State *L, int top)
+{
+	// Register reference classes (userdata)
+	LuaPerlinNoise::Register(L);
+	LuaPerlinNoiseMap::Register(L);
+	LuaPseudoRandom::Register(L);
+	LuaPcgRandom::Register(L);
+	LuaSecureRandom::Register(L);
+	LuaSettings::Register(L);
+	LuaVoxelManip::Register(L);
+	LuaVoxelBuffer::Register(L);
+
+	// Initialize mod api modules
+	ModApiItemMod::InitializeEmerge(L, top);
+	ModApiUtil::InitializeAsync(L, top);
+}
+
+void EmergeScripting::loadScripts(const std::vector<MapgenScript> &scripts)
+{
+	loadScript(getServer()->getBuiltinLuaPath() + DIR_DELIM "init.lua");
+
+	for (const MapgenScript &script : scripts)
+		loadMod(script.path, script.mod_name);
+}
+
+void EmergeScripting::on_generated(BlockMakeData *bmdata, u32 blockseed)
+{
+	SCRIPTAPI_PRECHECKHEADER
+
+	v3s16 minp = bmdata->blockpos_min * MAP_BLOCKSIZE;
+	v3s16 maxp = bmdata->blockpos_max * MAP_BLOCKSIZE +
+		v3s16(1, 1, 1) * (MAP_BLOCKSIZE - 1);
+
+	int error_handler = PUSH_ERROR_HANDLER(L);
+
+	lua_getglobal(L, "core");
+	lua_getfield(L, -1, "on_generated");
+	luaL_checktype(L, -1, LUA_TFUNCTION);
+
+	// The VoxelManip of the mapgen, not owned by the Lua object
+	LuaVoxelManip *o = new LuaVoxelManip(bmdata->vmanip, true);
+	*(void **)(lua_newuserdata(L, sizeof(void *))) = o;
+	luaL_getmetatable(L, "VoxelManip");
+	lua_setmetatable(L, -2);
+
+	push_v3s16(L, minp);
+	push_v3s16(L, maxp);
+	lua_pushnumber(L, blockseed);
+
+	PCALL_RES(lua_pcall(L, 4, 0, error_handler));
+	lua_pop(L, 2); // Pop core and error handler
+}
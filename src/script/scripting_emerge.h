@@ -0,0 +1,56 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "cpp_api/s_base.h"
+#include "cpp_api/s_security.h"
+
+class Server;
+struct BlockMakeData;
+struct MapgenScript;
+
+/*****************************************************************************/
+/* Scripting <-> EmergeThread Interface                                      */
+/*****************************************************************************/
+
+/*
+	Lua environment of one emerge thread. It runs the scripts registered
+	with core.register_mapgen_script() and has no access to the map or the
+	server environment, only to the chunk being generated.
+*/
+class EmergeScripting:
+		virtual public ScriptApiBase,
+		public ScriptApiSecurity
+{
+public:
+	EmergeScripting(Server *server);
+
+	// Loads builtin and the mapgen scripts, throws ModError on failure
+	void loadScripts(const std::vector<MapgenScript> &scripts);
+
+	// Runs the on_generated callbacks on the chunk made by the mapgen,
+	// before it is written to the map. Throws LuaError on failure.
+	void on_generated(BlockMakeData *bmdata, u32 blockseed);
+
+private:
+	void InitializeModApi(lua_State *L, int top);
+};
@@ -40,6 +40,8 @@ class MainMenuScripting
 	// Pass async events from engine to async threads
 	unsigned int queueAsync(const std::string &serialized_func,
 			const std::string &serialized_params);
+
+	AsyncEngine &getAsyncEngine() { return asyncEngine; } // KIDSCODE - Async batching
 private:
 	void initializeModApi(lua_State *L, int top);
 	static void registerLuaClasses(lua_State *L, int top);
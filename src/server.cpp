@@ -66,7 +66,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "server/player_sao.h"
 #include "server/serverinventorymgr.h"
 #include "translation.h"
+#include "object_position.h" // KIDSCODE - Compact position updates
 #include "network/upnpserver.h" // KIDSCODE - UPNP annoncement
+#include "server/mediastore.h" // KIDSCODE - Media store
 #include <sys/stat.h> // KIDSCODE - Limit media file size to 15Mb
 
 // >> KIDSCODE - Limit media file size to 15Mb
@@ -403,6 +405,12 @@ void Server::init()
 
 	m_modmgr->loadMods(m_script);
 
+	// >> KIDSCODE - Media store
+	s32 media_cache_size = g_settings->getS32("media_memory_cache_size");
+	m_media_store.reset(new MediaStore(
+		(size_t)MYMAX(media_cache_size, 0) * 1024 * 1024));
+	// << KIDSCODE
+
 	// Read Textures and calculate sha1 sums
 	fillMediaCache();
 
@@ -738,9 +746,25 @@ void Server::AsyncRunStep(bool initial_step)
 		MutexAutoLock envlock(m_env_mutex);
 		ScopeProfiler sp(g_profiler, "Server: send SAO messages");
 
+		// >> KIDSCODE - Batched object messages
+		/*
+			The messages of each object are serialized once, with and
+			without position updates, then appended to the data of every
+			client knowing the object.
+		*/
+		struct PackedMessages
+		{
+			ServerActiveObject *sao = nullptr;
+			std::string reliable, unreliable;
+			// Without AO_CMD_UPDATE_POSITION
+			std::string reliable_nopos, unreliable_nopos;
+			// With compact position updates expanded, for clients without
+			// KIDSCODE_CAP_COMPACT_POSITION
+			std::string reliable_legacy, unreliable_legacy;
+		};
+
 		// Key = object id
-		// Value = data sent by object
-		std::unordered_map<u16, std::vector<ActiveObjectMessage>*> buffered_messages;
+		std::unordered_map<u16, PackedMessages> buffered_messages;
 
 		// Get active object messages from environment
 		ActiveObjectMessage aom(0);
@@ -749,16 +773,45 @@ void Server::AsyncRunStep(bool initial_step)
 			if (!m_env->getActiveObjectMessage(&aom))
 				break;
 
-			std::vector<ActiveObjectMessage>* message_list = nullptr;
+			aom_count++;
+
 			auto n = buffered_messages.find(aom.id);
 			if (n == buffered_messages.end()) {
-				message_list = new std::vector<ActiveObjectMessage>;
-				buffered_messages[aom.id] = message_list;
-			} else {
-				message_list = n->second;
+				ServerActiveObject *sao = m_env->getActiveObject(aom.id);
+				// If object does not exist, skip it
+				if (!sao)
+					continue;
+				n = buffered_messages.emplace(aom.id, PackedMessages()).first;
+				n->second.sao = sao;
 			}
-			message_list->push_back(std::move(aom));
-			aom_count++;
+			PackedMessages &packed = n->second;
+
+			// u16 id
+			// std::string data
+			char idbuf[2];
+			writeU16((u8*) idbuf, aom.id);
+			std::string message(idbuf, sizeof(idbuf));
+			message.append(serializeString(aom.datastring));
+
+			(aom.reliable ? packed.reliable : packed.unreliable).append(message);
+
+			u8 cmd = aom.datastring[0];
+			if (cmd == AO_CMD_UPDATE_POSITION_COMPACT) {
+				std::istringstream is(aom.datastring.substr(1), std::ios::binary);
+				ObjectPositionUpdate update;
+				update.deSerialize(is, cmd);
+				std::ostringstream os(std::ios::binary);
+				update.serialize(os);
+				message.resize(sizeof(idbuf));
+				message.append(serializeString(os.str()));
+			}
+			(aom.reliable ? packed.reliable_legacy : packed.unreliable_legacy)
+				.append(message);
+
+			if (cmd != AO_CMD_UPDATE_POSITION &&
+					cmd != AO_CMD_UPDATE_POSITION_COMPACT)
+				(aom.reliable ? packed.reliable_nopos : packed.unreliable_nopos)
+					.append(message);
 		}
 
 		m_aom_buffer_counter->increment(aom_count);
@@ -772,39 +825,44 @@ void Server::AsyncRunStep(bool initial_step)
 			unreliable_data.clear();
 			RemoteClient *client = client_it.second;
 			PlayerSAO *player = getPlayerSAO(client->peer_id);
-			// Go through all objects in message buffer
-			for (const auto &buffered_message : buffered_messages) {
-				// If object does not exist or is not known by client, skip it
-				u16 id = buffered_message.first;
-				ServerActiveObject *sao = m_env->getActiveObject(id);
-				if (!sao || client->m_known_objects.find(id) == client->m_known_objects.end())
-					continue;
-
-				// Get message list of object
-				std::vector<ActiveObjectMessage>* list = buffered_message.second;
-				// Go through every message
-				for (const ActiveObjectMessage &aom : *list) {
-					// Send position updates to players who do not see the attachment
-					if (aom.datastring[0] == AO_CMD_UPDATE_POSITION) {
-						if (sao->getId() == player->getId())
-							continue;
-
-						// Do not send position updates for attached players
-						// as long the parent is known to the client
-						ServerActiveObject *parent = sao->getParent();
-						if (parent && client->m_known_objects.find(parent->getId()) !=
-								client->m_known_objects.end())
-							continue;
-					}
-
-					// Add full new data to appropriate buffer
-					std::string &buffer = aom.reliable ? reliable_data : unreliable_data;
-					char idbuf[2];
-					writeU16((u8*) idbuf, aom.id);
-					// u16 id
-					// std::string data
-					buffer.append(idbuf, sizeof(idbuf));
-					buffer.append(serializeString(aom.datastring));
+			const std::set<u16> &known = client->m_known_objects;
+			bool legacy = !(client->kidscode_caps &
+					KIDSCODE_CAP_COMPACT_POSITION);
+
+			auto add_messages = [&] (const PackedMessages &packed) {
+				// Send position updates to players who do not see the attachment
+				// Do not send position updates for attached players
+				// as long the parent is known to the client
+				ServerActiveObject *parent = packed.sao->getParent();
+				bool skip_pos = (player && packed.sao->getId() == player->getId()) ||
+					(parent && known.find(parent->getId()) != known.end());
+
+				if (skip_pos) {
+					reliable_data.append(packed.reliable_nopos);
+					unreliable_data.append(packed.unreliable_nopos);
+				} else if (legacy) {
+					reliable_data.append(packed.reliable_legacy);
+					unreliable_data.append(packed.unreliable_legacy);
+				} else {
+					reliable_data.append(packed.reliable);
+					unreliable_data.append(packed.unreliable);
+				}
+			};
+
+			// Go through the smaller of the message buffer and the objects
+			// known by the client
+			if (buffered_messages.size() <= known.size()) {
+				for (const auto &buffered_message : buffered_messages) {
+					// If object is not known by client, skip it
+					if (known.find(buffered_message.first) == known.end())
+						continue;
+					add_messages(buffered_message.second);
+				}
+			} else {
+				for (u16 id : known) {
+					auto n = buffered_messages.find(id);
+					if (n != buffered_messages.end())
+						add_messages(n->second);
 				}
 			}
 			/*
@@ -820,11 +878,7 @@ void Server::AsyncRunStep(bool initial_step)
 			}
 		}
 		m_clients.unlock();
-
-		// Clear buffered_messages
-		for (auto &buffered_message : buffered_messages) {
-			delete buffered_message.second;
-		}
+		// << KIDSCODE
 	}
 
 	/*
@@ -2439,9 +2493,9 @@ bool Server::SendBlock(session_t peer_id, const v3s16 &blockpos)
 	return true;
 }
 
-bool Server::addMediaFile(const std::string &filename,
-	const std::string &filepath, std::string *filedata_to,
-	std::string *digest_to)
+// KIDSCODE - Media store: checks split from addMediaFile
+bool Server::checkMediaFile(const std::string &filename,
+	const std::string &filepath, u64 *size, u64 *mtime)
 {
 	// If name contains illegal characters, ignore the file
 	if (!string_allowed(filename, TEXTURENAME_ALLOWED_CHARS)) {
@@ -2481,9 +2535,34 @@ bool Server::addMediaFile(const std::string &filename,
 					<< MEDIA_FILE_MAX_SIZE << " bytes)" << std::endl;
 			return false;
 		}
+		if (size)
+			*size = stat_buf.st_size;
+		// In nanoseconds where the platform has them, a file rewritten
+		// within the same second is still seen as modified
+		if (mtime) {
+#if defined(_WIN32)
+			*mtime = (u64)stat_buf.st_mtime * 1000000000ULL;
+#elif defined(__APPLE__)
+			*mtime = (u64)stat_buf.st_mtimespec.tv_sec * 1000000000ULL +
+				stat_buf.st_mtimespec.tv_nsec;
+#else
+			*mtime = (u64)stat_buf.st_mtim.tv_sec * 1000000000ULL +
+				stat_buf.st_mtim.tv_nsec;
+#endif
+		}
 	}
 	// << KIDSCODE - Limit media file size to 15Mb
 
+	return true;
+}
+
+bool Server::addMediaFile(const std::string &filename,
+	const std::string &filepath, std::string *filedata_to,
+	std::string *digest_to)
+{
+	if (!checkMediaFile(filename, filepath)) // KIDSCODE - Media store
+		return false;
+
 	// Ok, attempt to load the file and add to cache
 
 	// Read data
@@ -2547,20 +2626,66 @@ void Server::fillMediaCache()
 	fs::GetRecursiveDirs(paths, m_gamespec.path + DIR_DELIM + "textures");
 	fs::GetRecursiveDirs(paths, porting::path_user + DIR_DELIM + "textures" + DIR_DELIM + "server");
 
-	// Collect media file information from paths into cache
+	// >> KIDSCODE - Media store
+	// Only the files changed since the last start are hashed, in parallel
+	MediaIndex index(m_path_world + DIR_DELIM + "media_index.txt");
+	index.load();
+
+	std::vector<MediaHashJob> files;
+	std::vector<MediaHashJob> jobs;
+	std::vector<size_t> job_files;
+
+	// Collect media file information from paths
 	for (const std::string &mediapath : paths) {
 		std::vector<fs::DirListNode> dirlist = fs::GetDirListing(mediapath);
 		for (const fs::DirListNode &dln : dirlist) {
 			if (dln.dir) // Ignore dirs
 				continue;
 
-			std::string filepath = mediapath;
-			filepath.append(DIR_DELIM).append(dln.name);
-			addMediaFile(dln.name, filepath);
+			MediaHashJob file;
+			file.name = dln.name;
+			file.path = mediapath;
+			file.path.append(DIR_DELIM).append(dln.name);
+			if (!checkMediaFile(file.name, file.path, &file.size, &file.mtime))
+				continue;
+
+			if (!index.lookup(file.path, file.size, file.mtime, &file.digest)) {
+				job_files.push_back(files.size());
+				jobs.push_back(file);
+			}
+			files.push_back(file);
+		}
+	}
+
+	hash_media_files(jobs, Thread::getNumberOfProcessors());
+
+	for (size_t i = 0; i < jobs.size(); i++) {
+		const MediaHashJob &job = jobs[i];
+		if (job.digest.empty()) {
+			errorstream << "Server::fillMediaCache(): Could not read \""
+					<< job.path << "\" or it is empty" << std::endl;
+			continue;
 		}
+		index.update(job.path, job.size, job.mtime, job.digest);
+		files[job_files[i]].digest = job.digest;
 	}
 
-	infostream << "Server: " << m_media.size() << " media files collected" << std::endl;
+	// Put in cache, in the order of the paths for the overrides
+	for (const MediaHashJob &file : files) {
+		if (file.digest.empty())
+			continue;
+
+		m_media[file.name] = MediaInfo(file.path,
+			base64_encode((const unsigned char *)file.digest.c_str(), 20));
+		verbosestream << "Server: " << hex_encode(file.digest) << " is "
+				<< file.name << std::endl;
+	}
+
+	index.save();
+
+	infostream << "Server: " << m_media.size() << " media files collected, "
+			<< jobs.size() << " hashed" << std::endl;
+	// << KIDSCODE
 }
 
 void Server::sendMediaAnnouncement(session_t peer_id, const std::string &lang_code)
@@ -2596,10 +2721,11 @@ struct SendableMedia
 {
 	std::string name;
 	std::string path;
-	std::string data;
+	// KIDSCODE - Media store: shared with the media store
+	std::shared_ptr<const std::string> data;
 
 	SendableMedia(const std::string &name_="", const std::string &path_="",
-	              const std::string &data_=""):
+	              std::shared_ptr<const std::string> data_=nullptr):
 		name(name_),
 		path(path_),
 		data(data_)
@@ -2630,39 +2756,27 @@ void Server::sendRequestedMedia(session_t peer_id,
 		}
 
 		//TODO get path + name
-		std::string tpath = m_media[name].path;
-
-		// Read data
-		std::ifstream fis(tpath.c_str(), std::ios_base::binary);
-		if(!fis.good()){
-			errorstream<<"Server::sendRequestedMedia(): Could not open \""
-					<<tpath<<"\" for reading"<<std::endl;
-			continue;
-		}
-		std::ostringstream tmp_os(std::ios_base::binary);
-		bool bad = false;
-		for(;;) {
-			char buf[1024];
-			fis.read(buf, 1024);
-			std::streamsize len = fis.gcount();
-			tmp_os.write(buf, len);
-			file_size_bunch_total += len;
-			if(fis.eof())
-				break;
-			if(!fis.good()) {
-				bad = true;
-				break;
+		const MediaInfo &media = m_media[name];
+
+		// >> KIDSCODE - Media store
+		// Read data, unless it was sent recently
+		std::shared_ptr<const std::string> data =
+			m_media_store->get(media.sha1_digest);
+		if (!data) {
+			std::string filedata;
+			if (!read_media_file(media.path, &filedata)) {
+				errorstream<<"Server::sendRequestedMedia(): Failed to read \""
+						<<media.path<<"\""<<std::endl;
+				continue;
 			}
+			data = std::make_shared<const std::string>(std::move(filedata));
+			m_media_store->put(media.sha1_digest, data);
 		}
-		if (bad) {
-			errorstream<<"Server::sendRequestedMedia(): Failed to read \""
-					<<name<<"\""<<std::endl;
-			continue;
-		}
-		/*infostream<<"Server::sendRequestedMedia(): Loaded \""
-				<<tname<<"\""<<std::endl;*/
+		file_size_bunch_total += data->size();
+
 		// Put in list
-		file_bunches[file_bunches.size()-1].emplace_back(name, tpath, tmp_os.str());
+		file_bunches[file_bunches.size()-1].emplace_back(name, media.path, data);
+		// << KIDSCODE
 
 		// Start next bunch if got enough data
 		if(file_size_bunch_total >= bytes_per_bunch) {
@@ -2694,7 +2808,7 @@ void Server::sendRequestedMedia(session_t peer_id,
 
 		for (const SendableMedia &j : file_bunches[i]) {
 			pkt << j.name;
-			pkt.putLongString(j.data);
+			pkt.putLongString(*j.data); // KIDSCODE - Media store
 		}
 
 		verbosestream << "Server::sendRequestedMedia(): bunch "
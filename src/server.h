@@ -71,6 +71,7 @@ class ServerThread;
 class UpnpServerThread;
 class ServerModManager;
 class ServerInventoryManager;
+class MediaStore; // KIDSCODE - Media store
 
 enum ClientDeletionReason {
 	CDR_LEAVE,
@@ -449,6 +450,9 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	// Sends blocks to clients (locks env and con on its own)
 	void SendBlocks(float dtime);
 
+	// KIDSCODE - Media store: name, extension and size checks
+	bool checkMediaFile(const std::string &filename, const std::string &filepath,
+			u64 *size = nullptr, u64 *mtime = nullptr);
 	bool addMediaFile(const std::string &filename, const std::string &filepath,
 			std::string *filedata = nullptr, std::string *digest = nullptr);
 	void fillMediaCache();
@@ -634,6 +638,8 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 
 	// media files known to server
 	std::unordered_map<std::string, MediaInfo> m_media;
+	// Data of the media files recently sent
+	std::unique_ptr<MediaStore> m_media_store; // KIDSCODE - Media store
 
 	/*
 		Sounds
@@ -0,0 +1,467 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "abmhandler.h"
+#include <algorithm>
+#include <unordered_map>
+#include "gamedef.h"
+#include "map.h"
+#include "mapblock.h"
+#include "nodedef.h"
+#include "noise.h"
+#include "porting.h"
+#include "profiler.h"
+#include "server.h"
+#include "serverenvironment.h"
+#include "util/numeric.h"
+
+// Contents of a block with one node around it
+#define GRID_SIZE (MAP_BLOCKSIZE + 2)
+#define GRID_VOLUME (GRID_SIZE * GRID_SIZE * GRID_SIZE)
+
+// Blocks snapshotted and scanned at once per worker thread
+#define BLOCKS_PER_THREAD 4
+
+/*
+	ABMScanPool
+*/
+
+class ABMScanThread : public Thread
+{
+public:
+	ABMScanThread(ABMScanPool *pool) :
+		Thread("ABMScan"),
+		m_pool(pool)
+	{}
+
+	void *run()
+	{
+		while (!stopRequested()) {
+			std::pair<const ABMHandler *, ABMScanJob *> job =
+				m_pool->m_jobs.pop_frontNoEx(100);
+			if (!job.second)
+				continue;
+
+			job.first->scan(*job.second);
+			m_pool->m_done.post();
+		}
+		return nullptr;
+	}
+
+private:
+	ABMScanPool *m_pool;
+};
+
+ABMScanPool::ABMScanPool(unsigned int num_threads)
+{
+	for (unsigned int i = 0; i < num_threads; i++) {
+		ABMScanThread *thread = new ABMScanThread(this);
+		if (!thread->start()) {
+			delete thread;
+			break;
+		}
+		m_threads.push_back(thread);
+	}
+}
+
+ABMScanPool::~ABMScanPool()
+{
+	for (ABMScanThread *thread : m_threads)
+		thread->stop();
+	for (ABMScanThread *thread : m_threads) {
+		thread->wait();
+		delete thread;
+	}
+}
+
+void ABMScanPool::scan(const ABMHandler *handler, std::vector<ABMScanJob> &jobs)
+{
+	if (m_threads.empty()) {
+		for (ABMScanJob &job : jobs)
+			handler->scan(job);
+		return;
+	}
+
+	for (ABMScanJob &job : jobs)
+		m_jobs.push_back(std::make_pair(handler, &job));
+	for (size_t i = 0; i < jobs.size(); i++)
+		m_done.wait();
+}
+
+/*
+	ABMHandler
+*/
+
+ABMHandler::ABMHandler(std::vector<ABMWithState> &abms,
+	float dtime_s, ServerEnvironment *env,
+	bool use_timers):
+	m_env(env)
+{
+	if(dtime_s < 0.001)
+		return;
+	const NodeDefManager *ndef = env->getGameDef()->ndef();
+	std::unordered_map<std::string, u32> stats_ids;
+	for (ABMWithState &abmws : abms) {
+		ActiveBlockModifier *abm = abmws.abm;
+		float trigger_interval = abm->getTriggerInterval();
+		if(trigger_interval < 0.001)
+			trigger_interval = 0.001;
+		float actual_interval = dtime_s;
+		if(use_timers){
+			abmws.timer += dtime_s;
+			if(abmws.timer < trigger_interval)
+				continue;
+			abmws.timer -= trigger_interval;
+			actual_interval = trigger_interval;
+		}
+		float chance = abm->getTriggerChance();
+		if(chance == 0)
+			chance = 1;
+		ActiveABM aabm;
+		aabm.abm = abm;
+		if (abm->getSimpleCatchUp()) {
+			float intervals = actual_interval / trigger_interval;
+			if(intervals == 0)
+				continue;
+			aabm.chance = chance / intervals;
+			if(aabm.chance == 0)
+				aabm.chance = 1;
+		} else {
+			aabm.chance = chance;
+		}
+
+		// Trigger neighbors
+		const std::vector<std::string> &required_neighbors_s =
+			abm->getRequiredNeighbors();
+		for (const std::string &required_neighbor_s : required_neighbors_s) {
+			ndef->getIds(required_neighbor_s, aabm.required_neighbors);
+		}
+		aabm.check_required_neighbors = !required_neighbors_s.empty();
+
+		aabm.neighbor_check = m_neighbor_checks.size();
+		if (aabm.check_required_neighbors) {
+			NeighborCheck check;
+			check.contents.resize(U16_MAX + 1);
+			for (content_t c : aabm.required_neighbors)
+				check.contents[c] = true;
+			m_neighbor_checks.push_back(std::move(check));
+		}
+
+		auto stats_it = stats_ids.emplace(abm->getLabel(), m_stats.size());
+		if (stats_it.second) {
+			m_stats.emplace_back();
+			m_stats.back().label = abm->getLabel();
+		}
+		aabm.stats = stats_it.first->second;
+
+		// Trigger contents
+		const std::vector<std::string> &contents_s = abm->getTriggerContents();
+		for (const std::string &content_s : contents_s) {
+			std::vector<content_t> ids;
+			ndef->getIds(content_s, ids);
+			for (content_t c : ids) {
+				if (c >= m_aabms.size())
+					m_aabms.resize(c + 256, NULL);
+				if (!m_aabms[c])
+					m_aabms[c] = new std::vector<ActiveABM>;
+				m_aabms[c]->push_back(aabm);
+			}
+		}
+	}
+
+	m_is_trigger.resize(U16_MAX + 1);
+	for (size_t c = 0; c < m_aabms.size(); c++)
+		m_is_trigger[c] = m_aabms[c] != nullptr;
+}
+
+ABMHandler::~ABMHandler()
+{
+	for (auto &aabms : m_aabms)
+		delete aabms;
+}
+
+u32 ABMHandler::countObjects(MapBlock *block, ServerMap * map, u32 &wider)
+{
+	wider = 0;
+	u32 wider_unknown_count = 0;
+	for(s16 x=-1; x<=1; x++)
+		for(s16 y=-1; y<=1; y++)
+			for(s16 z=-1; z<=1; z++)
+			{
+				MapBlock *block2 = map->getBlockNoCreateNoEx(
+					block->getPos() + v3s16(x,y,z));
+				if(block2==NULL){
+					wider_unknown_count++;
+					continue;
+				}
+				wider += block2->m_static_objects.m_active.size()
+					+ block2->m_static_objects.m_stored.size();
+			}
+	// Extrapolate
+	u32 active_object_count = block->m_static_objects.m_active.size();
+	u32 wider_known_count = 3*3*3 - wider_unknown_count;
+	wider += wider_unknown_count * wider / wider_known_count;
+	return active_object_count;
+}
+
+bool ABMHandler::hasRequiredNeighbor(MapBlock *block, v3s16 p0,
+	const ActiveABM &aabm)
+{
+	ServerMap *map = &m_env->getServerMap();
+	v3s16 p1;
+	for(p1.X = p0.X-1; p1.X <= p0.X+1; p1.X++)
+	for(p1.Y = p0.Y-1; p1.Y <= p0.Y+1; p1.Y++)
+	for(p1.Z = p0.Z-1; p1.Z <= p0.Z+1; p1.Z++)
+	{
+		if(p1 == p0)
+			continue;
+		content_t c;
+		if (block->isValidPosition(p1)) {
+			// if the neighbor is found on the same map block
+			// get it straight from there
+			const MapNode &n = block->getNodeUnsafe(p1);
+			c = n.getContent();
+		} else {
+			// otherwise consult the map
+			MapNode n = map->getNode(p1 + block->getPosRelative());
+			c = n.getContent();
+		}
+		if (CONTAINS(aabm.required_neighbors, c))
+			return true;
+	}
+	return false;
+}
+
+/*
+	Counts the required neighbors in the 3x3x3 box around every node of
+	the block with one pass per axis, minus the node itself.
+*/
+static void build_neighbor_mask(const std::vector<content_t> &grid,
+	const std::vector<bool> &contents, std::vector<u8> &mask)
+{
+	static thread_local std::vector<u8> self, count, count_y;
+	self.resize(GRID_VOLUME);
+	count.resize(GRID_VOLUME);
+	count_y.resize(GRID_VOLUME);
+
+	const u32 ystride = GRID_SIZE;
+	const u32 zstride = GRID_SIZE * GRID_SIZE;
+
+	for (u32 i = 0; i < GRID_VOLUME; i++)
+		self[i] = contents[grid[i]];
+
+	// Values wrapping over row and plane ends are never read back
+	for (u32 i = 1; i < GRID_VOLUME - 1; i++)
+		count[i] = self[i - 1] + self[i] + self[i + 1];
+	for (u32 i = ystride; i < GRID_VOLUME - ystride; i++)
+		count_y[i] = count[i - ystride] + count[i] + count[i + ystride];
+	for (u32 i = zstride; i < GRID_VOLUME - zstride; i++)
+		count[i] = count_y[i - zstride] + count_y[i] + count_y[i + zstride];
+
+	mask.resize(MapBlock::nodecount);
+	u32 n = 0;
+	for (u32 z = 1; z <= MAP_BLOCKSIZE; z++)
+	for (u32 y = 1; y <= MAP_BLOCKSIZE; y++) {
+		u32 g = z * zstride + y * ystride + 1;
+		for (u32 x = 0; x < MAP_BLOCKSIZE; x++, g++)
+			mask[n++] = count[g] > self[g];
+	}
+}
+
+bool ABMHandler::prepare(v3s16 blockpos, ABMScanJob &job)
+{
+	MapBlock *block = m_env->getServerMap().getBlockNoCreateNoEx(blockpos);
+	if (!block)
+		return false;
+
+	// Set current time as timestamp
+	block->setTimestampNoChangedFlag(m_env->getGameTime());
+
+	if(m_aabms.empty() || block->isDummy())
+		return false;
+
+	// Skip blocks without any of the trigger contents
+	bool run_abms = false;
+	for (const auto &entry : block->getContentHistogram()) {
+		if (m_is_trigger[entry.first]) {
+			run_abms = true;
+			break;
+		}
+	}
+	if (!run_abms) {
+		m_blocks_skipped++;
+		return false;
+	}
+	m_blocks_scanned++;
+
+	job.blockpos = blockpos;
+	job.seed = myrand();
+	job.grid.resize(GRID_VOLUME);
+	v3s16 base = block->getPosRelative();
+	m_env->getServerMap().getContentInArea(base - v3s16(1, 1, 1),
+		base + v3s16(MAP_BLOCKSIZE, MAP_BLOCKSIZE, MAP_BLOCKSIZE),
+		job.grid.data());
+	return true;
+}
+
+void ABMHandler::scan(ABMScanJob &job) const
+{
+	PcgRandom rand(job.seed);
+	// Built the first time a node of the block passes the chance check
+	std::vector<std::vector<u8>> masks(m_neighbor_checks.size());
+
+	// X, Y, Z order, ABM actions run in the order they always did
+	for (u32 x = 1; x <= MAP_BLOCKSIZE; x++)
+	for (u32 y = 1; y <= MAP_BLOCKSIZE; y++)
+	for (u32 z = 1; z <= MAP_BLOCKSIZE; z++) {
+		content_t c = job.grid[(z * GRID_SIZE + y) * GRID_SIZE + x];
+		// Index in the block data
+		u32 i = ((z - 1) * MAP_BLOCKSIZE + y - 1) * MAP_BLOCKSIZE + x - 1;
+
+		if (!m_is_trigger[c])
+			continue;
+
+		for (const ActiveABM &aabm : *m_aabms[c]) {
+			if (rand.next() % aabm.chance != 0)
+				continue;
+
+			if (aabm.check_required_neighbors) {
+				std::vector<u8> &mask = masks[aabm.neighbor_check];
+				if (mask.empty())
+					build_neighbor_mask(job.grid,
+						m_neighbor_checks[aabm.neighbor_check].contents, mask);
+				if (!mask[i])
+					continue;
+			}
+
+			job.candidates.push_back({(u16)i, c, &aabm});
+		}
+	}
+}
+
+void ABMHandler::trigger(ABMScanJob &job)
+{
+	// Deactivated since the snapshot, the scan spans several server steps
+	if (!m_env->isABMBlockActive(job.blockpos))
+		return;
+
+	MapBlock *block = m_env->getServerMap().getBlockNoCreateNoEx(job.blockpos);
+	if (!block || block->isDummy())
+		return;
+
+	if (job.candidates.empty())
+		return;
+
+	ServerMap *map = &m_env->getServerMap();
+
+	u32 active_object_count_wider;
+	u32 active_object_count = this->countObjects(block, map, active_object_count_wider);
+	m_env->m_added_objects = 0;
+
+	for (const ABMCandidate &candidate : job.candidates) {
+		const ActiveABM &aabm = *candidate.aabm;
+		const MapNode &n = block->getData()[candidate.node];
+		// Changed by an action since the snapshot
+		if (n.getContent() != candidate.content)
+			continue;
+
+		ABMStats &stats = m_stats[aabm.stats];
+		u64 t0 = porting::getTimeUs();
+
+		v3s16 p0(candidate.node % MAP_BLOCKSIZE,
+			candidate.node / MAP_BLOCKSIZE % MAP_BLOCKSIZE,
+			candidate.node / (MAP_BLOCKSIZE * MAP_BLOCKSIZE));
+		// The neighborhood may have changed as well
+		if (aabm.check_required_neighbors &&
+				!hasRequiredNeighbor(block, p0, aabm)) {
+			stats.time_us += porting::getTimeUs() - t0;
+			continue;
+		}
+
+		v3s16 p = p0 + block->getPosRelative();
+		m_abms_run++;
+		// Call all the trigger variations
+		aabm.abm->trigger(m_env, p, n);
+		aabm.abm->trigger(m_env, p, n,
+			active_object_count, active_object_count_wider);
+
+		stats.runs++;
+		stats.time_us += porting::getTimeUs() - t0;
+
+		// Count surrounding objects again if the abms added any
+		if(m_env->m_added_objects > 0) {
+			active_object_count = countObjects(block, map, active_object_count_wider);
+			m_env->m_added_objects = 0;
+		}
+	}
+}
+
+bool ABMHandler::step(const std::vector<v3s16> &blocks, u32 max_time_ms,
+	ABMScanPool *pool)
+{
+	TimeTaker timer("ABMHandler::step", nullptr, PRECISION_MILLI);
+	const size_t batch_size = MYMAX(1,
+		BLOCKS_PER_THREAD * pool->getThreadCount());
+
+	for (;;) {
+		if (m_pending.empty()) {
+			if (timer.getTimerTime() > max_time_ms)
+				return false;
+			if (m_next_block >= blocks.size())
+				return true;
+
+			// Snapshot and scan the next batch of blocks
+			std::vector<ABMScanJob> jobs;
+			while (jobs.size() < batch_size && m_next_block < blocks.size()) {
+				ABMScanJob job;
+				if (prepare(blocks[m_next_block++], job))
+					jobs.push_back(std::move(job));
+			}
+			pool->scan(this, jobs);
+			for (ABMScanJob &job : jobs)
+				m_pending.push_back(std::move(job));
+		}
+
+		// Run the Lua actions in block order
+		while (!m_pending.empty()) {
+			trigger(m_pending.front());
+			m_pending.pop_front();
+			if (timer.getTimerTime() > max_time_ms)
+				return m_pending.empty() && m_next_block >= blocks.size();
+		}
+	}
+}
+
+void ABMHandler::reportProfiler()
+{
+	g_profiler->avg("ServerEnv: active blocks skipped for ABMs", m_blocks_skipped);
+	g_profiler->avg("ServerEnv: active blocks scanned for ABMs", m_blocks_scanned);
+	g_profiler->avg("ServerEnv: ABMs run", m_abms_run);
+
+	for (const ABMStats &stats : m_stats) {
+		const std::string label = stats.label.empty() ?
+			"(unlabeled)" : stats.label;
+		g_profiler->avg("ServerEnv: ABM " + label + " run", stats.runs);
+		g_profiler->avg("ServerEnv: ABM " + label + " time [ms]",
+			stats.time_us / 1000.0f);
+	}
+}
@@ -0,0 +1,167 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "irr_v3d.h"
+#include "mapnode.h"
+#include "threading/semaphore.h"
+#include "threading/thread.h"
+#include "util/container.h"
+
+class ABMHandler;
+class ActiveBlockModifier;
+struct ABMWithState;
+class MapBlock;
+class ServerEnvironment;
+class ServerMap;
+
+struct ActiveABM
+{
+	ActiveBlockModifier *abm;
+	int chance;
+	std::vector<content_t> required_neighbors;
+	bool check_required_neighbors; // false if required_neighbors is known to be empty
+	// Shared by the copies of the ABM for each of its trigger contents
+	u32 neighbor_check; // index in ABMHandler::m_neighbor_checks
+	u32 stats; // index in ABMHandler::m_stats
+};
+
+// A node that passed the chance and neighbor checks of an ABM
+struct ABMCandidate
+{
+	u16 node; // index in the MapBlock data
+	content_t content;
+	const ActiveABM *aabm;
+};
+
+/*
+	Scanning of one block. The inputs are a snapshot taken on the server
+	thread, so that the scan can run on any thread.
+*/
+struct ABMScanJob
+{
+	v3s16 blockpos;
+	// Seed of the chance checks, drawn in block order for repeatable runs
+	u32 seed;
+	// Contents of the block and one node around it, in VoxelArea order
+	std::vector<content_t> grid;
+
+	std::vector<ABMCandidate> candidates;
+};
+
+class ABMScanThread;
+
+// Worker threads scanning blocks for ABM candidates
+class ABMScanPool
+{
+public:
+	ABMScanPool(unsigned int num_threads);
+	~ABMScanPool();
+
+	// Scans the jobs, returns when all are done
+	void scan(const ABMHandler *handler, std::vector<ABMScanJob> &jobs);
+
+	size_t getThreadCount() const { return m_threads.size(); }
+
+private:
+	friend class ABMScanThread;
+
+	std::vector<ABMScanThread *> m_threads;
+	MutexedQueue<std::pair<const ABMHandler *, ABMScanJob *>> m_jobs;
+	Semaphore m_done;
+};
+
+/*
+	Runs the ABMs of one abm_interval. Blocks are scanned in batches and
+	the triggers run in the order of the block list, across as many server
+	steps as needed.
+*/
+class ABMHandler
+{
+public:
+	ABMHandler(std::vector<ABMWithState> &abms,
+		float dtime_s, ServerEnvironment *env,
+		bool use_timers);
+	~ABMHandler();
+
+	// Processes the blocks from `blocks` until the list is done or
+	// `max_time_ms` is used up. Returns true when all blocks are processed.
+	bool step(const std::vector<v3s16> &blocks, u32 max_time_ms,
+		ABMScanPool *pool);
+
+	// Thread safe, reads only the job and the ABM tables
+	void scan(ABMScanJob &job) const;
+
+	u32 getBlocksProcessed() const { return m_next_block; }
+
+	void reportProfiler();
+
+private:
+	// Find out how many objects the given block and its neighbours contain.
+	// Returns the number of objects in the block, and also in 'wider' the
+	// number of objects in the block and all its neighbours. The latter
+	// may an estimate if any neighbours are unloaded.
+	u32 countObjects(MapBlock *block, ServerMap * map, u32 &wider);
+
+	// Checks the current state of the map
+	bool hasRequiredNeighbor(MapBlock *block, v3s16 p0, const ActiveABM &aabm);
+
+	// Takes the snapshot of the block, false if there is nothing to scan
+	bool prepare(v3s16 blockpos, ABMScanJob &job);
+	void trigger(ABMScanJob &job);
+
+	ServerEnvironment *m_env;
+	std::vector<std::vector<ActiveABM> *> m_aabms;
+
+	// Content id -> any ABM triggers on it
+	std::vector<bool> m_is_trigger;
+
+	// Required neighbors of an ABM
+	struct NeighborCheck
+	{
+		std::vector<bool> contents;
+	};
+	std::vector<NeighborCheck> m_neighbor_checks;
+
+	// Per label, definitions with identical labels are listed as one
+	struct ABMStats
+	{
+		std::string label;
+		u32 runs = 0;
+		u64 time_us = 0;
+	};
+	std::vector<ABMStats> m_stats;
+
+	// Progress in the block list
+	u32 m_next_block = 0;
+	// Scanned, not yet triggered
+	std::deque<ABMScanJob> m_pending;
+
+	int m_blocks_scanned = 0;
+	int m_abms_run = 0;
+	int m_blocks_skipped = 0;
+};
@@ -17,6 +17,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#include <algorithm>
+#include <cmath>
 #include <log.h>
 #include "mapblock.h"
 #include "profiler.h"
@@ -25,6 +27,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 namespace server
 {
 
+// KIDSCODE - Spatial index: side length of a grid cell, in BS units
+#define OBJECT_INDEX_CELL_SIZE (2 * MAP_BLOCKSIZE * BS)
+
 void ActiveObjectMgr::clear(const std::function<bool(ServerActiveObject *, u16)> &cb)
 {
 	std::vector<u16> objects_to_remove;
@@ -38,6 +43,7 @@ void ActiveObjectMgr::clear(const std::function<bool(ServerActiveObject *, u16)>
 	// Remove references from m_active_objects
 	for (u16 i : objects_to_remove) {
 		m_active_objects.erase(i);
+		unindexObject(i); // KIDSCODE - Spatial index
 	}
 }
 
@@ -47,6 +53,7 @@ void ActiveObjectMgr::step(
 	g_profiler->avg("ActiveObjectMgr: SAO count [#]", m_active_objects.size());
 	for (auto &ao_it : m_active_objects) {
 		f(ao_it.second);
+		indexObject(ao_it.second); // KIDSCODE - Spatial index
 	}
 }
 
@@ -88,6 +95,7 @@ bool ActiveObjectMgr::registerObject(ServerActiveObject *obj)
 	}
 
 	m_active_objects[obj->getId()] = obj;
+	indexObject(obj); // KIDSCODE - Spatial index
 
 	verbosestream << "Server::ActiveObjectMgr::addActiveObjectRaw(): "
 			<< "Added id=" << obj->getId() << "; there are now "
@@ -107,6 +115,7 @@ void ActiveObjectMgr::removeObject(u16 id)
 	}
 
 	m_active_objects.erase(id);
+	unindexObject(id); // KIDSCODE - Spatial index
 	delete obj;
 }
 
@@ -132,38 +141,120 @@ void ActiveObjectMgr::getAddedActiveObjectsAroundPos(const v3f &player_pos, f32
 		std::queue<u16> &added_objects)
 {
 	/*
-		Go through the object list,
+		Go through the candidate objects,
 		- discard removed/deactivated objects,
 		- discard objects that are too far away,
 		- discard objects that are found in current_objects.
 		- add remaining objects to added_objects
 	*/
-	for (auto &ao_it : m_active_objects) {
-		u16 id = ao_it.first;
-
+	auto check_object = [&] (u16 id) {
 		// Get object
-		ServerActiveObject *object = ao_it.second;
+		ServerActiveObject *object = getActiveObject(id);
 		if (!object)
-			continue;
+			return;
 
 		if (object->isGone())
-			continue;
+			return;
 
 		f32 distance_f = object->getBasePosition().getDistanceFrom(player_pos);
 		if (object->getType() == ACTIVEOBJECT_TYPE_PLAYER) {
 			// Discard if too far
 			if (distance_f > player_radius && player_radius != 0)
-				continue;
+				return;
 		} else if (distance_f > radius)
-			continue;
+			return;
 
 		// Discard if already on current_objects
 		auto n = current_objects.find(id);
 		if (n != current_objects.end())
-			continue;
+			return;
 		// Add to added_objects
 		added_objects.push(id);
+	};
+
+	// >> KIDSCODE - Spatial index
+	for (u16 id : m_player_ids)
+		check_object(id);
+
+	v3s16 min_cell = getCell(player_pos - v3f(radius, radius, radius));
+	v3s16 max_cell = getCell(player_pos + v3f(radius, radius, radius));
+	u64 cell_count = (u64)(max_cell.X - min_cell.X + 1) *
+		(max_cell.Y - min_cell.Y + 1) * (max_cell.Z - min_cell.Z + 1);
+
+	// Huge radius: cheaper to go through the occupied cells only
+	if (cell_count > m_cells.size()) {
+		for (const auto &cell_it : m_cells) {
+			const v3s16 &c = cell_it.first;
+			if (c.X < min_cell.X || c.X > max_cell.X ||
+					c.Y < min_cell.Y || c.Y > max_cell.Y ||
+					c.Z < min_cell.Z || c.Z > max_cell.Z)
+				continue;
+			for (u16 id : cell_it.second)
+				check_object(id);
+		}
+		return;
+	}
+
+	v3s16 c;
+	for (c.X = min_cell.X; c.X <= max_cell.X; c.X++)
+	for (c.Y = min_cell.Y; c.Y <= max_cell.Y; c.Y++)
+	for (c.Z = min_cell.Z; c.Z <= max_cell.Z; c.Z++) {
+		auto cell_it = m_cells.find(c);
+		if (cell_it == m_cells.end())
+			continue;
+		for (u16 id : cell_it->second)
+			check_object(id);
+	}
+	// << KIDSCODE
+}
+
+// >> KIDSCODE - Spatial index
+v3s16 ActiveObjectMgr::getCell(const v3f &pos)
+{
+	return v3s16(
+		std::floor(pos.X / OBJECT_INDEX_CELL_SIZE),
+		std::floor(pos.Y / OBJECT_INDEX_CELL_SIZE),
+		std::floor(pos.Z / OBJECT_INDEX_CELL_SIZE));
+}
+
+void ActiveObjectMgr::indexObject(ServerActiveObject *obj)
+{
+	u16 id = obj->getId();
+	if (obj->getType() == ACTIVEOBJECT_TYPE_PLAYER) {
+		m_player_ids.insert(id);
+		return;
+	}
+
+	v3s16 cell = getCell(obj->getBasePosition());
+	auto it = m_object_cells.find(id);
+	if (it != m_object_cells.end()) {
+		if (it->second == cell)
+			return;
+		unindexObject(id);
 	}
+
+	m_cells[cell].push_back(id);
+	m_object_cells[id] = cell;
 }
 
+void ActiveObjectMgr::unindexObject(u16 id)
+{
+	m_player_ids.erase(id);
+
+	auto it = m_object_cells.find(id);
+	if (it == m_object_cells.end())
+		return;
+
+	auto cell_it = m_cells.find(it->second);
+	std::vector<u16> &ids = cell_it->second;
+	*std::find(ids.begin(), ids.end(), id) = ids.back();
+	ids.pop_back();
+	if (ids.empty())
+		m_cells.erase(cell_it);
+
+	m_object_cells.erase(it);
+}
+// << KIDSCODE
+
+
 } // namespace server
@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #pragma once
 
 #include <functional>
+#include <unordered_set>
 #include <vector>
 #include "../activeobjectmgr.h"
 #include "serveractiveobject.h"
@@ -42,5 +43,32 @@ class ActiveObjectMgr : public ::ActiveObjectMgr<ServerActiveObject>
 	void getAddedActiveObjectsAroundPos(const v3f &player_pos, f32 radius,
 			f32 player_radius, std::set<u16> &current_objects,
 			std::queue<u16> &added_objects);
+
+	// >> KIDSCODE - Spatial index
+private:
+	/*
+		Grid of the non-player objects, so that the objects around a player
+		can be found without going through all of them. Cells are updated
+		when objects are stepped, an object moved in between is found at its
+		former cell until the next step.
+	*/
+	struct CellHash
+	{
+		size_t operator()(const v3s16 &p) const
+		{
+			return ((u32)p.X * 73856093u) ^ ((u32)p.Y * 19349663u) ^
+				((u32)p.Z * 83492791u);
+		}
+	};
+
+	static v3s16 getCell(const v3f &pos);
+	void indexObject(ServerActiveObject *obj);
+	void unindexObject(u16 id);
+
+	std::unordered_map<v3s16, std::vector<u16>, CellHash> m_cells;
+	std::unordered_map<u16, v3s16> m_object_cells;
+	// Players can be sent from farther away, they are not in the grid
+	std::unordered_set<u16> m_player_ids;
+	// << KIDSCODE
 };
 } // namespace server
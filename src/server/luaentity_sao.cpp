@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "luaentity_sao.h"
 #include "collision.h"
 #include "constants.h"
+#include "object_position.h" // KIDSCODE - Dead reckoning
 #include "player_sao.h"
 #include "scripting_server.h"
 #include "server.h"
@@ -204,9 +205,22 @@ void LuaEntitySAO::step(float dtime, bool send_recommended)
 		} else if(m_last_sent_position_timer > 0.2){
 			minchange = 0.05*BS;
 		}
-		float move_d = m_base_position.getDistanceFrom(m_last_sent_position);
+		// >> KIDSCODE - Dead reckoning
+		// Clients extrapolate the object from the last update, only send
+		// when it's off from where they see it. Physical objects collide
+		// client side, their last sent state is the better estimate.
+		v3f predicted_pos = m_last_sent_position;
+		v3f predicted_vel = m_last_sent_velocity;
+		if (!m_prop.physical) {
+			float t = m_last_sent_position_timer;
+			predicted_pos += m_last_sent_velocity * t +
+				m_last_sent_acceleration * (0.5f * t * t);
+			predicted_vel += m_last_sent_acceleration * t;
+		}
+		float move_d = m_base_position.getDistanceFrom(predicted_pos);
 		move_d += m_last_sent_move_precision;
-		float vel_d = m_velocity.getDistanceFrom(m_last_sent_velocity);
+		float vel_d = m_velocity.getDistanceFrom(predicted_vel);
+		// << KIDSCODE
 		if (move_d > minchange || vel_d > minchange ||
 				std::fabs(m_rotation.X - m_last_sent_rotation.X) > 1.0f ||
 				std::fabs(m_rotation.Y - m_last_sent_rotation.Y) > 1.0f ||
@@ -487,8 +501,6 @@ void LuaEntitySAO::sendPosition(bool do_interpolate, bool is_movement_end)
 			m_last_sent_position);
 	m_last_sent_position_timer = 0;
 	m_last_sent_position = m_base_position;
-	m_last_sent_velocity = m_velocity;
-	//m_last_sent_acceleration = m_acceleration;
 	m_last_sent_rotation = m_rotation;
 
 	float update_interval = m_env->getSendRecommendedInterval();
@@ -502,6 +514,16 @@ void LuaEntitySAO::sendPosition(bool do_interpolate, bool is_movement_end)
 		is_movement_end,
 		update_interval
 	);
+
+	// >> KIDSCODE - Dead reckoning
+	// Clients extrapolate from the velocity and acceleration as quantized
+	// by the compact command, so predict from the same values
+	std::istringstream is(str, std::ios::binary);
+	ObjectPositionUpdate sent;
+	sent.deSerialize(is, readU8(is));
+	m_last_sent_velocity = sent.velocity;
+	m_last_sent_acceleration = sent.acceleration;
+	// << KIDSCODE
 	// create message and add to list
 	m_messages_out.emplace(getId(), false, str);
 }
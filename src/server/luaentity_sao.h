@@ -86,6 +86,7 @@ class LuaEntitySAO : public UnitSAO
 
 	v3f m_last_sent_position;
 	v3f m_last_sent_velocity;
+	v3f m_last_sent_acceleration; // KIDSCODE - Dead reckoning
 	v3f m_last_sent_rotation;
 	float m_last_sent_position_timer = 0.0f;
 	float m_last_sent_move_precision = 0.0f;
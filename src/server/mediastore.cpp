@@ -0,0 +1,232 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include "mediastore.h"
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include "filesys.h"
+#include "log.h"
+#include "threading/semaphore.h"
+#include "threading/thread.h"
+#include "util/hex.h"
+#include "util/sha1.h"
+
+bool read_media_file(const std::string &path, std::string *data)
+{
+	std::ifstream fis(path.c_str(), std::ios_base::binary);
+	if (!fis.good())
+		return false;
+
+	std::ostringstream os(std::ios_base::binary);
+	os << fis.rdbuf();
+	if (fis.bad())
+		return false;
+
+	*data = os.str();
+	return true;
+}
+
+/*
+	Parallel hashing
+*/
+
+static void hash_media_file(MediaHashJob &job)
+{
+	std::string data;
+	if (!read_media_file(job.path, &data) || data.empty())
+		return;
+
+	SHA1 sha1;
+	sha1.addBytes(data.c_str(), data.length());
+	unsigned char *digest = sha1.getDigest();
+	job.digest = std::string((char *)digest, 20);
+	free(digest);
+}
+
+class MediaHashThread : public Thread
+{
+public:
+	MediaHashThread(std::vector<MediaHashJob> &jobs, std::atomic<size_t> &next,
+			Semaphore &go) :
+		Thread("MediaHash"),
+		m_jobs(jobs),
+		m_next(next),
+		m_go(go)
+	{}
+
+	void *run()
+	{
+		// Thread::start() returns once the thread runs, it must not be
+		// done before
+		m_go.wait();
+
+		for (size_t i = m_next++; i < m_jobs.size(); i = m_next++)
+			hash_media_file(m_jobs[i]);
+		return nullptr;
+	}
+
+private:
+	std::vector<MediaHashJob> &m_jobs;
+	std::atomic<size_t> &m_next;
+	Semaphore &m_go;
+};
+
+void hash_media_files(std::vector<MediaHashJob> &jobs, unsigned int num_threads)
+{
+	std::atomic<size_t> next(0);
+	Semaphore go;
+	std::vector<MediaHashThread *> threads;
+	for (unsigned int i = 1; i < num_threads && i < jobs.size(); i++) {
+		MediaHashThread *thread = new MediaHashThread(jobs, next, go);
+		if (!thread->start()) {
+			delete thread;
+			break;
+		}
+		threads.push_back(thread);
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+		go.post();
+
+	// The calling thread works too
+	for (size_t i = next++; i < jobs.size(); i = next++)
+		hash_media_file(jobs[i]);
+
+	for (MediaHashThread *thread : threads) {
+		thread->wait();
+		delete thread;
+	}
+}
+
+/*
+	MediaIndex
+*/
+
+void MediaIndex::load()
+{
+	m_entries.clear();
+
+	std::ifstream is(m_path.c_str(), std::ios_base::binary);
+	if (!is.good())
+		return;
+
+	// <hex digest> <size> <mtime> <path>
+	std::string line;
+	while (std::getline(is, line)) {
+		std::istringstream iss(line);
+		std::string hex_digest, path;
+		Entry entry;
+		if (!(iss >> hex_digest >> entry.size >> entry.mtime))
+			continue;
+		iss.get();
+		std::getline(iss, path);
+		if (hex_digest.size() != 40 || path.empty())
+			continue;
+
+		bool valid = true;
+		entry.digest.resize(20);
+		for (size_t i = 0; i < 20 && valid; i++) {
+			unsigned char high, low;
+			valid = hex_digit_decode(hex_digest[2 * i], high) &&
+				hex_digit_decode(hex_digest[2 * i + 1], low);
+			entry.digest[i] = (high << 4) | low;
+		}
+		if (!valid)
+			continue;
+
+		entry.used = false;
+		m_entries[path] = entry;
+	}
+}
+
+bool MediaIndex::save()
+{
+	std::ostringstream os(std::ios_base::binary);
+	for (const auto &it : m_entries) {
+		if (!it.second.used && !fs::PathExists(it.first))
+			continue;
+		os << hex_encode(it.second.digest) << " " << it.second.size << " "
+			<< it.second.mtime << " " << it.first << "\n";
+	}
+
+	if (!fs::safeWriteToFile(m_path, os.str())) {
+		warningstream << "MediaIndex: failed to save " << m_path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool MediaIndex::lookup(const std::string &path, u64 size, u64 mtime,
+	std::string *digest)
+{
+	auto it = m_entries.find(path);
+	if (it == m_entries.end() || it->second.size != size ||
+			it->second.mtime != mtime)
+		return false;
+
+	it->second.used = true;
+	*digest = it->second.digest;
+	return true;
+}
+
+void MediaIndex::update(const std::string &path, u64 size, u64 mtime,
+	const std::string &digest)
+{
+	Entry &entry = m_entries[path];
+	entry.size = size;
+	entry.mtime = mtime;
+	entry.digest = digest;
+	entry.used = true;
+}
+
+/*
+	MediaStore
+*/
+
+std::shared_ptr<const std::string> MediaStore::get(const std::string &digest)
+{
+	auto it = m_index.find(digest);
+	if (it == m_index.end())
+		return nullptr;
+
+	// Most recently used
+	m_items.splice(m_items.begin(), m_items, it->second);
+	return it->second->second;
+}
+
+void MediaStore::put(const std::string &digest,
+	std::shared_ptr<const std::string> data)
+{
+	if (data->size() > m_max_size || m_index.find(digest) != m_index.end())
+		return;
+
+	m_items.emplace_front(digest, data);
+	m_index[digest] = m_items.begin();
+	m_size += data->size();
+
+	// Forget the least recently used
+	while (m_size > m_max_size) {
+		const Item &item = m_items.back();
+		m_size -= item.second->size();
+		m_index.erase(item.first);
+		m_items.pop_back();
+	}
+}
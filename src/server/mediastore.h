@@ -0,0 +1,109 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "irrlichttypes.h"
+
+// A media file to hash
+struct MediaHashJob
+{
+	std::string name;
+	std::string path;
+	u64 size = 0;
+	u64 mtime = 0; // in nanoseconds, or whole seconds on Windows
+
+	// Raw SHA1 digest, empty if the file could not be read or is empty
+	std::string digest;
+};
+
+// Reads a whole media file
+bool read_media_file(const std::string &path, std::string *data);
+
+// Reads and hashes the files of the jobs, on up to num_threads threads
+void hash_media_files(std::vector<MediaHashJob> &jobs, unsigned int num_threads);
+
+/*
+	Persistent index of the media file digests. A file is hashed again only
+	when its path, size or modification time changed since the last save.
+*/
+class MediaIndex
+{
+public:
+	MediaIndex(const std::string &path) : m_path(path) {}
+
+	// A missing or unreadable index is empty
+	void load();
+	// Forgets the entries not looked up or updated since the load whose
+	// file is gone
+	bool save();
+
+	// Raw SHA1 digest of the file if it did not change
+	bool lookup(const std::string &path, u64 size, u64 mtime,
+		std::string *digest);
+	void update(const std::string &path, u64 size, u64 mtime,
+		const std::string &digest);
+
+	size_t size() const { return m_entries.size(); }
+
+private:
+	struct Entry
+	{
+		u64 size;
+		u64 mtime;
+		std::string digest;
+		bool used;
+	};
+
+	std::string m_path;
+	std::unordered_map<std::string, Entry> m_entries;
+};
+
+/*
+	Data of the media files sent to the clients, by digest. Keeps the most
+	recently sent files up to a size limit, so that clients joining one
+	after the other don't make the server read the same files again.
+*/
+class MediaStore
+{
+public:
+	MediaStore(size_t max_size) : m_max_size(max_size) {}
+
+	// nullptr if the data is not stored
+	std::shared_ptr<const std::string> get(const std::string &digest);
+	// Data larger than the limit is not stored
+	void put(const std::string &digest, std::shared_ptr<const std::string> data);
+
+	size_t getSize() const { return m_size; }
+
+private:
+	typedef std::pair<std::string, std::shared_ptr<const std::string>> Item;
+
+	size_t m_max_size;
+	size_t m_size = 0;
+	// Most recently used first
+	std::list<Item> m_items;
+	std::unordered_map<std::string, std::list<Item>::iterator> m_index;
+};
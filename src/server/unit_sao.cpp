@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "unit_sao.h"
 #include "scripting_server.h"
 #include "serverenvironment.h"
+#include "object_position.h" // KIDSCODE - Compact position updates
 
 UnitSAO::UnitSAO(ServerEnvironment *env, v3f pos) : ServerActiveObject(env, pos)
 {
@@ -301,24 +302,22 @@ std::string UnitSAO::generateUpdatePositionCommand(const v3f &position,
 		const v3f &velocity, const v3f &acceleration, const v3f &rotation,
 		bool do_interpolate, bool is_movement_end, f32 update_interval)
 {
+	// >> KIDSCODE - Compact position updates
+	ObjectPositionUpdate update;
+	update.position = position;
+	update.velocity = velocity;
+	update.acceleration = acceleration;
+	update.rotation = rotation;
+	update.do_interpolate = do_interpolate;
+	update.is_movement_end = is_movement_end;
+	update.update_interval = update_interval;
+
+	// Older clients get it converted by the server
 	std::ostringstream os(std::ios::binary);
-	// command
-	writeU8(os, AO_CMD_UPDATE_POSITION);
-	// pos
-	writeV3F32(os, position);
-	// velocity
-	writeV3F32(os, velocity);
-	// acceleration
-	writeV3F32(os, acceleration);
-	// rotation
-	writeV3F32(os, rotation);
-	// do_interpolate
-	writeU8(os, do_interpolate);
-	// is_end_position (for interpolation)
-	writeU8(os, is_movement_end);
-	// update_interval (for interpolation)
-	writeF32(os, update_interval);
+	if (!update.serializeCompact(os))
+		update.serialize(os);
 	return os.str();
+	// << KIDSCODE
 }
 
 std::string UnitSAO::generateSetPropertiesCommand(const ObjectProperties &prop) const
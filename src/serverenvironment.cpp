@@ -49,6 +49,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #endif
 #include "server/luaentity_sao.h"
 #include "server/player_sao.h"
+#include "server/abmhandler.h" // KIDSCODE - Parallel ABM scanning
+#include "pathfinder.h" // KIDSCODE - Pathfinder cache
 
 #define LBM_NAME_ALLOWED_CHARS "abcdefghijklmnopqrstuvwxyz0123456789_:"
 
@@ -258,12 +260,30 @@ void LBMManager::applyLBMs(ServerEnvironment *env, MapBlock *block, u32 stamp)
 	v3s16 pos;
 	MapNode n;
 	content_t c;
+	// >> KIDSCODE - Content histogram
+	// Contents of the block with LBMs in the current lookup entry
+	std::vector<std::pair<content_t, const std::vector<LoadingBlockModifierDef *> *>>
+		targets;
+	// << KIDSCODE
 	lbm_lookup_map::const_iterator it = getLBMsIntroducedAfter(stamp);
 	for (; it != m_lbm_lookup.end(); ++it) {
-		// Cache previous version to speedup lookup which has a very high performance
-		// penalty on each call
-		content_t previous_c{};
-		std::vector<LoadingBlockModifierDef *> *lbm_list = nullptr;
+		// >> KIDSCODE - Content histogram
+		// Skip the block unless it contains one of the node types, the
+		// lookup runs once per content type instead of once per node
+		targets.clear();
+		// LBMs run before may have changed the block
+		for (const auto &entry : block->getContentHistogram()) {
+			const std::vector<LoadingBlockModifierDef *> *lbm_list =
+				it->second.lookup(entry.first);
+			if (lbm_list)
+				targets.emplace_back(entry.first, lbm_list);
+		}
+		if (targets.empty())
+			continue;
+
+		// Cache previous version, runs of the same content are common
+		content_t previous_c = CONTENT_IGNORE;
+		const std::vector<LoadingBlockModifierDef *> *lbm_list = nullptr;
 
 		for (pos.X = 0; pos.X < MAP_BLOCKSIZE; pos.X++)
 			for (pos.Y = 0; pos.Y < MAP_BLOCKSIZE; pos.Y++)
@@ -271,10 +291,14 @@ void LBMManager::applyLBMs(ServerEnvironment *env, MapBlock *block, u32 stamp)
 					n = block->getNodeNoEx(pos);
 					c = n.getContent();
 
-					// If content_t are not matching perform an LBM lookup
 					if (previous_c != c) {
-						lbm_list = (std::vector<LoadingBlockModifierDef *> *)
-							it->second.lookup(c);
+						lbm_list = nullptr;
+						for (const auto &target : targets) {
+							if (target.first == c) {
+								lbm_list = target.second;
+								break;
+							}
+						}
 						previous_c = c;
 					}
 
@@ -284,6 +308,7 @@ void LBMManager::applyLBMs(ServerEnvironment *env, MapBlock *block, u32 stamp)
 						lbmdef->trigger(env, pos + pos_of_block, n);
 					}
 				}
+		// << KIDSCODE
 	}
 }
 
@@ -460,20 +485,34 @@ ServerEnvironment::ServerEnvironment(ServerMap *map,
 
 	m_player_database = openPlayerDatabase(player_backend_name, path_world, conf);
 	m_auth_database = openAuthDatabase(auth_backend_name, path_world, conf);
+
+	// >> KIDSCODE - Parallel ABM scanning
+	s16 abm_scan_threads = g_settings->getS16("abm_scan_threads");
+	if (abm_scan_threads < 0)
+		abm_scan_threads = MYMIN(4, (s16)Thread::getNumberOfProcessors() / 2);
+	m_abm_scan_pool.reset(new ABMScanPool(abm_scan_threads));
+	// << KIDSCODE
 }
 
 ServerEnvironment::~ServerEnvironment()
 {
 	// Clear active block list.
 	// This makes the next one delete all active objects.
+	detachNodeTimers(); // KIDSCODE - Node timer scheduling
 	m_active_blocks.clear();
 
 	// Convert all objects to static and delete the active objects
 	deactivateFarObjects(true);
 
 	// Drop/delete map
+	m_pathfinder_cache.reset(); // KIDSCODE - Pathfinder cache
 	m_map->drop();
 
+	// >> KIDSCODE - Parallel ABM scanning
+	m_abm_handler.reset();
+	m_abm_scan_pool.reset();
+	// << KIDSCODE
+
 	// Delete ActiveBlockModifiers
 	for (ABMWithState &m_abm : m_abms) {
 		delete m_abm.abm;
@@ -498,6 +537,15 @@ ServerMap & ServerEnvironment::getServerMap()
 	return *m_map;
 }
 
+// >> KIDSCODE - Pathfinder cache
+PathfinderCache *ServerEnvironment::getPathfinderCache()
+{
+	if (!m_pathfinder_cache)
+		m_pathfinder_cache.reset(new PathfinderCache(m_map, m_server->ndef()));
+	return m_pathfinder_cache.get();
+}
+// << KIDSCODE
+
 RemotePlayer *ServerEnvironment::getPlayer(const session_t peer_id)
 {
 	for (RemotePlayer *player : m_players) {
@@ -724,216 +772,6 @@ void ServerEnvironment::loadDefaultMeta()
 	m_lbm_mgr.loadIntroductionTimes("", m_server, m_game_time);
 }
 
-struct ActiveABM
-{
-	ActiveBlockModifier *abm;
-	int chance;
-	std::vector<content_t> required_neighbors;
-	bool check_required_neighbors; // false if required_neighbors is known to be empty
-};
-
-class ABMHandler
-{
-private:
-	ServerEnvironment *m_env;
-	std::vector<std::vector<ActiveABM> *> m_aabms;
-public:
-	ABMHandler(std::vector<ABMWithState> &abms,
-		float dtime_s, ServerEnvironment *env,
-		bool use_timers):
-		m_env(env)
-	{
-		if(dtime_s < 0.001)
-			return;
-		const NodeDefManager *ndef = env->getGameDef()->ndef();
-		for (ABMWithState &abmws : abms) {
-			ActiveBlockModifier *abm = abmws.abm;
-			float trigger_interval = abm->getTriggerInterval();
-			if(trigger_interval < 0.001)
-				trigger_interval = 0.001;
-			float actual_interval = dtime_s;
-			if(use_timers){
-				abmws.timer += dtime_s;
-				if(abmws.timer < trigger_interval)
-					continue;
-				abmws.timer -= trigger_interval;
-				actual_interval = trigger_interval;
-			}
-			float chance = abm->getTriggerChance();
-			if(chance == 0)
-				chance = 1;
-			ActiveABM aabm;
-			aabm.abm = abm;
-			if (abm->getSimpleCatchUp()) {
-				float intervals = actual_interval / trigger_interval;
-				if(intervals == 0)
-					continue;
-				aabm.chance = chance / intervals;
-				if(aabm.chance == 0)
-					aabm.chance = 1;
-			} else {
-				aabm.chance = chance;
-			}
-
-			// Trigger neighbors
-			const std::vector<std::string> &required_neighbors_s =
-				abm->getRequiredNeighbors();
-			for (const std::string &required_neighbor_s : required_neighbors_s) {
-				ndef->getIds(required_neighbor_s, aabm.required_neighbors);
-			}
-			aabm.check_required_neighbors = !required_neighbors_s.empty();
-
-			// Trigger contents
-			const std::vector<std::string> &contents_s = abm->getTriggerContents();
-			for (const std::string &content_s : contents_s) {
-				std::vector<content_t> ids;
-				ndef->getIds(content_s, ids);
-				for (content_t c : ids) {
-					if (c >= m_aabms.size())
-						m_aabms.resize(c + 256, NULL);
-					if (!m_aabms[c])
-						m_aabms[c] = new std::vector<ActiveABM>;
-					m_aabms[c]->push_back(aabm);
-				}
-			}
-		}
-	}
-
-	~ABMHandler()
-	{
-		for (auto &aabms : m_aabms)
-			delete aabms;
-	}
-
-	// Find out how many objects the given block and its neighbours contain.
-	// Returns the number of objects in the block, and also in 'wider' the
-	// number of objects in the block and all its neighbours. The latter
-	// may an estimate if any neighbours are unloaded.
-	u32 countObjects(MapBlock *block, ServerMap * map, u32 &wider)
-	{
-		wider = 0;
-		u32 wider_unknown_count = 0;
-		for(s16 x=-1; x<=1; x++)
-			for(s16 y=-1; y<=1; y++)
-				for(s16 z=-1; z<=1; z++)
-				{
-					MapBlock *block2 = map->getBlockNoCreateNoEx(
-						block->getPos() + v3s16(x,y,z));
-					if(block2==NULL){
-						wider_unknown_count++;
-						continue;
-					}
-					wider += block2->m_static_objects.m_active.size()
-						+ block2->m_static_objects.m_stored.size();
-				}
-		// Extrapolate
-		u32 active_object_count = block->m_static_objects.m_active.size();
-		u32 wider_known_count = 3*3*3 - wider_unknown_count;
-		wider += wider_unknown_count * wider / wider_known_count;
-		return active_object_count;
-
-	}
-	void apply(MapBlock *block, int &blocks_scanned, int &abms_run, int &blocks_cached)
-	{
-		if(m_aabms.empty() || block->isDummy())
-			return;
-
-		// Check the content type cache first
-		// to see whether there are any ABMs
-		// to be run at all for this block.
-		if (block->contents_cached) {
-			blocks_cached++;
-			bool run_abms = false;
-			for (content_t c : block->contents) {
-				if (c < m_aabms.size() && m_aabms[c]) {
-					run_abms = true;
-					break;
-				}
-			}
-			if (!run_abms)
-				return;
-		} else {
-			// Clear any caching
-			block->contents.clear();
-		}
-		blocks_scanned++;
-
-		ServerMap *map = &m_env->getServerMap();
-
-		u32 active_object_count_wider;
-		u32 active_object_count = this->countObjects(block, map, active_object_count_wider);
-		m_env->m_added_objects = 0;
-
-		v3s16 p0;
-		for(p0.X=0; p0.X<MAP_BLOCKSIZE; p0.X++)
-		for(p0.Y=0; p0.Y<MAP_BLOCKSIZE; p0.Y++)
-		for(p0.Z=0; p0.Z<MAP_BLOCKSIZE; p0.Z++)
-		{
-			const MapNode &n = block->getNodeUnsafe(p0);
-			content_t c = n.getContent();
-			// Cache content types as we go
-			if (!block->contents_cached && !block->do_not_cache_contents) {
-				block->contents.insert(c);
-				if (block->contents.size() > 64) {
-					// Too many different nodes... don't try to cache
-					block->do_not_cache_contents = true;
-					block->contents.clear();
-				}
-			}
-
-			if (c >= m_aabms.size() || !m_aabms[c])
-				continue;
-
-			v3s16 p = p0 + block->getPosRelative();
-			for (ActiveABM &aabm : *m_aabms[c]) {
-				if (myrand() % aabm.chance != 0)
-					continue;
-
-				// Check neighbors
-				if (aabm.check_required_neighbors) {
-					v3s16 p1;
-					for(p1.X = p0.X-1; p1.X <= p0.X+1; p1.X++)
-					for(p1.Y = p0.Y-1; p1.Y <= p0.Y+1; p1.Y++)
-					for(p1.Z = p0.Z-1; p1.Z <= p0.Z+1; p1.Z++)
-					{
-						if(p1 == p0)
-							continue;
-						content_t c;
-						if (block->isValidPosition(p1)) {
-							// if the neighbor is found on the same map block
-							// get it straight from there
-							const MapNode &n = block->getNodeUnsafe(p1);
-							c = n.getContent();
-						} else {
-							// otherwise consult the map
-							MapNode n = map->getNode(p1 + block->getPosRelative());
-							c = n.getContent();
-						}
-						if (CONTAINS(aabm.required_neighbors, c))
-							goto neighbor_found;
-					}
-					// No required neighbor found
-					continue;
-				}
-				neighbor_found:
-
-				abms_run++;
-				// Call all the trigger variations
-				aabm.abm->trigger(m_env, p, n);
-				aabm.abm->trigger(m_env, p, n,
-					active_object_count, active_object_count_wider);
-
-				// Count surrounding objects again if the abms added any
-				if(m_env->m_added_objects > 0) {
-					active_object_count = countObjects(block, map, active_object_count_wider);
-					m_env->m_added_objects = 0;
-				}
-			}
-		}
-		block->contents_cached = !block->do_not_cache_contents;
-	}
-};
-
 void ServerEnvironment::activateBlock(MapBlock *block, u32 additional_dtime)
 {
 	// Reset usage timer immediately, otherwise a block that becomes active
@@ -1277,6 +1115,8 @@ void ServerEnvironment::step(float dtime)
 
 			// Set current time as timestamp (and let it set ChangedFlag)
 			block->setTimestamp(m_game_time);
+
+			block->m_node_timers.detach(); // KIDSCODE - Node timer scheduling
 		}
 
 		/*
@@ -1292,6 +1132,8 @@ void ServerEnvironment::step(float dtime)
 			}
 
 			activateBlock(block);
+			// KIDSCODE - Node timer scheduling
+			block->m_node_timers.attach(&m_node_timer_scheduler, p);
 		}
 	}
 
@@ -1311,6 +1153,10 @@ void ServerEnvironment::step(float dtime)
 			// Reset block usage timer
 			block->resetUsageTimer();
 
+			// KIDSCODE - Node timer scheduling: a block loaded or generated
+			// again at an active position replaces the attached one
+			block->m_node_timers.attach(&m_node_timer_scheduler, p);
+
 			// Set current time as timestamp
 			block->setTimestampNoChangedFlag(m_game_time);
 			// If time has changed much from the one on disk,
@@ -1318,9 +1164,24 @@ void ServerEnvironment::step(float dtime)
 			if(block->getTimestamp() > block->getDiskTimestamp() + 60)
 				block->raiseModified(MOD_STATE_WRITE_AT_UNLOAD,
 					MOD_REASON_BLOCK_EXPIRED);
+		}
+
+		// >> KIDSCODE - Node timer scheduling
+		// Run node timers, only the blocks with a timer due are visited.
+		// Timers set by the callbacks run in the next interval at the earliest.
+		m_node_timer_scheduler.step(dtime);
+		std::vector<std::pair<v3s16, double>> due;
+		v3s16 blockpos;
+		double time;
+		while (m_node_timer_scheduler.popDue(&blockpos, &time))
+			due.emplace_back(blockpos, time);
+
+		for (const auto &entry : due) {
+			MapBlock *block = m_map->getBlockNoCreateNoEx(entry.first);
+			if (!block || !block->m_node_timers.popScheduled(entry.second))
+				continue;
 
-			// Run node timers
-			std::vector<NodeTimer> elapsed_timers = block->m_node_timers.step(dtime);
+			std::vector<NodeTimer> elapsed_timers = block->m_node_timers.step(0.0f);
 			if (!elapsed_timers.empty()) {
 				MapNode n;
 				v3s16 p2;
@@ -1334,58 +1195,45 @@ void ServerEnvironment::step(float dtime)
 				}
 			}
 		}
+		g_profiler->avg("ServerEnv: blocks with node timers due", due.size());
+		// << KIDSCODE
 	}
 
+	// >> KIDSCODE - Parallel ABM scanning
 	if (m_active_block_modifier_interval.step(dtime, m_cache_abm_interval)) {
-		ScopeProfiler sp(g_profiler, "SEnv: modify in blocks avg per interval", SPT_AVG);
-		TimeTaker timer("modify in active blocks per interval");
+		if (m_abm_handler) {
+			warningstream << "active block modifiers did not finish in time"
+				<< " (processed " << m_abm_handler->getBlocksProcessed()
+				<< " of " << m_abm_blocks.size() << " active blocks)"
+				<< std::endl;
+			m_abm_handler->reportProfiler();
+		}
 
 		// Initialize handling of ActiveBlockModifiers
-		ABMHandler abmhandler(m_abms, m_cache_abm_interval, this, true);
-
-		int blocks_scanned = 0;
-		int abms_run = 0;
-		int blocks_cached = 0;
-
-		std::vector<v3s16> output(m_active_blocks.m_abm_list.size());
+		m_abm_handler.reset(new ABMHandler(m_abms, m_cache_abm_interval,
+			this, true));
 
 		// Shuffle the active blocks so that each block gets an equal chance
 		// of having its ABMs run.
-		std::copy(m_active_blocks.m_abm_list.begin(), m_active_blocks.m_abm_list.end(), output.begin());
-		std::shuffle(output.begin(), output.end(), m_rgen);
-
-		int i = 0;
-		// The time budget for ABMs is 20%.
-		u32 max_time_ms = m_cache_abm_interval * 1000 / 5;
-		for (const v3s16 &p : output) {
-			MapBlock *block = m_map->getBlockNoCreateNoEx(p);
-			if (!block)
-				continue;
-
-			i++;
-
-			// Set current time as timestamp
-			block->setTimestampNoChangedFlag(m_game_time);
-
-			/* Handle ActiveBlockModifiers */
-			abmhandler.apply(block, blocks_scanned, abms_run, blocks_cached);
-
-			u32 time_ms = timer.getTimerTime();
-
-			if (time_ms > max_time_ms) {
-				warningstream << "active block modifiers took "
-					  << time_ms << "ms (processed " << i << " of "
-					  << output.size() << " active blocks)" << std::endl;
-				break;
-			}
+		m_abm_blocks.assign(m_active_blocks.m_abm_list.begin(),
+			m_active_blocks.m_abm_list.end());
+		std::shuffle(m_abm_blocks.begin(), m_abm_blocks.end(), m_rgen);
+		g_profiler->avg("ServerEnv: active blocks", m_abm_blocks.size());
+	}
+
+	if (m_abm_handler) {
+		ScopeProfiler sp(g_profiler, "SEnv: modify in blocks avg per step", SPT_AVG);
+
+		// The time budget for ABMs is 20% of each step, so that the work
+		// of an interval is spread over its steps
+		u32 max_time_ms = MYMAX(1, dtime * 1000 / 5);
+		if (m_abm_handler->step(m_abm_blocks, max_time_ms,
+				m_abm_scan_pool.get())) {
+			m_abm_handler->reportProfiler();
+			m_abm_handler.reset();
 		}
-		g_profiler->avg("ServerEnv: active blocks", m_active_blocks.m_abm_list.size());
-		g_profiler->avg("ServerEnv: active blocks cached", blocks_cached);
-		g_profiler->avg("ServerEnv: active blocks scanned for ABMs", blocks_scanned);
-		g_profiler->avg("ServerEnv: ABMs run", abms_run);
-
-		timer.stop(true);
 	}
+	// << KIDSCODE
 
 	/*
 		Step script environment (run global on_step())
@@ -1641,6 +1489,42 @@ void ServerEnvironment::getSelectedActiveObjects(
 	}
 }
 
+// >> KIDSCODE - Batched raycasts
+void ServerEnvironment::getSelectedActiveObjectsBatch(
+	const std::vector<core::line3d<f32>> &shootlines,
+	std::vector<std::vector<PointedThing>> &objects)
+{
+	objects.clear();
+	objects.resize(shootlines.size());
+	if (shootlines.empty())
+		return;
+
+	// One lookup for the objects around all the lines
+	aabb3f bounds(shootlines[0].start);
+	for (const core::line3d<f32> &line : shootlines) {
+		bounds.addInternalPoint(line.start);
+		bounds.addInternalPoint(line.end);
+	}
+	std::vector<ServerActiveObject *> objs;
+	getObjectsInsideRadius(objs, bounds.getCenter(),
+		bounds.getExtent().getLength() / 2 + 10.0f, nullptr);
+
+	std::vector<std::pair<u16, aabb3f>> boxes;
+	for (auto obj : objs) {
+		if (obj->isGone())
+			continue;
+		aabb3f selection_box;
+		if (!obj->getSelectionBox(&selection_box))
+			continue;
+
+		v3f pos = obj->getBasePosition();
+		boxes.emplace_back(obj->getId(), aabb3f(selection_box.MinEdge + pos,
+			selection_box.MaxEdge + pos));
+	}
+	selectBoxesBatch(boxes, shootlines, objects);
+}
+// << KIDSCODE
+
 /*
 	************ Private methods *************
 */
@@ -2295,5 +2179,17 @@ bool ServerEnvironment::migrateAuthDatabase(
 
 // Clear active blocks list
 void ServerEnvironment::clearActiveBlocks() {
+	detachNodeTimers(); // KIDSCODE - Node timer scheduling
 	m_active_blocks.clear();
 }
+
+// >> KIDSCODE - Node timer scheduling
+void ServerEnvironment::detachNodeTimers()
+{
+	for (const v3s16 &p : m_active_blocks.m_list) {
+		MapBlock *block = m_map->getBlockNoCreateNoEx(p);
+		if (block)
+			block->m_node_timers.detach();
+	}
+}
+// << KIDSCODE
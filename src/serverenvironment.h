@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "activeobject.h"
 #include "environment.h"
 #include "mapnode.h"
+#include "nodetimer.h" // KIDSCODE - Node timer scheduling
 #include "settings.h"
 #include "server/activeobjectmgr.h"
 #include "util/numeric.h"
@@ -38,6 +39,9 @@ class AuthDatabase;
 class PlayerSAO;
 class ServerEnvironment;
 class ActiveBlockModifier;
+class ABMHandler; // KIDSCODE - Parallel ABM scanning
+class ABMScanPool; // KIDSCODE - Parallel ABM scanning
+class PathfinderCache; // KIDSCODE - Pathfinder cache
 struct StaticObject;
 class ServerActiveObject;
 class Server;
@@ -67,6 +71,8 @@ class ActiveBlockModifier
 	virtual u32 getTriggerChance() = 0;
 	// Whether to modify chance to simulate time lost by an unnattended block
 	virtual bool getSimpleCatchUp() = 0;
+	// Label for profiling, may be empty // KIDSCODE - ABM scanning
+	virtual const std::string &getLabel() const = 0;
 	// This is called usually at interval for 1/chance of the nodes
 	virtual void trigger(ServerEnvironment *env, v3s16 p, MapNode n){};
 	virtual void trigger(ServerEnvironment *env, v3s16 p, MapNode n,
@@ -213,6 +219,9 @@ class ServerEnvironment : public Environment
 
 	ServerMap & getServerMap();
 
+	// KIDSCODE - Pathfinder cache
+	PathfinderCache *getPathfinderCache();
+
 	//TODO find way to remove this fct!
 	ServerScripting* getScriptIface()
 	{ return m_script; }
@@ -302,6 +311,11 @@ class ServerEnvironment : public Environment
 		std::vector<PointedThing> &objects
 	);
 
+	// Uses a grid of the objects around the lines // KIDSCODE - Batched raycasts
+	virtual void getSelectedActiveObjectsBatch(
+		const std::vector<core::line3d<f32>> &shootlines,
+		std::vector<std::vector<PointedThing>> &objects);
+
 	/*
 		Activate objects and dynamically modify for the dtime determined
 		from timestamp and additional_dtime
@@ -314,6 +328,11 @@ class ServerEnvironment : public Environment
 	*/
 
 	void addActiveBlockModifier(ActiveBlockModifier *abm);
+	// KIDSCODE - Parallel ABM scanning: the ABMs run in the block
+	bool isABMBlockActive(v3s16 blockpos) const
+	{
+		return m_active_blocks.m_abm_list.count(blockpos) != 0;
+	}
 	void addLoadingBlockModifierDef(LoadingBlockModifierDef *lbm);
 
 	/*
@@ -415,6 +434,9 @@ class ServerEnvironment : public Environment
 	*/
 	void activateObjects(MapBlock *block, u32 dtime_s);
 
+	// Detaches the node timers of the active blocks from the scheduler
+	void detachNodeTimers(); // KIDSCODE - Node timer scheduling
+
 	/*
 		A few helpers used by the three above methods
 	*/
@@ -429,6 +451,8 @@ class ServerEnvironment : public Environment
 
 	// The map
 	ServerMap *m_map;
+	// KIDSCODE - Pathfinder cache
+	std::unique_ptr<PathfinderCache> m_pathfinder_cache;
 	// Lua state
 	ServerScripting* m_script;
 	// Server definition
@@ -457,8 +481,16 @@ class ServerEnvironment : public Environment
 	// Time of last clearObjects call (game time).
 	// When a mapblock older than this is loaded, its objects are cleared.
 	u32 m_last_clear_objects_time = 0;
+	// KIDSCODE - Node timer scheduling
+	NodeTimerScheduler m_node_timer_scheduler;
 	// Active block modifiers
 	std::vector<ABMWithState> m_abms;
+	// >> KIDSCODE - Parallel ABM scanning
+	// Pass of the current abm_interval, spread over several steps
+	std::unique_ptr<ABMHandler> m_abm_handler;
+	std::vector<v3s16> m_abm_blocks;
+	std::unique_ptr<ABMScanPool> m_abm_scan_pool;
+	// << KIDSCODE
 	LBMManager m_lbm_mgr;
 	// An interval for generally sending object positions and stuff
 	float m_recommended_send_interval = 0.1f;
@@ -20,6 +20,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "test.h"
 
 #include "activeobject.h"
+#include <sstream>
+#include "object_position.h" // KIDSCODE - Compact position updates
 
 class TestActiveObject : public TestBase
 {
@@ -30,6 +32,7 @@ class TestActiveObject : public TestBase
 	void runTests(IGameDef *gamedef);
 
 	void testAOAttributes();
+	void testPositionUpdate(); // KIDSCODE - Compact position updates
 };
 
 static TestActiveObject g_test_instance;
@@ -37,6 +40,7 @@ static TestActiveObject g_test_instance;
 void TestActiveObject::runTests(IGameDef *gamedef)
 {
 	TEST(testAOAttributes);
+	TEST(testPositionUpdate); // KIDSCODE - Compact position updates
 }
 
 class TestAO : public ActiveObject
@@ -58,3 +62,64 @@ void TestActiveObject::testAOAttributes()
 	ao.setId(558);
 	UASSERT(ao.getId() == 558);
 }
+
+// >> KIDSCODE - Compact position updates
+void TestActiveObject::testPositionUpdate()
+{
+	ObjectPositionUpdate update;
+	update.position = v3f(-1234.567f, 45.01f, 30999.9f);
+	update.velocity = v3f(12.5f, -3.0f, 0.0f);
+	update.acceleration = v3f(0.0f, -98.1f, 0.0f);
+	update.rotation = v3f(0.0f, 271.3f, 0.0f);
+	update.do_interpolate = true;
+	update.is_movement_end = false;
+	update.update_interval = 0.09f;
+
+	std::ostringstream os(std::ios::binary);
+	UASSERT(update.serializeCompact(os));
+	std::string data = os.str();
+	UASSERT(data[0] == AO_CMD_UPDATE_POSITION_COMPACT);
+	UASSERT(data.size() == 33);
+
+	std::istringstream is(data.substr(1), std::ios::binary);
+	ObjectPositionUpdate result;
+	result.deSerialize(is, AO_CMD_UPDATE_POSITION_COMPACT);
+	UASSERT(result.position.getDistanceFrom(update.position) < 0.01f);
+	UASSERT(result.velocity.getDistanceFrom(update.velocity) < 0.05f);
+	UASSERT(result.acceleration.getDistanceFrom(update.acceleration) < 0.05f);
+	UASSERT(result.rotation.getDistanceFrom(update.rotation) < 0.01f);
+	UASSERT(result.do_interpolate && !result.is_movement_end);
+	UASSERT(std::fabs(result.update_interval - 0.09f) < 0.005f);
+
+	// Vectors that are zero are left out
+	update.velocity = update.acceleration = update.rotation = v3f();
+	os.str("");
+	UASSERT(update.serializeCompact(os));
+	UASSERT(os.str().size() == 15);
+
+	// Out of the compact range, the full command is used
+	update.velocity = v3f(5000.0f, 0.0f, 0.0f);
+	os.str("");
+	UASSERT(!update.serializeCompact(os));
+	UASSERT(os.str().empty());
+	update.serialize(os);
+	data = os.str();
+	UASSERT(data[0] == AO_CMD_UPDATE_POSITION);
+
+	is.str(data.substr(1));
+	is.clear();
+	result.deSerialize(is, AO_CMD_UPDATE_POSITION);
+	UASSERT(result.position == update.position);
+	UASSERT(result.velocity == update.velocity);
+	UASSERT(result.do_interpolate);
+
+	// So are positions whose block doesn't fit a s16, or isn't finite
+	update.velocity = v3f();
+	update.position = v3f(0.0f, -1e10f, 0.0f);
+	os.str("");
+	UASSERT(!update.serializeCompact(os));
+	update.position = v3f(0.0f, 0.0f, NAN);
+	UASSERT(!update.serializeCompact(os));
+	UASSERT(os.str().empty());
+}
+// << KIDSCODE
@@ -0,0 +1,148 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include "test.h"
+
+#include <algorithm>
+#include "cpp_api/s_async.h"
+
+// Gives access to the queue and shared data, without worker threads
+class TestAsyncEngine : public AsyncEngine
+{
+public:
+	using AsyncEngine::takeJobs;
+	using AsyncEngine::getSharedData;
+};
+
+class TestAsync : public TestBase
+{
+public:
+	TestAsync() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestAsync"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testJobShare();
+	void testSharedData();
+};
+
+static TestAsync g_test_instance;
+
+void TestAsync::runTests(IGameDef *gamedef)
+{
+	TEST(testJobShare);
+	TEST(testSharedData);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestAsync::testJobShare()
+{
+	TestAsyncEngine engine;
+	std::vector<std::string> params;
+	for (int i = 0; i < 1000; i++)
+		params.push_back(std::to_string(i));
+	UASSERTEQ(unsigned int, engine.queueAsyncJobs("f", params), 0);
+
+	// Each take is a fair share of the queue for 4 workers, at least one job
+	// and at most ASYNC_MAX_BATCH, in queue order
+	std::vector<LuaJobInfo> jobs;
+	size_t queued = params.size();
+	unsigned int next_id = 0;
+	while (queued > 0) {
+		engine.takeJobs(jobs, 4);
+		size_t share = std::max<size_t>(
+			std::min<size_t>(queued / 4, ASYNC_MAX_BATCH), 1);
+		UASSERTEQ(size_t, jobs.size(), share);
+		for (const LuaJobInfo &job : jobs) {
+			UASSERT(job.valid);
+			UASSERTEQ(unsigned int, job.id, next_id);
+			UASSERT(job.serializedParams == std::to_string(next_id));
+			UASSERT(*job.serializedFunction == "f");
+			next_id++;
+		}
+		queued -= jobs.size();
+	}
+
+	// The jobs of a batch share the function
+	params.resize(8);
+	UASSERTEQ(unsigned int, engine.queueAsyncJobs("g", params), 1000);
+	engine.takeJobs(jobs, 1);
+	UASSERTEQ(size_t, jobs.size(), 8);
+	for (const LuaJobInfo &job : jobs)
+		UASSERT(job.serializedFunction == jobs[0].serializedFunction);
+
+	// A single worker takes at most ASYNC_MAX_BATCH jobs at once
+	params.resize(ASYNC_MAX_BATCH + 1);
+	engine.queueAsyncJobs("h", params);
+	engine.takeJobs(jobs, 1);
+	UASSERTEQ(size_t, jobs.size(), ASYNC_MAX_BATCH);
+	engine.takeJobs(jobs, 1);
+	UASSERTEQ(size_t, jobs.size(), 1);
+}
+
+static bool has_data(const std::vector<std::pair<std::string, std::string>> &changed,
+	const std::string &name, const std::string &value)
+{
+	return std::find(changed.begin(), changed.end(),
+		std::make_pair(name, value)) != changed.end();
+}
+
+void TestAsync::testSharedData()
+{
+	TestAsyncEngine engine;
+	std::vector<std::pair<std::string, std::string>> changed;
+
+	// Nothing published yet
+	u32 version = 0;
+	engine.getSharedData(version, changed);
+	UASSERT(changed.empty());
+	UASSERTEQ(u32, version, 0);
+
+	engine.setSharedData("a", "1");
+	engine.setSharedData("b", "2");
+	engine.getSharedData(version, changed);
+	UASSERTEQ(size_t, changed.size(), 2);
+	UASSERT(has_data(changed, "a", "1"));
+	UASSERT(has_data(changed, "b", "2"));
+	u32 first_version = version;
+
+	// Up to date
+	changed.clear();
+	engine.getSharedData(version, changed);
+	UASSERT(changed.empty());
+	UASSERTEQ(u32, version, first_version);
+
+	// Only what changed since the known version
+	engine.setSharedData("a", "3");
+	engine.getSharedData(version, changed);
+	UASSERTEQ(size_t, changed.size(), 1);
+	UASSERT(has_data(changed, "a", "3"));
+	UASSERT(version > first_version);
+
+	// A new worker gets the latest value of everything
+	u32 new_version = 0;
+	changed.clear();
+	engine.getSharedData(new_version, changed);
+	UASSERTEQ(size_t, changed.size(), 2);
+	UASSERT(has_data(changed, "a", "3"));
+	UASSERT(has_data(changed, "b", "2"));
+	UASSERTEQ(u32, new_version, version);
+}
@@ -0,0 +1,267 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <deque>
+#include "network/congestioncontrol.h"
+#include "noise.h"
+
+#define PACKET_SIZE 512
+#define MIN_WINDOW 0x40
+#define MAX_WINDOW 0x8000
+
+class TestCongestion : public TestBase {
+public:
+	TestCongestion() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestCongestion"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testSlowStart();
+	void testLossReducesWindow();
+	void testPacing();
+	void testBottleneckLink();
+	void testLossyLink();
+};
+
+static TestCongestion g_test_instance;
+
+void TestCongestion::runTests(IGameDef *gamedef)
+{
+	TEST(testSlowStart);
+	TEST(testLossReducesWindow);
+	TEST(testPacing);
+	TEST(testBottleneckLink);
+	TEST(testLossyLink);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+	Bulk transfer over a simulated bottleneck: a drop-tail queue in front of
+	a link of fixed rate, constant propagation delay and random loss.
+	Runs on a virtual millisecond clock, which makes it deterministic.
+*/
+struct SimulatedLink
+{
+	SimulatedLink(u32 a_rate, u32 a_rtt, u32 a_queue_limit, s32 a_loss) :
+		rate(a_rate), rtt(a_rtt), queue_limit(a_queue_limit), loss(a_loss)
+	{}
+
+	u32 rate;        // packets per second
+	u32 rtt;         // propagation round trip time [ms]
+	u32 queue_limit; // packets
+	s32 loss;        // random loss in per mille
+
+	u32 delivered = 0;
+	u32 lost = 0;
+
+	void run(con::CongestionControl &cc, u64 start, u32 duration, u32 measure_from)
+	{
+		PseudoRandom pr(13);
+		std::deque<u64> queue;
+		std::deque<std::pair<u64, u64>> acks; // (arrival, send time)
+		std::deque<std::pair<u64, u64>> losses; // (detection, send time)
+		u32 in_flight = 0;
+		float link_credit = 0.0f;
+		// Losses are detected by the resend timeout
+		const u32 rto = 3 * rtt;
+
+		for (u64 now = start; now < start + duration; now++) {
+			bool measure = now >= start + measure_from;
+
+			while (!acks.empty() && acks.front().first <= now) {
+				cc.onAck(PACKET_SIZE, (now - acks.front().second) / 1000.0f, now);
+				acks.pop_front();
+				in_flight--;
+				if (measure)
+					delivered++;
+			}
+
+			while (!losses.empty() && losses.front().first <= now) {
+				cc.onLoss(1, losses.front().second, now);
+				losses.pop_front();
+				in_flight--;
+				if (measure)
+					lost++;
+			}
+
+			link_credit += rate / 1000.0f;
+			while (link_credit >= 1.0f && !queue.empty()) {
+				acks.emplace_back(now + rtt, queue.front());
+				queue.pop_front();
+				link_credit -= 1.0f;
+			}
+			if (queue.empty())
+				link_credit = std::min(link_credit, 1.0f);
+
+			u32 budget = cc.getPacingBudget(now);
+			while (in_flight < cc.getWindow() && budget > 0) {
+				cc.onPacketSent();
+				budget--;
+				in_flight++;
+				if (pr.range(0, 999) < loss || queue.size() >= queue_limit)
+					losses.emplace_back(now + rto, now);
+				else
+					queue.push_back(now);
+			}
+		}
+	}
+};
+
+void TestCongestion::testSlowStart()
+{
+	con::CongestionControl cc(MIN_WINDOW, MIN_WINDOW, MAX_WINDOW);
+	UASSERT(cc.inSlowStart());
+	UASSERT(cc.getSmoothedRTT() < 0.0f);
+	UASSERT(cc.getBandwidth() < 0.0f);
+
+	// One round trip worth of ACKs doubles the window
+	for (int i = 0; i < MIN_WINDOW; i++)
+		cc.onAck(PACKET_SIZE, 0.1f, 1000 + i);
+	UASSERT(cc.getWindow() == 2 * MIN_WINDOW);
+	UASSERT(std::fabs(cc.getSmoothedRTT() - 0.1f) < 0.001f);
+
+	// ACKs of resent packets carry no RTT sample
+	cc.onAck(PACKET_SIZE, -1.0f, 1100);
+	UASSERT(std::fabs(cc.getSmoothedRTT() - 0.1f) < 0.001f);
+
+	// Never beyond the maximum
+	for (int i = 0; i < MAX_WINDOW; i++)
+		cc.onAck(PACKET_SIZE, 0.1f, 1100);
+	UASSERT(cc.getWindow() == MAX_WINDOW);
+}
+
+void TestCongestion::testLossReducesWindow()
+{
+	con::CongestionControl cc(MIN_WINDOW, MIN_WINDOW, MAX_WINDOW);
+	for (int i = 0; i < 1000; i++)
+		cc.onAck(PACKET_SIZE, 0.1f, 1000);
+	float window = cc.getWindow();
+
+	cc.onLoss(3, 990, 1000);
+	UASSERT(!cc.inSlowStart());
+	UASSERT(cc.getWindow() < window);
+	UASSERT(cc.getWindow() >= window * 0.5f);
+
+	// Losses of packets sent before the reduction count once
+	window = cc.getWindow();
+	cc.onLoss(1, 995, 1050);
+	UASSERT(cc.getWindow() == window);
+	cc.onLoss(1, 1100, 1200);
+	UASSERT(cc.getWindow() < window);
+
+	// Nothing lost, nothing changes
+	window = cc.getWindow();
+	cc.onLoss(0, 1900, 2000);
+	UASSERT(cc.getWindow() == window);
+
+	// Never below the minimum
+	for (u64 t = 3000; t < 10000; t += 200)
+		cc.onLoss(1, t - 1, t);
+	UASSERT(cc.getWindow() == MIN_WINDOW);
+
+	// Grows back without loss
+	for (int i = 0; i < 1000; i++)
+		cc.onAck(PACKET_SIZE, 0.1f, 10000 + i);
+	UASSERT(cc.getWindow() > MIN_WINDOW);
+
+	// Reset restarts slow start
+	cc.reset(1024);
+	UASSERT(cc.getWindow() == 1024);
+	UASSERT(cc.inSlowStart());
+}
+
+void TestCongestion::testPacing()
+{
+	con::CongestionControl cc(1000, MIN_WINDOW, MAX_WINDOW);
+
+	// Unpaced until the round trip time is known
+	UASSERT(cc.getPacingRate() < 0.0f);
+	UASSERT(cc.getPacingBudget(1000) == U32_MAX);
+
+	cc.reset(1000);
+	cc.onAck(PACKET_SIZE, 0.5f, 1000);
+	float rate = cc.getPacingRate();
+	UASSERT(rate > 0.0f);
+
+	// A whole window may not be sent at once
+	u32 budget = cc.getPacingBudget(1000);
+	UASSERT(budget > 0);
+	UASSERT(budget < cc.getWindow());
+
+	for (u32 i = 0; i < budget; i++)
+		cc.onPacketSent();
+	UASSERT(cc.getPacingBudget(1000) == 0);
+
+	// Tokens refill at the pacing rate
+	budget = cc.getPacingBudget(1010);
+	UASSERT(budget > 0);
+	UASSERT(budget <= rate * 0.01f + 1.0f);
+
+	// Idle periods don't build up bursts
+	UASSERT(cc.getPacingBudget(100000) <= std::max(16.0f, rate * 0.05f));
+}
+
+void TestCongestion::testBottleneckLink()
+{
+	// 2.5 MB/s with 100ms round trip time, a bandwidth delay product of
+	// 500 packets and half as much buffering
+	con::CongestionControl cc(1024, MIN_WINDOW, MAX_WINDOW);
+	SimulatedLink link(5000, 100, 250, 0);
+	link.run(cc, 1000, 30000, 10000);
+
+	// Throughput close to the link rate over the last 20s
+	u32 expected = link.rate * 20;
+	UASSERT(link.delivered > expected * 0.8f);
+	UASSERT(link.delivered <= expected);
+
+	// The window converged around the bandwidth delay product plus buffer
+	UASSERT(cc.getWindow() < 3 * 750);
+	UASSERT(!cc.inSlowStart());
+
+	// The initial window overflowed the queue, after convergence only
+	// few packets are dropped
+	UASSERT(link.lost < link.delivered / 20);
+
+	float bandwidth = cc.getBandwidth();
+	UASSERT(bandwidth > link.rate * PACKET_SIZE * 0.8f);
+	UASSERT(bandwidth < link.rate * PACKET_SIZE * 1.2f);
+
+	// Queuing delay stays bounded by the buffer
+	UASSERT(cc.getSmoothedRTT() >= 0.1f);
+	UASSERT(cc.getSmoothedRTT() < 0.1f + 250.0f / link.rate + 0.01f);
+}
+
+void TestCongestion::testLossyLink()
+{
+	// Same link with 1% random loss, the transfer must not collapse
+	con::CongestionControl cc(1024, MIN_WINDOW, MAX_WINDOW);
+	SimulatedLink link(5000, 100, 250, 10);
+	link.run(cc, 1000, 30000, 10000);
+
+	UASSERT(cc.getWindow() >= MIN_WINDOW);
+	UASSERT(link.lost > 0);
+	UASSERT(link.delivered > MIN_WINDOW * 10 * 20 * 0.8f);
+
+	float bandwidth = cc.getBandwidth();
+	UASSERT(bandwidth > 0.0f);
+	UASSERT(bandwidth < link.rate * PACKET_SIZE * 1.2f);
+}
@@ -89,7 +89,7 @@ void TestConnection::testHelpers()
 	Address a(127,0,0,1, 10);
 	const u16 seqnum = 34352;
 
-	con::BufferedPacket p1 = con::makePacket(a, data1,
+	con::BufferedPacketPtr p1 = con::makePacket(a, data1,
 			proto_id, peer_id, channel);
 	/*
 		We should now have a packet with this data:
@@ -100,10 +100,10 @@ void TestConnection::testHelpers()
 		Data:
 			[7] u8 data1[0]
 	*/
-	UASSERT(readU32(&p1.data[0]) == proto_id);
-	UASSERT(readU16(&p1.data[4]) == peer_id);
-	UASSERT(readU8(&p1.data[6]) == channel);
-	UASSERT(readU8(&p1.data[7]) == data1[0]);
+	UASSERT(readU32(&p1->data[0]) == proto_id);
+	UASSERT(readU16(&p1->data[4]) == peer_id);
+	UASSERT(readU8(&p1->data[6]) == channel);
+	UASSERT(readU8(&p1->data[7]) == data1[0]);
 
 	//infostream<<"initial data1[0]="<<((u32)data1[0]&0xff)<<std::endl;
 
@@ -119,6 +119,18 @@ void TestConnection::testHelpers()
 	UASSERT(readU8(&p2[0]) == con::PACKET_TYPE_RELIABLE);
 	UASSERT(readU16(&p2[1]) == seqnum);
 	UASSERT(readU8(&p2[3]) == data1[0]);
+
+	con::BufferedPacketPtr p3 = con::makeReliableBufferedPacket(a, data1,
+			seqnum, proto_id, peer_id, channel);
+
+	/*
+		Same as makePacket() applied to makeReliablePacket(), built at once
+	*/
+	UASSERT(p3->data.getSize() == BASE_HEADER_SIZE + p2.getSize());
+	UASSERT(readU32(&p3->data[0]) == proto_id);
+	UASSERT(readU16(&p3->data[4]) == peer_id);
+	UASSERT(readU8(&p3->data[6]) == channel);
+	UASSERT(memcmp(&p3->data[BASE_HEADER_SIZE], *p2, p2.getSize()) == 0);
 }
 
 
@@ -0,0 +1,84 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "mapblock.h"
+
+class TestMapBlock : public TestBase
+{
+public:
+	TestMapBlock() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapBlock"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testContentHistogram(IGameDef *gamedef);
+};
+
+static TestMapBlock g_test_instance;
+
+void TestMapBlock::runTests(IGameDef *gamedef)
+{
+	TEST(testContentHistogram, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static u16 histogram_count(MapBlock &block, content_t c)
+{
+	for (const auto &entry : block.getContentHistogram())
+		if (entry.first == c)
+			return entry.second;
+	return 0;
+}
+
+void TestMapBlock::testContentHistogram(IGameDef *gamedef)
+{
+	MapBlock block(nullptr, v3s16(0, 0, 0), gamedef);
+	UASSERT(block.getContentHistogram().size() == 1);
+	UASSERT(histogram_count(block, CONTENT_IGNORE) == MapBlock::nodecount);
+
+	MapNode n(CONTENT_AIR);
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+		block.setNode(v3s16(x, 0, 0), n);
+	UASSERT(histogram_count(block, CONTENT_AIR) == MAP_BLOCKSIZE);
+	UASSERT(histogram_count(block, CONTENT_IGNORE) ==
+		MapBlock::nodecount - MAP_BLOCKSIZE);
+
+	// Content gone from the block
+	MapNode n2(CONTENT_IGNORE);
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+		block.setNodeNoCheck(v3s16(x, 0, 0), n2);
+	UASSERT(!block.containsContent(CONTENT_AIR));
+	UASSERT(block.containsContent(CONTENT_IGNORE));
+	UASSERT(block.getContentHistogram().size() == 1);
+
+	// Direct writes to the data are counted again after raiseModified()
+	block.getData()[5] = MapNode(CONTENT_AIR);
+	block.raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_VMANIP);
+	UASSERT(histogram_count(block, CONTENT_AIR) == 1);
+	UASSERT(histogram_count(block, CONTENT_IGNORE) == MapBlock::nodecount - 1);
+
+	// Replace all the nodes of a content
+	block.setNode(v3s16(5, 0, 0), n2);
+	block.setNode(v3s16(15, 15, 15), n);
+	UASSERT(histogram_count(block, CONTENT_AIR) == 1);
+	UASSERT(block.getContentHistogram().size() == 2);
+}
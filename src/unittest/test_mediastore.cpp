@@ -0,0 +1,143 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include "test.h"
+
+#include <fstream>
+#include "filesys.h"
+#include "server/mediastore.h"
+#include "util/hex.h"
+
+class TestMediaStore : public TestBase
+{
+public:
+	TestMediaStore() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMediaStore"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testHashing();
+	void testIndex();
+	void testStore();
+};
+
+static TestMediaStore g_test_instance;
+
+void TestMediaStore::runTests(IGameDef *gamedef)
+{
+	TEST(testHashing);
+	TEST(testIndex);
+	TEST(testStore);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestMediaStore::testHashing()
+{
+	std::string dir = getTestTempDirectory();
+	std::vector<MediaHashJob> jobs;
+	for (int i = 0; i < 20; i++) {
+		MediaHashJob job;
+		job.name = "media_" + std::to_string(i) + ".png";
+		job.path = dir + DIR_DELIM + job.name;
+		std::ofstream(job.path.c_str(), std::ios_base::binary) << "abc";
+		jobs.push_back(job);
+	}
+
+	// Empty and missing files have no digest
+	std::ofstream(jobs[3].path.c_str(), std::ios_base::binary).flush();
+	jobs[4].path = dir + DIR_DELIM + "missing.png";
+
+	hash_media_files(jobs, 4);
+
+	for (size_t i = 0; i < jobs.size(); i++) {
+		if (i == 3 || i == 4) {
+			UASSERT(jobs[i].digest.empty());
+		} else {
+			UASSERTEQ(std::string, hex_encode(jobs[i].digest),
+				"a9993e364706816aba3e25717850c26c9cd0d89d");
+		}
+	}
+
+	std::string data;
+	UASSERT(read_media_file(jobs[0].path, &data));
+	UASSERTEQ(std::string, data, "abc");
+	UASSERT(!read_media_file(jobs[4].path, &data));
+}
+
+void TestMediaStore::testIndex()
+{
+	std::string path = getTestTempFile();
+	std::string digest_a(20, 'a'), digest_b(20, 'b'), digest;
+
+	MediaIndex index(path);
+	index.load();
+	UASSERT(index.size() == 0);
+	index.update("/media/a b.png", 10, 100, digest_a);
+	index.update("/media/b.png", 20, 200, digest_b);
+	// An existing file, the index itself
+	index.update(path, 30, 300, digest_b);
+	UASSERT(index.save());
+
+	MediaIndex index2(path);
+	index2.load();
+	UASSERT(index2.size() == 3);
+	UASSERT(index2.lookup("/media/a b.png", 10, 100, &digest));
+	UASSERT(digest == digest_a);
+
+	// Changed files are hashed again
+	UASSERT(!index2.lookup("/media/b.png", 20, 201, &digest));
+	UASSERT(!index2.lookup("/media/b.png", 21, 200, &digest));
+	UASSERT(!index2.lookup("/media/c.png", 20, 200, &digest));
+
+	// The files not seen since the load are forgotten if they are gone
+	UASSERT(index2.save());
+	MediaIndex index3(path);
+	index3.load();
+	UASSERT(index3.size() == 2);
+	UASSERT(index3.lookup("/media/a b.png", 10, 100, &digest));
+	UASSERT(index3.lookup(path, 30, 300, &digest));
+}
+
+void TestMediaStore::testStore()
+{
+	MediaStore store(10);
+	auto data_a = std::make_shared<const std::string>("aaaa");
+	auto data_b = std::make_shared<const std::string>("bbbb");
+	auto data_c = std::make_shared<const std::string>("cccc");
+
+	UASSERT(!store.get("a"));
+	store.put("a", data_a);
+	store.put("b", data_b);
+	UASSERT(store.get("a") == data_a);
+	UASSERT(store.getSize() == 8);
+
+	// The least recently used is forgotten
+	store.put("c", data_c);
+	UASSERT(store.getSize() == 8);
+	UASSERT(!store.get("b"));
+	UASSERT(store.get("a") == data_a);
+	UASSERT(store.get("c") == data_c);
+
+	// Too large to be stored
+	store.put("d", std::make_shared<const std::string>(std::string(11, 'd')));
+	UASSERT(!store.get("d"));
+	UASSERT(store.getSize() == 8);
+}
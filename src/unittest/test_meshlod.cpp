@@ -0,0 +1,73 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "client/mapblock_mesh.h"
+
+class TestMeshLod : public TestBase
+{
+public:
+	TestMeshLod() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMeshLod"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testLevels();
+	void testHysteresis();
+};
+
+static TestMeshLod g_test_instance;
+
+void TestMeshLod::runTests(IGameDef *gamedef)
+{
+	TEST(testLevels);
+	TEST(testHysteresis);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestMeshLod::testLevels()
+{
+	UASSERT(getMeshLod(50.0f, 100.0f) == 0);
+	UASSERT(getMeshLod(100.0f, 100.0f) == 1);
+	UASSERT(getMeshLod(199.0f, 100.0f) == 1);
+	UASSERT(getMeshLod(200.0f, 100.0f) == 2);
+	UASSERT(getMeshLod(400.0f, 100.0f) == 3);
+	UASSERT(getMeshLod(100000.0f, 100.0f) == MESH_LOD_MAX);
+
+	// Disabled
+	UASSERT(getMeshLod(100000.0f, 0.0f) == 0);
+	UASSERT(getMeshLod(100000.0f, 0.0f, 2) == 0);
+}
+
+void TestMeshLod::testHysteresis()
+{
+	// A level is kept a little outside of its range
+	UASSERT(getMeshLod(105.0f, 100.0f, 0) == 0);
+	UASSERT(getMeshLod(95.0f, 100.0f, 1) == 1);
+	UASSERT(getMeshLod(205.0f, 100.0f, 1) == 1);
+	UASSERT(getMeshLod(195.0f, 100.0f, 2) == 2);
+
+	// But not beyond the margin
+	UASSERT(getMeshLod(150.0f, 100.0f, 0) == 1);
+	UASSERT(getMeshLod(50.0f, 100.0f, 1) == 0);
+	UASSERT(getMeshLod(1000.0f, 100.0f, 1) == 3);
+	UASSERT(getMeshLod(10.0f, 100.0f, 3) == 0);
+}
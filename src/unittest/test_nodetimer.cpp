@@ -0,0 +1,183 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <cmath>
+#include <sstream>
+#include "nodetimer.h"
+
+class TestNodeTimer : public TestBase
+{
+public:
+	TestNodeTimer() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestNodeTimer"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testStep();
+	void testScheduler();
+	void testAttachDetach();
+	void testOutdatedEntries();
+};
+
+static TestNodeTimer g_test_instance;
+
+void TestNodeTimer::runTests(IGameDef *gamedef)
+{
+	TEST(testStep);
+	TEST(testScheduler);
+	TEST(testAttachDetach);
+	TEST(testOutdatedEntries);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Steps the scheduler and the lists it has due, like ServerEnvironment does
+static std::vector<NodeTimer> step_scheduler(NodeTimerScheduler &scheduler,
+	NodeTimerList &list, float dtime, u32 *entries = nullptr)
+{
+	std::vector<NodeTimer> elapsed;
+	scheduler.step(dtime);
+	v3s16 blockpos;
+	double time;
+	while (scheduler.popDue(&blockpos, &time)) {
+		if (entries)
+			(*entries)++;
+		if (!list.popScheduled(time))
+			continue;
+		std::vector<NodeTimer> timers = list.step(0.0f);
+		elapsed.insert(elapsed.end(), timers.begin(), timers.end());
+	}
+	return elapsed;
+}
+
+void TestNodeTimer::testStep()
+{
+	NodeTimerList list;
+	list.set(NodeTimer(1.0f, 0.0f, v3s16(1, 2, 3)));
+	list.set(NodeTimer(2.0f, 0.5f, v3s16(4, 5, 6)));
+
+	UASSERT(list.step(0.5f).empty());
+	UASSERT(std::fabs(list.get(v3s16(1, 2, 3)).elapsed - 0.5f) < 0.001f);
+
+	std::vector<NodeTimer> elapsed = list.step(0.7f);
+	UASSERT(elapsed.size() == 1);
+	UASSERT(elapsed[0].position == v3s16(1, 2, 3));
+	UASSERT(std::fabs(elapsed[0].elapsed - 1.2f) < 0.001f);
+	UASSERT(list.get(v3s16(1, 2, 3)).timeout == 0.0f);
+
+	elapsed = list.step(0.3f);
+	UASSERT(elapsed.size() == 1);
+	UASSERT(elapsed[0].position == v3s16(4, 5, 6));
+}
+
+void TestNodeTimer::testScheduler()
+{
+	NodeTimerScheduler scheduler;
+	NodeTimerList list;
+	list.attach(&scheduler, v3s16(0, 0, 0));
+	UASSERT(scheduler.size() == 0);
+
+	list.set(NodeTimer(1.0f, 0.0f, v3s16(1, 1, 1)));
+	list.set(NodeTimer(0.5f, 0.0f, v3s16(2, 2, 2)));
+	// The earlier timer adds an entry
+	UASSERT(scheduler.size() == 2);
+
+	UASSERT(step_scheduler(scheduler, list, 0.2f).empty());
+	// Time passes without stepping the list
+	UASSERT(std::fabs(list.get(v3s16(1, 1, 1)).elapsed - 0.2f) < 0.001f);
+
+	std::vector<NodeTimer> elapsed = step_scheduler(scheduler, list, 0.4f);
+	UASSERT(elapsed.size() == 1);
+	UASSERT(elapsed[0].position == v3s16(2, 2, 2));
+	UASSERT(std::fabs(elapsed[0].elapsed - 0.6f) < 0.001f);
+
+	elapsed = step_scheduler(scheduler, list, 0.4f);
+	UASSERT(elapsed.size() == 1);
+	UASSERT(elapsed[0].position == v3s16(1, 1, 1));
+	UASSERT(std::fabs(elapsed[0].elapsed - 1.0f) < 0.001f);
+
+	// Nothing left to do
+	u32 entries = 0;
+	UASSERT(step_scheduler(scheduler, list, 10.0f, &entries).empty());
+	UASSERT(scheduler.size() == 0);
+}
+
+void TestNodeTimer::testAttachDetach()
+{
+	NodeTimerScheduler scheduler;
+	scheduler.step(100.0f);
+
+	NodeTimerList list;
+	list.set(NodeTimer(1.0f, 0.25f, v3s16(1, 1, 1)));
+	list.attach(&scheduler, v3s16(0, 0, 0));
+	// The list keeps its own time through the migration
+	UASSERT(std::fabs(list.get(v3s16(1, 1, 1)).elapsed - 0.25f) < 0.001f);
+
+	step_scheduler(scheduler, list, 0.5f);
+	UASSERT(std::fabs(list.get(v3s16(1, 1, 1)).elapsed - 0.75f) < 0.001f);
+
+	// Inactive blocks don't run their timers
+	list.detach();
+	UASSERT(step_scheduler(scheduler, list, 5.0f).empty());
+	UASSERT(std::fabs(list.get(v3s16(1, 1, 1)).elapsed - 0.75f) < 0.001f);
+
+	// Serialization sees the same state
+	std::ostringstream os(std::ios_base::binary);
+	list.serialize(os, 25);
+	NodeTimerList list2;
+	std::istringstream is(os.str(), std::ios_base::binary);
+	list2.deSerialize(is, 25);
+	UASSERT(std::fabs(list2.get(v3s16(1, 1, 1)).elapsed - 0.75f) < 0.001f);
+
+	list.attach(&scheduler, v3s16(0, 0, 0));
+	std::vector<NodeTimer> elapsed = step_scheduler(scheduler, list, 0.3f);
+	UASSERT(elapsed.size() == 1);
+	UASSERT(std::fabs(elapsed[0].elapsed - 1.05f) < 0.001f);
+}
+
+void TestNodeTimer::testOutdatedEntries()
+{
+	NodeTimerScheduler scheduler;
+	NodeTimerList list;
+	list.attach(&scheduler, v3s16(0, 0, 0));
+
+	// Timer moved later, the old entry wakes the list up for nothing
+	list.set(NodeTimer(0.5f, 0.0f, v3s16(1, 1, 1)));
+	list.set(NodeTimer(2.0f, 0.0f, v3s16(1, 1, 1)));
+	UASSERT(step_scheduler(scheduler, list, 1.0f).empty());
+	std::vector<NodeTimer> elapsed = step_scheduler(scheduler, list, 1.0f);
+	UASSERT(elapsed.size() == 1);
+	UASSERT(std::fabs(elapsed[0].elapsed - 2.0f) < 0.001f);
+
+	// Removed timer
+	list.set(NodeTimer(0.5f, 0.0f, v3s16(1, 1, 1)));
+	list.remove(v3s16(1, 1, 1));
+	UASSERT(step_scheduler(scheduler, list, 1.0f).empty());
+
+	// Entries made before a detach are ignored after attaching again
+	list.set(NodeTimer(0.5f, 0.0f, v3s16(1, 1, 1)));
+	list.detach();
+	list.attach(&scheduler, v3s16(0, 0, 0));
+	u32 entries = 0;
+	elapsed = step_scheduler(scheduler, list, 1.0f, &entries);
+	UASSERT(entries == 2);
+	UASSERT(elapsed.size() == 1);
+}
@@ -0,0 +1,127 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "client/occlusionbuffer.h"
+#include "gamedef.h"
+#include "mapblock.h"
+
+class TestOcclusionBuffer : public TestBase
+{
+public:
+	TestOcclusionBuffer() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestOcclusionBuffer"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testQuad();
+	void testBlockOccluders(IGameDef *gamedef);
+};
+
+static TestOcclusionBuffer g_test_instance;
+
+void TestOcclusionBuffer::runTests(IGameDef *gamedef)
+{
+	TEST(testQuad);
+	TEST(testBlockOccluders, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Box of the given size around a point, in nodes
+static aabb3f box_at(v3f center, f32 half_size)
+{
+	return aabb3f((center - half_size) * BS, (center + half_size) * BS);
+}
+
+void TestOcclusionBuffer::testQuad()
+{
+	OcclusionBuffer buffer;
+	buffer.begin(v3f(0, 0, 0), v3f(0, 0, 1), 1.5f);
+	buffer.finish();
+	UASSERT(!buffer.isBoxOccluded(box_at(v3f(0, 0, 30), 1)));
+
+	// 4x4 nodes, 10 nodes ahead
+	buffer.begin(v3f(0, 0, 0), v3f(0, 0, 1), 1.5f);
+	v3f corners[4] = {
+		v3f(-2, -2, 10) * BS, v3f(2, -2, 10) * BS,
+		v3f(2, 2, 10) * BS, v3f(-2, 2, 10) * BS,
+	};
+	buffer.addQuad(corners);
+	buffer.finish();
+	UASSERT(buffer.getQuadCount() == 1);
+
+	UASSERT(buffer.isBoxOccluded(box_at(v3f(0, 0, 30), 1)));
+	// In front of the quad
+	UASSERT(!buffer.isBoxOccluded(box_at(v3f(0, 0, 5), 0.5f)));
+	// Beside it
+	UASSERT(!buffer.isBoxOccluded(box_at(v3f(11, 0, 30), 1)));
+	// Larger than its shadow
+	UASSERT(!buffer.isBoxOccluded(box_at(v3f(0, 0, 30), 8)));
+	// Behind the camera
+	UASSERT(!buffer.isBoxOccluded(box_at(v3f(0, 0, -30), 1)));
+}
+
+void TestOcclusionBuffer::testBlockOccluders(IGameDef *gamedef)
+{
+	const NodeDefManager *ndef = gamedef->ndef();
+
+	// Stone block from z = 32 to z = 47
+	MapBlock block(nullptr, v3s16(0, 0, 2), gamedef);
+	MapNode stone(t_CONTENT_STONE);
+	v3s16 p;
+	for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+	for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+	for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++)
+		block.setNode(p, stone);
+
+	// Looking at the block from the middle of its -Z side
+	v3f camera_pos = v3f(7.5f, 7.5f, 0) * BS;
+	aabb3f behind = box_at(v3f(7.5f, 7.5f, 70), 4);
+
+	OcclusionBuffer buffer;
+	buffer.begin(camera_pos, v3f(0, 0, 1), 1.5f);
+	buffer.addBlock(&block, ndef);
+	buffer.finish();
+	UASSERT(buffer.getQuadCount() > 0);
+	UASSERT(buffer.isBoxOccluded(behind));
+
+	// A hole through the block
+	MapNode air(CONTENT_AIR);
+	for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+	for (p.Y = 4; p.Y < 8; p.Y++)
+	for (p.X = 4; p.X < 8; p.X++)
+		block.setNode(p, air);
+
+	buffer.begin(camera_pos, v3f(0, 0, 1), 1.5f);
+	buffer.addBlock(&block, ndef);
+	buffer.finish();
+	UASSERT(!buffer.isBoxOccluded(behind));
+	// Only the hole lets the view through
+	UASSERT(buffer.isBoxOccluded(box_at(v3f(13.5f, 13.5f, 70), 1)));
+
+	// Forgotten blocks are computed again
+	std::vector<v3s16> forget = {block.getPos()};
+	buffer.forgetBlocks(forget);
+	buffer.begin(camera_pos, v3f(0, 0, 1), 1.5f);
+	buffer.addBlock(&block, ndef);
+	buffer.finish();
+	UASSERT(!buffer.isBoxOccluded(behind));
+}
@@ -0,0 +1,143 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "gamedef.h"
+#include "log.h"
+#include "map.h"
+#include "mapblock.h"
+#include "mapsector.h"
+#include "pathfinder.h"
+
+class TestPathfinder : public TestBase
+{
+public:
+	TestPathfinder() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestPathfinder"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testStraightPath(IGameDef *gamedef);
+	void testCacheInvalidation(IGameDef *gamedef);
+};
+
+static TestPathfinder g_test_instance;
+
+void TestPathfinder::runTests(IGameDef *gamedef)
+{
+	TEST(testStraightPath, gamedef);
+	TEST(testCacheInvalidation, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// A row of 4 blocks along X, stone floor at y = 0 and air above
+static void make_map(Map &map, IGameDef *gamedef)
+{
+	MapSector *sector = nullptr;
+	for (s16 x = 0; x < 4; x++) {
+		sector = new MapSector(&map, v2s16(x, 0), gamedef);
+		(*map.getSectorsPtr())[v2s16(x, 0)] = sector;
+		MapBlock *block = sector->createBlankBlock(0);
+
+		v3s16 p;
+		for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+		for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+		for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++) {
+			MapNode n(p.Y == 0 ? t_CONTENT_STONE : CONTENT_AIR);
+			block->setNode(p, n);
+		}
+	}
+}
+
+// A wall across the map at x = 32, with a gap at z = gap_z
+static void set_wall(Map &map, s16 gap_z, content_t c)
+{
+	MapBlock *block = map.getBlockNoCreateNoEx(v3s16(2, 0, 0));
+	v3s16 p(0, 1, 0);
+	for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+	for (p.Y = 1; p.Y < MAP_BLOCKSIZE; p.Y++) {
+		MapNode n(p.Z == gap_z ? CONTENT_AIR : c);
+		block->setNode(p, n);
+	}
+}
+
+void TestPathfinder::testStraightPath(IGameDef *gamedef)
+{
+	Map map(dstream, gamedef);
+	make_map(map, gamedef);
+	PathfinderCache cache(&map, gamedef->ndef());
+
+	std::vector<v3s16> path = get_path(&cache, v3s16(1, 1, 4),
+		v3s16(60, 1, 4), 4, 1, 1, PA_PLAIN_NP);
+	UASSERT(path.size() == 60);
+	UASSERT(path.front() == v3s16(1, 1, 4));
+	UASSERT(path.back() == v3s16(60, 1, 4));
+	for (const v3s16 &p : path)
+		UASSERT(p.Y == 1);
+
+	// Only the loaded blocks are cached
+	UASSERT(cache.size() == 4);
+
+	// The cached data gives the same result
+	UASSERT(get_path(&cache, v3s16(1, 1, 4), v3s16(60, 1, 4), 4, 1, 1,
+		PA_PLAIN_NP) == path);
+
+	// Outside of the loaded area
+	UASSERT(get_path(&cache, v3s16(1, 1, 4), v3s16(1, 1, 40), 4, 1, 1,
+		PA_PLAIN_NP).empty());
+}
+
+void TestPathfinder::testCacheInvalidation(IGameDef *gamedef)
+{
+	Map map(dstream, gamedef);
+	make_map(map, gamedef);
+	PathfinderCache cache(&map, gamedef->ndef());
+
+	UASSERT(get_path(&cache, v3s16(1, 1, 4), v3s16(60, 1, 4), 16, 1, 1,
+		PA_PLAIN).size() == 60);
+
+	// Through the gap of the wall
+	set_wall(map, 12, t_CONTENT_STONE);
+	std::vector<v3s16> path = get_path(&cache, v3s16(1, 1, 4),
+		v3s16(60, 1, 4), 16, 1, 1, PA_PLAIN);
+	UASSERT(path.size() == 60 + 2 * 8);
+	bool through_gap = false;
+	for (const v3s16 &p : path)
+		through_gap |= p == v3s16(32, 1, 12);
+	UASSERT(through_gap);
+
+	// The blocks aren't connected anymore
+	set_wall(map, -1, t_CONTENT_STONE);
+	UASSERT(get_path(&cache, v3s16(1, 1, 4), v3s16(60, 1, 4), 16, 1, 1,
+		PA_PLAIN).empty());
+
+	// A step of one node can be jumped on
+	set_wall(map, -1, CONTENT_AIR);
+	MapNode n(t_CONTENT_STONE);
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		map.getBlockNoCreateNoEx(v3s16(2, 0, 0))->setNode(v3s16(0, 1, z), n);
+	path = get_path(&cache, v3s16(1, 1, 4), v3s16(60, 1, 4), 16, 1, 1,
+		PA_PLAIN);
+	UASSERT(!path.empty());
+	UASSERT(path[31] == v3s16(32, 2, 4));
+	UASSERT(get_path(&cache, v3s16(1, 1, 4), v3s16(60, 1, 4), 16, 0, 1,
+		PA_PLAIN).empty());
+}
@@ -0,0 +1,232 @@
+/*
+Kidscode
+Copyright (C) 2020 EvidenceB
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <algorithm>
+#include "environment.h"
+#include "gamedef.h"
+#include "log.h"
+#include "map.h"
+#include "mapblock.h"
+#include "mapsector.h"
+#include "nodedef.h"
+#include "raycast.h"
+
+class TestRaycast : public TestBase
+{
+public:
+	TestRaycast() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestRaycast"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testBlockCache(IGameDef *gamedef);
+	void testBatch(IGameDef *gamedef);
+};
+
+static TestRaycast g_test_instance;
+
+void TestRaycast::runTests(IGameDef *gamedef)
+{
+	TEST(testBlockCache, gamedef);
+	TEST(testBatch, gamedef);
+}
+
+// Environment with fixed selection boxes as objects
+class TestRaycastEnvironment : public Environment
+{
+public:
+	TestRaycastEnvironment(Map *map, IGameDef *gamedef) :
+		Environment(gamedef), m_map(map)
+	{}
+
+	void step(f32 dtime) {}
+	Map &getMap() { return *m_map; }
+
+	// Tests every box, like ServerEnvironment::getSelectedActiveObjects
+	void getSelectedActiveObjects(const core::line3d<f32> &shootline_on_map,
+		std::vector<PointedThing> &objects)
+	{
+		const v3f line_vector = shootline_on_map.getVector();
+		for (const auto &box : boxes) {
+			v3f current_intersection;
+			v3s16 current_normal;
+			if (boxLineCollision(box.second, shootline_on_map.start,
+					line_vector, &current_intersection, &current_normal)) {
+				objects.emplace_back((s16) box.first, current_intersection,
+					current_normal,
+					(current_intersection - shootline_on_map.start).getLengthSQ());
+			}
+		}
+	}
+
+	// Same lookup as ServerEnvironment::getSelectedActiveObjectsBatch
+	void getSelectedActiveObjectsBatch(
+		const std::vector<core::line3d<f32>> &shootlines,
+		std::vector<std::vector<PointedThing>> &objects)
+	{
+		objects.clear();
+		selectBoxesBatch(boxes, shootlines, objects);
+	}
+
+	std::vector<std::pair<u16, aabb3f>> boxes;
+
+private:
+	Map *m_map;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestRaycast::testBlockCache(IGameDef *gamedef)
+{
+	Map map(dstream, gamedef);
+	MapSector *sector = new MapSector(&map, v2s16(0, 0), gamedef);
+	(*map.getSectorsPtr())[v2s16(0, 0)] = sector;
+
+	// Block of air with a stone and a water node
+	MapBlock *block = sector->createBlankBlock(0);
+	MapNode air(CONTENT_AIR);
+	v3s16 p;
+	for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+	for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+	for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++)
+		block->setNode(p, air);
+	MapNode stone(t_CONTENT_STONE);
+	MapNode water(t_CONTENT_WATER);
+	block->setNode(v3s16(3, 4, 5), stone);
+	block->setNode(v3s16(15, 15, 15), stone);
+	block->setNode(v3s16(0, 1, 2), water);
+
+	// Only air, nothing to point at
+	MapBlock *empty = sector->createBlankBlock(1);
+	for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+	for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+	for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++)
+		empty->setNode(p, air);
+
+	RaycastBlockCache cache(&map);
+	bool water_pointable = gamedef->ndef()->get(t_CONTENT_WATER).pointable;
+
+	UASSERT(cache.isPointable(v3s16(3, 4, 5), false));
+	UASSERT(cache.isPointable(v3s16(15, 15, 15), true));
+	UASSERT(!cache.isPointable(v3s16(3, 4, 6), false));
+	UASSERT(!cache.isPointable(v3s16(3, 4, 6), true));
+	UASSERT(cache.isPointable(v3s16(0, 1, 2), false) == water_pointable);
+	UASSERT(cache.isPointable(v3s16(0, 1, 2), true));
+
+	UASSERT(!cache.isPointable(v3s16(3, 20, 5), false));
+	UASSERT(!cache.isPointable(v3s16(3, 20, 5), true));
+
+	// Unloaded block
+	UASSERT(!cache.isPointable(v3s16(3, -4, 5), true));
+}
+
+static bool sort_by_id(const PointedThing &a, const PointedThing &b)
+{
+	return a.object_id < b.object_id;
+}
+
+void TestRaycast::testBatch(IGameDef *gamedef)
+{
+	Map map(dstream, gamedef);
+	MapSector *sector = new MapSector(&map, v2s16(0, 0), gamedef);
+	(*map.getSectorsPtr())[v2s16(0, 0)] = sector;
+
+	// Stone floor with a few pillars, a water pool and an unloaded block
+	MapBlock *block = sector->createBlankBlock(0);
+	v3s16 p;
+	for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+	for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+	for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++) {
+		content_t c = CONTENT_AIR;
+		if (p.Y == 0 || (p.X % 5 == 0 && p.Z % 7 == 0 && p.Y < 6))
+			c = t_CONTENT_STONE;
+		else if (p.Y == 1 && p.X > 9 && p.Z > 9)
+			c = t_CONTENT_WATER;
+		MapNode n(c);
+		block->setNode(p, n);
+	}
+
+	TestRaycastEnvironment env(&map, gamedef);
+	// Boxes of different sizes, some across several grid cells and
+	// some overlapping
+	u16 id = 1;
+	for (s16 x = -2; x < 18; x += 3)
+	for (s16 z = -1; z < 17; z += 4) {
+		v3f pos(x * BS, (1 + (x + z) % 4) * BS, z * BS);
+		f32 size = (0.2f + (id % 5) * 0.7f) * BS;
+		env.boxes.emplace_back(id++,
+			aabb3f(pos - v3f(size, size / 2, size), pos + v3f(size, size, size)));
+	}
+
+	// Lines from a few points in many directions, of different lengths
+	std::vector<core::line3d<f32>> lines;
+	const v3f starts[] = {
+		v3f(8, 3, 8) * BS,
+		v3f(-4, 6, 20) * BS,
+		v3f(1, 1.5f, 3) * BS,     // inside a box
+		v3f(30, 12, -10) * BS,
+	};
+	for (const v3f &start : starts)
+	for (int yaw = 0; yaw < 360; yaw += 15)
+	for (int pitch = -75; pitch <= 75; pitch += 25) {
+		v3f dir(1.0f, 0.0f, 0.0f);
+		dir.rotateXYBy(pitch);
+		dir.rotateXZBy(yaw);
+		f32 length = (4 + (yaw + pitch + 360) % 40) * BS;
+		lines.emplace_back(start, start + dir * length);
+	}
+
+	// The objects met by each line
+	std::vector<std::vector<PointedThing>> batch;
+	env.getSelectedActiveObjectsBatch(lines, batch);
+	UASSERTEQ(size_t, batch.size(), lines.size());
+	bool any_object = false;
+	for (size_t i = 0; i < lines.size(); i++) {
+		std::vector<PointedThing> single;
+		env.getSelectedActiveObjects(lines[i], single);
+		std::sort(single.begin(), single.end(), sort_by_id);
+		std::sort(batch[i].begin(), batch[i].end(), sort_by_id);
+		UASSERTEQ(size_t, batch[i].size(), single.size());
+		for (size_t j = 0; j < single.size(); j++) {
+			UASSERT(batch[i][j] == single[j]);
+			UASSERT(batch[i][j].intersection_point == single[j].intersection_point);
+			UASSERT(batch[i][j].intersection_normal == single[j].intersection_normal);
+		}
+		any_object |= !single.empty();
+	}
+	UASSERT(any_object);
+
+	// The first thing met by each line, with and without objects and liquids
+	for (int flags = 0; flags < 4; flags++) {
+		bool objects_pointable = flags & 1;
+		bool liquids_pointable = flags & 2;
+		std::vector<PointedThing> results;
+		env.raycastBatch(lines, objects_pointable, liquids_pointable, results);
+		UASSERTEQ(size_t, results.size(), lines.size());
+		for (size_t i = 0; i < lines.size(); i++) {
+			RaycastState state(lines[i], objects_pointable, liquids_pointable);
+			PointedThing single;
+			env.continueRaycast(&state, &single);
+			UASSERT(results[i] == single);
+			UASSERT(results[i].intersection_point == single.intersection_point);
+		}
+	}
+}
@@ -48,6 +48,7 @@ class TestServerActiveObjectMgr : public TestBase
 	void testRemoveObject();
 	void testGetObjectsInsideRadius();
 	void testGetAddedActiveObjectsAroundPos();
+	void testObjectIndex(); // KIDSCODE - Spatial index
 };
 
 static TestServerActiveObjectMgr g_test_instance;
@@ -59,6 +60,7 @@ void TestServerActiveObjectMgr::runTests(IGameDef *gamedef)
 	TEST(testRemoveObject)
 	TEST(testGetObjectsInsideRadius);
 	TEST(testGetAddedActiveObjectsAroundPos);
+	TEST(testObjectIndex); // KIDSCODE - Spatial index
 }
 
 void clearSAOMgr(server::ActiveObjectMgr *saomgr)
@@ -198,3 +200,44 @@ void TestServerActiveObjectMgr::testGetAddedActiveObjectsAroundPos()
 
 	clearSAOMgr(&saomgr);
 }
+
+// >> KIDSCODE - Spatial index
+void TestServerActiveObjectMgr::testObjectIndex()
+{
+	server::ActiveObjectMgr saomgr;
+	auto tsao = new TestServerActiveObject(v3f(5000, 0, 0));
+	saomgr.registerObject(tsao);
+	saomgr.registerObject(new TestServerActiveObject(v3f(-5000, 0, 0)));
+
+	std::queue<u16> result;
+	std::set<u16> cur_objects;
+	saomgr.getAddedActiveObjectsAroundPos(v3f(), 100, 50, cur_objects, result);
+	UASSERTCMP(int, ==, result.size(), 0);
+
+	// Objects are moved to their new cell when stepped
+	tsao->setBasePosition(v3f(20, 0, 0));
+	saomgr.step(0.1f, [](ServerActiveObject *obj) {});
+	saomgr.getAddedActiveObjectsAroundPos(v3f(), 100, 50, cur_objects, result);
+	UASSERTCMP(int, ==, result.size(), 1);
+	UASSERT(result.front() == tsao->getId());
+
+	// Known objects are not added again
+	cur_objects.insert(tsao->getId());
+	result = std::queue<u16>();
+	saomgr.getAddedActiveObjectsAroundPos(v3f(), 100, 50, cur_objects, result);
+	UASSERTCMP(int, ==, result.size(), 0);
+
+	// A radius covering more cells than there are objects
+	cur_objects.clear();
+	saomgr.getAddedActiveObjectsAroundPos(v3f(), 30000, 50, cur_objects, result);
+	UASSERTCMP(int, ==, result.size(), 2);
+
+	// Removed objects leave the index
+	result = std::queue<u16>();
+	saomgr.removeObject(tsao->getId());
+	saomgr.getAddedActiveObjectsAroundPos(v3f(), 100, 50, cur_objects, result);
+	UASSERTCMP(int, ==, result.size(), 0);
+
+	clearSAOMgr(&saomgr);
+}
+// << KIDSCODE
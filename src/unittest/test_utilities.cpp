@@ -56,6 +56,7 @@ class TestUtilities : public TestBase {
 	void testMyround();
 	void testStringJoin();
 	void testEulerConversion();
+	void testSphereInSight(); // KIDSCODE - Draw list index
 };
 
 static TestUtilities g_test_instance;
@@ -87,6 +88,7 @@ void TestUtilities::runTests(IGameDef *gamedef)
 	TEST(testMyround);
 	TEST(testStringJoin);
 	TEST(testEulerConversion);
+	TEST(testSphereInSight); // KIDSCODE - Draw list index
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -416,6 +418,43 @@ void TestUtilities::testStringJoin()
 	UASSERT(str_join(input, " and ") == "one and two and three");
 }
 
+// >> KIDSCODE - Draw list index
+void TestUtilities::testSphereInSight()
+{
+	v3f camera_pos(0, 0, 0);
+	v3f camera_dir(0, 0, 1);
+	f32 fov = 1.5f;
+	f32 range = 100 * BS;
+	f32 d;
+
+	UASSERT(isSphereInSight(v3f(0, 0, 50 * BS), BS, camera_pos, camera_dir,
+		fov, range, &d));
+	UASSERT(std::fabs(d - 49 * BS) < 0.01f);
+	UASSERT(!isSphereInSight(v3f(0, 0, -50 * BS), BS, camera_pos, camera_dir,
+		fov, range));
+	UASSERT(!isSphereInSight(v3f(50 * BS, 0, 0), BS, camera_pos, camera_dir,
+		fov, range));
+	UASSERT(!isSphereInSight(v3f(0, 0, 150 * BS), BS, camera_pos, camera_dir,
+		fov, range));
+
+	// A large sphere reaches into the view
+	UASSERT(isSphereInSight(v3f(50 * BS, 0, 10 * BS), 45 * BS, camera_pos,
+		camera_dir, fov, range));
+	// Around the camera
+	UASSERT(isSphereInSight(v3f(0, 0, -5 * BS), 10 * BS, camera_pos,
+		camera_dir, fov, range, &d));
+	UASSERT(d == 0);
+
+	// Blocks are tested as their bounding sphere
+	v3f block_center = v3f(8, 8, 8 + 5 * MAP_BLOCKSIZE) * BS;
+	f32 block_radius = 0.866025403784f * MAP_BLOCKSIZE * BS;
+	f32 d2;
+	UASSERT(isBlockInSight(v3s16(0, 0, 5), camera_pos, camera_dir, fov, range, &d) ==
+		isSphereInSight(block_center, block_radius, camera_pos, camera_dir,
+			fov, range, &d2));
+	UASSERT(d == d2);
+}
+// << KIDSCODE
 
 static bool within(const f32 value1, const f32 value2, const f32 precision)
 {
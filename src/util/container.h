@@ -28,6 +28,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <map>
 #include <set>
 #include <queue>
+#include <utility>
 
 /*
 Queue with unique values with fast checking of value existence
@@ -139,7 +140,7 @@ class MutexedQueue
 	void push_back(T t)
 	{
 		MutexAutoLock lock(m_mutex);
-		m_queue.push_back(t);
+		m_queue.push_back(std::move(t));
 		m_signal.post();
 	}
 
@@ -151,7 +152,7 @@ class MutexedQueue
 		if (m_signal.wait(wait_time_max_ms)) {
 			MutexAutoLock lock(m_mutex);
 
-			T t = m_queue.front();
+			T t = std::move(m_queue.front());
 			m_queue.pop_front();
 			return t;
 		}
@@ -164,7 +165,7 @@ class MutexedQueue
 		if (m_signal.wait(wait_time_max_ms)) {
 			MutexAutoLock lock(m_mutex);
 
-			T t = m_queue.front();
+			T t = std::move(m_queue.front());
 			m_queue.pop_front();
 			return t;
 		}
@@ -178,7 +179,7 @@ class MutexedQueue
 
 		MutexAutoLock lock(m_mutex);
 
-		T t = m_queue.front();
+		T t = std::move(m_queue.front());
 		m_queue.pop_front();
 		return t;
 	}
@@ -188,7 +189,7 @@ class MutexedQueue
 		if (m_signal.wait(wait_time_max_ms)) {
 			MutexAutoLock lock(m_mutex);
 
-			T t = m_queue.back();
+			T t = std::move(m_queue.back());
 			m_queue.pop_back();
 			return t;
 		}
@@ -204,7 +205,7 @@ class MutexedQueue
 		if (m_signal.wait(wait_time_max_ms)) {
 			MutexAutoLock lock(m_mutex);
 
-			T t = m_queue.back();
+			T t = std::move(m_queue.back());
 			m_queue.pop_back();
 			return t;
 		}
@@ -218,7 +219,7 @@ class MutexedQueue
 
 		MutexAutoLock lock(m_mutex);
 
-		T t = m_queue.back();
+		T t = std::move(m_queue.back());
 		m_queue.pop_back();
 		return t;
 	}
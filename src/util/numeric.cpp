@@ -119,6 +119,14 @@ bool isBlockInSight(v3s16 blockpos_b, v3f camera_pos, v3f camera_dir,
 			((float)blockpos_nodes.Z + MAP_BLOCKSIZE/2) * BS
 	);
 
+	return isSphereInSight(blockpos, block_max_radius, camera_pos, camera_dir,
+		camera_fov, range, distance_ptr); // KIDSCODE - Draw list index
+}
+
+// KIDSCODE - Draw list index: isBlockInSight() for any sphere
+bool isSphereInSight(v3f blockpos, f32 block_max_radius, v3f camera_pos,
+		v3f camera_dir, f32 camera_fov, f32 range, f32 *distance_ptr)
+{
 	// Block position relative to camera
 	v3f blockpos_relative = blockpos - camera_pos;
 
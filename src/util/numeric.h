@@ -251,6 +251,10 @@ u64 murmur_hash_64_ua(const void *key, int len, unsigned int seed);
 bool isBlockInSight(v3s16 blockpos_b, v3f camera_pos, v3f camera_dir,
 		f32 camera_fov, f32 range, f32 *distance_ptr=NULL);
 
+// Same test for any sphere, used to cull groups of blocks at once // KIDSCODE - Draw list index
+bool isSphereInSight(v3f center, f32 radius, v3f camera_pos, v3f camera_dir,
+		f32 camera_fov, f32 range, f32 *distance_ptr=NULL);
+
 s16 adjustDist(s16 dist, float zoom_fov);
 
 /*
@@ -51,6 +51,13 @@ class Buffer
 		else
 			data = NULL;
 	}
+	Buffer(Buffer &&buffer)
+	{
+		m_size = buffer.m_size;
+		data = buffer.data;
+		buffer.m_size = 0;
+		buffer.data = NULL;
+	}
 	Buffer(const T *t, unsigned int size)
 	{
 		m_size = size;
@@ -81,6 +88,17 @@ class Buffer
 			data = NULL;
 		return *this;
 	}
+	Buffer& operator=(Buffer &&buffer)
+	{
+		if(this == &buffer)
+			return *this;
+		drop();
+		m_size = buffer.m_size;
+		data = buffer.data;
+		buffer.m_size = 0;
+		buffer.data = NULL;
+		return *this;
+	}
 	T & operator[](unsigned int i) const
 	{
 		return data[i];